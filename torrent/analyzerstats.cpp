@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "analyzerstats.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+
+#include <kglobal.h>
+
+static const char *const counterNames[AnalyzerStats::CounterCount] = {
+    "streams.seen",
+    "streams.analyzed",
+    "streams.duplicate",
+    "streams.prefetched",
+    "rejected.empty",
+    "rejected.not_dictionary",
+    "rejected.truncated",
+    "rejected.malformed",
+    "rejected.no_info",
+    "rejected.no_length",
+    "rejected.memory_limit",
+    "exceptions_caught",
+    "bytes_read",
+    "buffer_refills",
+    "nodes.string",
+    "nodes.int",
+    "nodes.list",
+    "nodes.dict",
+    "fields_emitted",
+    "resume.seen",
+    "resume.analyzed",
+    "resume.rejected",
+    "resume.entries"
+};
+
+namespace {
+
+class ThreadStats;
+
+// Every thread's block, plus the totals of threads that have exited.
+struct StatsRegistry
+{
+    QMutex mutex;
+    QList<ThreadStats *> threads;
+    AnalyzerStats exited;
+};
+
+}
+
+K_GLOBAL_STATIC(StatsRegistry, statsRegistry)
+
+namespace {
+
+// The owning thread is the only writer, the mutex is there for
+// collect().  It is uncontended in practice, and only taken once per
+// stream.
+class ThreadStats
+{
+public:
+    ThreadStats()
+    {
+        QMutexLocker lock(&statsRegistry->mutex);
+        statsRegistry->threads.append(this);
+    }
+
+    // Called by QThreadStorage when the thread exits.
+    ~ThreadStats()
+    {
+        if(statsRegistry.isDestroyed())
+            return;
+
+        QMutexLocker lock(&statsRegistry->mutex);
+        statsRegistry->threads.removeAll(this);
+        statsRegistry->exited.merge(stats);
+    }
+
+    QMutex mutex;
+    AnalyzerStats stats;
+};
+
+}
+
+static QThreadStorage<ThreadStats *> threadStats;
+
+AnalyzerStats::AnalyzerStats()
+{
+    for(int i = 0; i < CounterCount; ++i)
+        m_counters[i] = 0;
+    for(int i = 0; i < ParseTimeBuckets; ++i)
+        m_parseTimes[i] = 0;
+    for(int i = 0; i < ParseMemoryBuckets; ++i)
+        m_parseMemory[i] = 0;
+}
+
+// @return the power of 2 bucket of @p value, out of @p buckets.
+static int bucketOf(quint64 value, int buckets)
+{
+    int bucket = 0;
+
+    while(value >= 2 && bucket < buckets - 1) {
+        value >>= 1;
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+void AnalyzerStats::addParseTime(qint64 nsecs)
+{
+    ++m_parseTimes[bucketOf(nsecs > 0 ? nsecs / 1000 : 0, ParseTimeBuckets)];
+}
+
+void AnalyzerStats::addParseMemory(quint64 peakBytes)
+{
+    ++m_parseMemory[bucketOf(peakBytes / 1024, ParseMemoryBuckets)];
+}
+
+void AnalyzerStats::merge(const AnalyzerStats &other)
+{
+    for(int i = 0; i < CounterCount; ++i)
+        m_counters[i] += other.m_counters[i];
+    for(int i = 0; i < ParseTimeBuckets; ++i)
+        m_parseTimes[i] += other.m_parseTimes[i];
+    for(int i = 0; i < ParseMemoryBuckets; ++i)
+        m_parseMemory[i] += other.m_parseMemory[i];
+}
+
+QByteArray AnalyzerStats::toText() const
+{
+    QByteArray text;
+
+    for(int i = 0; i < CounterCount; ++i) {
+        text += counterNames[i];
+        text += ' ';
+        text += QByteArray::number(m_counters[i]);
+        text += '\n';
+    }
+
+    for(int i = 0; i < ParseTimeBuckets; ++i) {
+        if(m_parseTimes[i] == 0)
+            continue;
+
+        // Named after the upper bound of the bucket
+        text += "parse_time.";
+        if(i == ParseTimeBuckets - 1)
+            text += "inf ";
+        else {
+            text += QByteArray::number(2ULL << i);
+            text += "us ";
+        }
+        text += QByteArray::number(m_parseTimes[i]);
+        text += '\n';
+    }
+
+    for(int i = 0; i < ParseMemoryBuckets; ++i) {
+        if(m_parseMemory[i] == 0)
+            continue;
+
+        text += "parse_memory.";
+        if(i == ParseMemoryBuckets - 1)
+            text += "inf ";
+        else {
+            text += QByteArray::number(2ULL << i);
+            text += "kb ";
+        }
+        text += QByteArray::number(m_parseMemory[i]);
+        text += '\n';
+    }
+
+    return text;
+}
+
+void AnalyzerStats::record(const AnalyzerStats &stats)
+{
+    if(!threadStats.hasLocalData())
+        threadStats.setLocalData(new ThreadStats);
+
+    ThreadStats *local = threadStats.localData();
+    QMutexLocker lock(&local->mutex);
+    local->stats.merge(stats);
+}
+
+AnalyzerStats AnalyzerStats::collect()
+{
+    QMutexLocker lock(&statsRegistry->mutex);
+    AnalyzerStats total(statsRegistry->exited);
+
+    foreach(ThreadStats *thread, statsRegistry->threads) {
+        QMutexLocker threadLock(&thread->mutex);
+        total.merge(thread->stats);
+    }
+
+    return total;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_STATS_H
+#define TORRENT_ANALYZER_STATS_H
+
+#include <QtGlobal>
+
+class QByteArray;
+
+/**
+ * Counters describing what the torrent analyzer has been doing.
+ *
+ * To keep the cost down, the analyzer fills in one AnalyzerStats per
+ * stream on the stack and hands it to record(), which adds it to a
+ * block owned by the calling thread.  collect() adds up the blocks of
+ * every thread (including threads which have since exited) on demand.
+ */
+class AnalyzerStats
+{
+public:
+    enum Counter {
+        StreamsSeen,            /**< Streams given to the analyzer. */
+        StreamsAnalyzed,        /**< Streams fields were extracted from. */
+        StreamsDuplicate,       /**< Copies of an already indexed torrent. */
+        StreamsPrefetched,      /**< Streams read ahead on another thread. */
+        RejectedEmpty,          /**< Rejected: no data at all. */
+        RejectedNotDictionary,  /**< Rejected: doesn't start with 'd'. */
+        RejectedTruncated,      /**< Rejected: ended in the middle. */
+        RejectedMalformed,      /**< Rejected: not valid b-encoding. */
+        RejectedNoInfo,         /**< Rejected: no "info" dictionary. */
+        RejectedNoLength,       /**< Rejected: no usable length. */
+        RejectedMemoryLimit,    /**< Rejected: needed more than the memory limit. */
+        ExceptionsCaught,       /**< Exceptions caught in connectInputStream. */
+        BytesRead,              /**< Bytes Decoder::refill() read from the input. */
+        BufferRefills,          /**< Blocks Decoder::refill() read, sized by nextReadSize(). */
+        StringNodes,            /**< Strings decoded or skipped, keys included. */
+        IntNodes,               /**< Integers decoded or skipped. */
+        ListNodes,              /**< Lists decoded or skipped. */
+        DictNodes,              /**< Dictionaries decoded or skipped. */
+        FieldsEmitted,          /**< Values added to analysis results. */
+        ResumeFilesSeen,        /**< Resume data files given to the resume analyzer. */
+        ResumeFilesAnalyzed,    /**< Resume data files entries were extracted from. */
+        ResumeFilesRejected,    /**< Resume data files which were invalid or neither format. */
+        ResumeEntries,          /**< Torrents found in resume data files. */
+        CounterCount
+    };
+
+    /**
+     * Parse times are kept in a histogram with power of 2 buckets:
+     * bucket 0 counts parses under 2 microseconds, bucket n counts
+     * parses taking [2^n, 2^(n+1)) microseconds, and the last bucket
+     * counts everything longer.
+     */
+    enum { ParseTimeBuckets = 24 };
+
+    /**
+     * The most memory each parse had in use at once is kept in the same
+     * kind of histogram, in kilobytes: bucket 0 counts parses which
+     * stayed under 2 KB, bucket n counts those peaking in
+     * [2^n, 2^(n+1)) KB.
+     */
+    enum { ParseMemoryBuckets = 24 };
+
+    AnalyzerStats();
+
+    quint64 counter(Counter counter) const { return m_counters[counter]; }
+    quint64 parseTimeBucket(int bucket) const { return m_parseTimes[bucket]; }
+    quint64 parseMemoryBucket(int bucket) const { return m_parseMemory[bucket]; }
+
+    void add(Counter counter, quint64 amount = 1) { m_counters[counter] += amount; }
+    void addParseTime(qint64 nsecs);
+    void addParseMemory(quint64 peakBytes);
+
+    /**
+     * Adds every counter of @p other to this one.
+     */
+    void merge(const AnalyzerStats &other);
+
+    /**
+     * @return the statistics as "name value" lines, for logging.
+     */
+    QByteArray toText() const;
+
+    /**
+     * Adds @p stats to the totals of the calling thread.
+     */
+    static void record(const AnalyzerStats &stats);
+
+    /**
+     * @return the totals of all threads in the process.
+     */
+    static AnalyzerStats collect();
+
+private:
+    quint64 m_counters[CounterCount];
+    quint64 m_parseTimes[ParseTimeBuckets];
+    quint64 m_parseMemory[ParseMemoryBuckets];
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -62,6 +62,37 @@ class BBase
      */
     virtual classID type_id() const = 0;
 
+    /**
+     * Returns this object as a @p T, which is one of BString, BInt,
+     * BList and BDict, if that is what it is.  This only compares
+     * type_id(), so it costs much less than a dynamic_cast and no
+     * reference count is touched.
+     *
+     * @return this object, or 0 if it isn't a @p T
+     */
+    template<class T>
+    const T *as() const
+    {
+        return type_id() == T::TypeId ? static_cast<const T *>(this) : 0;
+    }
+
+    template<class T>
+    T *as()
+    {
+        return type_id() == T::TypeId ? static_cast<T *>(this) : 0;
+    }
+
+    /**
+     * Calls the operator() of @p visitor which takes this object's
+     * actual type, switching on type_id().  The visitor needs one for
+     * each of const BString &, const BInt &, const BList & and
+     * const BDict &, all returning Visitor::result_type.
+     *
+     * This is defined in bvisitor.h, which must be included to use it.
+     */
+    template<class Visitor>
+    typename Visitor::result_type visit(Visitor &visitor) const;
+
     /**
      * Destructor for the class.  This function must be reimplemented
      * in subclasses.
@@ -18,9 +18,12 @@
  */
 #include "bdict.h"
 #include "bytestream.h"
+#include "qtsinks.h"
+#include "core/encoder.h"
 #include "bstring.h"
 #include "bint.h"
 #include "blist.h"
+#include "tracing.h"
 
 #include <QtCore/QIODevice>
 #include <QtCore/QByteArray>
@@ -30,14 +33,19 @@
 #include <stdexcept>
 #include <string>
 
-BDict::BDict (ByteStream &stream)
+BDict::BDict (ByteStream &stream, const QByteArray &captureKey, QByteArray *captured)
     : m_dict()
 {
+    TORRENT_TRACE_SPAN("BDict");
+    stream.countNode(bDict);
+    stream.chargeNode(sizeof(BDict));
+
     if (*stream != 'd')
     {
         throw std::runtime_error("Trying to read dictionary, but this isn't a dictionary");
     }
 
+    Bencode::Decoder::Nesting nesting(stream.decoder());
     ++stream;
 
     // We need to loop and read in a string, then read in some data
@@ -48,6 +56,10 @@ BDict::BDict (ByteStream &stream)
 
         BBase::Ptr temp_item;
 
+        const bool capture = captured && str->raw_data() == captureKey;
+        if (capture)
+            stream.beginCapture();
+
         // Read in data
         switch (*stream)
         {
@@ -68,6 +80,9 @@ BDict::BDict (ByteStream &stream)
                 temp_item = BBase::Ptr(new BString (stream));
         }
 
+        if (capture)
+            *captured = stream.endCapture();
+
         m_dict.insert(str->raw_data(), temp_item);
     }
 
@@ -75,33 +90,127 @@ BDict::BDict (ByteStream &stream)
     ++stream;
 }
 
+BDict::BDict (Bencode::Decoder &decoder, const LazyData::Ptr &source, int base)
+    : m_dict()
+{
+    TORRENT_TRACE_SPAN("BDict");
+    decoder.countNode(Bencode::Decoder::DictNode);
+
+    if (decoder.current() != 'd')
+    {
+        throw std::runtime_error("Trying to read dictionary, but this isn't a dictionary");
+    }
+
+    Bencode::Decoder::Nesting nesting(decoder);
+    decoder.advance();
+
+    std::string unused;
+
+    // Skipping checks a value just as thoroughly as decoding it, so
+    // decoding it later can't fail.
+    while (decoder.current() != 'e')
+    {
+        // The key may point to unused rather than into the data, so it
+        // is copied before unused goes away.
+        const Bencode::ByteSpan key = decoder.readString(unused);
+
+        const int offset = int(decoder.offset());
+        decoder.skipValue();
+
+        m_pending.insert(QByteArray(key.data(), key.size()),
+                         LazyRange(base + offset, int(decoder.offset()) - offset));
+    }
+
+    decoder.advance();
+
+    if (!m_pending.isEmpty())
+        m_source = source;
+}
+
+BDict::BDict ()
+    : m_dict()
+{
+}
+
+BDict::Ptr BDict::parseLazily (const LazyData::Ptr &source)
+{
+    Bencode::MemorySource memory(source->data());
+    Bencode::Decoder decoder(&memory);
+    decoder.setExpectedSize(source->data().size());
+    decoder.advance(); // Read first character
+
+    return Ptr(new BDict(decoder, source, 0));
+}
+
 BDict::~BDict ()
 {
 }
 
 int BDict::count() const
 {
-    return m_dict.count();
+    // A key is never both decoded and pending.
+    return m_dict.count() + m_pending.count();
 }
 
 BBase::Ptr BDict::find (const QByteArray &key) const
 {
-    return m_dict.value(key);
+    const BBase::Ptr *item = lookup(key);
+    return item ? *item : BBase::Ptr();
 }
 
 bool BDict::contains (const QByteArray &key)
 {
-    return m_dict.contains(key);
+    return m_dict.contains(key) || m_pending.contains(key);
+}
+
+void BDict::insert (const QByteArray &key, const BBase::Ptr &value)
+{
+    if (m_source)
+        m_pending.remove(key);
+
+    m_dict.insert(key, value);
 }
 
 BDictionaryIterator BDict::iterator() const
 {
+    decodeAll();
     return BDictionaryIterator(m_dict);
 }
 
+void BDict::decode (const QByteArray &key) const
+{
+    QHash<QByteArray, LazyRange>::iterator it = m_pending.find(key);
+    if (it == m_pending.end())
+        return;
+
+    m_dict.insert(key, LazyData::decode(m_source, it.value()));
+    m_pending.erase(it);
+
+    if (m_pending.isEmpty())
+        m_source.reset();
+}
+
+void BDict::decodeAll () const
+{
+    if (!m_source)
+        return;
+
+    QHash<QByteArray, LazyRange>::iterator it = m_pending.begin();
+    while (it != m_pending.end())
+    {
+        m_dict.insert(it.key(), LazyData::decode(m_source, it.value()));
+        it = m_pending.erase(it);
+    }
+
+    m_source.reset();
+}
+
 bool BDict::writeToDevice(QIODevice &device)
 {
-    if(!device.putChar('d'))
+    DeviceSink sink(device);
+    Bencode::Encoder encoder(sink);
+
+    if(!encoder.beginDict())
         return false;
 
     // Strings are supposed to be written in the dictionary such that
@@ -109,18 +218,13 @@ bool BDict::writeToDevice(QIODevice &device)
     // ordering, so we have to get a list of all the keys, sort it, and
     // then go by the list.
 
+    decodeAll();
+
     QList<QByteArray> keys = m_dict.keys();
     qSort(keys);
 
     foreach (const QByteArray &key, keys) {
-        const QByteArray lenString(QByteArray::number(key.length()));
-
-        // Write out length of key
-        if(lenString.size() != device.write(lenString.constData(), lenString.size()))
-            return false;
-
-        // Write out actual key
-        if(key.size() != device.write(key.constData(), key.size()))
+        if(!encoder.writeString(Bencode::ByteSpan(key.constData(), key.size())))
             return false;
 
         // Write out the key's data
@@ -129,10 +233,7 @@ bool BDict::writeToDevice(QIODevice &device)
             return false;
     }
 
-    if(!device.putChar('e'))
-        return false;
-
-    return true;
+    return encoder.end();
 }
 
 // vim: set et sw=4 ts=4:
@@ -20,11 +20,17 @@
 #define TORRENT_ANALYZER_DICT_H
 
 #include "bbase.h"
+#include "lazydata.h"
 
+#include <QtCore/QByteArray>
 #include <QtCore/QHash>
 
 class ByteStream;
 
+namespace Bencode {
+    class Decoder;
+}
+
 // Some useful typedefs
 typedef QHash<QByteArray, BBase::Ptr> BDictionary;
 typedef QHashIterator<QByteArray, BBase::Ptr> BDictionaryIterator;
@@ -34,11 +40,18 @@ typedef QHashIterator<QByteArray, BBase::Ptr> BDictionaryIterator;
  * using QByteArray, and stores shared pointers to a class descended
  * from BBase, such as BInt, BString, BList, or even more BDicts.
  *
+ * A dictionary from parseLazily() only notes where each of its values
+ * lies, and decodes a value the first time it is asked for, keeping it
+ * from then on.  Since that changes the dictionary, such a tree must not
+ * be used from several threads at once.
+ *
  * @author Michael Pyne <michael.pyne@kdemail.net>
  * @see BBase, BInt, BString, BList
  */
 class BDict : public BBase
 {
+    friend class LazyData;
+
     public:
 
     typedef boost::shared_ptr<BDict> Ptr;
@@ -51,10 +64,35 @@ class BDict : public BBase
      * dictionary if successful.  If not successful, an exception will
      * be thrown (std::runtime_error).
      *
+     * If @p captured is non-null, the raw b-encoded bytes of the value
+     * stored under @p captureKey are copied into it as they are read.
+     * This is used to compute the info-hash of a torrent without having
+     * to re-encode the "info" dictionary afterwards.
+     *
      * @param stream the ByteStream to read from
+     * @param captureKey the key whose value should be captured
+     * @param captured where to store the captured bytes, or 0
      * @see ByteStream
      */
-    BDict (ByteStream &stream);
+    BDict (ByteStream &stream, const QByteArray &captureKey = QByteArray(),
+           QByteArray *captured = 0);
+
+    /**
+     * Constructs an empty BDict, to be filled in with insert().
+     */
+    BDict ();
+
+    /**
+     * Decodes the dictionary at the start of the data of @p source
+     * lazily: the whole of it is checked, as the constructor does, but
+     * values are only decoded once find(), value() or iterator() reach
+     * them.  Nested dictionaries and lists are lazy in turn, so a long
+     * "pieces" string or "files" list costs next to nothing unless it's
+     * used.
+     *
+     * @throw std::runtime_error if the data isn't a valid dictionary
+     */
+    static Ptr parseLazily (const LazyData::Ptr &source);
 
     virtual ~BDict();
 
@@ -65,6 +103,11 @@ class BDict : public BBase
      */
     virtual classID type_id() const { return bDict; }
 
+    /**
+     * The type_id() of this class, for BBase::as().
+     */
+    static const classID TypeId = bDict;
+
     /**
      * Returns the number of keyed values contained within this
      * dictionary.
@@ -83,6 +126,12 @@ class BDict : public BBase
      */
     virtual bool contains (const QByteArray &key);
 
+    /**
+     * Stores @p value under @p key, replacing any value already there
+     * just like a repeated key in b-encoded data does.
+     */
+    void insert (const QByteArray &key, const BBase::Ptr &value);
+
     /**
      * Returns a pointer to the BBase descendant keyed by @p key.  You
      * can use the type_id() method to determine the type of the
@@ -106,7 +155,37 @@ class BDict : public BBase
     template<class T>
     boost::shared_ptr<T> findType (const QByteArray &key) const
     {
-        return boost::dynamic_pointer_cast<T>(m_dict.value(key));
+        const BBase::Ptr *item = lookup(key);
+        if (!item || (*item)->type_id() != T::TypeId)
+            return boost::shared_ptr<T>();
+
+        return boost::static_pointer_cast<T>(*item);
+    }
+
+    /**
+     * Returns the value keyed by @p key without copying its shared
+     * pointer, which makes looking around a big tree cheaper, especially
+     * from several threads at once.  The value lives as long as the
+     * dictionary holds it.
+     *
+     * @return the value, or 0 if there is none
+     */
+    const BBase *value (const QByteArray &key) const
+    {
+        const BBase::Ptr *item = lookup(key);
+        return item ? item->get() : 0;
+    }
+
+    /**
+     * Like value(), but also checks that the value is a @p T.
+     *
+     * @return the value, or 0 if there is none or it isn't a @p T
+     */
+    template<class T>
+    const T *value (const QByteArray &key) const
+    {
+        const BBase *item = value(key);
+        return item ? item->as<T>() : 0;
     }
 
     /**
@@ -128,7 +207,34 @@ class BDict : public BBase
 
     private:
 
-    BDictionary m_dict; /// The QHash that actually store the data
+    /**
+     * Reads a dictionary lazily from @p decoder, which reads the data of
+     * @p source starting @p base bytes in, all of it in one block.
+     */
+    BDict (Bencode::Decoder &decoder, const LazyData::Ptr &source, int base);
+
+    /**
+     * @return the value keyed by @p key, decoding it first if need be,
+     *         or 0 if there is none
+     */
+    const BBase::Ptr *lookup (const QByteArray &key) const
+    {
+        if (m_source)
+            decode(key);
+
+        BDictionary::const_iterator it = m_dict.constFind(key);
+        return it == m_dict.constEnd() ? 0 : &it.value();
+    }
+
+    void decode (const QByteArray &key) const;
+    void decodeAll () const;
+
+    mutable BDictionary m_dict; /// The QHash that actually store the data
+
+    // Values of a lazy dictionary which haven't been decoded yet, and the
+    // data they are in.  Once every value is decoded both are dropped.
+    mutable QHash<QByteArray, LazyRange> m_pending;
+    mutable LazyData::Ptr m_source;
 };
 
 #endif /* TORRENT_ANALYZER_DICT_H */
@@ -0,0 +1,598 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-benchmark: times the parser over a synthetic corpus and writes
+// one JSON object per case and phase, so that runs from different commits
+// can be compared.
+//
+//   torrent-benchmark [--seed n] [--scale f] [--min-time seconds]
+//                     [--case name]... [--label text] [--baseline file]
+//                     [--threads n] [--query expression]
+//                     [--page-cache warm|cold]
+//   torrent-benchmark --write-corpus <directory> [--seed n] [--scale f]
+//
+// The phases are "parse" (decoding into a BDict tree), "lazy"
+// (BDict::parseLazily() and looking up the top-level and info scalars
+// the analyzer uses, leaving the rest undecoded), "push" and
+// "push-4k" (the same with PushParser, given the whole input at once or
+// in 4 KB pieces), "parallel" (parseTorrentInParallel(), using at most
+// --threads threads), "extract" (the analyzer's field extraction, parse
+// included), "schema" (decoding straight into a Bencode::TorrentMeta),
+// "query-stream" and "query-tree" (a PathQuery evaluated on the stream, or
+// over the tree after decoding it; see --query), "json" (transcoding to
+// JSON with binary strings in hex, compare with "copy" for a plain memcpy
+// of the input) and "roundtrip" (writeToDevice() of an already decoded
+// tree).
+// To see how the parallel parse scales, compare runs with different
+// --threads over a big files list, e.g. --case files-250k --scale 2 for
+// 500k files.  "file-read" and "file-mmap" run the extraction over the
+// case written to a temporary file, read through a Strigi stream or from
+// a MappedFile; with --page-cache cold the file is dropped from the page
+// cache before every iteration.  For each, the median and
+// minimum time per iteration are reported along with the heap allocations
+// and bytes allocated per iteration, the peak heap growth during the phase,
+// the peak RSS of the process so far and the number of reads made on the
+// input stream (-1 for phases which don't use one).
+
+#include "corpus.h"
+#include "bdict.h"
+#include "bytestream.h"
+#include "jsontranscoder.h"
+#include "mappedfile.h"
+#include "parallelparser.h"
+#include "pathquery.h"
+#include "pushparser.h"
+#include "torrentfields.h"
+#include "core/bytesource.h"
+#include "core/torrentmeta.h"
+
+#include <strigi/fileinputstream.h>
+#include <strigi/stringstream.h>
+
+#include <QtCore/QBuffer>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtCore/QtAlgorithms>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Allocation accounting.  Qt allocates through malloc() rather than
+// operator new, so the malloc family itself is wrapped.  This relies on
+// glibc exporting its implementation under __libc_*; elsewhere the
+// allocation figures are reported as -1.
+#ifdef __GLIBC__
+#include <malloc.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static const bool haveAllocationStats = true;
+static qint64 allocationCount = 0;
+static qint64 allocationBytes = 0;
+static qint64 liveBytes = 0;
+static qint64 peakLiveBytes = 0;
+
+static inline void trackAllocation(void *ptr)
+{
+    if(!ptr)
+        return;
+
+    const qint64 size = malloc_usable_size(ptr);
+    ++allocationCount;
+    allocationBytes += size;
+    liveBytes += size;
+    if(liveBytes > peakLiveBytes)
+        peakLiveBytes = liveBytes;
+}
+
+static inline void trackFree(void *ptr)
+{
+    if(ptr)
+        liveBytes -= malloc_usable_size(ptr);
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    trackAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    trackAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    trackFree(ptr);
+    void *result = __libc_realloc(ptr, size);
+    trackAllocation(result ? result : (size ? 0 : result));
+    return result;
+}
+
+extern "C" void free(void *ptr)
+{
+    trackFree(ptr);
+    __libc_free(ptr);
+}
+#else
+static const bool haveAllocationStats = false;
+static qint64 allocationCount = 0;
+static qint64 allocationBytes = 0;
+static qint64 liveBytes = 0;
+static qint64 peakLiveBytes = 0;
+#endif
+
+namespace {
+
+enum Phase { Parse, Lazy, Push, Push4k, Parallel, Extract, FileRead, FileMapped, Schema,
+             QueryStream, QueryTree, ToJson, Copy, Roundtrip };
+const char *const phaseNames[] = { "parse", "lazy", "push", "push-4k", "parallel", "extract",
+                                   "file-read", "file-mmap", "schema", "query-stream", "query-tree",
+                                   "json", "copy", "roundtrip" };
+
+// The file read by the file phases, holding the current case.
+QString benchmarkFile;
+
+// Whether the file phases start each iteration with nothing cached.
+bool coldPageCache = false;
+
+// Reads made on the input by the last iteration, or -1 if the phase
+// doesn't read through a ByteStream.
+qint64 phaseRefills = -1;
+
+// What the query phases look for, by default the sort of thing asked of
+// torrents ad hoc.
+PathQuery benchmarkQuery("info/files/*/path|announce-list/0|info/*.utf-8");
+
+class CountingSink : public TorrentFieldSink
+{
+public:
+    CountingSink() : fields(0) { }
+
+    virtual void addValue(Field, const QByteArray &) { ++fields; }
+    virtual void addValue(Field, qlonglong) { ++fields; }
+
+    int fields;
+};
+
+struct Result
+{
+    int iterations;
+    qint64 medianNs;
+    qint64 minNs;
+    qint64 allocations;
+    qint64 allocatedBytes;
+    qint64 peakHeapBytes;
+    long maxRssKb;
+    qint64 refills;
+    bool ok;
+};
+
+BDict::Ptr parse(const QByteArray &data)
+{
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    ByteStream stream(&input);
+    ++stream; // Read first character
+
+    BDict::Ptr dict(new BDict(stream));
+    phaseRefills = stream.refillCount();
+    return dict;
+}
+
+// Drops the pages of the file at @p path from the page cache, so that
+// the next read has to go to the disk.  Only clean pages can be dropped,
+// so they are written back first.
+void evictFromPageCache(const QString &path)
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if(fd < 0)
+        return;
+
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+// Runs one iteration of @p phase, returning false if the input was
+// rejected (or, for round trips, didn't survive unchanged).
+bool runPhase(Phase phase, const CorpusCase &input, const BDict::Ptr &tree)
+{
+    phaseRefills = -1;
+
+    try {
+        switch(phase) {
+        case Parse:
+            parse(input.data);
+            return true;
+
+        case Lazy: {
+            const BDict::Ptr dict = BDict::parseLazily(LazyData::Ptr(new LazyData(input.data)));
+            const BDict *info = dict->value<BDict>("info");
+
+            return dict->value("announce") && info && info->value("name") &&
+                (info->value("length") || info->value("files")) && info->value("piece length");
+        }
+
+        case Push:
+        case Push4k: {
+            const int chunkSize = (phase == Push) ? input.data.size() : 4096;
+            PushParser parser("info");
+
+            for(int i = 0; i < input.data.size() && !parser.isComplete(); i += chunkSize)
+                parser.feed(input.data.constData() + i, qMin(chunkSize, input.data.size() - i));
+
+            return parser.finish()->type_id() == BBase::bDict;
+        }
+
+        case Parallel:
+            parseTorrentInParallel(input.data);
+            return true;
+
+        case Extract: {
+            Strigi::StringInputStream stringInput(input.data.constData(), input.data.size(), false);
+            ByteStream stream(&stringInput);
+            CountingSink sink;
+
+            ++stream; // Read first character
+            extractTorrentFields(stream, sink);
+            phaseRefills = stream.refillCount();
+            return sink.fields > 0;
+        }
+
+        case FileRead: {
+            Strigi::FileInputStream fileInput(QFile::encodeName(benchmarkFile).constData());
+            ByteStream stream(&fileInput);
+            CountingSink sink;
+
+            ++stream; // Read first character
+            extractTorrentFields(stream, sink);
+            phaseRefills = stream.refillCount();
+            return sink.fields > 0;
+        }
+
+        case FileMapped: {
+            MappedFile mapping;
+            if(!mapping.map(benchmarkFile))
+                return false;
+
+            ByteStream stream(mapping.data());
+            CountingSink sink;
+
+            ++stream; // Read first character
+            extractTorrentFields(stream, sink);
+            phaseRefills = stream.refillCount();
+            return sink.fields > 0;
+        }
+
+        case Schema: {
+            Bencode::MemorySource source(Bencode::ByteSpan(input.data.constData(), input.data.size()));
+            Bencode::TorrentMeta meta;
+
+            Bencode::decode(source, meta);
+            return true;
+        }
+
+        case QueryStream: {
+            Strigi::StringInputStream stringInput(input.data.constData(), input.data.size(), false);
+            ByteStream stream(&stringInput);
+
+            ++stream; // Read first character
+            benchmarkQuery.evaluate(stream);
+            phaseRefills = stream.refillCount();
+            return true;
+        }
+
+        case QueryTree:
+            benchmarkQuery.evaluate(parse(input.data));
+            return true;
+
+        case ToJson: {
+            Strigi::StringInputStream stringInput(input.data.constData(), input.data.size(), false);
+            ByteStream stream(&stringInput);
+            QBuffer buffer;
+            buffer.open(QIODevice::WriteOnly);
+
+            ++stream; // Read first character
+            const bool ok = Json::fromBencode(stream, buffer);
+            phaseRefills = stream.refillCount();
+            return ok;
+        }
+
+        case Copy: {
+            QByteArray copy;
+            copy.resize(input.data.size());
+            memcpy(copy.data(), input.data.constData(), input.data.size());
+            return true;
+        }
+
+        case Roundtrip: {
+            QByteArray output;
+            QBuffer buffer(&output);
+            buffer.open(QIODevice::WriteOnly);
+
+            return tree && tree->writeToDevice(buffer) &&
+                (!input.canonical || output == input.data);
+        }
+        }
+    }
+    catch(...) {
+    }
+
+    return false;
+}
+
+Result measure(Phase phase, const CorpusCase &input, double minSeconds)
+{
+    BDict::Ptr tree;
+    if(phase == Roundtrip && input.valid)
+        tree = parse(input.data);
+
+    // Warm up, and find out whether the input is accepted.
+    Result result;
+    result.ok = runPhase(phase, input, tree);
+
+    const qint64 allocationsBefore = allocationCount;
+    const qint64 bytesBefore = allocationBytes;
+    const qint64 liveBefore = liveBytes;
+    peakLiveBytes = liveBytes;
+
+    QVector<qint64> times;
+    QElapsedTimer total, timer;
+    total.start();
+
+    const bool evict = coldPageCache && (phase == FileRead || phase == FileMapped);
+
+    do {
+        if(evict)
+            evictFromPageCache(benchmarkFile);
+
+        timer.start();
+        runPhase(phase, input, tree);
+        times.append(timer.nsecsElapsed());
+    } while(times.count() < 1000 && (times.count() < 3 || total.nsecsElapsed() < minSeconds * 1e9));
+
+    qSort(times);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    result.iterations = times.count();
+    result.medianNs = times[times.count() / 2];
+    result.minNs = times.first();
+    result.allocations = haveAllocationStats ? (allocationCount - allocationsBefore) / times.count() : -1;
+    result.allocatedBytes = haveAllocationStats ? (allocationBytes - bytesBefore) / times.count() : -1;
+    result.peakHeapBytes = haveAllocationStats ? peakLiveBytes - liveBefore : -1;
+    result.maxRssKb = usage.ru_maxrss;
+    result.refills = phaseRefills;
+
+    return result;
+}
+
+QByteArray jsonValue(const QByteArray &line, const char *key)
+{
+    const QByteArray pattern = QByteArray("\"") + key + "\":";
+    int start = line.indexOf(pattern);
+    if(start < 0)
+        return QByteArray();
+
+    start += pattern.size();
+    int end = start;
+    while(end < line.size() && line[end] != ',' && line[end] != '}')
+        ++end;
+
+    QByteArray value = line.mid(start, end - start);
+    if(value.startsWith('"') && value.endsWith('"'))
+        value = value.mid(1, value.size() - 2);
+
+    return value;
+}
+
+// Reads the median times from the output of an earlier run, keyed by
+// "case/phase".
+QHash<QByteArray, qint64> readBaseline(const char *fileName)
+{
+    QHash<QByteArray, qint64> baseline;
+
+    QFile file(QFile::decodeName(fileName));
+    if(!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Unable to read baseline %s\n", fileName);
+        exit(1);
+    }
+
+    foreach(const QByteArray &line, file.readAll().split('\n')) {
+        const QByteArray key = jsonValue(line, "case") + '/' + jsonValue(line, "phase");
+        const QByteArray median = jsonValue(line, "median_ns");
+        if(!median.isEmpty())
+            baseline.insert(key, median.toLongLong());
+    }
+
+    return baseline;
+}
+
+int writeCorpus(const QList<CorpusCase> &corpus, const char *directory)
+{
+    foreach(const CorpusCase &input, corpus) {
+        const QString fileName = QFile::decodeName(directory) + QLatin1Char('/') +
+            QLatin1String(input.name) + QLatin1String(".torrent");
+
+        QFile file(fileName);
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+           file.write(input.data) != input.data.size())
+        {
+            fprintf(stderr, "Unable to write %s\n", QFile::encodeName(fileName).constData());
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "Usage: torrent-benchmark [--seed n] [--scale f] [--min-time seconds]\n"
+            "                         [--case name]... [--label text] [--baseline file]\n"
+            "                         [--threads n] [--query expression]\n"
+            "                         [--page-cache warm|cold]\n"
+            "       torrent-benchmark --write-corpus <directory> [--seed n] [--scale f]\n");
+    exit(1);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    quint32 seed = 1;
+    double scale = 1.0;
+    double minSeconds = 0.5;
+    QList<QByteArray> cases;
+    QByteArray label;
+    const char *baselineFile = 0;
+    const char *corpusDirectory = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(i + 1 >= argc)
+            usage();
+
+        if(strcmp(argv[i], "--seed") == 0)
+            seed = strtoul(argv[++i], 0, 10);
+        else if(strcmp(argv[i], "--scale") == 0)
+            scale = atof(argv[++i]);
+        else if(strcmp(argv[i], "--min-time") == 0)
+            minSeconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "--case") == 0)
+            cases.append(argv[++i]);
+        else if(strcmp(argv[i], "--label") == 0)
+            label = argv[++i];
+        else if(strcmp(argv[i], "--baseline") == 0)
+            baselineFile = argv[++i];
+        else if(strcmp(argv[i], "--write-corpus") == 0)
+            corpusDirectory = argv[++i];
+        else if(strcmp(argv[i], "--query") == 0) {
+            benchmarkQuery = PathQuery(argv[++i]);
+            if(!benchmarkQuery.isValid()) {
+                fprintf(stderr, "Invalid query: %s\n", benchmarkQuery.errorString().toLocal8Bit().constData());
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--page-cache") == 0) {
+            ++i;
+            if(strcmp(argv[i], "cold") == 0)
+                coldPageCache = true;
+            else if(strcmp(argv[i], "warm") != 0)
+                usage();
+        }
+        else if(strcmp(argv[i], "--threads") == 0)
+            QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, atoi(argv[++i])));
+        else
+            usage();
+    }
+
+    if(scale <= 0)
+        usage();
+
+    QList<CorpusCase> corpus;
+    if(cases.isEmpty()) {
+        corpus = generateCorpus(seed, scale);
+    }
+    else {
+        foreach(const QByteArray &name, cases) {
+            corpus.append(generateCorpusCase(name.constData(), seed, scale));
+            if(!corpus.last().name) {
+                fprintf(stderr, "Unknown case %s\n", name.constData());
+                return 1;
+            }
+        }
+    }
+
+    if(corpusDirectory)
+        return writeCorpus(corpus, corpusDirectory);
+
+    QHash<QByteArray, qint64> baseline;
+    if(baselineFile)
+        baseline = readBaseline(baselineFile);
+
+    foreach(const CorpusCase &input, corpus) {
+        QTemporaryFile file;
+        if(!file.open() || file.write(input.data) != input.data.size()) {
+            fprintf(stderr, "Unable to write a temporary file\n");
+            return 1;
+        }
+        file.close();
+        benchmarkFile = file.fileName();
+
+        for(int phase = Parse; phase <= Roundtrip; ++phase) {
+            if(phase == Roundtrip && !input.valid)
+                continue;
+
+            const Result result = measure(Phase(phase), input, minSeconds);
+            const double mbPerSecond = input.data.size() / 1e6 / qMax(result.medianNs / 1e9, 1e-9);
+
+            printf("{\"label\":\"%s\",\"case\":\"%s\",\"phase\":\"%s\",\"bytes\":%d,"
+                   "\"iterations\":%d,\"median_ns\":%lld,\"min_ns\":%lld,\"mb_per_s\":%.2f,"
+                   "\"allocations\":%lld,\"allocated_bytes\":%lld,\"peak_heap_bytes\":%lld,"
+                   "\"max_rss_kb\":%ld,\"refills\":%lld,\"ok\":%s}\n",
+                   label.constData(), input.name, phaseNames[phase], input.data.size(),
+                   result.iterations, result.medianNs, result.minNs, mbPerSecond,
+                   result.allocations, result.allocatedBytes, result.peakHeapBytes,
+                   result.maxRssKb, result.refills, result.ok ? "true" : "false");
+            fflush(stdout);
+
+            const QByteArray key = QByteArray(input.name) + '/' + phaseNames[phase];
+            if(baseline.contains(key)) {
+                const qint64 before = baseline.value(key);
+                fprintf(stderr, "%-14s %-10s %12lld ns -> %12lld ns  %+6.1f%%\n",
+                        input.name, phaseNames[phase], before, result.medianNs,
+                        before ? 100.0 * (result.medianNs - before) / before : 0.0);
+            }
+
+            // An input the corpus says is valid must be accepted.  The
+            // extract, file and schema phases also reject valid
+            // b-encoding which is missing torrent keys, and a copy
+            // accepts anything.
+            const bool extracts = (phase == Extract || phase == FileRead || phase == FileMapped ||
+                                   phase == Schema);
+            if(input.valid != result.ok && !extracts && phase != Copy)
+                fprintf(stderr, "warning: %s/%s was %s\n", input.name, phaseNames[phase],
+                        result.ok ? "unexpectedly accepted" : "rejected");
+        }
+    }
+
+    return 0;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,259 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "corpus.h"
+#include "core/decoder.h"
+
+#include <string.h>
+
+namespace {
+
+// A small LCG so the corpus doesn't depend on the C library's rand().
+class Random
+{
+public:
+    explicit Random(quint32 seed) : m_state(seed * 2654435761U + 1) { }
+
+    quint32 next()
+    {
+        m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return quint32(m_state >> 33);
+    }
+
+    quint32 below(quint32 limit) { return next() % limit; }
+
+    void fill(char *data, int size)
+    {
+        for(int i = 0; i < size; ++i)
+            data[i] = char(next() >> 8);
+    }
+
+    QByteArray word(int minLength, int maxLength)
+    {
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+        QByteArray result(minLength + below(maxLength - minLength + 1), 0);
+
+        for(int i = 0; i < result.size(); ++i)
+            result[i] = letters[below(sizeof letters - 1)];
+
+        return result;
+    }
+
+private:
+    quint64 m_state;
+};
+
+// Appenders producing canonical b-encoding.  Dictionary keys must be
+// written in sorted order by the callers.
+void putInt(QByteArray &out, qlonglong value)
+{
+    out.append('i');
+    out.append(QByteArray::number(value));
+    out.append('e');
+}
+
+void putString(QByteArray &out, const QByteArray &value)
+{
+    out.append(QByteArray::number(value.size()));
+    out.append(':');
+    out.append(value);
+}
+
+void putRandomString(QByteArray &out, Random &random, int size)
+{
+    out.append(QByteArray::number(size));
+    out.append(':');
+
+    const int start = out.size();
+    out.resize(start + size);
+    random.fill(out.data() + start, size);
+}
+
+struct TorrentShape
+{
+    int files;          // 0 for a single-file torrent
+    int pieces;
+    int commentLength;  // 0 for none
+    int nesting;        // depth of a nested list under "x-nested", or 0
+};
+
+QByteArray makeTorrent(Random &random, const TorrentShape &shape)
+{
+    const qlonglong pieceLength = 256 * 1024;
+    QByteArray out;
+
+    out.append('d');
+    putString(out, "announce");
+    putString(out, "http://tracker.example.org:6969/announce");
+
+    if(shape.commentLength > 0) {
+        QByteArray comment;
+        comment.reserve(shape.commentLength + 16);
+        while(comment.size() < shape.commentLength) {
+            comment.append(random.word(1, 12));
+            comment.append(' ');
+        }
+        comment.truncate(shape.commentLength);
+
+        putString(out, "comment");
+        putString(out, comment);
+    }
+
+    putString(out, "created by");
+    putString(out, "corpus generator");
+    putString(out, "creation date");
+    putInt(out, 1234567890 + random.below(100000000));
+
+    putString(out, "info");
+    out.append('d');
+
+    if(shape.files > 0) {
+        putString(out, "files");
+        out.append('l');
+
+        for(int i = 0; i < shape.files; ++i) {
+            out.append('d');
+            putString(out, "length");
+            putInt(out, 1 + random.below(64 * 1024 * 1024));
+            putString(out, "path");
+            out.append('l');
+            putString(out, random.word(3, 10));
+            putString(out, random.word(4, 24) + ".dat");
+            out.append("ee");
+        }
+
+        out.append('e');
+    }
+    else {
+        putString(out, "length");
+        putInt(out, qlonglong(shape.pieces) * pieceLength - random.below(pieceLength));
+    }
+
+    putString(out, "name");
+    putString(out, random.word(8, 32));
+    putString(out, "piece length");
+    putInt(out, pieceLength);
+    putString(out, "pieces");
+    putRandomString(out, random, shape.pieces * 20);
+    out.append('e');
+
+    if(shape.nesting > 0) {
+        putString(out, "x-nested");
+        out.append(QByteArray(shape.nesting, 'l'));
+        putInt(out, 42);
+        out.append(QByteArray(shape.nesting, 'e'));
+    }
+
+    out.append('e');
+    return out;
+}
+
+int scaled(int value, double scale)
+{
+    return qMax(1, int(value * scale));
+}
+
+const char *const caseNames[] = {
+    "tiny", "typical", "pieces-50mb", "files-250k", "deep-nesting",
+    "too-deep", "long-comment", "truncated", "noise"
+};
+
+const int caseCount = sizeof caseNames / sizeof caseNames[0];
+
+}
+
+QList<CorpusCase> generateCorpus(quint32 seed, double scale)
+{
+    QList<CorpusCase> corpus;
+    for(int i = 0; i < caseCount; ++i)
+        corpus.append(generateCorpusCase(caseNames[i], seed, scale));
+
+    return corpus;
+}
+
+CorpusCase generateCorpusCase(const char *name, quint32 seed, double scale)
+{
+    CorpusCase result = { 0, QByteArray(), true, true };
+
+    // Use our own copy of the name, so the caller's needn't outlive
+    // the result.
+    for(int i = 0; i < caseCount && !result.name; ++i) {
+        if(strcmp(name, caseNames[i]) == 0)
+            result.name = caseNames[i];
+    }
+
+    if(!result.name)
+        return result;
+
+    // Seed each case separately so that adding a case doesn't change
+    // the others.
+    quint32 caseSeed = seed;
+    for(const char *c = name; *c; ++c)
+        caseSeed = caseSeed * 31 + *c;
+
+    Random random(caseSeed);
+
+    if(strcmp(name, "tiny") == 0) {
+        TorrentShape shape = { 0, 1, 0, 0 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "typical") == 0) {
+        TorrentShape shape = { 40, 2000, 200, 0 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "pieces-50mb") == 0) {
+        TorrentShape shape = { 0, scaled(50 * 1024 * 1024 / 20, scale), 0, 0 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "files-250k") == 0) {
+        TorrentShape shape = { scaled(250000, scale), 20000, 0, 0 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "deep-nesting") == 0) {
+        // As deep as the decoder allows, counting the top-level
+        // dictionary.
+        TorrentShape shape = { 0, 16, 0, Bencode::Decoder::maxDepth - 1 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "too-deep") == 0) {
+        // Must be refused at the depth limit rather than overflow the
+        // stack, however far it goes.
+        TorrentShape shape = { 0, 16, 0, Bencode::Decoder::maxDepth + scaled(1000000, scale) };
+        result.data = makeTorrent(random, shape);
+        result.valid = result.canonical = false;
+    }
+    else if(strcmp(name, "long-comment") == 0) {
+        TorrentShape shape = { 0, 16, scaled(16 * 1024 * 1024, scale), 0 };
+        result.data = makeTorrent(random, shape);
+    }
+    else if(strcmp(name, "truncated") == 0) {
+        TorrentShape shape = { 1000, 4000, 0, 0 };
+        result.data = makeTorrent(random, shape);
+        result.data.truncate(result.data.size() * 3 / 5);
+        result.valid = result.canonical = false;
+    }
+    else if(strcmp(name, "noise") == 0) {
+        result.data.resize(scaled(1024 * 1024, scale));
+        random.fill(result.data.data(), result.data.size());
+        result.valid = result.canonical = false;
+    }
+
+    return result;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,62 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_BENCHMARKS_CORPUS_H
+#define TORRENT_BENCHMARKS_CORPUS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+/**
+ * One input of the synthetic benchmark corpus.
+ */
+struct CorpusCase
+{
+    const char *name;
+    QByteArray data;
+
+    /// Whether the data is a valid torrent, as opposed to one of the
+    /// truncated or noise inputs which are expected to fail parsing.
+    bool valid;
+
+    /// Whether writeToDevice() should reproduce the data byte for byte.
+    bool canonical;
+};
+
+/**
+ * Generates the benchmark corpus.  The output depends only on @p seed and
+ * @p scale, so results can be compared between commits and machines.
+ *
+ * The corpus holds a tiny single-file torrent, a typical multi-file
+ * torrent, and adversarial inputs: 50 MB of "pieces", 250000 files, lists
+ * nested as deep as Bencode::Decoder::maxDepth allows and a million levels
+ * deeper, a very long comment, a truncated torrent and random noise.
+ * @p scale multiplies the size of the large inputs, to allow quicker runs.
+ */
+QList<CorpusCase> generateCorpus(quint32 seed = 1, double scale = 1.0);
+
+/**
+ * Returns just the case called @p name (with the same @p seed and
+ * @p scale as generateCorpus()), or a case with a null name if there is
+ * none.
+ */
+CorpusCase generateCorpusCase(const char *name, quint32 seed = 1, double scale = 1.0);
+
+#endif
+
+// vim: set et sw=4 ts=4:
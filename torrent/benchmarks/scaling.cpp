@@ -0,0 +1,528 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-scaling: runs TorrentThroughAnalyzer instances on several
+// threads at once, the way Strigi's indexing threads do, to find out what
+// stops the analyzer from scaling with them.
+//
+//   torrent-scaling [--threads 1,2,4,...] [--seconds s] [--seed n]
+//                   [--scale f] [--case name]... [--label text]
+//
+// The analyzer is linked in directly and driven through the Strigi
+// interfaces: one factory shared by every thread, one analyzer per
+// thread, a real AnalysisResult per stream writing to an IndexWriter that
+// throws everything away, and the synthetic corpus (at --scale 0.02 by
+// default, a realistic mix of sizes) in memory.  Every thread goes
+// through the corpus round-robin, starting at a different case, for
+// --seconds at each thread count.
+//
+// One JSON object per thread count is written with the throughput, the
+// speedup and efficiency against the first thread count, and per stream:
+//
+//  - allocations, and the average CPU cycles spent in each malloc, free
+//    or realloc.  Cycles per call rising with the thread count means the
+//    threads are waiting for each other's arena locks.  allocator_share
+//    is the fraction of the workers' time spent in the allocator.
+//  - cache misses, and instructions per cycle.  Misses rising with the
+//    thread count while the allocator stays flat points at cache lines
+//    written by several threads: shared_ptr reference counts, the shared
+//    info-hash set, or QHash and QByteArray reference counts.
+//
+// Allocator figures need glibc on x86; hardware counters need Linux and
+// permission to use perf_event_open() (see perf_event_paranoid).  Either
+// is reported as -1 when unavailable.  Setting
+// STRIGI_TORRENT_INFOHASH_CAPACITY=0 takes the shared info-hash set out
+// of the picture.
+
+#include "corpus.h"
+#include "torrent_analyzer_factory.h"
+
+#include <strigi/analysisresult.h>
+#include <strigi/analyzerconfiguration.h>
+#include <strigi/indexwriter.h>
+#include <strigi/streamanalyzer.h>
+#include <strigi/stringstream.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Allocator accounting, kept per thread and only on the workers.  As in
+// torrent-benchmark the malloc family is wrapped, relying on glibc
+// exporting its implementation under __libc_*.  Calls are timed with the
+// CPU's time stamp counter, which costs a few cycles where a clock would
+// cost tens of nanoseconds.
+#if defined(__GLIBC__) && (defined(__x86_64__) || defined(__i386__))
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static const bool haveAllocatorStats = true;
+static __thread bool trackAllocator = false;
+static __thread quint64 allocatorCalls = 0;
+static __thread quint64 allocatorCycles = 0;
+
+static inline quint64 cycleCount()
+{
+    return __builtin_ia32_rdtsc();
+}
+
+extern "C" void *malloc(size_t size)
+{
+    if(!trackAllocator)
+        return __libc_malloc(size);
+
+    const quint64 start = cycleCount();
+    void *ptr = __libc_malloc(size);
+    allocatorCycles += cycleCount() - start;
+    ++allocatorCalls;
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if(!trackAllocator)
+        return __libc_calloc(count, size);
+
+    const quint64 start = cycleCount();
+    void *ptr = __libc_calloc(count, size);
+    allocatorCycles += cycleCount() - start;
+    ++allocatorCalls;
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if(!trackAllocator)
+        return __libc_realloc(ptr, size);
+
+    const quint64 start = cycleCount();
+    void *result = __libc_realloc(ptr, size);
+    allocatorCycles += cycleCount() - start;
+    ++allocatorCalls;
+    return result;
+}
+
+extern "C" void free(void *ptr)
+{
+    if(!trackAllocator || !ptr) {
+        __libc_free(ptr);
+        return;
+    }
+
+    const quint64 start = cycleCount();
+    __libc_free(ptr);
+    allocatorCycles += cycleCount() - start;
+    ++allocatorCalls;
+}
+#else
+static const bool haveAllocatorStats = false;
+static bool trackAllocator = false;
+static quint64 allocatorCalls = 0;
+static quint64 allocatorCycles = 0;
+
+static inline quint64 cycleCount()
+{
+    return 0;
+}
+#endif
+
+namespace {
+
+/**
+ * A hardware event counter for the calling thread, counting in user space
+ * only.  value() is -1 if the counter couldn't be opened.
+ */
+class HardwareCounter
+{
+public:
+    explicit HardwareCounter(quint64 event)
+      : m_fd(-1)
+    {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = event;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        Q_UNUSED(event);
+#endif
+    }
+
+    ~HardwareCounter()
+    {
+        if(m_fd >= 0)
+            close(m_fd);
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if(m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    qint64 stop()
+    {
+#ifdef __linux__
+        quint64 count;
+        if(m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if(read(m_fd, &count, sizeof(count)) == sizeof(count))
+                return count;
+        }
+#endif
+        return -1;
+    }
+
+private:
+    Q_DISABLE_COPY(HardwareCounter)
+
+    int m_fd;
+};
+
+/**
+ * Stands in for the index, so that only the analyzer's share of the work
+ * is measured.  Shared by every thread, so it must keep no state.
+ */
+class NullIndexWriter : public Strigi::IndexWriter
+{
+public:
+    virtual void deleteEntries(const std::vector<std::string> &) { }
+    virtual void deleteAllEntries() { }
+
+protected:
+    virtual void startAnalysis(const Strigi::AnalysisResult *) { }
+    virtual void addText(const Strigi::AnalysisResult *, const char *, int32_t) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const std::string &) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const unsigned char *, uint32_t) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, int32_t) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, uint32_t) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, double) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const std::string &, const std::string &) { }
+    virtual void addTriplet(const std::string &, const std::string &, const std::string &) { }
+    virtual void finishAnalysis(const Strigi::AnalysisResult *) { }
+};
+
+struct Run
+{
+    QList<CorpusCase> corpus;
+    Strigi::StreamThroughAnalyzerFactory *factory;
+    Strigi::StreamAnalyzer *streamAnalyzer;
+    NullIndexWriter writer;
+
+    QSemaphore ready;   // Released by each worker once it is set up
+    QSemaphore go;      // Released by the main thread to start them
+    QAtomicInt stop;
+};
+
+/**
+ * What one worker did during the measured period.
+ */
+struct WorkerStats
+{
+    WorkerStats()
+      : streams(0), bytes(0), allocations(0), allocatorCycles(0), cycles(0),
+        cacheMisses(0), cpuCycles(0), instructions(0)
+    {
+    }
+
+    void merge(const WorkerStats &other)
+    {
+        streams += other.streams;
+        bytes += other.bytes;
+        allocations += other.allocations;
+        allocatorCycles += other.allocatorCycles;
+        cycles += other.cycles;
+
+        // A counter which failed on any thread is no use in total.
+        cacheMisses = (cacheMisses < 0 || other.cacheMisses < 0) ? -1 : cacheMisses + other.cacheMisses;
+        cpuCycles = (cpuCycles < 0 || other.cpuCycles < 0) ? -1 : cpuCycles + other.cpuCycles;
+        instructions = (instructions < 0 || other.instructions < 0) ? -1 : instructions + other.instructions;
+    }
+
+    qint64 streams;
+    qint64 bytes;
+    quint64 allocations;
+    quint64 allocatorCycles;
+    quint64 cycles;         // Time stamp counter ticks while measuring
+    qint64 cacheMisses;
+    qint64 cpuCycles;
+    qint64 instructions;
+};
+
+class Worker : public QThread
+{
+public:
+    Worker(Run &run, int id)
+      : m_run(run), m_id(id)
+    {
+    }
+
+    WorkerStats stats;
+
+protected:
+    virtual void run()
+    {
+        Strigi::StreamThroughAnalyzer *analyzer = m_run.factory->newInstance();
+        HardwareCounter cacheMisses(PERF_COUNT_HW_CACHE_MISSES);
+        HardwareCounter cpuCycles(PERF_COUNT_HW_CPU_CYCLES);
+        HardwareCounter instructions(PERF_COUNT_HW_INSTRUCTIONS);
+
+        // Each stream gets a path of its own, as files being indexed do.
+        int next = m_id % m_run.corpus.count();
+
+        m_run.ready.release();
+        m_run.go.acquire();
+
+        trackAllocator = true;
+        cacheMisses.start();
+        cpuCycles.start();
+        instructions.start();
+        const quint64 startCycles = cycleCount();
+
+        while(!int(m_run.stop)) {
+            const CorpusCase &input = m_run.corpus[next];
+            next = (next + 1) % m_run.corpus.count();
+
+            char path[64];
+            snprintf(path, sizeof(path), "/scaling/%d/%lld.torrent", m_id, stats.streams);
+
+            Strigi::StringInputStream stream(input.data.constData(), input.data.size(), false);
+            Strigi::AnalysisResult result(path, 0, m_run.writer, *m_run.streamAnalyzer);
+
+            analyzer->setIndexable(&result);
+            analyzer->connectInputStream(&stream);
+
+            ++stats.streams;
+            stats.bytes += input.data.size();
+        }
+
+        stats.cycles = cycleCount() - startCycles;
+        stats.instructions = instructions.stop();
+        stats.cpuCycles = cpuCycles.stop();
+        stats.cacheMisses = cacheMisses.stop();
+        trackAllocator = false;
+
+        stats.allocations = allocatorCalls;
+        stats.allocatorCycles = allocatorCycles;
+
+        delete analyzer;
+    }
+
+private:
+    Run &m_run;
+    int m_id;
+};
+
+// Runs @p threads workers for @p seconds, returning their combined stats
+// and setting @p elapsedNs to how long they actually ran.
+WorkerStats measure(Run &run, int threads, double seconds, qint64 *elapsedNs)
+{
+    run.stop = 0;
+
+    QList<Worker *> workers;
+    for(int i = 0; i < threads; ++i) {
+        workers.append(new Worker(run, i));
+        workers.last()->start();
+    }
+
+    run.ready.acquire(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+    run.go.release(threads);
+
+    usleep(static_cast<useconds_t>(seconds * 1e6));
+    run.stop = 1;
+
+    WorkerStats total;
+    foreach(Worker *worker, workers) {
+        worker->wait();
+        total.merge(worker->stats);
+    }
+
+    *elapsedNs = timer.nsecsElapsed();
+    qDeleteAll(workers);
+
+    return total;
+}
+
+QList<int> parseThreadCounts(const char *text)
+{
+    QList<int> counts;
+    foreach(const QByteArray &item, QByteArray(text).split(',')) {
+        bool ok = false;
+        const int count = item.toInt(&ok);
+        if(!ok || count < 1)
+            return QList<int>();
+        counts.append(count);
+    }
+
+    return counts;
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "Usage: torrent-scaling [--threads 1,2,4,...] [--seconds s] [--seed n]\n"
+            "                       [--scale f] [--case name]... [--label text]\n");
+    exit(1);
+}
+
+double ratio(double a, double b)
+{
+    return b > 0 ? a / b : -1;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    quint32 seed = 1;
+    double scale = 0.02;
+    double seconds = 2.0;
+    QList<QByteArray> cases;
+    QByteArray label;
+    QList<int> threadCounts;
+
+    for(int i = 1; i < argc; ++i) {
+        if(i + 1 >= argc)
+            usage();
+
+        if(strcmp(argv[i], "--threads") == 0) {
+            threadCounts = parseThreadCounts(argv[++i]);
+            if(threadCounts.isEmpty())
+                usage();
+        }
+        else if(strcmp(argv[i], "--seconds") == 0)
+            seconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0)
+            seed = strtoul(argv[++i], 0, 10);
+        else if(strcmp(argv[i], "--scale") == 0)
+            scale = atof(argv[++i]);
+        else if(strcmp(argv[i], "--case") == 0)
+            cases.append(argv[++i]);
+        else if(strcmp(argv[i], "--label") == 0)
+            label = argv[++i];
+        else
+            usage();
+    }
+
+    if(scale <= 0 || seconds <= 0)
+        usage();
+
+    if(threadCounts.isEmpty()) {
+        for(int count = 1; count < QThread::idealThreadCount(); count *= 2)
+            threadCounts.append(count);
+        threadCounts.append(qMax(QThread::idealThreadCount(), 1));
+    }
+
+    Run run;
+    if(cases.isEmpty())
+        run.corpus = generateCorpus(seed, scale);
+    else {
+        foreach(const QByteArray &name, cases) {
+            run.corpus.append(generateCorpusCase(name.constData(), seed, scale));
+            if(!run.corpus.last().name) {
+                fprintf(stderr, "Unknown case %s\n", name.constData());
+                return 1;
+            }
+        }
+    }
+
+    Strigi::AnalyzerConfiguration configuration;
+    Strigi::StreamAnalyzer streamAnalyzer(configuration);
+    TorrentThroughAnalyzerFactory factory;
+
+    run.factory = &factory;
+    run.factory->registerFields(configuration.fieldRegister());
+    run.streamAnalyzer = &streamAnalyzer;
+
+    // Warm up: fault in the corpus and fill the info-hash set, so that
+    // the first thread count isn't measured against a cold process.
+    qint64 elapsedNs;
+    measure(run, 1, qMin(seconds, 0.5), &elapsedNs);
+
+    double baseRate = 0;
+    int baseThreads = 0;
+
+    foreach(const int threads, threadCounts) {
+        const WorkerStats stats = measure(run, threads, seconds, &elapsedNs);
+        const double elapsed = qMax(elapsedNs / 1e9, 1e-9);
+        const double rate = stats.streams / elapsed;
+
+        if(baseThreads == 0) {
+            baseRate = rate;
+            baseThreads = threads;
+        }
+
+        const double speedup = ratio(rate, baseRate);
+        const double efficiency = speedup * baseThreads / threads;
+        const qint64 streams = qMax(stats.streams, Q_INT64_C(1));
+
+        printf("{\"label\":\"%s\",\"threads\":%d,\"streams\":%lld,\"streams_per_s\":%.1f,"
+               "\"mb_per_s\":%.2f,\"speedup\":%.2f,\"efficiency\":%.2f,"
+               "\"allocations_per_stream\":%.1f,\"allocator_cycles_per_call\":%.1f,"
+               "\"allocator_share\":%.3f,\"cache_misses_per_stream\":%.1f,"
+               "\"instructions_per_cycle\":%.2f}\n",
+               label.constData(), threads, stats.streams, rate, stats.bytes / 1e6 / elapsed,
+               speedup, efficiency,
+               haveAllocatorStats ? double(stats.allocations) / streams : -1.0,
+               haveAllocatorStats ? ratio(stats.allocatorCycles, stats.allocations) : -1.0,
+               haveAllocatorStats ? ratio(stats.allocatorCycles, stats.cycles) : -1.0,
+               stats.cacheMisses >= 0 ? double(stats.cacheMisses) / streams : -1.0,
+               stats.instructions >= 0 && stats.cpuCycles > 0 ?
+                   double(stats.instructions) / stats.cpuCycles : -1.0);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+// vim: set et sw=4 ts=4:
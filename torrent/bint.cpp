@@ -18,39 +18,30 @@
  */
 #include "bint.h"
 #include "bytestream.h"
+#include "qtsinks.h"
+#include "core/encoder.h"
+#include "tracing.h"
 
 #include <QtCore/QString>
 #include <QtCore/QIODevice>
 
-#include <stdexcept>
-#include <string>
-
 // A bencoded int is (approximately) as follows:
 // i(\d)+e
 BInt::BInt (ByteStream &stream)
     : m_value(0)
 {
+    TORRENT_TRACE_SPAN("BInt");
+    stream.chargeNode(sizeof(BInt));
+
     if (*stream != 'i')
         return;
 
-    ++stream; // Move to start of digits
-    QByteArray digits;
-
-    // Loop until we encounter the 'e'
-    while (*stream != 'e') {
-        digits.append(*stream);
-        ++stream;
-    }
-
-    // Eat the 'e'
-    ++stream;
-
-    bool a_isValid; // We want to make sure the string is a valid number
-
-    m_value = digits.toLongLong(&a_isValid);
+    m_value = stream.decoder().readInt();
+}
 
-    if(!a_isValid)
-        throw std::runtime_error("Invalid int read");
+BInt::BInt (qlonglong value)
+    : m_value(value)
+{
 }
 
 BInt::~BInt()
@@ -59,18 +50,8 @@ BInt::~BInt()
 
 bool BInt::writeToDevice (QIODevice &device)
 {
-    if(!device.putChar('i'))
-        return false;
-
-    QByteArray value(QByteArray::number(m_value));
-
-    if(value.size() != device.write(value.constData(), value.size()))
-        return false;
-
-    if(!device.putChar('e'))
-        return false;
-
-    return true;
+    DeviceSink sink(device);
+    return Bencode::Encoder(sink).writeInt(m_value);
 }
 
 // vim: set et ts=4 sw=4:
@@ -49,6 +49,11 @@ class BInt : public BBase
      */
     BInt (ByteStream &stream);
 
+    /**
+     * Constructs a BInt holding @p value.
+     */
+    explicit BInt (qlonglong value);
+
     /**
      * Destructor for this class.  No special action is taken.
      */
@@ -69,6 +74,11 @@ class BInt : public BBase
      */
     virtual classID type_id() const { return bInt; }
 
+    /**
+     * The type_id() of this class, for BBase::as().
+     */
+    static const classID TypeId = bInt;
+
     /**
      * Outputs the b-encoded representation of the object to the given
      * QIODevice.
@@ -18,9 +18,12 @@
  */
 #include "blist.h"
 #include "bytestream.h"
+#include "qtsinks.h"
+#include "core/encoder.h"
 #include "bdict.h"
 #include "bstring.h"
 #include "bint.h"
+#include "tracing.h"
 
 #include <QtCore/QIODevice>
 
@@ -28,13 +31,18 @@
 #include <string>
 
 BList::BList (ByteStream &stream)
-    : m_array()
+    : m_array(), m_pendingCount(0)
 {
+    TORRENT_TRACE_SPAN("BList");
+    stream.countNode(bList);
+    stream.chargeNode(sizeof(BList));
+
     BBase::Ptr temp;
 
     if (*stream != 'l')
         return;
 
+    Bencode::Decoder::Nesting nesting(stream.decoder());
     ++stream;
 
     /* Repeat circling over the string until the list is over */
@@ -68,12 +76,49 @@ BList::BList (ByteStream &stream)
     ++stream;
 }
 
+BList::BList (Bencode::Decoder &decoder, const LazyData::Ptr &source, int base)
+    : m_array(), m_pendingCount(0)
+{
+    TORRENT_TRACE_SPAN("BList");
+    decoder.countNode(Bencode::Decoder::ListNode);
+
+    if (decoder.current() != 'l')
+        return;
+
+    Bencode::Decoder::Nesting nesting(decoder);
+    decoder.advance();
+
+    // Skipping checks an item just as thoroughly as decoding it, so
+    // decoding it later can't fail.
+    while (decoder.current() != 'e')
+    {
+        const int offset = int(decoder.offset());
+        decoder.skipValue();
+        m_ranges.append(LazyRange(base + offset, int(decoder.offset()) - offset));
+    }
+
+    decoder.advance();
+
+    m_pendingCount = m_ranges.count();
+    if (m_pendingCount > 0)
+        m_source = source;
+}
+
+BList::BList ()
+    : m_array(), m_pendingCount(0)
+{
+}
+
 BList::~BList()
 {
 }
 
 unsigned int BList::count() const
 {
+    // The items of a lazy list get their places once one is needed.
+    if (m_source && m_array.isEmpty())
+        return m_ranges.count();
+
     return m_array.count();
 }
 
@@ -82,28 +127,76 @@ BBase::Ptr BList::index (unsigned int i) const
     if (i >= count())
         throw std::runtime_error("BList array access out of bounds");
 
+    if (m_source)
+        decode(i);
+
     return m_array[i];
 }
 
+void BList::append (const BBase::Ptr &item)
+{
+    if (m_source)
+        makeRoom();
+
+    m_array.append(item);
+}
+
 BBaseVectorIterator BList::iterator() const
 {
+    decodeAll();
     return BBaseVectorIterator(m_array);
 }
 
+void BList::makeRoom () const
+{
+    if (!m_array.isEmpty())
+        return;
+
+    m_array.reserve(m_ranges.count());
+    for (int i = 0; i < m_ranges.count(); ++i)
+        m_array.append(BBase::Ptr());
+}
+
+void BList::decode (unsigned int i) const
+{
+    if (i >= static_cast<unsigned int>(m_ranges.count()))
+        return;
+
+    makeRoom();
+    if (m_array.at(i))
+        return;
+
+    m_array[i] = LazyData::decode(m_source, m_ranges.at(i));
+
+    if (--m_pendingCount == 0)
+    {
+        m_ranges.clear();
+        m_source.reset();
+    }
+}
+
+void BList::decodeAll () const
+{
+    for (int i = 0; m_source && i < m_ranges.count(); ++i)
+        decode(i);
+}
+
 bool BList::writeToDevice(QIODevice &device)
 {
-    if (!device.putChar('l'))
+    DeviceSink sink(device);
+    Bencode::Encoder encoder(sink);
+
+    if (!encoder.beginList())
         return false;
 
+    decodeAll();
+
     foreach(const BBase::Ptr &ptr, m_array) {
         if(!ptr->writeToDevice(device))
             return false;
     }
 
-    if (!device.putChar('e'))
-        return false;
-
-    return true;
+    return encoder.end();
 }
 
 // vim: set et sw=4 ts=4:
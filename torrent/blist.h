@@ -22,9 +22,16 @@
 #include <QtCore/QList>
 
 #include "bbase.h"
+#include "lazydata.h"
+
+#include <QtCore/QVector>
 
 class ByteStream;
 
+namespace Bencode {
+    class Decoder;
+}
+
 typedef QList<BBase::Ptr> BBaseVector;
 typedef QListIterator<BBase::Ptr> BBaseVectorIterator;
 
@@ -32,11 +39,16 @@ typedef QListIterator<BBase::Ptr> BBaseVectorIterator;
  * Class to construct a list of BBase objects from a b-encoded
  * list.
  *
+ * A list inside a tree from BDict::parseLazily() only notes where each
+ * of its items lies, and decodes an item the first time it is asked for.
+ *
  * @author Michael Pyne <michael.pyne@kdemail.net>
  * @see BBase
  */
 class BList : public BBase
 {
+    friend class LazyData;
+
 public:
     typedef boost::shared_ptr<BList> Ptr;
 
@@ -53,6 +65,11 @@ public:
      */
     BList (ByteStream &stream);
 
+    /**
+     * Constructs an empty BList, to be filled in with append().
+     */
+    BList ();
+
     virtual ~BList ();
 
     /**
@@ -62,6 +79,11 @@ public:
      */
     virtual classID type_id() const { return bList; }
 
+    /**
+     * The type_id() of this class, for BBase::as().
+     */
+    static const classID TypeId = bList;
+
     /**
      * Returns the number of items contained within the list.
      *
@@ -79,6 +101,11 @@ public:
      */
     BBase::Ptr index (unsigned int i) const;
 
+    /**
+     * Adds @p item to the end of the list.
+     */
+    void append (const BBase::Ptr &item);
+
     /**
      * Convenience function to return a pointer to the appropriate
      * item in the list, already casted to the appropriate type.
@@ -92,7 +119,38 @@ public:
     template<class T>
     boost::shared_ptr<T> indexType(unsigned int i) const
     {
-        return boost::dynamic_pointer_cast<T>(index(i));
+        const BBase::Ptr item = index(i);
+        if (item->type_id() != T::TypeId)
+            return boost::shared_ptr<T>();
+
+        return boost::static_pointer_cast<T>(item);
+    }
+
+    /**
+     * Returns item @p i without copying its shared pointer, which makes
+     * going through a long list cheaper, especially from several threads
+     * at once.  The item lives as long as the list holds it.
+     *
+     * @return the item, or 0 if @p i is out of bounds
+     */
+    const BBase *at(unsigned int i) const
+    {
+        if (m_source)
+            decode(i);
+
+        return i < static_cast<unsigned int>(m_array.count()) ? m_array.at(i).get() : 0;
+    }
+
+    /**
+     * Like at(), but also checks that the item is a @p T.
+     *
+     * @return the item, or 0 if @p i is out of bounds or it isn't a @p T
+     */
+    template<class T>
+    const T *at(unsigned int i) const
+    {
+        const BBase *item = at(i);
+        return item ? item->as<T>() : 0;
     }
 
     /**
@@ -114,7 +172,24 @@ public:
     virtual bool writeToDevice (QIODevice &device);
 
 private:
-    BBaseVector m_array;
+    /**
+     * Reads a list lazily from @p decoder, which reads the data of
+     * @p source starting @p base bytes in.
+     */
+    BList (Bencode::Decoder &decoder, const LazyData::Ptr &source, int base);
+
+    void makeRoom () const;
+    void decode (unsigned int i) const;
+    void decodeAll () const;
+
+    // Items of a lazy list which haven't been decoded yet are null.
+    mutable BBaseVector m_array;
+
+    // Where each item of a lazy list lies, and the data it is in, until
+    // every item is decoded.
+    mutable QVector<LazyRange> m_ranges;
+    mutable LazyData::Ptr m_source;
+    mutable int m_pendingCount;
 };
 
 #endif /* TORRENT_ANALYZER_LIST_H */
@@ -18,42 +18,34 @@
  */
 #include "bstring.h"
 #include "bytestream.h"
+#include "qtsinks.h"
+#include "core/encoder.h"
+#include "tracing.h"
 
 #include <QtCore/QString>
 #include <QtCore/QIODevice>
 
 #include <kdebug.h>
 
-#include <stdexcept>
-#include <string>
-
 // The reason we don't store stuff in a QString is because BitTorrent
 // b-encoded strings may contain zeroes within the string, which makes
 // a BString more of a buffer than a true string.
 BString::BString (ByteStream &stream)
     : m_data()
 {
-    // A BString is \d+:.{n}, where n is whatever \d+ converted to.
-    // So, read in the number part first.
-    QByteArray numberData;
-
-    while(*stream != ':') {
-        numberData.append(*stream);
-        ++stream;
-    }
+    TORRENT_TRACE_SPAN("BString");
+    stream.chargeNode(sizeof(BString));
 
-    ++stream; // Read past ':'
-
-    bool validNumber = false;
-    quint32 length = numberData.toUInt(&validNumber);
+    // A BString is \d+:.{n}, where n is whatever \d+ converted to.
+    ByteArraySink sink(m_data);
+    stream.decoder().readString(sink);
 
-    if(!validNumber)
-        throw std::runtime_error("Invalid number in string data");
+    TORRENT_TRACE_ARG(m_data.size());
+}
 
-    for(quint32 i = 0; i < length; ++i) {
-        m_data.append(*stream);
-        ++stream;
-    }
+BString::BString (const QByteArray &data)
+    : m_data(data)
+{
 }
 
 BString::~BString ()
@@ -62,23 +54,13 @@ BString::~BString ()
 
 QString BString::toString() const
 {
-    return QString::fromUtf8(m_data.constData());
+    return QString::fromUtf8(m_data.constData(), m_data.size());
 }
 
 bool BString::writeToDevice(QIODevice &device)
 {
-    const QByteArray lengthStr(QByteArray::number(m_data.length()));
-
-    if(lengthStr.size() != device.write(lengthStr.data(), lengthStr.size()))
-        return false;
-
-    if(!device.putChar(':'))
-        return false;
-
-    if(m_data.size() != device.write(m_data.constData(), m_data.size()))
-        return false;
-
-    return true;
+    DeviceSink sink(device);
+    return Bencode::Encoder(sink).writeString(Bencode::ByteSpan(m_data.constData(), m_data.size()));
 }
 
 bool BString::setValue (const QString &str)
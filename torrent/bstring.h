@@ -54,6 +54,12 @@ class BString : public BBase
      */
     BString (ByteStream &stream);
 
+    /**
+     * Constructs a BString holding @p data, for parsers which decode the
+     * string themselves.
+     */
+    explicit BString (const QByteArray &data);
+
     virtual ~BString ();
 
     /**
@@ -88,6 +94,11 @@ class BString : public BBase
      */
     virtual classID type_id() const { return bString; }
 
+    /**
+     * The type_id() of this class, for BBase::as().
+     */
+    static const classID TypeId = bString;
+
     /**
      * Outputs the b-encoded representation of the object to the given
      * QIODevice.
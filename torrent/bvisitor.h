@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_BVISITOR_H
+#define TORRENT_ANALYZER_BVISITOR_H
+
+#include "bbase.h"
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+
+#include <stdexcept>
+
+/**
+ * A visitor for BBase::visit() can derive from this to get its
+ * result_type, e.g. BVisitor<void> or BVisitor<qlonglong>.
+ */
+template<class Result>
+struct BVisitor
+{
+    typedef Result result_type;
+};
+
+template<class Visitor>
+typename Visitor::result_type BBase::visit(Visitor &visitor) const
+{
+    switch(type_id()) {
+        case bString: return visitor(static_cast<const BString &>(*this));
+        case bInt:    return visitor(static_cast<const BInt &>(*this));
+        case bList:   return visitor(static_cast<const BList &>(*this));
+        case bDict:   return visitor(static_cast<const BDict &>(*this));
+        case bBase:   break;
+    }
+
+    throw std::logic_error("BBase subclass without a type");
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -18,65 +18,144 @@
  */
 
 #include "bytestream.h"
+#include "tracing.h"
 
-#include <kdemacros.h>
+// Used unless STRIGI_TORRENT_MEMORY_LIMIT says otherwise.  The biggest
+// real torrents decode to a small fraction of this.
+static const quint64 defaultLimit = 256 * 1024 * 1024;
 
-#include <stdexcept>
+ByteStream::ByteStream(Strigi::InputStream *in)
+  : m_input(in), m_source(in), m_memorySource(Bencode::ByteSpan()), m_decoder(&m_source),
+    m_budget(defaultMemoryLimit()), m_captureSink(m_capture), m_captureStart(-1)
+{
+    // Reads are sized to suit the data, when the stream knows how much
+    // there is.
+    m_decoder.setExpectedSize(in->size());
+    m_decoder.setMemoryBudget(&m_budget);
+}
 
-end_of_stream::end_of_stream() : std::runtime_error("reached eos")
+ByteStream::ByteStream(const Bencode::ByteSpan &data)
+  : m_input(0), m_source(0), m_data(data), m_memorySource(data), m_decoder(&m_memorySource),
+    m_budget(defaultMemoryLimit()), m_captureSink(m_capture), m_captureStart(-1)
 {
+    m_decoder.setExpectedSize(data.size());
+    m_decoder.setMemoryBudget(&m_budget);
 }
 
-ByteStream::ByteStream(Strigi::InputStream *in)
-  : m_input(in), m_bufSize(0), m_buffer(0), m_curPos(0), m_atEnd(true)
+static quint64 memoryLimitFromEnvironment()
 {
+    bool ok = false;
+    const qint64 limit = qgetenv("STRIGI_TORRENT_MEMORY_LIMIT").toLongLong(&ok);
+
+    return ok && limit >= 0 ? quint64(limit) : defaultLimit;
 }
 
-char ByteStream::operator*() const
+quint64 ByteStream::defaultMemoryLimit()
 {
-    if(KDE_ISUNLIKELY(m_atEnd)) {
-        throw end_of_stream();
-    }
+    // Every stream asks, and qgetenv() copies the environment each time.
+    static const quint64 limit = memoryLimitFromEnvironment();
+    return limit;
+}
 
-    if(KDE_ISUNLIKELY(0 == m_buffer)) {
-        throw std::logic_error("operator*() called before operator++()");
+void ByteStream::beginCapture()
+{
+    // Everything is at hand already, so only where it starts is needed.
+    if(!m_input) {
+        m_captureStart = m_decoder.offset();
+        return;
     }
 
-    return *m_curPos;
+    m_capture.clear();
+    m_decoder.beginCapture(&m_captureSink);
 }
 
-void ByteStream::operator++()
+QByteArray ByteStream::endCapture()
 {
-    m_curPos++;
+    if(!m_input) {
+        const qint64 start = m_captureStart;
+        m_captureStart = -1;
+        return view(start, m_decoder.offset() - start);
+    }
 
-    // If not setup or we're past end of buffer, refill
-    if(KDE_ISUNLIKELY(0 == m_buffer || (m_curPos - m_buffer) >= m_bufSize)) {
-        refillBuffer();
+    m_decoder.endCapture();
+
+    QByteArray result(m_capture);
+    m_capture.clear();
+    return result;
+}
+
+void ByteStream::readString(QByteArray &value)
+{
+    // The string is taken from the data by where it ends, not from the
+    // span, which may point to the scratch copy the decoder makes of a
+    // string running up to the end of the data.
+    if(!m_input) {
+        std::string unused;
+        const Bencode::ByteSpan span = m_decoder.readString(unused);
+        value = view(m_decoder.offset() - span.size(), span.size());
+        return;
     }
+
+    value.clear();
+    ByteArraySink sink(value);
+    m_decoder.readString(sink);
 }
 
-void ByteStream::refillBuffer()
+QByteArray ByteStream::readAll()
 {
-    // This roundabout pointer manipulation works around what I think
-    // is a g++ 4.3 bug searching through template functions.
-    const char *ptr;
-    m_bufSize = m_input->read(ptr, 4096, 0);
-    m_buffer = const_cast<char *>(ptr);
+    if(!m_input) {
+        if(m_decoder.atEnd())
+            return QByteArray();
 
-    if(m_bufSize < -1)
-        throw std::runtime_error("Failed to refill buffer");
+        const qint64 offset = m_decoder.offset();
+        const qint64 count = qint64(m_data.size()) - offset;
 
-    if(m_bufSize == -1) {
-        m_atEnd = true;
-        m_bufSize = 0;
-        m_buffer = 0;
-        m_curPos = 0;
+        m_decoder.consume(count);
+        return view(offset, count);
+    }
+
+    QByteArray data;
+
+    if(m_input->size() > m_decoder.bytesRead()) {
+        const qint64 size = m_input->size() - m_decoder.bytesRead() + 4096;
+        m_budget.require(size);
+        data.reserve(size);
+    }
+
+    ByteArraySink sink(data);
+    m_decoder.readAll(sink);
 
+    return data;
+}
+
+void ByteStream::consume(quint32 count, QByteArray *data)
+{
+    if(!data) {
+        m_decoder.consume(count);
         return;
     }
 
-    m_atEnd = false;
-    m_curPos = m_buffer;
+    ByteArraySink sink(*data);
+    m_decoder.consume(count, &sink);
+}
+
+QByteArray ByteStream::view(qint64 offset, qint64 count) const
+{
+    return QByteArray::fromRawData(m_data.data() + offset, int(count));
+}
+
+long ByteStream::InputSource::read(const char *&start, long wanted)
+{
+    TORRENT_TRACE_SPAN("refill");
+
+    // This roundabout pointer manipulation works around what I think
+    // is a g++ 4.3 bug searching through template functions.
+    const char *ptr;
+    const qint32 size = m_input->read(ptr, wanted, 0);
+    start = ptr;
+
+    TORRENT_TRACE_ARG(size);
+    return size;
 }
 
 // vim: set et sw=4 ts=4:
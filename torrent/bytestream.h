@@ -20,47 +20,192 @@
 #define TORRENT_ANALYZER_BYTESTREAM_H
 
 #include <QtGlobal>
+#include <QtCore/QByteArray>
+
+#include "bbase.h"
+#include "qtsinks.h"
+#include "core/bytesource.h"
+#include "core/decoder.h"
+#include "core/memorybudget.h"
 
 #include <strigi/streambase.h>
 
-#include <stdexcept>
+/**
+ * Thrown when the data ends in the middle of a value.
+ */
+typedef Bencode::EndOfInput end_of_stream;
 
-class end_of_stream : public std::runtime_error
-{
-public:
-    end_of_stream();
-};
+/**
+ * Thrown when a parse would need more memory than its stream allows.
+ */
+typedef Bencode::MemoryLimitExceeded memory_limit_exceeded;
 
 /**
  * A very simple class to read characters one by one from a
- * Strigi::InputStream, for use in decoding b-encoded data.
+ * Strigi::InputStream, for use in decoding b-encoded data.  The reading
+ * itself is done by a Bencode::Decoder, which this adapts to Strigi and
+ * Qt types.
+ *
+ * Every stream has a Bencode::MemoryBudget which the decoder and the
+ * b-encoded types charge what they allocate to, limited to
+ * defaultMemoryLimit().
  */
 class ByteStream
 {
 public:
     ByteStream(Strigi::InputStream *in);
 
+    /**
+     * Reads from @p data, which is already in memory, such as a
+     * MappedFile.  Strings read with readString() and captures are then
+     * views into @p data instead of copies, so it must outlive them as
+     * well as the stream.
+     */
+    explicit ByteStream(const Bencode::ByteSpan &data);
+
     /**
      * Reads the current character.  If you have not already
      * called operator ++ at least once then there is not data,
      * and an exception will be thrown instead.
      */
-    char operator*() const;
+    char operator*() const { return m_decoder.current(); }
 
     /**
      * Prefix increment operator, advances to the next character.
      */
-    void operator++();
+    void operator++() { m_decoder.advance(); }
+
+    bool atEnd() const { return m_decoder.atEnd(); }
+
+    /**
+     * Starts recording the raw bytes read from the stream, beginning
+     * with the current character.  Only one capture may be active at
+     * a time.
+     */
+    void beginCapture();
 
-    bool atEnd() const { return m_atEnd; }
+    /**
+     * Stops recording and returns the bytes read since beginCapture(),
+     * not including the current character.
+     */
+    QByteArray endCapture();
+
+    /**
+     * Reads the string value at the current position into @p value.
+     */
+    void readString(QByteArray &value);
+
+    /**
+     * Reads everything left in the stream, starting with the current
+     * character, for parsers which need all of the data at once.  The
+     * stream is at its end afterwards.
+     */
+    QByteArray readAll();
+
+    /**
+     * Moves past the next @p count characters, starting with the current
+     * one, as @p count calls to operator++() would.  If @p data is not 0
+     * the characters are appended to it, copied a buffer at a time.
+     *
+     * end_of_stream is thrown if the stream ends first.
+     */
+    void consume(quint32 count, QByteArray *data = 0);
+
+    /**
+     * Called by the b-encoded types as they are constructed, to keep
+     * track of how many nodes of each type a parse creates.
+     */
+    void countNode(BBase::classID type)
+    {
+        m_decoder.countNode(static_cast<Bencode::Decoder::NodeType>(type));
+    }
+
+    /**
+     * Charged with every node for the shared pointer's count and the
+     * parent's slot, which its size leaves out.
+     */
+    enum { NodeOverhead = 48 };
+
+    /**
+     * Called by the b-encoded types as they are constructed, to charge a
+     * node of @p size bytes to the memory budget.  Its string data, if
+     * any, is charged by the decoder as it is read.
+     */
+    void chargeNode(size_t size) { m_budget.charge(size + NodeOverhead); }
+
+    /**
+     * @return what this stream has charged, and its limit.
+     */
+    Bencode::MemoryBudget &memoryBudget() { return m_budget; }
+
+    /**
+     * @return the most memory in use at once while reading this stream,
+     * in bytes, as estimated by the memory budget.
+     */
+    quint64 peakMemory() const { return m_budget.peak(); }
+
+    /**
+     * @return the memory limit new streams start with.  This is taken
+     * from STRIGI_TORRENT_MEMORY_LIMIT (in bytes, 0 for no limit) the
+     * first time it is needed.
+     */
+    static quint64 defaultMemoryLimit();
+
+    /**
+     * @return the number of nodes of @p type created from this stream.
+     */
+    quint64 nodeCount(BBase::classID type) const
+    {
+        return m_decoder.nodeCount(static_cast<Bencode::Decoder::NodeType>(type));
+    }
+
+    /**
+     * @return the number of bytes read from the underlying InputStream.
+     */
+    qint64 bytesRead() const { return m_decoder.bytesRead(); }
+
+    /**
+     * @return the number of reads made on the underlying InputStream.
+     */
+    quint32 refillCount() const { return m_decoder.refillCount(); }
+
+    /**
+     * @return the decoder doing the reading, for parsers which can work
+     * a value at a time instead of a character at a time.
+     */
+    Bencode::Decoder &decoder() { return m_decoder; }
 
 private:
-    void refillBuffer();
+    /**
+     * Feeds the decoder from a Strigi::InputStream.
+     */
+    class InputSource : public Bencode::ByteSource
+    {
+    public:
+        explicit InputSource(Strigi::InputStream *in) : m_input(in) { }
+
+        virtual long read(const char *&start, long wanted);
+
+    private:
+        Strigi::InputStream *m_input;
+    };
+
+    /**
+     * Makes a QByteArray of @p count bytes of the data in memory,
+     * starting @p offset bytes in, without copying them.
+     */
+    QByteArray view(qint64 offset, qint64 count) const;
+
+    Strigi::InputStream *m_input; // 0 when reading from m_data
+    InputSource m_source;
+    Bencode::ByteSpan m_data;
+    Bencode::MemorySource m_memorySource;
+    Bencode::Decoder m_decoder;
+    Bencode::MemoryBudget m_budget;
 
-    Strigi::InputStream *m_input;
-    qint32 m_bufSize;
-    char *m_buffer, *m_curPos;
-    bool m_atEnd;
+    QByteArray m_capture;
+    ByteArraySink m_captureSink;
+    qint64 m_captureStart;
 };
 
 #endif
@@ -0,0 +1,416 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "columnstore.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <kdebug.h>
+
+#include <string.h>
+
+// A store is a sequence of segments, each laid out as below in host byte
+// order.  Every array starts on an 8-byte boundary, so the mapped arrays
+// can be used in place.
+//
+//   header          SegmentHeader
+//   length          qint64[rows]
+//   piece length    qint64[rows]
+//   creation date   qint64[rows]
+//   files           qint32[rows]
+//   tracker         quint32[rows], ids into the tracker dictionary
+//   info-hash       char[rows][20]
+//   name offsets    quint64[rows + 1], into the names
+//   names           char[nameBytes]
+//   tracker offsets quint64[trackerCount + 1], into the tracker names
+//   tracker names   char[trackerBytes]
+static const char segmentMagic[4] = { 'T', 'C', 'O', 'L' };
+static const quint32 segmentVersion = 1;
+
+struct SegmentHeader
+{
+    char magic[4];
+    quint32 version;
+    quint64 size;          // Of the whole segment, header included
+    quint32 rows;
+    quint32 trackerCount;
+    quint64 nameBytes;
+    quint64 trackerBytes;
+};
+
+static quint64 align(quint64 size)
+{
+    return (size + 7) & ~Q_UINT64_C(7);
+}
+
+namespace {
+
+// Where each array of a segment starts.
+struct SegmentLayout
+{
+    SegmentLayout(quint64 rows, quint64 trackerCount, quint64 nameBytes, quint64 trackerBytes)
+    {
+        quint64 pos = sizeof(SegmentHeader);
+
+        length = pos;         pos += rows * sizeof(qint64);
+        pieceLength = pos;    pos += rows * sizeof(qint64);
+        creationDate = pos;   pos += rows * sizeof(qint64);
+        numFiles = pos;       pos = align(pos + rows * sizeof(qint32));
+        tracker = pos;        pos = align(pos + rows * sizeof(quint32));
+        infoHashes = pos;     pos = align(pos + rows * 20);
+        nameOffsets = pos;    pos += (rows + 1) * sizeof(quint64);
+        names = pos;          pos = align(pos + nameBytes);
+        trackerOffsets = pos; pos += (trackerCount + 1) * sizeof(quint64);
+        trackerNames = pos;   pos = align(pos + trackerBytes);
+        size = pos;
+    }
+
+    quint64 length, pieceLength, creationDate, numFiles, tracker, infoHashes;
+    quint64 nameOffsets, names, trackerOffsets, trackerNames;
+    quint64 size;
+};
+
+}
+
+// Writes @p size bytes and pads them out to the next array.
+static bool writeArray(QFile &file, const void *data, quint64 size)
+{
+    static const char padding[8] = { 0 };
+    const qint64 padSize = align(size) - size;
+
+    return file.write(static_cast<const char *>(data), size) == qint64(size) &&
+           file.write(padding, padSize) == padSize;
+}
+
+TorrentRecord::TorrentRecord()
+  : length(0), numFiles(0), pieceLength(0), creationDate(ColumnStore::NoDate)
+{
+    memset(infoHash, 0, sizeof infoHash);
+}
+
+ColumnStoreWriter::ColumnStoreWriter(const QString &fileName, int segmentRows)
+  : m_file(fileName), m_segmentRows(qMax(segmentRows, 1)), m_failed(false)
+{
+    m_nameOffsets.append(0);
+}
+
+ColumnStoreWriter::~ColumnStoreWriter()
+{
+    if(m_file.isOpen())
+        finish();
+}
+
+bool ColumnStoreWriter::open()
+{
+    if(!m_file.open(QIODevice::ReadWrite))
+        return false;
+
+    // Find the end of the last complete segment.
+    const qint64 fileSize = m_file.size();
+    qint64 end = 0;
+
+    while(end < fileSize) {
+        SegmentHeader header;
+
+        if(!m_file.seek(end) ||
+           m_file.read(reinterpret_cast<char *>(&header), sizeof header) != sizeof header ||
+           memcmp(header.magic, segmentMagic, sizeof header.magic) != 0 ||
+           header.version != segmentVersion ||
+           header.size > quint64(fileSize - end))
+        {
+            break;
+        }
+
+        end += header.size;
+    }
+
+    // Don't destroy a file that was never a store in the first place.  A
+    // first segment cut short is still recognised by its magic and
+    // version, of which a crash may have left only a part.
+    if(end == 0 && fileSize > 0) {
+        SegmentHeader expected;
+        memcpy(expected.magic, segmentMagic, sizeof expected.magic);
+        expected.version = segmentVersion;
+
+        const qint64 checkSize = qMin(fileSize, qint64(sizeof expected.magic + sizeof expected.version));
+        const QByteArray start = m_file.seek(0) ? m_file.read(checkSize) : QByteArray();
+
+        if(start.size() != checkSize ||
+           memcmp(start.constData(), reinterpret_cast<const char *>(&expected), checkSize) != 0)
+        {
+            kWarning() << m_file.fileName() << "is not a torrent column store";
+            m_file.close();
+            return false;
+        }
+    }
+
+    if(end < fileSize) {
+        kWarning() << "Discarding an incomplete segment at the end of" << m_file.fileName();
+        if(!m_file.resize(end))
+            return false;
+    }
+
+    return m_file.seek(end);
+}
+
+void ColumnStoreWriter::add(const TorrentRecord &record)
+{
+    QMutexLocker lock(&m_mutex);
+
+    m_length.append(record.length);
+    m_pieceLength.append(record.pieceLength);
+    m_creationDate.append(record.creationDate);
+    m_numFiles.append(record.numFiles);
+    m_infoHashes.append(record.infoHash, sizeof record.infoHash);
+
+    m_names.append(record.name);
+    m_nameOffsets.append(m_names.size());
+
+    quint32 tracker = ColumnStore::NoTracker;
+    if(!record.tracker.isEmpty()) {
+        QHash<QByteArray, quint32>::const_iterator it = m_trackerIds.constFind(record.tracker);
+        if(it != m_trackerIds.constEnd())
+            tracker = it.value();
+        else {
+            tracker = m_trackers.count();
+            m_trackerIds.insert(record.tracker, tracker);
+            m_trackers.append(record.tracker);
+        }
+    }
+    m_tracker.append(tracker);
+
+    if(m_length.count() >= m_segmentRows && !writeSegment())
+        m_failed = true;
+}
+
+// Must be called with m_mutex held.
+bool ColumnStoreWriter::writeSegment()
+{
+    const quint32 rows = m_length.count();
+    if(rows == 0)
+        return true;
+
+    QVector<quint64> trackerOffsets;
+    QByteArray trackerNames;
+    trackerOffsets.append(0);
+    foreach(const QByteArray &tracker, m_trackers) {
+        trackerNames.append(tracker);
+        trackerOffsets.append(trackerNames.size());
+    }
+
+    const SegmentLayout layout(rows, m_trackers.count(), m_names.size(), trackerNames.size());
+
+    SegmentHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, segmentMagic, sizeof header.magic);
+    header.version = segmentVersion;
+    header.size = layout.size;
+    header.rows = rows;
+    header.trackerCount = m_trackers.count();
+    header.nameBytes = m_names.size();
+    header.trackerBytes = trackerNames.size();
+
+    const qint64 start = m_file.pos();
+    const bool ok =
+        writeArray(m_file, &header, sizeof header) &&
+        writeArray(m_file, m_length.constData(), rows * sizeof(qint64)) &&
+        writeArray(m_file, m_pieceLength.constData(), rows * sizeof(qint64)) &&
+        writeArray(m_file, m_creationDate.constData(), rows * sizeof(qint64)) &&
+        writeArray(m_file, m_numFiles.constData(), rows * sizeof(qint32)) &&
+        writeArray(m_file, m_tracker.constData(), rows * sizeof(quint32)) &&
+        writeArray(m_file, m_infoHashes.constData(), rows * 20) &&
+        writeArray(m_file, m_nameOffsets.constData(), (rows + 1) * sizeof(quint64)) &&
+        writeArray(m_file, m_names.constData(), m_names.size()) &&
+        writeArray(m_file, trackerOffsets.constData(), trackerOffsets.count() * sizeof(quint64)) &&
+        writeArray(m_file, trackerNames.constData(), trackerNames.size());
+
+    m_length.clear();
+    m_pieceLength.clear();
+    m_creationDate.clear();
+    m_numFiles.clear();
+    m_tracker.clear();
+    m_infoHashes.clear();
+    m_nameOffsets.clear();
+    m_nameOffsets.append(0);
+    m_names.clear();
+    m_trackerIds.clear();
+    m_trackers.clear();
+
+    if(!ok) {
+        // Leave the file ending with the last good segment.
+        kWarning() << "Unable to write a segment to" << m_file.fileName();
+        m_file.resize(start);
+        m_file.seek(start);
+    }
+
+    return ok;
+}
+
+bool ColumnStoreWriter::finish()
+{
+    QMutexLocker lock(&m_mutex);
+
+    if(!m_file.isOpen())
+        return false;
+
+    const bool ok = writeSegment() && !m_failed && m_file.flush();
+    m_file.close();
+
+    return ok;
+}
+
+const qint64 ColumnStore::NoDate = Q_INT64_C(-0x7fffffffffffffff) - 1;
+const quint32 ColumnStore::NoTracker;
+
+QByteArray ColumnStore::Segment::name(quint32 row) const
+{
+    return QByteArray(names + nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+}
+
+QByteArray ColumnStore::Segment::trackerName(quint32 id) const
+{
+    if(id >= trackerCount)
+        return QByteArray();
+
+    return QByteArray(trackerNames + trackerOffsets[id], trackerOffsets[id + 1] - trackerOffsets[id]);
+}
+
+// Offsets into a string heap of @p bytes must start at 0, never go
+// backwards and end at its end.
+static bool validOffsets(const quint64 *offsets, quint64 count, quint64 bytes)
+{
+    if(offsets[0] != 0 || offsets[count] != bytes)
+        return false;
+
+    bool ok = true;
+    for(quint64 i = 0; i < count; ++i)
+        ok &= offsets[i] <= offsets[i + 1];
+    return ok;
+}
+
+ColumnStore::ColumnStore()
+  : m_map(0), m_rows(0)
+{
+}
+
+ColumnStore::~ColumnStore()
+{
+    if(m_map)
+        m_file.unmap(m_map);
+}
+
+bool ColumnStore::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const quint64 size = m_file.size();
+    if(size == 0)
+        return true;
+
+    m_map = m_file.map(0, size);
+    if(!m_map)
+        return false;
+
+    quint64 pos = 0;
+
+    // A segment running past the end is still being written, and is left
+    // for next time.
+    while(size - pos >= sizeof(SegmentHeader)) {
+        const SegmentHeader *header = reinterpret_cast<const SegmentHeader *>(m_map + pos);
+
+        if(memcmp(header->magic, segmentMagic, sizeof header->magic) != 0 ||
+           header->version != segmentVersion ||
+           header->nameBytes > size || header->trackerBytes > size ||
+           header->trackerCount == NoTracker)
+        {
+            kWarning() << fileName << "is not a valid torrent column store";
+            return false;
+        }
+
+        const SegmentLayout layout(header->rows, header->trackerCount,
+                                   header->nameBytes, header->trackerBytes);
+        if(layout.size != header->size) {
+            kWarning() << fileName << "is not a valid torrent column store";
+            return false;
+        }
+
+        if(header->size > size - pos)
+            break;
+
+        const uchar *base = m_map + pos;
+        Segment segment;
+        segment.rows = header->rows;
+        segment.trackerCount = header->trackerCount;
+        segment.length = reinterpret_cast<const qint64 *>(base + layout.length);
+        segment.pieceLength = reinterpret_cast<const qint64 *>(base + layout.pieceLength);
+        segment.creationDate = reinterpret_cast<const qint64 *>(base + layout.creationDate);
+        segment.numFiles = reinterpret_cast<const qint32 *>(base + layout.numFiles);
+        segment.tracker = reinterpret_cast<const quint32 *>(base + layout.tracker);
+        segment.infoHashes = reinterpret_cast<const char *>(base + layout.infoHashes);
+        segment.nameOffsets = reinterpret_cast<const quint64 *>(base + layout.nameOffsets);
+        segment.names = reinterpret_cast<const char *>(base + layout.names);
+        segment.trackerOffsets = reinterpret_cast<const quint64 *>(base + layout.trackerOffsets);
+        segment.trackerNames = reinterpret_cast<const char *>(base + layout.trackerNames);
+
+        // Checked once here so that scans needn't.
+        bool trackersOk = true;
+        for(quint32 i = 0; i < segment.rows; ++i)
+            trackersOk &= segment.tracker[i] < segment.trackerCount || segment.tracker[i] == NoTracker;
+
+        if(!trackersOk ||
+           !validOffsets(segment.nameOffsets, segment.rows, header->nameBytes) ||
+           !validOffsets(segment.trackerOffsets, segment.trackerCount, header->trackerBytes))
+        {
+            kWarning() << fileName << "is not a valid torrent column store";
+            return false;
+        }
+
+        m_segments.append(segment);
+        m_rows += segment.rows;
+        pos += header->size;
+    }
+
+    return true;
+}
+
+QByteArray ColumnStore::trackerOf(const QByteArray &announce)
+{
+    int start = announce.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+
+    int end = start;
+    while(end < announce.size() && announce[end] != '/' && announce[end] != '?' && announce[end] != '#')
+        ++end;
+
+    QByteArray host = announce.mid(start, end - start);
+
+    const int at = host.lastIndexOf('@');
+    if(at >= 0)
+        host.remove(0, at + 1);
+
+    // Leave the colons of an IPv6 address alone.
+    const int portStart = host.indexOf(':', host.startsWith('[') ? host.indexOf(']') : 0);
+    if(portStart >= 0)
+        host.truncate(portStart);
+
+    return host.toLower();
+}
+
+// vim: set et sw=4 ts=4:
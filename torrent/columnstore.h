@@ -0,0 +1,194 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_COLUMNSTORE_H
+#define TORRENT_ANALYZER_COLUMNSTORE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/**
+ * The fields of one torrent kept in a column store.
+ */
+struct TorrentRecord
+{
+    TorrentRecord();
+
+    char infoHash[20];      ///< SHA-1 of the "info" dictionary
+    QByteArray name;        ///< UTF-8
+    QByteArray tracker;     ///< Host of the announce URL, see trackerOf()
+    qint64 length;          ///< Total size of the content
+    qint32 numFiles;
+    qint64 pieceLength;     ///< 0 if missing
+    qint64 creationDate;    ///< Seconds since the epoch, or NoDate
+};
+
+/**
+ * Appends TorrentRecords to a column store file, for aggregate queries
+ * over far more torrents than it would be practical to parse again.
+ *
+ * Records are gathered in memory, one array per field, and written out
+ * as a segment once there are enough of them.  Each export adds segments
+ * to the end of the file, so a file can be built up a directory at a
+ * time.  Tracker hosts, of which there are few, are dictionary-encoded
+ * per segment; names are stored as they are.
+ *
+ * add() may be called from several threads at once.
+ *
+ * @see ColumnStore
+ */
+class ColumnStoreWriter
+{
+public:
+    /**
+     * @param fileName the store to append to, which is created if need be
+     * @param segmentRows how many records to gather before writing them
+     */
+    explicit ColumnStoreWriter(const QString &fileName, int segmentRows = 1 << 20);
+
+    /**
+     * Calls finish() if it hasn't been.
+     */
+    ~ColumnStoreWriter();
+
+    /**
+     * Opens the file for appending.  Whatever follows the last complete
+     * segment, such as one cut short by a crash, is discarded, even if
+     * that was the first.
+     *
+     * @return false if the file couldn't be opened or isn't a column store
+     */
+    bool open();
+
+    void add(const TorrentRecord &record);
+
+    /**
+     * Writes out the records not yet written and closes the file.
+     *
+     * @return true if every segment was written successfully
+     */
+    bool finish();
+
+private:
+    Q_DISABLE_COPY(ColumnStoreWriter)
+
+    bool writeSegment();
+
+    QFile m_file;
+    int m_segmentRows;
+    QMutex m_mutex;
+    bool m_failed;
+
+    // The segment being gathered
+    QVector<qint64> m_length, m_pieceLength, m_creationDate;
+    QVector<qint32> m_numFiles;
+    QVector<quint32> m_tracker;
+    QByteArray m_infoHashes;
+    QVector<quint64> m_nameOffsets;
+    QByteArray m_names;
+    QHash<QByteArray, quint32> m_trackerIds;
+    QList<QByteArray> m_trackers;
+};
+
+/**
+ * Read-only access to a file written by ColumnStoreWriter.  The file is
+ * memory-mapped and each field of a segment is one contiguous array, so
+ * a scan only touches the fields it uses and can run over them in tight
+ * loops.  It is safe to scan from several threads at once.
+ */
+class ColumnStore
+{
+public:
+    /**
+     * creationDate of a record without one.
+     */
+    static const qint64 NoDate;
+
+    /**
+     * Tracker id of a record without an announce URL.
+     */
+    static const quint32 NoTracker = 0xffffffff;
+
+    /**
+     * One segment of the store.  The arrays have rows entries each, and
+     * every tracker id is either less than trackerCount or NoTracker.
+     */
+    class Segment
+    {
+    public:
+        quint32 rows;
+        quint32 trackerCount;
+
+        const qint64 *length;
+        const qint64 *pieceLength;
+        const qint64 *creationDate;
+        const qint32 *numFiles;
+        const quint32 *tracker;
+        const char *infoHashes; ///< 20 bytes a row
+
+        QByteArray name(quint32 row) const;
+        QByteArray trackerName(quint32 id) const;
+
+    private:
+        friend class ColumnStore;
+
+        const quint64 *nameOffsets;
+        const char *names;
+        const quint64 *trackerOffsets;
+        const char *trackerNames;
+    };
+
+    ColumnStore();
+    ~ColumnStore();
+
+    /**
+     * Maps the store in @p fileName and checks every segment.
+     *
+     * @return false if the file couldn't be mapped or isn't a valid store
+     */
+    bool open(const QString &fileName);
+
+    const QList<Segment> &segments() const { return m_segments; }
+
+    quint64 rowCount() const { return m_rows; }
+
+    /**
+     * @return the tracker a record with announce URL @p announce is
+     * filed under: the host, in lower case, without any user name or
+     * port.  Private trackers put a key per user into the rest of the
+     * URL, which would otherwise split one tracker into many.
+     */
+    static QByteArray trackerOf(const QByteArray &announce);
+
+private:
+    Q_DISABLE_COPY(ColumnStore)
+
+    QFile m_file;
+    uchar *m_map;
+    QList<Segment> m_segments;
+    quint64 m_rows;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
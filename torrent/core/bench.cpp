@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Measures the Qt-free decoder on its own, so that it can be built and
+// profiled with nothing but a C++ compiler:
+//
+//   c++ -O2 -o bencode-bench *.cpp
+//   ./bencode-bench [--iterations n] file.torrent...
+//
+// Each file is read into memory and then decoded over and over, once
+// just checking and skipping every value ("skip") and once copying each
+// value to a re-encoded std::string ("copy"), which gives back the input
+// unless some of its numbers are written unusually (e.g. "i+1e").
+
+#include "bytesink.h"
+#include "bytesource.h"
+#include "decoder.h"
+#include "encoder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+void copyValue(Bencode::Decoder &decoder, Bencode::Encoder &encoder, std::string &scratch)
+{
+    switch(decoder.current()) {
+        case 'i':
+            encoder.writeInt(decoder.readInt());
+            break;
+
+        case 'l': {
+            Bencode::Decoder::Nesting nesting(decoder);
+            decoder.countNode(Bencode::Decoder::ListNode);
+            decoder.advance();
+            encoder.beginList();
+            while(decoder.current() != 'e')
+                copyValue(decoder, encoder, scratch);
+            decoder.advance();
+            encoder.end();
+            break;
+        }
+
+        case 'd': {
+            Bencode::Decoder::Nesting nesting(decoder);
+            decoder.countNode(Bencode::Decoder::DictNode);
+            decoder.advance();
+            encoder.beginDict();
+            while(decoder.current() != 'e') {
+                encoder.writeString(decoder.readString(scratch));
+                copyValue(decoder, encoder, scratch);
+            }
+            decoder.advance();
+            encoder.end();
+            break;
+        }
+
+        default:
+            encoder.writeString(decoder.readString(scratch));
+    }
+}
+
+// Returns false if @p data isn't valid.
+bool runOnce(const std::string &data, bool copy, long readSize, std::string &output)
+{
+    Bencode::MemorySource source(data);
+    Bencode::Decoder decoder(&source, readSize);
+
+    try {
+        decoder.advance();
+
+        if(copy) {
+            std::string scratch;
+            output.clear();
+            Bencode::StringSink sink(output);
+            Bencode::Encoder encoder(sink);
+            copyValue(decoder, encoder, scratch);
+        }
+        else
+            decoder.skipValue();
+    }
+    catch(const std::exception &) {
+        return false;
+    }
+
+    return true;
+}
+
+double seconds()
+{
+    return double(std::clock()) / CLOCKS_PER_SEC;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 100;
+    int first = 1;
+
+    if(argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::atoi(argv[2]);
+        first = 3;
+    }
+
+    if(first >= argc || iterations <= 0) {
+        std::fprintf(stderr, "usage: %s [--iterations n] file...\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%-40s %10s %10s %10s %s\n", "file", "bytes", "skip MB/s", "copy MB/s", "notes");
+
+    for(int i = first; i < argc; ++i) {
+        std::ifstream file(argv[i], std::ios::in | std::ios::binary);
+        if(!file) {
+            std::fprintf(stderr, "%s: cannot open\n", argv[i]);
+            continue;
+        }
+
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        const std::string data(contents.str());
+
+        std::string output;
+        double rates[2];
+
+        for(int copy = 0; copy < 2; ++copy) {
+            const double start = seconds();
+            for(int n = 0; n < iterations; ++n)
+                runOnce(data, copy, 4096, output);
+            const double elapsed = seconds() - start;
+
+            rates[copy] = elapsed > 0 ? double(data.size()) * iterations / elapsed / 1e6 : 0;
+        }
+
+        const bool valid = runOnce(data, true, 4096, output);
+        std::printf("%-40s %10lu %10.1f %10.1f %s\n", argv[i], (unsigned long) data.size(),
+                    rates[0], rates[1],
+                    !valid ? "invalid" : (output == data ? "" : "not canonical"));
+    }
+
+    return 0;
+}
+
+// vim: set et sw=4 ts=4:
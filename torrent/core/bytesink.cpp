@@ -0,0 +1,45 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "bytesink.h"
+
+namespace Bencode {
+
+ByteSink::~ByteSink()
+{
+}
+
+void ByteSink::reserve(std::size_t size)
+{
+    (void) size;
+}
+
+bool StringSink::write(const char *data, std::size_t size)
+{
+    m_data.append(data, size);
+    return true;
+}
+
+void StringSink::reserve(std::size_t size)
+{
+    m_data.reserve(m_data.size() + size);
+}
+
+}
+
+// vim: set et sw=4 ts=4:
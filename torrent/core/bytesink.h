@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_BYTESINK_H
+#define TORRENT_ANALYZER_CORE_BYTESINK_H
+
+#include <cstddef>
+#include <string>
+
+namespace Bencode {
+
+/**
+ * Where bytes produced by an Encoder, or copied out by a Decoder, go.
+ */
+class ByteSink
+{
+public:
+    virtual ~ByteSink();
+
+    /**
+     * Appends the @p size bytes at @p data.
+     *
+     * @return false if they could not all be written
+     */
+    virtual bool write(const char *data, std::size_t size) = 0;
+
+    /**
+     * A hint that about @p size more bytes are on their way, so that
+     * room can be made for them in one go.  Does nothing by default.
+     */
+    virtual void reserve(std::size_t size);
+};
+
+/**
+ * A ByteSink appending to a std::string, which must outlive it.
+ */
+class StringSink : public ByteSink
+{
+public:
+    explicit StringSink(std::string &data) : m_data(data) { }
+
+    virtual bool write(const char *data, std::size_t size);
+    virtual void reserve(std::size_t size);
+
+private:
+    std::string &m_data;
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,49 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "bytesource.h"
+
+namespace Bencode {
+
+ByteSource::~ByteSource()
+{
+}
+
+MemorySource::MemorySource(const ByteSpan &data)
+  : m_data(data), m_pos(0)
+{
+}
+
+long MemorySource::read(const char *&start, long wanted)
+{
+    if(m_pos >= m_data.size())
+        return -1;
+
+    // There's no copying to save, so hand over everything at once.
+    (void) wanted;
+
+    start = m_data.data() + m_pos;
+    const long size = long(m_data.size() - m_pos);
+    m_pos = m_data.size();
+
+    return size;
+}
+
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_BYTESOURCE_H
+#define TORRENT_ANALYZER_CORE_BYTESOURCE_H
+
+#include "bytespan.h"
+
+namespace Bencode {
+
+/**
+ * Where a Decoder gets its bytes from.  Implementations hand out their
+ * data a block at a time from whatever buffer they like; the Decoder
+ * never writes to it and stops using a block once it asks for the next.
+ */
+class ByteSource
+{
+public:
+    virtual ~ByteSource();
+
+    /**
+     * Makes the next block of data available at @p start.  The block
+     * stays valid until the next call.
+     *
+     * @param wanted roughly how many bytes the caller would like; more or
+     * fewer may be returned
+     * @return the size of the block, -1 at the end of the data, or less
+     * than -1 if reading failed
+     */
+    virtual long read(const char *&start, long wanted) = 0;
+};
+
+/**
+ * A ByteSource over data already in memory, which must outlive it.
+ */
+class MemorySource : public ByteSource
+{
+public:
+    explicit MemorySource(const ByteSpan &data);
+
+    virtual long read(const char *&start, long wanted);
+
+private:
+    ByteSpan m_data;
+    std::size_t m_pos;
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
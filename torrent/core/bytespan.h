@@ -0,0 +1,103 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_BYTESPAN_H
+#define TORRENT_ANALYZER_CORE_BYTESPAN_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace Bencode {
+
+/**
+ * A read-only view of bytes owned by someone else, in the spirit of
+ * C++17's std::string_view.  Nothing is copied, so the span is only good
+ * for as long as whatever it points into.
+ */
+class ByteSpan
+{
+public:
+    ByteSpan() : m_data(0), m_size(0) { }
+    ByteSpan(const char *data, std::size_t size) : m_data(data), m_size(size) { }
+    ByteSpan(const char *text) : m_data(text), m_size(text ? std::strlen(text) : 0) { }
+    ByteSpan(const std::string &text) : m_data(text.data()), m_size(text.size()) { }
+
+    const char *data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const char *begin() const { return m_data; }
+    const char *end() const { return m_data + m_size; }
+
+    char operator[](std::size_t i) const { return m_data[i]; }
+
+    /**
+     * @return the @p count bytes starting at @p pos, or as many of them
+     * as there are.
+     */
+    ByteSpan substr(std::size_t pos, std::size_t count = std::size_t(-1)) const
+    {
+        if(pos > m_size)
+            pos = m_size;
+        if(count > m_size - pos)
+            count = m_size - pos;
+        return ByteSpan(m_data + pos, count);
+    }
+
+    /**
+     * Compares bytewise, like memcmp() with the shorter span ordered
+     * first when one is a prefix of the other.
+     */
+    int compare(const ByteSpan &other) const
+    {
+        const std::size_t common = m_size < other.m_size ? m_size : other.m_size;
+        const int result = common ? std::memcmp(m_data, other.m_data, common) : 0;
+
+        if(result != 0)
+            return result;
+        return m_size < other.m_size ? -1 : (m_size > other.m_size ? 1 : 0);
+    }
+
+    std::string toString() const { return std::string(m_data, m_size); }
+
+private:
+    const char *m_data;
+    std::size_t m_size;
+};
+
+inline bool operator==(const ByteSpan &a, const ByteSpan &b)
+{
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+inline bool operator!=(const ByteSpan &a, const ByteSpan &b)
+{
+    return !(a == b);
+}
+
+inline bool operator<(const ByteSpan &a, const ByteSpan &b)
+{
+    return a.compare(b) < 0;
+}
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
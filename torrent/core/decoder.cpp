@@ -0,0 +1,398 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "decoder.h"
+#include "bytesink.h"
+#include "bytesource.h"
+#include "memorybudget.h"
+
+namespace Bencode {
+
+// Strings longer than this are only given room as their data arrives, in
+// case the length is a lie.
+static const unsigned int maxReserve = 1024 * 1024;
+
+// The most asked of a source at once, when a long string is being read.
+// Buffered Strigi streams keep a buffer as big as the biggest read, so
+// this also bounds what they hold on to.
+static const long maxReadSize = 1024 * 1024;
+
+// The least asked of a source at once, however small the data is said
+// to be.
+static const long minReadSize = 256;
+
+// Big inputs are read in blocks of a sixteenth of their size, up to this,
+// to save reads where there are no long strings to speed them up.
+static const long maxBlockReadSize = 64 * 1024;
+
+// Lengths and integers with more characters than this are unusual enough
+// to be charged to the memory budget.
+static const std::string::size_type freeNumberSize = 64;
+
+EndOfInput::EndOfInput() : std::runtime_error("reached eos")
+{
+}
+
+// Converts @p text the way QByteArray's conversions do.  @p limit is the
+// largest magnitude allowed for a positive number, and one more than
+// that for a negative one if @p allowMinus is set.
+static bool parseNumber(ByteSpan text, bool allowMinus, unsigned long long limit,
+                        bool *negative, unsigned long long *magnitude)
+{
+    // Qt converts from a NUL terminated copy.
+    const char *nul = static_cast<const char *>(std::memchr(text.data(), '\0', text.size()));
+    if(nul)
+        text = text.substr(0, nul - text.data());
+
+    const char *p = text.begin();
+    const char *end = text.end();
+
+    while(p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+        ++p;
+
+    *negative = false;
+    if(p < end && (*p == '+' || *p == '-')) {
+        *negative = (*p == '-');
+        if(*negative && !allowMinus)
+            return false;
+        ++p;
+    }
+
+    if(p == end)
+        return false;
+
+    if(*negative)
+        ++limit;
+
+    unsigned long long value = 0;
+    for(; p < end; ++p) {
+        if(*p < '0' || *p > '9')
+            return false;
+
+        const unsigned digit = *p - '0';
+        if(value > (limit - digit) / 10)
+            return false;
+
+        value = value * 10 + digit;
+    }
+
+    *magnitude = value;
+    return true;
+}
+
+bool parseLength(const ByteSpan &text, unsigned int *length)
+{
+    bool negative;
+    unsigned long long value;
+
+    if(!parseNumber(text, false, 0xffffffffULL, &negative, &value))
+        return false;
+
+    *length = static_cast<unsigned int>(value);
+    return true;
+}
+
+bool parseInteger(const ByteSpan &text, long long *value)
+{
+    bool negative;
+    unsigned long long magnitude;
+
+    if(!parseNumber(text, true, 0x7fffffffffffffffULL, &negative, &magnitude))
+        return false;
+
+    *value = negative ? static_cast<long long>(0 - magnitude) : static_cast<long long>(magnitude);
+    return true;
+}
+
+const int Decoder::maxDepth;
+
+Decoder::Decoder(ByteSource *source, long readSize)
+  : m_source(source), m_baseReadSize(readSize), m_readSize(readSize), m_growingReadSize(readSize),
+    m_expectedSize(-1), m_budget(0),
+    m_pos(0), m_end(0), m_captureSink(0), m_captureStart(0), m_numberCharged(freeNumberSize),
+    m_bytesRead(0), m_refillCount(0), m_depth(0)
+{
+    for(int i = 0; i <= DictNode; ++i)
+        m_nodeCounts[i] = 0;
+}
+
+void Decoder::consume(unsigned int count, ByteSink *sink)
+{
+    while(count > 0) {
+        if(BENCODE_UNLIKELY(m_pos == m_end))
+            throw EndOfInput();
+
+        const unsigned long available = m_end - m_pos;
+        const unsigned int taken = count < available ? count : static_cast<unsigned int>(available);
+
+        if(sink) {
+            if(m_budget)
+                m_budget->charge(taken);
+            sink->write(m_pos, taken);
+        }
+
+        m_pos += taken;
+        count -= taken;
+        if(m_pos == m_end)
+            refill(count);
+    }
+}
+
+void Decoder::readAll(ByteSink &sink)
+{
+    while(m_pos != m_end) {
+        if(m_budget)
+            m_budget->charge(m_end - m_pos);
+        sink.write(m_pos, m_end - m_pos);
+        m_pos = m_end;
+        refill(maxReadSize);
+    }
+}
+
+void Decoder::setExpectedSize(long long size)
+{
+    m_expectedSize = size;
+    m_readSize = m_baseReadSize;
+
+    if(size / 16 > m_readSize)
+        m_readSize = size / 16 < maxBlockReadSize ? static_cast<long>(size / 16) : maxBlockReadSize;
+    if(m_readSize < m_baseReadSize)
+        m_readSize = m_baseReadSize;
+
+    m_growingReadSize = m_readSize;
+}
+
+void Decoder::beginCapture(ByteSink *sink)
+{
+    if(m_captureSink)
+        throw std::logic_error("beginCapture() called during a capture");
+
+    m_captureSink = sink;
+    m_captureStart = m_pos;
+}
+
+void Decoder::endCapture()
+{
+    if(!m_captureSink)
+        throw std::logic_error("endCapture() called without beginCapture()");
+
+    if(m_pos) {
+        if(m_budget)
+            m_budget->charge(m_pos - m_captureStart);
+        m_captureSink->write(m_captureStart, m_pos - m_captureStart);
+    }
+
+    m_captureSink = 0;
+    m_captureStart = 0;
+}
+
+unsigned int Decoder::readLength()
+{
+    countNode(StringNode);
+
+    // A string is \d+:.{n}, where n is whatever \d+ converted to.
+    m_number.clear();
+    while(current() != ':') {
+        m_number += *m_pos;
+        if(BENCODE_UNLIKELY(m_number.size() > m_numberCharged))
+            chargeNumber();
+        advance();
+    }
+
+    advance(); // Read past ':'
+
+    unsigned int length;
+    if(!parseLength(m_number, &length))
+        throw std::runtime_error("Invalid number in string data");
+
+    // A length running past the end of the data can only be a lie, or
+    // the data was cut short; either way there's no use reading it.
+    if(m_expectedSize >= 0 && length > m_expectedSize - offset())
+        throw EndOfInput();
+
+    return length;
+}
+
+ByteSpan Decoder::readString(std::string &scratch)
+{
+    return readBytes(readLength(), scratch);
+}
+
+ByteSpan Decoder::readBytes(unsigned int length, std::string &scratch)
+{
+    // Stopping short of the end of the block means nothing needs to be
+    // read, so the block stays valid.
+    if(length < static_cast<unsigned long>(m_end - m_pos)) {
+        const ByteSpan result(m_pos, length);
+        m_pos += length;
+        return result;
+    }
+
+    if(m_budget)
+        m_budget->require(length);
+
+    scratch.clear();
+    StringSink sink(scratch);
+    sink.reserve(length < maxReserve ? length : maxReserve);
+    consume(length, &sink);
+
+    // The scratch space is the caller's to reuse, so only counts towards
+    // the peak.
+    if(m_budget)
+        m_budget->release(length);
+
+    return ByteSpan(scratch);
+}
+
+void Decoder::readString(ByteSink &sink)
+{
+    const unsigned int length = readLength();
+
+    if(m_budget)
+        m_budget->require(length);
+
+    sink.reserve(length < maxReserve ? length : maxReserve);
+    consume(length, &sink);
+}
+
+long long Decoder::readInt()
+{
+    countNode(IntNode);
+    advance(); // Move to start of digits
+
+    m_number.clear();
+    while(current() != 'e') {
+        m_number += *m_pos;
+        if(BENCODE_UNLIKELY(m_number.size() > m_numberCharged))
+            chargeNumber();
+        advance();
+    }
+
+    advance(); // Eat the 'e'
+
+    long long value;
+    if(!parseInteger(m_number, &value))
+        throw std::runtime_error("Invalid int read");
+
+    return value;
+}
+
+void Decoder::skipValue()
+{
+    switch(current()) {
+        case 'i':
+            readInt();
+            break;
+
+        case 'l': {
+            Nesting nesting(*this);
+            countNode(ListNode);
+            advance();
+            while(current() != 'e')
+                skipValue();
+            advance();
+            break;
+        }
+
+        case 'd': {
+            Nesting nesting(*this);
+            countNode(DictNode);
+            advance();
+            while(current() != 'e') {
+                consume(readLength());
+                skipValue();
+            }
+            advance();
+            break;
+        }
+
+        default:
+            consume(readLength());
+    }
+}
+
+void Decoder::chargeNumber()
+{
+    // Charged in steps of doubling size, as a string grows, so that this
+    // is rarely called.
+    const std::string::size_type charged = m_numberCharged;
+    m_numberCharged *= 2;
+
+    if(m_budget)
+        m_budget->charge(m_numberCharged - charged);
+}
+
+long Decoder::nextReadSize(unsigned long pending)
+{
+    long wanted = m_readSize;
+
+    // In the middle of a long string, ask for twice as much as last time
+    // (up to what the string still needs) so that it takes few reads.
+    // Anything else starts again from the usual size.
+    if(pending > static_cast<unsigned long>(m_readSize)) {
+        if(m_growingReadSize < maxReadSize)
+            m_growingReadSize *= 2;
+
+        wanted = m_growingReadSize;
+        if(static_cast<unsigned long>(wanted) > pending)
+            wanted = static_cast<long>(pending);
+    }
+    else
+        m_growingReadSize = m_readSize;
+
+    // Don't ask for more than is left, so that a buffered source isn't
+    // made to hold a bigger buffer than the whole of the data.
+    if(m_expectedSize >= 0) {
+        const long long left = m_expectedSize - m_bytesRead;
+        if(left < wanted)
+            wanted = static_cast<long>(left < minReadSize ? minReadSize : left);
+    }
+
+    return wanted;
+}
+
+void Decoder::refill(unsigned long pending)
+{
+    // The old block is only valid until the next read, so save whatever
+    // part of it is being captured first.
+    if(m_captureSink && m_captureStart) {
+        if(m_budget)
+            m_budget->charge(m_end - m_captureStart);
+        m_captureSink->write(m_captureStart, m_end - m_captureStart);
+    }
+
+    const char *start = 0;
+    const long size = m_source->read(start, nextReadSize(pending));
+    ++m_refillCount;
+
+    if(size < -1)
+        throw std::runtime_error("Failed to refill buffer");
+
+    if(size <= 0) {
+        m_pos = m_end = m_captureStart = 0;
+        return;
+    }
+
+    m_pos = m_captureStart = start;
+    m_end = start + size;
+    m_bytesRead += size;
+}
+
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,323 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_DECODER_H
+#define TORRENT_ANALYZER_CORE_DECODER_H
+
+#include "bytespan.h"
+
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__)
+#define BENCODE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define BENCODE_UNLIKELY(x) (x)
+#endif
+
+namespace Bencode {
+
+class ByteSink;
+class ByteSource;
+class MemoryBudget;
+
+/**
+ * Thrown when the data ends in the middle of a value.  Anything else
+ * wrong with the data is reported as a plain std::runtime_error.
+ */
+class EndOfInput : public std::runtime_error
+{
+public:
+    EndOfInput();
+};
+
+/**
+ * Converts the length in front of a b-encoded string.  The same text is
+ * accepted as by QByteArray::toUInt(): optional leading white space, an
+ * optional '+', and decimal digits, stopping at any NUL byte.
+ *
+ * @return false if @p text isn't a length that fits in 32 bits
+ */
+bool parseLength(const ByteSpan &text, unsigned int *length);
+
+/**
+ * Converts the digits of a b-encoded integer, accepting the same text as
+ * QByteArray::toLongLong() (see parseLength()) including a leading '-'.
+ *
+ * @return false if @p text isn't a 64-bit integer
+ */
+bool parseInteger(const ByteSpan &text, long long *value);
+
+/**
+ * Reads b-encoded data from a ByteSource, one character or one value at
+ * a time.  This is the part of ByteStream which needs nothing but the
+ * standard library; ByteStream adapts it to Strigi and Qt.
+ *
+ * Like ByteStream the decoder starts out before the first character, so
+ * advance() must be called once before anything else.
+ */
+class Decoder
+{
+public:
+    /**
+     * The kinds of value counted by countNode().  These line up with
+     * BBase::classID.
+     */
+    enum NodeType {
+        StringNode = 1,
+        IntNode,
+        ListNode,
+        DictNode
+    };
+
+    /**
+     * How deeply lists and dictionaries may be nested.  Anything deeper
+     * is refused, so that reading the data recursively, or destroying a
+     * tree decoded from it, can't run out of stack on a hostile file.
+     * Real torrents nest 4 or 5 levels at most.
+     */
+    static const int maxDepth = 256;
+
+    /**
+     * Counts a list or dictionary as open for as long as it exists.
+     * Anything reading nested values recursively keeps one for each
+     * container it goes into.
+     *
+     * @throw std::runtime_error if that makes more than maxDepth open
+     */
+    class Nesting
+    {
+    public:
+        explicit Nesting(Decoder &decoder) : m_decoder(decoder)
+        {
+            if(BENCODE_UNLIKELY(++decoder.m_depth > maxDepth)) {
+                --decoder.m_depth;
+                throw std::runtime_error("Values are nested too deeply");
+            }
+        }
+
+        ~Nesting() { --m_decoder.m_depth; }
+
+    private:
+        Nesting(const Nesting &);
+        Nesting &operator=(const Nesting &);
+
+        Decoder &m_decoder;
+    };
+
+    /**
+     * @param source where the data comes from, which must outlive the
+     * decoder
+     * @param readSize how much to ask @p source for at a time.  While a
+     * long string is being read this is doubled with every read, up to
+     * 1 MB.  See also setExpectedSize().
+     */
+    explicit Decoder(ByteSource *source, long readSize = 4096);
+
+    /**
+     * Tells the decoder that the source holds @p size bytes in all, or
+     * -1 if that isn't known.  Reads are then never for more than is
+     * left, and big inputs are read in bigger blocks (up to 64 KB).
+     */
+    void setExpectedSize(long long size);
+
+    /**
+     * Charges everything the decoder copies out of the source to
+     * @p budget, which must outlive the decoder, or to nothing if it is
+     * 0.  A string too long for what is left of the budget is refused
+     * with MemoryLimitExceeded before anything is set aside for it.
+     *
+     * Independently of any budget, a string longer than what is left of
+     * the size given to setExpectedSize() is refused with EndOfInput as
+     * soon as its length is read.
+     */
+    void setMemoryBudget(MemoryBudget *budget) { m_budget = budget; }
+
+    /**
+     * @return the budget given to setMemoryBudget(), or 0.
+     */
+    MemoryBudget *memoryBudget() const { return m_budget; }
+
+    /**
+     * @return the current character
+     * @throw EndOfInput if there is none
+     */
+    char current() const
+    {
+        if(BENCODE_UNLIKELY(m_pos == m_end))
+            throw EndOfInput();
+        return *m_pos;
+    }
+
+    /**
+     * Moves to the next character, reading more from the source when
+     * the current block runs out.
+     */
+    void advance()
+    {
+        if(m_pos != m_end)
+            ++m_pos;
+        if(BENCODE_UNLIKELY(m_pos == m_end))
+            refill();
+    }
+
+    bool atEnd() const { return m_pos == m_end; }
+
+    /**
+     * Moves past the next @p count characters, starting with the current
+     * one, writing them to @p sink if it is not 0.
+     *
+     * @throw EndOfInput if the data ends first
+     */
+    void consume(unsigned int count, ByteSink *sink = 0);
+
+    /**
+     * Writes everything left, starting with the current character, to
+     * @p sink.  The decoder is at the end afterwards.
+     */
+    void readAll(ByteSink &sink);
+
+    /**
+     * Starts sending the raw bytes read to @p sink, beginning with the
+     * current character.  Only one capture may be active at a time.
+     */
+    void beginCapture(ByteSink *sink);
+
+    /**
+     * Stops the capture, after writing the bytes read since
+     * beginCapture() up to but not including the current character.
+     */
+    void endCapture();
+
+    /**
+     * Reads the string value at the current position.  When the string
+     * lies entirely within the current block the span points straight
+     * into it and nothing is copied; otherwise it is copied into
+     * @p scratch.  Either way the span is only valid until the next call
+     * which reads from the decoder.
+     */
+    ByteSpan readString(std::string &scratch);
+
+    /**
+     * Reads the string value at the current position into @p sink.
+     */
+    void readString(ByteSink &sink);
+
+    /**
+     * Reads the length in front of the string value at the current
+     * position and the ':' after it, leaving the decoder on the first
+     * byte of the string itself for the caller to consume().  This lets
+     * a long string be processed piece by piece.
+     */
+    unsigned int readLength();
+
+    /**
+     * Reads the next @p count bytes, starting with the current character,
+     * in the same way as readString() reads a string's content: straight
+     * from the current block if they lie within it, otherwise copied
+     * into @p scratch.
+     */
+    ByteSpan readBytes(unsigned int count, std::string &scratch);
+
+    /**
+     * Reads the integer value at the current position, which must be on
+     * its 'i'.
+     */
+    long long readInt();
+
+    /**
+     * @return the digits of the last length or integer read, exactly as
+     * they were written, for checking that they are in canonical form.
+     */
+    const std::string &numberText() const { return m_number; }
+
+    /**
+     * Moves past the value at the current position, checking it as
+     * thoroughly as reading it would (including against maxDepth) but
+     * keeping none of it.
+     */
+    void skipValue();
+
+    /**
+     * Counts a node of @p type as read, for the parse statistics.  The
+     * read and skip functions count what they read themselves.
+     */
+    void countNode(NodeType type) { ++m_nodeCounts[type]; }
+
+    /**
+     * @return the number of nodes of @p type read so far.
+     */
+    unsigned long long nodeCount(NodeType type) const { return m_nodeCounts[type]; }
+
+    /**
+     * @return the number of bytes read from the source.
+     */
+    long long bytesRead() const { return m_bytesRead; }
+
+    /**
+     * @return how far the current character is from the start of the
+     * data.
+     */
+    long long offset() const { return m_bytesRead - (m_end - m_pos); }
+
+    /**
+     * @return the number of reads made on the source.
+     */
+    unsigned int refillCount() const { return m_refillCount; }
+
+private:
+    /**
+     * Reads the next block from the source.  @p pending is how many more
+     * bytes the caller already knows it needs, such as the rest of a
+     * string.
+     */
+    void refill(unsigned long pending = 0);
+
+    long nextReadSize(unsigned long pending);
+
+    /**
+     * Charges the digits in m_number to the budget as it grows, since a
+     * length or integer can have any number of them.
+     */
+    void chargeNumber();
+
+    ByteSource *m_source;
+    long m_baseReadSize;    // As given to the constructor
+    long m_readSize;
+    long m_growingReadSize; // Read size within a long string
+    long long m_expectedSize;
+    MemoryBudget *m_budget;
+    const char *m_pos, *m_end;
+
+    ByteSink *m_captureSink;
+    const char *m_captureStart;
+
+    std::string m_number; // Digits of the length or integer being read
+    std::string::size_type m_numberCharged; // Room in m_number already charged
+
+    long long m_bytesRead;
+    unsigned int m_refillCount;
+    int m_depth; // Containers open, see Nesting
+    unsigned long long m_nodeCounts[DictNode + 1];
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
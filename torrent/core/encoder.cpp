@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "encoder.h"
+#include "bytesink.h"
+
+namespace Bencode {
+
+// Formats @p magnitude in decimal at the end of the buffer at @p end,
+// returning where it starts.
+static char *formatDecimal(unsigned long long magnitude, char *end)
+{
+    char *p = end;
+
+    do {
+        *--p = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude != 0);
+
+    return p;
+}
+
+bool Encoder::writeInt(long long value)
+{
+    char buffer[24];
+    char *end = buffer + sizeof buffer;
+
+    *--end = 'e';
+    const unsigned long long magnitude = value < 0 ? 0 - static_cast<unsigned long long>(value)
+                                                   : static_cast<unsigned long long>(value);
+    char *p = formatDecimal(magnitude, end);
+    if(value < 0)
+        *--p = '-';
+    *--p = 'i';
+
+    return m_sink.write(p, buffer + sizeof buffer - p);
+}
+
+bool Encoder::writeString(const ByteSpan &data)
+{
+    char buffer[24];
+    char *end = buffer + sizeof buffer;
+
+    *--end = ':';
+    char *p = formatDecimal(data.size(), end);
+
+    return m_sink.write(p, buffer + sizeof buffer - p) &&
+           (data.empty() || m_sink.write(data.data(), data.size()));
+}
+
+bool Encoder::beginList()
+{
+    return m_sink.write("l", 1);
+}
+
+bool Encoder::beginDict()
+{
+    return m_sink.write("d", 1);
+}
+
+bool Encoder::end()
+{
+    return m_sink.write("e", 1);
+}
+
+}
+
+// vim: set et sw=4 ts=4:
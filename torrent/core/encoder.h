@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_ENCODER_H
+#define TORRENT_ANALYZER_CORE_ENCODER_H
+
+#include "bytespan.h"
+
+namespace Bencode {
+
+class ByteSink;
+
+/**
+ * Writes b-encoded values to a ByteSink.  Lists and dictionaries are
+ * written as begin, their contents, then end(); dictionary keys must be
+ * written with writeString() in sorted order, which is left to the
+ * caller.
+ *
+ * Every function returns false if the sink failed to take the data.
+ */
+class Encoder
+{
+public:
+    explicit Encoder(ByteSink &sink) : m_sink(sink) { }
+
+    bool writeInt(long long value);
+    bool writeString(const ByteSpan &data);
+    bool beginList();
+    bool beginDict();
+    bool end();
+
+private:
+    ByteSink &m_sink;
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,34 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "memorybudget.h"
+
+namespace Bencode {
+
+MemoryLimitExceeded::MemoryLimitExceeded() : std::runtime_error("memory limit exceeded")
+{
+}
+
+MemoryBudget::MemoryBudget(unsigned long long limit)
+  : m_limit(limit), m_used(0), m_peak(0)
+{
+}
+
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,128 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_MEMORYBUDGET_H
+#define TORRENT_ANALYZER_CORE_MEMORYBUDGET_H
+
+#include <stdexcept>
+
+namespace Bencode {
+
+/**
+ * Thrown when a parse would need more memory than its MemoryBudget
+ * allows.  Nothing has been allocated for the value being read.
+ */
+class MemoryLimitExceeded : public std::runtime_error
+{
+public:
+    MemoryLimitExceeded();
+};
+
+/**
+ * Keeps account of the memory one parse has set aside, so that a corrupt
+ * or malicious file can be refused before it takes everything the
+ * process is allowed.
+ *
+ * The decoder charges the bytes it copies out of its source, and the
+ * tree classes charge each node they create.  The figures are estimates
+ * of what was asked of the allocator rather than what it handed out,
+ * but they grow with the data the same way.
+ *
+ * A budget is not thread-safe; each parse should have its own.
+ */
+class MemoryBudget
+{
+public:
+    /**
+     * @param limit the most that may be in use at once, in bytes, or 0
+     * for no limit
+     */
+    explicit MemoryBudget(unsigned long long limit = 0);
+
+    void setLimit(unsigned long long limit) { m_limit = limit; }
+    unsigned long long limit() const { return m_limit; }
+
+    /**
+     * @return the bytes in use now.
+     */
+    unsigned long long used() const { return m_used; }
+
+    /**
+     * @return the most bytes that were in use at once.
+     */
+    unsigned long long peak() const { return m_peak; }
+
+    /**
+     * @return true if @p bytes more could be charged without going over
+     * the limit.
+     */
+    bool allows(unsigned long long bytes) const
+    {
+        return m_limit == 0 || bytes <= m_limit - m_used;
+    }
+
+    /**
+     * Throws MemoryLimitExceeded if @p bytes more couldn't be charged,
+     * without charging them.  For checking a declared size before
+     * anything is allocated for it.
+     */
+    void require(unsigned long long bytes) const
+    {
+        if(!allows(bytes))
+            throw MemoryLimitExceeded();
+    }
+
+    /**
+     * Adds @p bytes to the memory in use.
+     *
+     * @throw MemoryLimitExceeded if that would go over the limit, in
+     * which case nothing is charged
+     */
+    void charge(unsigned long long bytes)
+    {
+        require(bytes);
+
+        m_used += bytes;
+        if(m_used > m_peak)
+            m_peak = m_used;
+    }
+
+    /**
+     * Takes @p bytes, charged earlier, off the memory in use.
+     */
+    void release(unsigned long long bytes)
+    {
+        m_used -= bytes < m_used ? bytes : m_used;
+    }
+
+    /**
+     * Forgets everything charged, keeping the limit.
+     */
+    void reset() { m_used = m_peak = 0; }
+
+private:
+    unsigned long long m_limit;
+    unsigned long long m_used;
+    unsigned long long m_peak;
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "schema.h"
+
+namespace Bencode {
+
+SchemaError::SchemaError(Kind kind, const std::string &path, const std::string &message)
+  : std::runtime_error(message), m_kind(kind), m_path(path)
+{
+    m_what = m_path.empty() ? message : m_path + ": " + message;
+}
+
+SchemaError::~SchemaError() throw()
+{
+}
+
+const char *SchemaError::what() const throw()
+{
+    return m_what.c_str();
+}
+
+void SchemaError::prependPath(const std::string &key)
+{
+    if(key.empty())
+        return;
+
+    m_path = m_path.empty() ? key : key + '/' + m_path;
+    m_what = m_path + ": " + std::runtime_error::what();
+}
+
+namespace Detail {
+
+void throwWrongType(const char *expected, char found)
+{
+    const char *actual = "a string";
+    switch(found) {
+        case 'i': actual = "an integer"; break;
+        case 'l': actual = "a list"; break;
+        case 'd': actual = "a dictionary"; break;
+        case 'e': actual = "the end of a list or dictionary"; break;
+    }
+
+    throw SchemaError(SchemaError::WrongType, std::string(),
+                      std::string("expected ") + expected + " but found " + actual);
+}
+
+// Must be called from within a catch block.  Errors from the decoder
+// itself are turned into SchemaErrors here, at the innermost key, so that
+// they get a path as well.
+void rethrowWithPath(const std::string &key)
+{
+    try {
+        throw;
+    }
+    catch(SchemaError &e) {
+        e.prependPath(key);
+        throw;
+    }
+    catch(const EndOfInput &e) {
+        throw SchemaError(SchemaError::Truncated, key, e.what());
+    }
+    catch(const std::runtime_error &e) {
+        throw SchemaError(SchemaError::Malformed, key, e.what());
+    }
+}
+
+std::string indexKey(std::size_t index)
+{
+    char buffer[24];
+    char *p = buffer + sizeof buffer;
+
+    *--p = '\0';
+    do {
+        *--p = char('0' + index % 10);
+        index /= 10;
+    } while(index != 0);
+
+    return std::string(p);
+}
+
+}
+
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,396 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_SCHEMA_H
+#define TORRENT_ANALYZER_CORE_SCHEMA_H
+
+#include "bytesink.h"
+#include "decoder.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * Decodes b-encoded data straight into plain C++ structs, without
+ * building a BBase tree first.
+ *
+ * Each struct describes its keys by specializing Bencode::Schema with a
+ * fields() template, which names every member along with the key it is
+ * stored under:
+ *
+ * @code
+ * template<> struct Schema<FileEntry>
+ * {
+ *     template<class Visitor>
+ *     static void fields(Visitor &v, FileEntry &entry)
+ *     {
+ *         v("length", entry.length, RequiredField);
+ *         v("path", entry.path, RequiredField);
+ *         v("md5sum", entry.md5sum);
+ *     }
+ * };
+ * @endcode
+ *
+ * The same fields() is instantiated once to match the keys of the
+ * dictionary being read and once to check that the required keys were
+ * there, so the key lookup compiles down to a short chain of comparisons
+ * against constant strings, much like the one a hand-written decoder
+ * would have.  Keys without a field are skipped without being copied.
+ *
+ * Member types may be long long, bool, std::string, another struct with a
+ * Schema, std::vector of any of these (for lists), Maybe<T> (to find out
+ * whether an optional key was present) and Captured<T> (to keep the raw
+ * bytes as well).
+ */
+
+namespace Bencode {
+
+class ByteSource;
+
+/**
+ * Thrown when the data doesn't fit the schema.  path() tells where, as
+ * the keys and list indices leading to the offending value separated by
+ * '/', e.g. "info/files/3/length".
+ */
+class SchemaError : public std::runtime_error
+{
+public:
+    enum Kind {
+        Malformed,   ///< The data isn't valid b-encoding
+        Truncated,   ///< The data ends in the middle of a value
+        WrongType,   ///< A value isn't the type its member needs
+        MissingKey   ///< A required key isn't in its dictionary
+    };
+
+    SchemaError(Kind kind, const std::string &path, const std::string &message);
+    virtual ~SchemaError() throw();
+
+    Kind kind() const { return m_kind; }
+    const std::string &path() const { return m_path; }
+
+    /**
+     * @return the error message with the path in front.
+     */
+    virtual const char *what() const throw();
+
+    /**
+     * Adds @p key at the front of the path, used as the error makes its
+     * way out of the nested values.
+     */
+    void prependPath(const std::string &key);
+
+private:
+    Kind m_kind;
+    std::string m_path;
+    std::string m_what;
+};
+
+/**
+ * Whether a key must be present for the dictionary to be accepted.
+ */
+enum FieldPresence {
+    OptionalField,
+    RequiredField
+};
+
+/**
+ * Describes the keys of the struct @p T.  Specialize it with a static
+ * fields() template as shown in the file documentation.
+ */
+template<class T> struct Schema;
+
+/**
+ * A value which may be missing: present tells whether its key was found.
+ */
+template<class T>
+struct Maybe
+{
+    Maybe() : value(), present(false) { }
+
+    T value;
+    bool present;
+};
+
+/**
+ * A value decoded along with the exact bytes it was decoded from, which
+ * is what the info hash of a torrent is computed over.  Captured values
+ * may not be nested inside each other.
+ */
+template<class T>
+struct Captured
+{
+    T value;
+    std::string raw;
+};
+
+namespace Detail {
+
+void throwWrongType(const char *expected, char found);
+void rethrowWithPath(const std::string &key);
+std::string indexKey(std::size_t index);
+
+inline void expect(Decoder &decoder, char type, const char *expected)
+{
+    const char found = decoder.current();
+    if(BENCODE_UNLIKELY(found != type))
+        throwWrongType(expected, found);
+}
+
+}
+
+/**
+ * Decodes the value at the current position of @p decoder into
+ * @p value.  The primary template handles structs with a Schema; the
+ * other supported types have specializations below.
+ */
+template<class T>
+struct ValueDecoder
+{
+    static void decode(Decoder &decoder, T &object);
+};
+
+template<>
+struct ValueDecoder<long long>
+{
+    static void decode(Decoder &decoder, long long &value)
+    {
+        Detail::expect(decoder, 'i', "an integer");
+        value = decoder.readInt();
+    }
+};
+
+template<>
+struct ValueDecoder<bool>
+{
+    static void decode(Decoder &decoder, bool &value)
+    {
+        Detail::expect(decoder, 'i', "an integer");
+        value = decoder.readInt() != 0;
+    }
+};
+
+template<>
+struct ValueDecoder<std::string>
+{
+    static void decode(Decoder &decoder, std::string &value)
+    {
+        const char found = decoder.current();
+        if(BENCODE_UNLIKELY(found == 'i' || found == 'l' || found == 'd' || found == 'e'))
+            Detail::throwWrongType("a string", found);
+
+        value.clear();
+        StringSink sink(value);
+        decoder.readString(sink);
+    }
+};
+
+template<class T>
+struct ValueDecoder<std::vector<T> >
+{
+    static void decode(Decoder &decoder, std::vector<T> &values)
+    {
+        Detail::expect(decoder, 'l', "a list");
+        Decoder::Nesting nesting(decoder);
+        decoder.countNode(Decoder::ListNode);
+        decoder.advance();
+
+        values.clear();
+        while(decoder.current() != 'e') {
+            values.push_back(T());
+
+            try {
+                ValueDecoder<T>::decode(decoder, values.back());
+            }
+            catch(const std::runtime_error &) {
+                Detail::rethrowWithPath(Detail::indexKey(values.size() - 1));
+            }
+        }
+
+        decoder.advance();
+    }
+};
+
+template<class T>
+struct ValueDecoder<Maybe<T> >
+{
+    static void decode(Decoder &decoder, Maybe<T> &value)
+    {
+        ValueDecoder<T>::decode(decoder, value.value);
+        value.present = true;
+    }
+};
+
+template<class T>
+struct ValueDecoder<Captured<T> >
+{
+    static void decode(Decoder &decoder, Captured<T> &value)
+    {
+        value.raw.clear();
+        StringSink sink(value.raw);
+
+        decoder.beginCapture(&sink);
+        ValueDecoder<T>::decode(decoder, value.value);
+        decoder.endCapture();
+    }
+};
+
+namespace Detail {
+
+/**
+ * The fields() visitor which decodes the value of the one field whose
+ * name is the key just read.
+ */
+class FieldMatcher
+{
+public:
+    FieldMatcher(Decoder &decoder, const ByteSpan &key)
+      : m_decoder(decoder), m_key(key), m_index(0), m_matched(-1)
+    {
+    }
+
+    template<class V>
+    void operator()(const char *name, V &value, FieldPresence = OptionalField)
+    {
+        if(m_matched < 0 && m_key == ByteSpan(name)) {
+            // The key may point into the decoder's buffer, so it is no
+            // longer usable once the value has been read.
+            m_matched = m_index;
+
+            try {
+                ValueDecoder<V>::decode(m_decoder, value);
+            }
+            catch(const std::runtime_error &) {
+                rethrowWithPath(name);
+            }
+        }
+
+        ++m_index;
+    }
+
+    /**
+     * @return the position of the field in fields() which was decoded,
+     * or -1 if the key isn't in the schema.
+     */
+    int matched() const { return m_matched; }
+
+private:
+    Decoder &m_decoder;
+    const ByteSpan m_key;
+    int m_index;
+    int m_matched;
+};
+
+/**
+ * The fields() visitor which checks that every required field was seen.
+ */
+class RequiredChecker
+{
+public:
+    explicit RequiredChecker(unsigned long long seen) : m_seen(seen), m_index(0)
+    {
+    }
+
+    template<class V>
+    void operator()(const char *name, V &, FieldPresence presence = OptionalField)
+    {
+        if(presence == RequiredField && !(m_seen & (1ULL << m_index)))
+            throw SchemaError(SchemaError::MissingKey, name, "required key is missing");
+
+        ++m_index;
+    }
+
+private:
+    unsigned long long m_seen;
+    int m_index;
+};
+
+}
+
+// A schema may describe at most 64 fields, one for each bit of "seen".
+template<class T>
+void ValueDecoder<T>::decode(Decoder &decoder, T &object)
+{
+    Detail::expect(decoder, 'd', "a dictionary");
+    Decoder::Nesting nesting(decoder);
+    decoder.countNode(Decoder::DictNode);
+    decoder.advance();
+
+    std::string scratch;
+    unsigned long long seen = 0;
+
+    while(decoder.current() != 'e') {
+        Detail::FieldMatcher matcher(decoder, decoder.readString(scratch));
+        Schema<T>::fields(matcher, object);
+
+        if(matcher.matched() < 0)
+            decoder.skipValue();
+        else
+            seen |= 1ULL << matcher.matched();
+    }
+
+    decoder.advance();
+
+    Detail::RequiredChecker checker(seen);
+    Schema<T>::fields(checker, object);
+}
+
+/**
+ * Decodes the value at the current position of @p decoder, which must
+ * already have been advanced onto its first character, into @p value.
+ *
+ * @throw SchemaError if the data isn't valid or doesn't fit the schema
+ */
+template<class T>
+void decodeValue(Decoder &decoder, T &value)
+{
+    try {
+        ValueDecoder<T>::decode(decoder, value);
+    }
+    catch(const std::runtime_error &) {
+        Detail::rethrowWithPath(std::string());
+    }
+}
+
+/**
+ * Decodes the b-encoded value at the start of @p source into @p value.
+ * Anything after the value is left unread.
+ *
+ * @throw SchemaError if the data isn't valid or doesn't fit the schema
+ */
+template<class T>
+void decode(ByteSource &source, T &value)
+{
+    Decoder decoder(&source);
+
+    try {
+        decoder.advance();
+    }
+    catch(const std::runtime_error &) {
+        Detail::rethrowWithPath(std::string());
+    }
+
+    decodeValue(decoder, value);
+}
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,141 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_CORE_TORRENTMETA_H
+#define TORRENT_ANALYZER_CORE_TORRENTMETA_H
+
+#include "schema.h"
+
+#include <string>
+#include <vector>
+
+namespace Bencode {
+
+/**
+ * One entry of the "files" list of a multi-file torrent.
+ */
+struct TorrentFileEntry
+{
+    TorrentFileEntry() : length(0) { }
+
+    long long length;
+    std::vector<std::string> path;
+    Maybe<std::vector<std::string> > pathUtf8;
+    std::string md5sum;
+};
+
+/**
+ * The "info" dictionary, which the info hash is computed over.  Exactly
+ * one of length (single-file torrents) and files (multi-file torrents)
+ * is normally present.
+ */
+struct TorrentInfo
+{
+    TorrentInfo() : pieceLength(0), isPrivate(false) { }
+
+    /**
+     * @return the size of the content, adding up the files of a
+     * multi-file torrent.
+     */
+    long long totalLength() const
+    {
+        if(length.present)
+            return length.value;
+
+        long long total = 0;
+        for(std::vector<TorrentFileEntry>::const_iterator it = files.value.begin(); it != files.value.end(); ++it)
+            total += it->length;
+        return total;
+    }
+
+    std::string name;
+    Maybe<std::string> nameUtf8;
+    long long pieceLength;
+    std::string pieces;         ///< Concatenated 20-byte SHA-1 piece hashes
+    Maybe<long long> length;
+    Maybe<std::vector<TorrentFileEntry> > files;
+    bool isPrivate;
+};
+
+/**
+ * The metadata of a .torrent file, as described by BEP 3 and the common
+ * extensions to it.
+ */
+struct TorrentMeta
+{
+    TorrentMeta() : creationDate(0) { }
+
+    std::string announce;
+    std::vector<std::vector<std::string> > announceList;
+    long long creationDate;
+    std::string comment;
+    std::string createdBy;
+    std::string encoding;
+    Captured<TorrentInfo> info;
+};
+
+template<>
+struct Schema<TorrentFileEntry>
+{
+    template<class Visitor>
+    static void fields(Visitor &v, TorrentFileEntry &entry)
+    {
+        v("length", entry.length, RequiredField);
+        v("path", entry.path, RequiredField);
+        v("path.utf-8", entry.pathUtf8);
+        v("md5sum", entry.md5sum);
+    }
+};
+
+template<>
+struct Schema<TorrentInfo>
+{
+    template<class Visitor>
+    static void fields(Visitor &v, TorrentInfo &info)
+    {
+        v("name", info.name, RequiredField);
+        v("name.utf-8", info.nameUtf8);
+        v("piece length", info.pieceLength, RequiredField);
+        v("pieces", info.pieces, RequiredField);
+        v("length", info.length);
+        v("files", info.files);
+        v("private", info.isPrivate);
+    }
+};
+
+template<>
+struct Schema<TorrentMeta>
+{
+    template<class Visitor>
+    static void fields(Visitor &v, TorrentMeta &meta)
+    {
+        v("announce", meta.announce);
+        v("announce-list", meta.announceList);
+        v("creation date", meta.creationDate);
+        v("comment", meta.comment);
+        v("created by", meta.createdBy);
+        v("encoding", meta.encoding);
+        v("info", meta.info, RequiredField);
+    }
+};
+
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,294 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "extractionplan.h"
+
+#include <kdebug.h>
+
+#include <string.h>
+
+static const char *const builtinFieldNames[] = {
+    "announce",
+    "creation date",
+    "length",
+    "files",
+    "name",
+    "piece length",
+    "comment",
+    "info hash",
+    "duplicate of",
+    "file pieces"
+};
+
+// FilePieces costs 8 bytes a file, so it has to be asked for.
+static const int defaultFields = (1 << (TorrentFieldSink::DuplicateOf + 1)) - 1;
+
+ExtractionPlan::ExtractionPlan()
+  : m_enabled(defaultFields)
+{
+    compile();
+}
+
+ExtractionPlan::ExtractionPlan(const QByteArray &spec)
+  : m_enabled(defaultFields)
+{
+    QByteArray entries(spec);
+    entries.replace('\n', ';');
+
+    foreach(const QByteArray &entry, entries.split(';'))
+        addEntry(entry.trimmed());
+
+    compile();
+}
+
+ExtractionPlan ExtractionPlan::fromConfiguration()
+{
+    const QByteArray spec = qgetenv("STRIGI_TORRENT_FIELDS");
+    return spec.isEmpty() ? ExtractionPlan() : ExtractionPlan(spec);
+}
+
+const char *ExtractionPlan::fieldName(TorrentFieldSink::Field field)
+{
+    return builtinFieldNames[field];
+}
+
+int ExtractionPlan::child(const Node &parent, TorrentKey knownKey, const char *key, int size) const
+{
+    for(int i = 0; i < parent.children.count(); ++i) {
+        const Node &candidate = m_nodes[parent.children[i]];
+
+        // Keys in the vocabulary were already identified, so only the
+        // others need comparing.
+        if(candidate.knownKey != UnknownKey) {
+            if(candidate.knownKey == knownKey)
+                return parent.children[i];
+        }
+        else if(candidate.key.size() == size && memcmp(candidate.key.constData(), key, size) == 0)
+            return parent.children[i];
+    }
+
+    return parent.wildcard;
+}
+
+void ExtractionPlan::addEntry(const QByteArray &entry)
+{
+    if(entry.isEmpty())
+        return;
+
+    if(entry.startsWith('-') || entry.startsWith('+')) {
+        const QByteArray name = entry.mid(1).trimmed();
+
+        for(int field = 0; field <= TorrentFieldSink::FilePieces; ++field) {
+            if(name == builtinFieldNames[field]) {
+                if(entry.startsWith('+'))
+                    m_enabled |= 1 << field;
+                else
+                    m_enabled &= ~(1 << field);
+                return;
+            }
+        }
+
+        kWarning() << "Ignoring unknown torrent field" << name;
+        return;
+    }
+
+    const int equals = entry.indexOf('=');
+    const QByteArray path = (equals < 0 ? entry : entry.left(equals)).trimmed();
+    QByteArray fieldName = (equals < 0 ? QByteArray() : entry.mid(equals + 1)).trimmed();
+
+    if(path.isEmpty() || path.startsWith('/') || path.endsWith('/') || path.contains("//")) {
+        kWarning() << "Ignoring invalid torrent field path" << path;
+        return;
+    }
+
+    if(m_paths.contains(path)) {
+        kWarning() << "Ignoring repeated torrent field path" << path;
+        return;
+    }
+
+    if(fieldName.isEmpty())
+        fieldName = "torrent." + QByteArray(path).replace('/', '.');
+
+    m_paths.append(path);
+    m_pathFieldNames.append(fieldName);
+}
+
+void ExtractionPlan::compile()
+{
+    m_nodes.clear();
+    m_nodes.append(Node()); // The root
+
+    // What the built-in fields need.  "encoding" says how to read the
+    // text fields, and "info" with its "length" and "files" decides
+    // whether the file is a torrent at all, so those are always there.
+    addPath("encoding", EncodingSlot);
+
+    if(isEnabled(TorrentFieldSink::Announce)) {
+        addPath("announce", AnnounceSlot);
+        addPath("announce.utf-8", AnnounceUtf8Slot);
+    }
+
+    if(isEnabled(TorrentFieldSink::CreationDate))
+        addPath("creation date", CreationDateSlot);
+
+    addPath("info", InfoSlot);
+
+    if(isEnabled(TorrentFieldSink::Name)) {
+        addPath("info/name", NameSlot);
+        addPath("info/name.utf-8", NameUtf8Slot);
+    }
+
+    if(isEnabled(TorrentFieldSink::Comment)) {
+        addPath("info/comment", CommentSlot);
+        addPath("info/comment.utf-8", CommentUtf8Slot);
+    }
+
+    addPath("info/length", LengthSlot);
+    addPath("info/files", FilesSlot);
+
+    const bool filePieces = isEnabled(TorrentFieldSink::FilePieces);
+
+    if(isEnabled(TorrentFieldSink::Length) || filePieces)
+        addPath("info/files/*/length", FileLengthSlot);
+
+    if(isEnabled(TorrentFieldSink::PieceLength) || filePieces)
+        addPath("info/piece length", PieceLengthSlot);
+
+    for(int i = 0; i < m_paths.count(); ++i)
+        m_nodes[addPath(m_paths[i], NoSlot)].paths.append(i);
+
+    // A key with a node of its own must still lead everywhere the
+    // wildcard beside it does, so that the parser only ever has to
+    // follow one node.
+    mergeWildcards(0);
+}
+
+int ExtractionPlan::addPath(const QByteArray &path, Slot slot)
+{
+    int current = 0;
+
+    foreach(const QByteArray &key, path.split('/')) {
+        int next = -1;
+
+        if(key == "*")
+            next = m_nodes[current].wildcard;
+        else {
+            const QVector<int> &children = m_nodes[current].children;
+            for(int i = 0; i < children.count() && next < 0; ++i) {
+                if(m_nodes[children[i]].key == key)
+                    next = children[i];
+            }
+        }
+
+        if(next < 0) {
+            Node node;
+            node.key = key;
+            if(key != "*")
+                node.knownKey = lookupTorrentKey(key.constData(), key.size());
+
+            next = m_nodes.count();
+            m_nodes.append(node);
+
+            if(key == "*")
+                m_nodes[current].wildcard = next;
+            else
+                m_nodes[current].children.append(next);
+        }
+
+        current = next;
+    }
+
+    if(slot != NoSlot)
+        m_nodes[current].slot = slot;
+
+    return current;
+}
+
+int ExtractionPlan::copySubtree(int index)
+{
+    const int copy = m_nodes.count();
+    m_nodes.append(m_nodes[index]);
+    m_nodes[copy].slot = NoSlot;
+
+    // m_nodes may move as it grows, so index it afresh each time.
+    for(int i = 0; i < m_nodes[copy].children.count(); ++i) {
+        const int child = copySubtree(m_nodes[copy].children[i]);
+        m_nodes[copy].children[i] = child;
+    }
+
+    if(m_nodes[copy].wildcard >= 0) {
+        const int wildcard = copySubtree(m_nodes[copy].wildcard);
+        m_nodes[copy].wildcard = wildcard;
+    }
+
+    return copy;
+}
+
+void ExtractionPlan::mergeSubtree(int target, int source)
+{
+    foreach(int path, m_nodes[source].paths) {
+        if(!m_nodes[target].paths.contains(path))
+            m_nodes[target].paths.append(path);
+    }
+
+    const QVector<int> sourceChildren = m_nodes[source].children;
+    foreach(int sourceChild, sourceChildren) {
+        int match = -1;
+        foreach(int targetChild, m_nodes[target].children) {
+            if(m_nodes[targetChild].key == m_nodes[sourceChild].key)
+                match = targetChild;
+        }
+
+        if(match >= 0)
+            mergeSubtree(match, sourceChild);
+        else {
+            const int copy = copySubtree(sourceChild);
+            m_nodes[target].children.append(copy);
+        }
+    }
+
+    const int sourceWildcard = m_nodes[source].wildcard;
+    if(sourceWildcard < 0)
+        return;
+
+    if(m_nodes[target].wildcard >= 0)
+        mergeSubtree(m_nodes[target].wildcard, sourceWildcard);
+    else {
+        const int copy = copySubtree(sourceWildcard);
+        m_nodes[target].wildcard = copy;
+    }
+}
+
+void ExtractionPlan::mergeWildcards(int index)
+{
+    const int wildcard = m_nodes[index].wildcard;
+    const QVector<int> children = m_nodes[index].children;
+
+    if(wildcard >= 0) {
+        foreach(int child, children)
+            mergeSubtree(child, wildcard);
+    }
+
+    foreach(int child, children)
+        mergeWildcards(child);
+
+    if(wildcard >= 0)
+        mergeWildcards(wildcard);
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_EXTRACTIONPLAN_H
+#define TORRENT_ANALYZER_EXTRACTIONPLAN_H
+
+#include "torrentfields.h"
+#include "torrentkeys.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+/**
+ * Describes which fields extractTorrentFields() produces, compiled into
+ * a trie of dictionary keys for the parser to follow.  Values that no
+ * field needs are skipped without being decoded into anything.
+ *
+ * A plan starts out with the built-in fields of TorrentFieldSink::Field
+ * other than FilePieces, any of which can be dropped or added, and can
+ * have extra fields added, each named by the path of keys leading to it:
+ *
+ * @code
+ * created by
+ * info/private
+ * info/source
+ * @endcode
+ *
+ * Keys are separated by '/' and a key of '*' stands for every element
+ * of a list or every value of a dictionary, as in "announce-list" then
+ * '*' twice for every tracker.  A path only produces strings and
+ * integers; lists and dictionaries at its end are ignored.  Extra fields
+ * are handed to TorrentFieldSink::addPathValue() by their index in the
+ * plan, in the order they appear in the file.
+ */
+class ExtractionPlan
+{
+public:
+    /**
+     * What the parser does with the value a trie node is reached by,
+     * beyond following the node's children.
+     */
+    enum Slot {
+        NoSlot,
+        AnnounceSlot,
+        AnnounceUtf8Slot,
+        EncodingSlot,
+        CreationDateSlot,
+        InfoSlot,
+        NameSlot,
+        NameUtf8Slot,
+        CommentSlot,
+        CommentUtf8Slot,
+        LengthSlot,
+        PieceLengthSlot,
+        FilesSlot,
+        FileLengthSlot
+    };
+
+    /**
+     * A trie node, reached from its parent by the dictionary key @p key
+     * (or from any list element or dictionary value if it is the
+     * parent's wildcard).
+     */
+    struct Node
+    {
+        Node() : knownKey(UnknownKey), wildcard(-1), slot(NoSlot) { }
+
+        QByteArray key;
+        TorrentKey knownKey; // key as a TorrentKey, if it is one
+        QVector<int> children;
+        int wildcard;        // Index of the '*' child, or -1
+        Slot slot;
+        QVector<int> paths;  // Indexes of the extra fields ending here
+    };
+
+    /**
+     * Creates a plan for all of the built-in fields and no others.
+     */
+    ExtractionPlan();
+
+    /**
+     * Creates a plan from @p spec, a list of entries separated by ';' or
+     * newlines.  Each entry is either a path to add as an extra field,
+     * optionally followed by '=' and the name to register it under, or a
+     * built-in field name (see fieldName()) preceded by '-' to drop it or
+     * '+' to add it.
+     * Entries which make no sense are ignored with a warning.
+     */
+    explicit ExtractionPlan(const QByteArray &spec);
+
+    /**
+     * @return the plan given by STRIGI_TORRENT_FIELDS, or the default
+     * plan if it isn't set.
+     */
+    static ExtractionPlan fromConfiguration();
+
+    /**
+     * @return the name used for the built-in @p field in plan entries,
+     * such as "piece length".
+     */
+    static const char *fieldName(TorrentFieldSink::Field field);
+
+    /**
+     * @return whether the built-in @p field is produced.
+     */
+    bool isEnabled(TorrentFieldSink::Field field) const { return m_enabled & (1 << field); }
+
+    /**
+     * @return the number of extra fields.
+     */
+    int pathCount() const { return m_paths.count(); }
+
+    /**
+     * @return the key path of extra field @p index, as written in the spec.
+     */
+    QByteArray path(int index) const { return m_paths[index]; }
+
+    /**
+     * @return the name extra field @p index should be registered under.
+     */
+    QByteArray pathFieldName(int index) const { return m_pathFieldNames[index]; }
+
+    /**
+     * @return the root of the trie, reached by the whole file.
+     */
+    const Node &root() const { return m_nodes[0]; }
+
+    const Node &node(int index) const { return m_nodes[index]; }
+
+    /**
+     * @return the child of @p parent reached by the dictionary key
+     * @p key, which lookupTorrentKey() identified as @p knownKey.  Falls
+     * back to the wildcard, which is -1 if there is none.  Whatever the
+     * wildcard leads to has already been merged into the other children.
+     */
+    int child(const Node &parent, TorrentKey knownKey, const char *key, int size) const;
+
+private:
+    void addEntry(const QByteArray &entry);
+    void compile();
+    int addPath(const QByteArray &path, Slot slot);
+    int copySubtree(int index);
+    void mergeSubtree(int target, int source);
+    void mergeWildcards(int index);
+
+    QVector<Node> m_nodes;
+    int m_enabled; // Bit (1 << Field) for each built-in field
+    QList<QByteArray> m_paths;
+    QList<QByteArray> m_pathFieldNames;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "infohashset.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include <ksavefile.h>
+#include <kdebug.h>
+
+#include <string.h>
+
+// On-disk format: magic, version, count, then count (key, path length,
+// path) entries in host byte order.  The file is a cache, so it's not
+// meant to be moved between machines.  Version 1 files only kept a
+// fingerprint of the path and are ignored.
+static const char fileMagic[4] = { 'T', 'I', 'H', 'S' };
+static const quint32 fileVersion = 2;
+
+static const quint32 minimumSlots = 1024;
+static const int filterHashCount = 4;
+
+// The filter has 8 bits per slot and is addressed with 32-bit bit numbers,
+// so 2^28 slots is as far as the table can go.  That is 3 GB of table,
+// well past any sensible capacity anyway.
+static const quint32 maximumSlots = 1U << 28;
+static const quint32 maximumCapacity = maximumSlots / 4 * 3;
+
+static quint32 nextPowerOf2(quint64 n)
+{
+    quint64 result = 1;
+    while(result < n)
+        result <<= 1;
+
+    return result > maximumSlots ? maximumSlots : quint32(result);
+}
+
+// Offsets into the path buffer are 32 bits, and QByteArray can't hold
+// much more than 2 GB anyway.
+static const int maximumPathData = 0x7fff0000;
+
+InfoHashSet::InfoHashSet(quint32 capacity, quint32 pathCapacity)
+  : m_capacity(capacity), m_pathCapacity(pathCapacity), m_count(0), m_slots(0), m_keys(0), m_pathOffsets(0),
+    m_filter(0), m_filterBits(0), m_warnedFull(false)
+{
+    if(m_capacity > maximumCapacity) {
+        kWarning() << "Info-hash set capacity" << m_capacity << "is too large, using"
+                   << maximumCapacity;
+        m_capacity = maximumCapacity;
+    }
+
+    if(m_pathCapacity > quint32(maximumPathData))
+        m_pathCapacity = maximumPathData;
+
+    resize(minimumSlots);
+}
+
+InfoHashSet::~InfoHashSet()
+{
+    delete[] m_keys;
+    delete[] m_pathOffsets;
+    delete[] m_filter;
+}
+
+bool InfoHashSet::insert(const QByteArray &infoHash, const QByteArray &path,
+                         QByteArray *original)
+{
+    // SHA-1 output is already uniformly distributed, so the first 8 bytes
+    // make a perfectly good hash table key.
+    quint64 key = 0;
+    memcpy(&key, infoHash.constData(), qMin(infoHash.size(), int(sizeof key)));
+    if(key == 0)
+        key = 1;
+
+    QMutexLocker lock(&m_mutex);
+    return insertKey(key, path, original);
+}
+
+quint32 InfoHashSet::count() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_count;
+}
+
+QByteArray InfoHashSet::pathAt(quint32 offset) const
+{
+    return QByteArray(m_paths.constData() + offset);
+}
+
+bool InfoHashSet::insertKey(quint64 key, const QByteArray &path, QByteArray *original)
+{
+    const quint32 mask = m_slots - 1;
+    quint32 slot = quint32(key) & mask;
+
+    if(filterContains(key)) {
+        while(m_keys[slot] != 0) {
+            if(m_keys[slot] == key) {
+                const QByteArray first = pathAt(m_pathOffsets[slot]);
+                if(first == path)
+                    return false;
+
+                if(original)
+                    *original = first;
+                return true;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    const quint64 pathData = quint64(m_paths.size()) + path.size() + 1;
+    if(m_count >= m_capacity || pathData > m_pathCapacity) {
+        if(!m_warnedFull && m_capacity > 0) {
+            kWarning() << "Info-hash set is full at" << m_count
+                       << "entries, new torrents won't be checked for duplicates";
+            m_warnedFull = true;
+        }
+
+        return false;
+    }
+
+    // Keep the load factor at or below 3/4 while we're allowed to grow.
+    if((m_count + 1) * 4ULL > m_slots * 3ULL &&
+       m_slots < nextPowerOf2(m_capacity * 4ULL / 3 + 1))
+    {
+        resize(m_slots * 2);
+        return insertKey(key, path, original);
+    }
+
+    // Left to itself, QByteArray doubles the buffer, which could take it
+    // well past the limit.
+    if(pathData > quint64(m_paths.capacity()))
+        m_paths.reserve(int(qMin(quint64(m_pathCapacity), qMax(pathData, m_paths.capacity() * 2ULL))));
+
+    while(m_keys[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    m_keys[slot] = key;
+    m_pathOffsets[slot] = m_paths.size();
+    m_paths.append(path);
+    m_paths.append('\0');
+    filterAdd(key);
+    ++m_count;
+
+    return false;
+}
+
+void InfoHashSet::resize(quint32 slots)
+{
+    quint64 *oldKeys = m_keys;
+    quint32 *oldPathOffsets = m_pathOffsets;
+    const quint32 oldSlots = m_slots;
+
+    m_slots = slots;
+    m_keys = new quint64[m_slots];
+    m_pathOffsets = new quint32[m_slots];
+    memset(m_keys, 0, m_slots * sizeof(quint64));
+
+    const quint32 mask = m_slots - 1;
+    for(quint32 i = 0; i < oldSlots; ++i) {
+        if(oldKeys[i] == 0)
+            continue;
+
+        quint32 slot = quint32(oldKeys[i]) & mask;
+        while(m_keys[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        m_keys[slot] = oldKeys[i];
+        m_pathOffsets[slot] = oldPathOffsets[i];
+    }
+
+    delete[] oldKeys;
+    delete[] oldPathOffsets;
+
+    rebuildFilter();
+}
+
+// The filter is sized at 8 bits per table slot, which works out to
+// 10-11 bits per stored hash, for a false positive rate around 1%.
+void InfoHashSet::rebuildFilter()
+{
+    delete[] m_filter;
+
+    const quint64 filterBits = quint64(m_slots) * 8;
+    Q_ASSERT(filterBits <= Q_UINT64_C(0x80000000));
+
+    m_filterBits = quint32(filterBits);
+    m_filter = new quint32[m_filterBits / 32];
+    memset(m_filter, 0, (m_filterBits / 32) * sizeof(quint32));
+
+    for(quint32 i = 0; i < m_slots; ++i) {
+        if(m_keys[i] != 0)
+            filterAdd(m_keys[i]);
+    }
+}
+
+// Double hashing on the upper half of the key; the lower half already
+// picks the table slot.
+bool InfoHashSet::filterContains(quint64 key) const
+{
+    const quint32 h1 = quint32(key >> 32);
+    const quint32 h2 = quint32(key >> 16) | 1;
+    const quint32 mask = m_filterBits - 1;
+
+    for(int i = 0; i < filterHashCount; ++i) {
+        const quint32 bit = (h1 + i * h2) & mask;
+        if(!(m_filter[bit / 32] & (1U << (bit % 32))))
+            return false;
+    }
+
+    return true;
+}
+
+void InfoHashSet::filterAdd(quint64 key)
+{
+    const quint32 h1 = quint32(key >> 32);
+    const quint32 h2 = quint32(key >> 16) | 1;
+    const quint32 mask = m_filterBits - 1;
+
+    for(int i = 0; i < filterHashCount; ++i) {
+        const quint32 bit = (h1 + i * h2) & mask;
+        m_filter[bit / 32] |= 1U << (bit % 32);
+    }
+}
+
+bool InfoHashSet::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    char magic[sizeof fileMagic];
+    quint32 version, count;
+
+    if(file.read(magic, sizeof magic) != sizeof magic ||
+       memcmp(magic, fileMagic, sizeof magic) != 0 ||
+       file.read(reinterpret_cast<char *>(&version), sizeof version) != sizeof version ||
+       version != fileVersion ||
+       file.read(reinterpret_cast<char *>(&count), sizeof count) != sizeof count)
+    {
+        kWarning() << "Ignoring invalid info-hash set" << fileName;
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+
+    for(quint32 i = 0; i < count; ++i) {
+        quint64 key;
+        quint32 length;
+        QByteArray path;
+
+        if(file.read(reinterpret_cast<char *>(&key), sizeof key) != sizeof key ||
+           file.read(reinterpret_cast<char *>(&length), sizeof length) != sizeof length ||
+           length > quint32(maximumPathData) ||
+           (path = file.read(length)).size() != int(length))
+        {
+            kWarning() << "Info-hash set" << fileName << "is truncated";
+            return false;
+        }
+
+        if(key != 0)
+            insertKey(key, path, 0);
+    }
+
+    return true;
+}
+
+bool InfoHashSet::save(const QString &fileName)
+{
+    KSaveFile file(fileName);
+    if(!file.open())
+        return false;
+
+    QMutexLocker lock(&m_mutex);
+
+    bool ok = file.write(fileMagic, sizeof fileMagic) == sizeof fileMagic &&
+        file.write(reinterpret_cast<const char *>(&fileVersion), sizeof fileVersion) == sizeof fileVersion &&
+        file.write(reinterpret_cast<const char *>(&m_count), sizeof m_count) == sizeof m_count;
+
+    for(quint32 i = 0; ok && i < m_slots; ++i) {
+        if(m_keys[i] == 0)
+            continue;
+
+        const QByteArray path = pathAt(m_pathOffsets[i]);
+        const quint32 length = path.size();
+
+        ok = file.write(reinterpret_cast<const char *>(&m_keys[i]), sizeof m_keys[i]) == sizeof m_keys[i] &&
+             file.write(reinterpret_cast<const char *>(&length), sizeof length) == sizeof length &&
+             file.write(path) == path.size();
+    }
+
+    if(!ok) {
+        file.abort();
+        return false;
+    }
+
+    return file.finalize();
+}
+
+// vim: set et sw=4 ts=4:
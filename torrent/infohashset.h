@@ -0,0 +1,116 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_INFOHASHSET_H
+#define TORRENT_ANALYZER_INFOHASHSET_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+
+class QString;
+
+/**
+ * A thread-safe set of torrent info-hashes, used to spot torrents that
+ * have already been indexed under a different file name.
+ *
+ * Each hash is stored as a 64-bit fingerprint in an open-addressed table,
+ * together with the path it was first seen at, so that copies can be
+ * pointed at the original and re-indexing the same file is not mistaken
+ * for a copy.  A Bloom filter sits in front of the table so that the
+ * common case of a new hash rarely has to touch the (much larger) table
+ * at all.
+ *
+ * The table grows as hashes are added, but never beyond the capacity
+ * given to the constructor.  Past its first 1024 slots it is kept
+ * between 3/8 and 3/4 full, so each hash costs 16 to 32 bytes of table
+ * and 1 to 3 bytes of filter.  The paths come on top of that, one after
+ * another in a single buffer, at their length plus one byte each; for
+ * most collections they are the larger part, which is why they have a
+ * limit of their own.  Once either limit is reached, new hashes are no
+ * longer recorded.
+ */
+class InfoHashSet
+{
+public:
+    /**
+     * @param capacity the maximum number of hashes that will be stored.
+     *        Capacities over about 200 million are reduced to that.
+     * @param pathCapacity the maximum number of bytes the paths may take
+     *        up, each counting its length plus one.  Limits over about
+     *        2 GB are reduced to that.
+     */
+    InfoHashSet(quint32 capacity, quint32 pathCapacity);
+    ~InfoHashSet();
+
+    /**
+     * Records that the torrent with the SHA-1 info-hash @p infoHash was
+     * found at @p path.
+     *
+     * @param original if not null and the torrent is a duplicate, set to
+     *        the path the hash was first recorded for
+     * @return true if the hash was already recorded for a different path,
+     *         i.e. the torrent is a duplicate.
+     */
+    bool insert(const QByteArray &infoHash, const QByteArray &path,
+                QByteArray *original = 0);
+
+    /**
+     * @return the number of hashes in the set.
+     */
+    quint32 count() const;
+
+    /**
+     * Adds the hashes saved in @p fileName by save() to the set.
+     *
+     * @return true if the file was read successfully
+     */
+    bool load(const QString &fileName);
+
+    /**
+     * Writes the set to @p fileName, replacing it atomically.
+     *
+     * @return true if the file was written successfully
+     */
+    bool save(const QString &fileName);
+
+private:
+    Q_DISABLE_COPY(InfoHashSet)
+
+    bool insertKey(quint64 key, const QByteArray &path, QByteArray *original);
+    QByteArray pathAt(quint32 offset) const;
+    void resize(quint32 slots);
+    void rebuildFilter();
+    bool filterContains(quint64 key) const;
+    void filterAdd(quint64 key);
+
+    mutable QMutex m_mutex;
+    quint32 m_capacity;
+    quint32 m_pathCapacity;
+    quint32 m_count;
+    quint32 m_slots;        // Always a power of 2
+    quint64 *m_keys;        // 0 marks an empty slot
+    quint32 *m_pathOffsets; // Into m_paths
+    quint32 *m_filter;
+    quint32 m_filterBits;   // Always a power of 2
+    QByteArray m_paths;     // Each path is followed by a 0 byte
+    bool m_warnedFull;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "json.h"
+
+#include <QtCore/QByteArray>
+
+void Json::appendString(QByteArray &out, const char *data, int size)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    out.append('"');
+
+    // Copy runs of characters that don't need escaping in one go.
+    int runStart = 0;
+    for(int i = 0; i < size; ++i) {
+        const unsigned char c = data[i];
+        if(c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        out.append(data + runStart, i - runStart);
+        runStart = i + 1;
+
+        switch(c) {
+            case '"':  out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            default: {
+                const char escape[6] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xf] };
+                out.append(escape, sizeof escape);
+            }
+        }
+    }
+
+    out.append(data + runStart, size - runStart);
+    out.append('"');
+}
+
+void Json::appendString(QByteArray &out, const QByteArray &data)
+{
+    appendString(out, data.constData(), data.size());
+}
+
+// vim: set et sw=4 ts=4:
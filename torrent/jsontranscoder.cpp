@@ -0,0 +1,662 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "jsontranscoder.h"
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+#include "bytestream.h"
+#include "json.h"
+#include "utf8.h"
+#include "core/bytesink.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QIODevice>
+#include <QtCore/QString>
+
+#include <stdexcept>
+#include <string>
+
+#include <string.h>
+
+namespace {
+
+// Output is handed to the device in blocks of about this size.
+const int blockSize = 64 * 1024;
+
+// Strings up to this size are read whole to see whether they are UTF-8.
+const unsigned int maxBufferedString = 1024 * 1024;
+
+const char hexDigits[] = "0123456789abcdef";
+const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const char hexMarker[] = "$hex";
+const char base64Marker[] = "$base64";
+const char elidedMarker[] = "$elided";
+
+void appendInteger(QByteArray &out, long long value)
+{
+    char buffer[24];
+    char *p = buffer + sizeof buffer;
+
+    unsigned long long magnitude = value < 0 ? 0 - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    do {
+        *--p = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude != 0);
+
+    if(value < 0)
+        *--p = '-';
+
+    out.append(p, buffer + sizeof buffer - p);
+}
+
+/**
+ * Collects the JSON, passing it on to the device a block at a time.  As
+ * a ByteSink it takes the content of a binary string, which it encodes
+ * as it goes.
+ */
+class JsonOutput : public Bencode::ByteSink
+{
+public:
+    explicit JsonOutput(QIODevice &device)
+      : m_device(device), m_ok(true), m_encoding(Json::HexEncoding), m_carrySize(0)
+    {
+        m_buffer.reserve(blockSize + 4096);
+    }
+
+    QByteArray &buffer() { return m_buffer; }
+
+    void flushIfFull()
+    {
+        if(m_buffer.size() >= blockSize)
+            flush();
+    }
+
+    bool flush()
+    {
+        if(m_ok && !m_buffer.isEmpty())
+            m_ok = m_device.write(m_buffer) == m_buffer.size();
+        m_buffer.clear();
+        return m_ok;
+    }
+
+    void beginBinary(Json::BinaryEncoding encoding)
+    {
+        m_encoding = encoding;
+        m_carrySize = 0;
+        m_buffer += encoding == Json::HexEncoding ? "{\"$hex\":\"" : "{\"$base64\":\"";
+    }
+
+    virtual bool write(const char *data, std::size_t size)
+    {
+        if(m_encoding == Json::HexEncoding)
+            appendHex(reinterpret_cast<const unsigned char *>(data), size);
+        else
+            appendBase64(reinterpret_cast<const unsigned char *>(data), size);
+
+        flushIfFull();
+        return m_ok;
+    }
+
+    void endBinary()
+    {
+        if(m_encoding == Json::Base64Encoding && m_carrySize > 0) {
+            const unsigned int bits = (m_carry[0] << 16) | (m_carrySize > 1 ? m_carry[1] << 8 : 0);
+            const char tail[4] = {
+                base64Digits[bits >> 18],
+                base64Digits[(bits >> 12) & 63],
+                m_carrySize > 1 ? base64Digits[(bits >> 6) & 63] : '=',
+                '='
+            };
+            m_buffer.append(tail, 4);
+        }
+
+        m_buffer += "\"}";
+    }
+
+private:
+    void appendHex(const unsigned char *data, std::size_t size)
+    {
+        const int start = m_buffer.size();
+        m_buffer.resize(start + 2 * size);
+
+        char *out = m_buffer.data() + start;
+        for(std::size_t i = 0; i < size; ++i) {
+            *out++ = hexDigits[data[i] >> 4];
+            *out++ = hexDigits[data[i] & 0xf];
+        }
+    }
+
+    // Groups of three bytes may straddle two writes, so up to two bytes
+    // are carried over to the next.
+    void appendBase64(const unsigned char *data, std::size_t size)
+    {
+        while(m_carrySize > 0 && m_carrySize < 3 && size > 0) {
+            m_carry[m_carrySize++] = *data++;
+            --size;
+        }
+
+        if(m_carrySize == 3) {
+            appendBase64Groups(m_carry, 3);
+            m_carrySize = 0;
+        }
+
+        const std::size_t whole = size - size % 3;
+        appendBase64Groups(data, whole);
+
+        for(std::size_t i = whole; i < size; ++i)
+            m_carry[m_carrySize++] = data[i];
+    }
+
+    void appendBase64Groups(const unsigned char *data, std::size_t size)
+    {
+        const int start = m_buffer.size();
+        m_buffer.resize(start + size / 3 * 4);
+
+        char *out = m_buffer.data() + start;
+        for(std::size_t i = 0; i < size; i += 3) {
+            const unsigned int bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            *out++ = base64Digits[bits >> 18];
+            *out++ = base64Digits[(bits >> 12) & 63];
+            *out++ = base64Digits[(bits >> 6) & 63];
+            *out++ = base64Digits[bits & 63];
+        }
+    }
+
+    QIODevice &m_device;
+    QByteArray m_buffer;
+    bool m_ok;
+    Json::BinaryEncoding m_encoding;
+    unsigned char m_carry[3];
+    int m_carrySize;
+};
+
+// Whether @p text is a number as canonical b-encoding writes it: no
+// leading zeros or '+', and no "-0".
+bool isCanonicalNumber(const std::string &text, bool allowMinus)
+{
+    std::size_t start = 0;
+    if(allowMinus && !text.empty() && text[0] == '-')
+        start = 1;
+
+    if(start == text.size())
+        return false;
+    if(text[start] == '0')
+        return text.size() == start + 1 && start == 0;
+
+    for(std::size_t i = start; i < text.size(); ++i) {
+        if(text[i] < '0' || text[i] > '9')
+            return false;
+    }
+
+    return true;
+}
+
+bool isMarker(const Bencode::ByteSpan &key)
+{
+    return key == hexMarker || key == base64Marker || key == elidedMarker;
+}
+
+/**
+ * Copies one value from the decoder to the output, recursively.
+ */
+class Transcoder
+{
+public:
+    Transcoder(Bencode::Decoder &decoder, JsonOutput &output, const Json::TranscodeOptions &options)
+      : m_decoder(decoder), m_output(output), m_options(options)
+    {
+    }
+
+    void value()
+    {
+        switch(m_decoder.current()) {
+            case 'i': integer(); break;
+            case 'l': list(); break;
+            case 'd': dictionary(); break;
+            default:  string(); break;
+        }
+
+        m_output.flushIfFull();
+    }
+
+private:
+    void checkNumber(bool allowMinus)
+    {
+        if(m_options.canonical && !isCanonicalNumber(m_decoder.numberText(), allowMinus))
+            throw std::runtime_error("Number is not in canonical form");
+    }
+
+    void integer()
+    {
+        const long long value = m_decoder.readInt();
+        checkNumber(true);
+        appendInteger(m_output.buffer(), value);
+    }
+
+    void string()
+    {
+        const unsigned int length = m_decoder.readLength();
+        checkNumber(false);
+
+        if(length > maxBufferedString) {
+            if(m_options.binary == Json::ElideBinary) {
+                m_decoder.consume(length);
+                writeElided(length);
+            }
+            else {
+                m_output.beginBinary(m_options.binary);
+                m_decoder.consume(length, &m_output);
+                m_output.endBinary();
+            }
+            return;
+        }
+
+        const Bencode::ByteSpan data = m_decoder.readBytes(length, m_string);
+
+        if(Utf8::isValid(data.data(), data.size()))
+            Json::appendString(m_output.buffer(), data.data(), data.size());
+        else if(m_options.binary == Json::ElideBinary)
+            writeElided(length);
+        else {
+            m_output.beginBinary(m_options.binary);
+            m_output.write(data.data(), data.size());
+            m_output.endBinary();
+        }
+    }
+
+    void writeElided(unsigned int length)
+    {
+        QByteArray &out = m_output.buffer();
+        out += "{\"$elided\":";
+        appendInteger(out, length);
+        out += '}';
+    }
+
+    void list()
+    {
+        Bencode::Decoder::Nesting nesting(m_decoder);
+        m_decoder.countNode(Bencode::Decoder::ListNode);
+        m_decoder.advance();
+        m_output.buffer() += '[';
+
+        for(bool first = true; m_decoder.current() != 'e'; first = false) {
+            if(!first)
+                m_output.buffer() += ',';
+            value();
+        }
+
+        m_decoder.advance();
+        m_output.buffer() += ']';
+    }
+
+    void dictionary()
+    {
+        Bencode::Decoder::Nesting nesting(m_decoder);
+        m_decoder.countNode(Bencode::Decoder::DictNode);
+        m_decoder.advance();
+        m_output.buffer() += '{';
+
+        std::string previous;
+        int count = 0;
+        bool lastWasMarker = false;
+
+        for(; m_decoder.current() != 'e'; ++count) {
+            const Bencode::ByteSpan key = m_decoder.readString(m_key);
+            checkNumber(false);
+
+            if(m_options.canonical) {
+                if(count > 0 && !(Bencode::ByteSpan(previous) < key))
+                    throw std::runtime_error("Dictionary keys are not in canonical order");
+                previous.assign(key.data(), key.size());
+            }
+
+            lastWasMarker = isMarker(key);
+
+            QByteArray &out = m_output.buffer();
+            if(count > 0)
+                out += ',';
+
+            if(Utf8::isValid(key.data(), key.size()))
+                Json::appendString(out, key.data(), key.size());
+            else if(m_options.canonical)
+                throw std::runtime_error("Dictionary key is not UTF-8");
+            else
+                Json::appendString(out, Utf8::fromLegacy(QByteArray(key.data(), key.size())));
+
+            out += ':';
+            value();
+        }
+
+        // {"$hex":"..."} and friends would come back as a string.
+        if(m_options.canonical && count == 1 && lastWasMarker)
+            throw std::runtime_error("Dictionary can't be told apart from a binary string");
+
+        m_decoder.advance();
+        m_output.buffer() += '}';
+    }
+
+    Bencode::Decoder &m_decoder;
+    JsonOutput &m_output;
+    const Json::TranscodeOptions &m_options;
+    std::string m_string;
+    std::string m_key;
+};
+
+/**
+ * Builds a BBase tree from JSON text, throwing std::runtime_error with
+ * the reason and position on anything it can't take.
+ */
+class JsonParser
+{
+public:
+    explicit JsonParser(const QByteArray &json)
+      : m_begin(json.constData()), m_pos(m_begin), m_end(m_begin + json.size()), m_depth(0)
+    {
+    }
+
+    BBase::Ptr document()
+    {
+        BBase::Ptr result = value();
+
+        skipSpace();
+        if(m_pos != m_end)
+            fail("Unexpected data after the value");
+
+        return result;
+    }
+
+    void fail(const char *message) const
+    {
+        throw std::runtime_error(std::string(message) + " at offset " +
+                                 QByteArray::number(qlonglong(m_pos - m_begin)).constData());
+    }
+
+private:
+    void skipSpace()
+    {
+        while(m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r'))
+            ++m_pos;
+    }
+
+    char peek()
+    {
+        skipSpace();
+        if(m_pos == m_end)
+            fail("Unexpected end of JSON");
+        return *m_pos;
+    }
+
+    void expect(char c)
+    {
+        if(peek() != c) {
+            const char message[] = { 'E', 'x', 'p', 'e', 'c', 't', 'e', 'd', ' ', '\'', c, '\'', '\0' };
+            fail(message);
+        }
+        ++m_pos;
+    }
+
+    BBase::Ptr value()
+    {
+        switch(peek()) {
+            case '{': return object();
+            case '[': return array();
+            case '"': return BBase::Ptr(new BString(string()));
+            case '-':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                return BBase::Ptr(new BInt(number()));
+            case 't':
+            case 'f':
+            case 'n':
+                fail("true, false and null have no b-encoding");
+        }
+
+        fail("Unexpected character");
+        return BBase::Ptr();
+    }
+
+    // Arrays and objects are held to the same depth as b-encoded
+    // containers, so that the tree can be written out again.
+    void enter()
+    {
+        if(++m_depth > Bencode::Decoder::maxDepth)
+            fail("Values are nested too deeply");
+    }
+
+    BBase::Ptr object()
+    {
+        enter();
+        ++m_pos; // Skip '{'
+        BDict::Ptr dict(new BDict);
+
+        while(peek() != '}') {
+            if(dict->count() > 0)
+                expect(',');
+            if(peek() != '"')
+                fail("Expected a key");
+
+            const QByteArray key = string();
+            if(dict->contains(key))
+                fail("Repeated key");
+
+            expect(':');
+            dict->insert(key, value());
+        }
+
+        expect('}');
+        --m_depth;
+
+        if(dict->count() == 1)
+            return binaryString(dict);
+        return dict;
+    }
+
+    // Turns {"$hex":"..."} and {"$base64":"..."} back into the string
+    // they stand for; other dictionaries are returned as they are.
+    BBase::Ptr binaryString(const BDict::Ptr &dict)
+    {
+        if(dict->contains(elidedMarker))
+            fail("Elided strings can't be converted back");
+
+        if(BString::Ptr hex = dict->findType<BString>(hexMarker)) {
+            const QByteArray &text = hex->raw_data();
+            if(text.size() % 2 != 0 || strspn(text.constData(), "0123456789abcdefABCDEF") != size_t(text.size()))
+                fail("Invalid hex string");
+            return BBase::Ptr(new BString(QByteArray::fromHex(text)));
+        }
+
+        if(BString::Ptr base64 = dict->findType<BString>(base64Marker)) {
+            const QByteArray &text = base64->raw_data();
+            int digits = strspn(text.constData(), base64Digits);
+            while(digits < text.size() && text[digits] == '=' && digits >= text.size() - 2)
+                ++digits;
+            if(text.size() % 4 != 0 || digits != text.size())
+                fail("Invalid base64 string");
+            return BBase::Ptr(new BString(QByteArray::fromBase64(text)));
+        }
+
+        return dict;
+    }
+
+    BBase::Ptr array()
+    {
+        enter();
+        ++m_pos; // Skip '['
+        BList::Ptr list(new BList);
+
+        while(peek() != ']') {
+            if(list->count() > 0)
+                expect(',');
+            list->append(value());
+        }
+
+        expect(']');
+        --m_depth;
+        return list;
+    }
+
+    qlonglong number()
+    {
+        const char *start = m_pos;
+        if(*m_pos == '-')
+            ++m_pos;
+
+        const char *digits = m_pos;
+        while(m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+            ++m_pos;
+
+        if(m_pos == digits || (*digits == '0' && m_pos - digits > 1))
+            fail("Invalid number");
+        if(m_pos != m_end && (*m_pos == '.' || *m_pos == 'e' || *m_pos == 'E'))
+            fail("Only integers have a b-encoding");
+
+        long long value;
+        if(!Bencode::parseInteger(Bencode::ByteSpan(start, m_pos - start), &value))
+            fail("Integer out of range");
+        return value;
+    }
+
+    QByteArray string()
+    {
+        ++m_pos; // Skip '"'
+        QByteArray result;
+
+        for(;;) {
+            // Copy runs without escapes in one go.
+            const char *run = m_pos;
+            while(m_pos != m_end && *m_pos != '"' && *m_pos != '\\')
+                ++m_pos;
+            result.append(run, m_pos - run);
+
+            if(m_pos == m_end)
+                fail("Unterminated string");
+            if(*m_pos++ == '"')
+                return result;
+
+            if(m_pos == m_end)
+                fail("Unterminated string");
+
+            switch(*m_pos++) {
+                case '"':  result += '"'; break;
+                case '\\': result += '\\'; break;
+                case '/':  result += '/'; break;
+                case 'b':  result += '\b'; break;
+                case 'f':  result += '\f'; break;
+                case 'n':  result += '\n'; break;
+                case 'r':  result += '\r'; break;
+                case 't':  result += '\t'; break;
+                case 'u':  appendUtf8(result, codePoint()); break;
+                default:   fail("Invalid escape");
+            }
+        }
+    }
+
+    unsigned int hexQuad()
+    {
+        if(m_end - m_pos < 4)
+            fail("Truncated \\u escape");
+
+        unsigned int value = 0;
+        for(int i = 0; i < 4; ++i) {
+            const char *digit = strchr(hexDigits, m_pos[i] | 0x20);
+            if(!digit)
+                fail("Invalid \\u escape");
+            value = value * 16 + (digit - hexDigits);
+        }
+
+        m_pos += 4;
+        return value;
+    }
+
+    // Reads the rest of a \u escape, joining surrogate pairs.
+    unsigned int codePoint()
+    {
+        const unsigned int high = hexQuad();
+        if(high < 0xd800 || high > 0xdfff)
+            return high;
+
+        if(high > 0xdbff || m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u')
+            fail("Unpaired surrogate");
+
+        m_pos += 2;
+        const unsigned int low = hexQuad();
+        if(low < 0xdc00 || low > 0xdfff)
+            fail("Unpaired surrogate");
+
+        return 0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00);
+    }
+
+    static void appendUtf8(QByteArray &out, unsigned int c)
+    {
+        if(c < 0x80)
+            out += char(c);
+        else if(c < 0x800) {
+            out += char(0xc0 | (c >> 6));
+            out += char(0x80 | (c & 0x3f));
+        }
+        else if(c < 0x10000) {
+            out += char(0xe0 | (c >> 12));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        }
+        else {
+            out += char(0xf0 | (c >> 18));
+            out += char(0x80 | ((c >> 12) & 0x3f));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        }
+    }
+
+    const char *m_begin;
+    const char *m_pos;
+    const char *m_end;
+    int m_depth; // Arrays and objects open
+};
+
+}
+
+bool Json::fromBencode(ByteStream &stream, QIODevice &output, const TranscodeOptions &options)
+{
+    JsonOutput json(output);
+    Transcoder(stream.decoder(), json, options).value();
+    return json.flush();
+}
+
+BBase::Ptr Json::parse(const QByteArray &json, QString *error)
+{
+    try {
+        return JsonParser(json).document();
+    }
+    catch(const std::runtime_error &e) {
+        if(error)
+            *error = QString::fromUtf8(e.what());
+        return BBase::Ptr();
+    }
+}
+
+bool Json::toBencode(const QByteArray &json, QIODevice &output, QString *error)
+{
+    BBase::Ptr value = parse(json, error);
+    return value && value->writeToDevice(output);
+}
+
+// vim: set et sw=4 ts=4:
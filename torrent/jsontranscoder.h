@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_JSONTRANSCODER_H
+#define TORRENT_ANALYZER_JSONTRANSCODER_H
+
+#include "bbase.h"
+
+class ByteStream;
+class QByteArray;
+class QIODevice;
+class QString;
+
+/**
+ * Conversion between b-encoded data and JSON.
+ *
+ * Strings which are valid UTF-8 become JSON strings.  Other strings,
+ * which can't be, are written as a one-key object according to
+ * BinaryEncoding: {"$hex":"..."}, {"$base64":"..."} or, if their
+ * content isn't wanted, {"$elided":size}.  Integers become JSON numbers
+ * and lists and dictionaries become arrays and objects.
+ */
+namespace Json
+{
+    enum BinaryEncoding {
+        HexEncoding,
+        Base64Encoding,
+        ElideBinary
+    };
+
+    struct TranscodeOptions
+    {
+        TranscodeOptions() : binary(HexEncoding), canonical(false) { }
+
+        BinaryEncoding binary;
+
+        /**
+         * Rejects anything which isn't canonical b-encoding (keys out of
+         * order or repeated, numbers with leading zeros or "-0") and any
+         * dictionary which would be mistaken for a binary string, so that
+         * the JSON converts back to exactly the same bytes.
+         */
+        bool canonical;
+    };
+
+    /**
+     * Writes the value at the current position of @p stream to @p output
+     * as JSON, in one pass.  Output is written in blocks as it is
+     * produced and only strings of up to 1 MB are held in memory, to find
+     * out whether they are UTF-8; longer ones are always written in the
+     * binary encoding.  Everything but the value's own dictionary keys is
+     * copied through without building a tree.
+     *
+     * @return false if writing to @p output failed
+     * @throw std::runtime_error if the data is not valid b-encoding, or
+     * not canonical when that was asked for
+     */
+    bool fromBencode(ByteStream &stream, QIODevice &output,
+                     const TranscodeOptions &options = TranscodeOptions());
+
+    /**
+     * Decodes the JSON in @p json, as written by fromBencode() without
+     * elision, into a tree of BBase values.  JSON which has no
+     * b-encoding (fractions, true, false and null) is rejected.
+     *
+     * @param error set to what is wrong with @p json, if anything
+     * @return the decoded value, or a null pointer on error
+     */
+    BBase::Ptr parse(const QByteArray &json, QString *error = 0);
+
+    /**
+     * Converts @p json to canonical b-encoding, written to @p output
+     * with BBase::writeToDevice().
+     *
+     * @return false if @p json is invalid or writing failed
+     */
+    bool toBencode(const QByteArray &json, QIODevice &output, QString *error = 0);
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "lazydata.h"
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+#include "tracing.h"
+#include "core/bytesource.h"
+#include "core/decoder.h"
+
+#include <string>
+
+LazyData::LazyData(const QByteArray &data)
+  : m_buffer(data), m_data(m_buffer.constData(), m_buffer.size())
+{
+}
+
+LazyData::~LazyData()
+{
+}
+
+BBase::Ptr LazyData::decode(const Ptr &source, const LazyRange &range)
+{
+    TORRENT_TRACE_SPAN("decodeLazily");
+    TORRENT_TRACE_ARG(range.size);
+
+    // The value has been checked already, so a bare decoder is enough.
+    // A ByteStream would read the memory limit and set up a budget and
+    // a capture buffer for every value.
+    Bencode::MemorySource memory(source->data().substr(range.offset, range.size));
+    Bencode::Decoder decoder(&memory);
+    decoder.advance(); // Read first character
+
+    switch(decoder.current()) {
+        case 'd':
+            return BBase::Ptr(new BDict(decoder, source, range.offset));
+        case 'l':
+            return BBase::Ptr(new BList(decoder, source, range.offset));
+        case 'i':
+            return BBase::Ptr(new BInt(decoder.readInt()));
+        default: {
+            // Copied, as the tree may outlive the data.
+            std::string unused;
+            const Bencode::ByteSpan value = decoder.readString(unused);
+            return BBase::Ptr(new BString(QByteArray(value.data(), value.size())));
+        }
+    }
+}
+
+// vim: set et sw=4 ts=4:
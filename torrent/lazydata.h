@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_LAZYDATA_H
+#define TORRENT_ANALYZER_LAZYDATA_H
+
+#include "bbase.h"
+#include "core/bytespan.h"
+
+#include <QtCore/QByteArray>
+
+/**
+ * Where a value lies in the data of a lazily decoded tree.
+ */
+struct LazyRange
+{
+    LazyRange() : offset(0), size(0) { }
+    LazyRange(int o, int s) : offset(o), size(s) { }
+
+    int offset;
+    int size;
+};
+
+/**
+ * The b-encoded data behind a tree from BDict::parseLazily().  Every
+ * container of the tree with values still to decode holds a reference,
+ * so the data is kept for as long as any of them needs it.
+ */
+class LazyData
+{
+public:
+    typedef boost::shared_ptr<const LazyData> Ptr;
+
+    /**
+     * Keeps a reference to @p data, which implicit sharing makes cheap.
+     * @p data must own its bytes, not be from QByteArray::fromRawData().
+     */
+    explicit LazyData(const QByteArray &data);
+
+    ~LazyData();
+
+    Bencode::ByteSpan data() const { return m_data; }
+
+    /**
+     * Decodes the value at @p range of the data of @p source, which
+     * must already have been checked.  Dictionaries and lists are
+     * decoded lazily in turn.
+     */
+    static BBase::Ptr decode(const Ptr &source, const LazyRange &range);
+
+private:
+    Q_DISABLE_COPY(LazyData)
+
+    QByteArray m_buffer;
+    Bencode::ByteSpan m_data;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
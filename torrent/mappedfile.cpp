@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "mappedfile.h"
+#include "tracing.h"
+
+#include <limits.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Mapping a small file costs more than the copies it saves.  See the
+// file-read and file-mmap phases of torrent-benchmark.
+static const qint64 defaultMapSize = 64 * 1024;
+
+MappedFile::MappedFile()
+  : m_data(0), m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+bool MappedFile::map(const QString &path)
+{
+    unmap();
+
+    m_file.setFileName(path);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    return mapOpenFile();
+}
+
+bool MappedFile::map(int fd)
+{
+    unmap();
+
+    if(!m_file.open(fd, QIODevice::ReadOnly))
+        return false;
+
+    return mapOpenFile();
+}
+
+void MappedFile::unmap()
+{
+    if(m_data)
+        m_file.unmap(m_data);
+
+    m_file.close();
+    m_data = 0;
+    m_size = 0;
+}
+
+bool MappedFile::isWorthwhile(qint64 size)
+{
+    bool ok = false;
+    qint64 threshold = qgetenv("STRIGI_TORRENT_MMAP_SIZE").toLongLong(&ok);
+    if(!ok || threshold < 0)
+        threshold = defaultMapSize;
+
+    return threshold > 0 && size >= threshold;
+}
+
+bool MappedFile::mapOpenFile()
+{
+    TORRENT_TRACE_SPAN("mapFile");
+
+#ifdef Q_OS_UNIX
+    // QFile would report a size for some special files too.
+    struct stat info;
+    if(fstat(m_file.handle(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        m_file.close();
+        return false;
+    }
+#endif
+
+    // The parser's offsets and QByteArray sizes are ints.
+    const qint64 size = m_file.size();
+    if(size <= 0 || size > INT_MAX) {
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if(!m_data) {
+        m_file.close();
+        return false;
+    }
+
+    m_size = size;
+    TORRENT_TRACE_ARG(m_size);
+
+#ifdef Q_OS_UNIX
+    // The mapping starts on a page boundary, as it is from offset 0.
+    posix_madvise(m_data, m_size, POSIX_MADV_SEQUENTIAL);
+    posix_madvise(m_data, m_size, POSIX_MADV_WILLNEED);
+#endif
+
+    return true;
+}
+
+// vim: set et sw=4 ts=4:
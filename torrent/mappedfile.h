@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_MAPPEDFILE_H
+#define TORRENT_ANALYZER_MAPPEDFILE_H
+
+#include "core/bytespan.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+/**
+ * A read-only memory mapping of a whole regular file, for parsing it in
+ * place rather than copying it through a stream's buffers.  The kernel
+ * is told that the mapping will be read from start to end, so that it
+ * reads ahead as it would for read().
+ *
+ * Only regular files can be mapped; pipes, devices and empty files are
+ * refused so that the caller can fall back to reading a stream.  If the
+ * file is truncated while it is mapped, touching the lost pages raises
+ * SIGBUS, as with any mapping.  Nothing catches that, so this is only
+ * for the command line tools, never for the Strigi analyzer, which runs
+ * inside the indexer on files other programs may be rewriting.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+
+    /**
+     * Unmaps the file.  Anything pointing into data() is invalid after.
+     */
+    ~MappedFile();
+
+    /**
+     * Maps the file at @p path, unmapping any file mapped before.
+     *
+     * @return false if it isn't a regular file or couldn't be mapped
+     */
+    bool map(const QString &path);
+
+    /**
+     * Maps the file open as @p fd, from its start whatever the descriptor's
+     * position.  The descriptor is not closed, and is not needed once this
+     * returns.
+     *
+     * @return false if it isn't a regular file or couldn't be mapped
+     */
+    bool map(int fd);
+
+    void unmap();
+
+    bool isMapped() const { return m_data != 0; }
+
+    /**
+     * @return the contents of the file, valid until it is unmapped
+     */
+    Bencode::ByteSpan data() const
+    {
+        return Bencode::ByteSpan(reinterpret_cast<const char *>(m_data), std::size_t(m_size));
+    }
+
+    /**
+     * @return true if a file of @p size bytes is big enough for mapping it
+     * to beat reading it, which costs a few system calls and page faults
+     * up front.  The threshold is taken from STRIGI_TORRENT_MMAP_SIZE (in
+     * bytes, 0 disables mapping).
+     */
+    static bool isWorthwhile(qint64 size);
+
+private:
+    Q_DISABLE_COPY(MappedFile)
+
+    bool mapOpenFile();
+
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_size;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,294 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "parallelparser.h"
+#include "pushparser.h"
+#include "bytestream.h"
+#include "tracing.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QtConcurrentRun>
+
+#include <stdexcept>
+#include <string.h>
+
+// Fewer entries than this aren't worth handing to another thread.
+static const int minFilesPerRun = 1024;
+
+namespace {
+
+// Moves past the string starting at @p p, setting @p data to its first
+// byte if it isn't 0.  As in the parsers, everything up to the ':' is the
+// length, for parseLength() to accept or refuse.
+const char *skipString(const char *p, const char *end, const char **data = 0)
+{
+    const char *colon = static_cast<const char *>(memchr(p, ':', end - p));
+    if(!colon)
+        throw end_of_stream();
+
+    unsigned int length;
+    if(!Bencode::parseLength(Bencode::ByteSpan(p, colon - p), &length))
+        throw std::runtime_error("Invalid number in string data");
+
+    p = colon + 1;
+    if(length > quint64(end - p))
+        throw end_of_stream();
+
+    if(data)
+        *data = p;
+    return p + length;
+}
+
+// Finds the end of the value starting at @p p without decoding it.  This
+// only checks enough to find the end; the parsers check the rest.
+const char *skipValue(const char *p, const char *end)
+{
+    int depth = 0;
+
+    do {
+        if(p >= end)
+            throw end_of_stream();
+
+        switch(*p) {
+            case 'i': {
+                const char *e = static_cast<const char *>(memchr(p, 'e', end - p));
+                if(!e)
+                    throw end_of_stream();
+                p = e + 1;
+                break;
+            }
+
+            case 'l':
+            case 'd':
+                ++depth;
+                ++p;
+                break;
+
+            case 'e':
+                if(depth == 0)
+                    throw std::runtime_error("Unexpected end of container");
+                --depth;
+                ++p;
+                break;
+
+            default:
+                p = skipString(p, end);
+        }
+    } while(depth > 0);
+
+    return p;
+}
+
+// Reads the key starting at @p p, returning the position after it.
+const char *readKey(const char *p, const char *end, const char **key, int *keySize)
+{
+    const char *next = skipString(p, end, key);
+
+    *keySize = next - *key;
+    return next;
+}
+
+// Finds the value stored under @p name in the dictionary at @p p, and
+// returns the position of its first byte, or 0 if it isn't there.  Like
+// the parsers, the last of several copies of the key wins.
+const char *findValue(const char *p, const char *end, const char *name)
+{
+    if(p >= end || *p != 'd')
+        return 0;
+
+    const int nameSize = strlen(name);
+    const char *found = 0;
+
+    ++p;
+    while(p < end && *p != 'e') {
+        const char *key;
+        int keySize;
+        p = readKey(p, end, &key, &keySize);
+
+        if(keySize == nameSize && memcmp(key, name, nameSize) == 0)
+            found = p;
+
+        p = skipValue(p, end);
+    }
+
+    return found;
+}
+
+struct FileRun
+{
+    const char *const *bounds; // Start of each entry, then the end of the last
+    int count;
+    QVector<BBase::Ptr> entries;
+    Bencode::MemoryBudget budget; // This run's share of the limit
+    bool failed;
+    bool overBudget;
+};
+
+void parseRun(FileRun *run)
+{
+    TORRENT_TRACE_SPAN("parseRun");
+    TORRENT_TRACE_ARG(run->count);
+
+    run->entries.reserve(run->count);
+
+    try {
+        for(int i = 0; i < run->count; ++i) {
+            const size_t size = run->bounds[i + 1] - run->bounds[i];
+            PushParser parser;
+            parser.setMemoryBudget(&run->budget);
+            parser.feed(run->bounds[i], size);
+
+            // The scan and the parser must agree on where it ends.
+            if(parser.bytesConsumed() != size)
+                throw std::runtime_error("Invalid file entry");
+
+            run->entries.append(parser.finish());
+        }
+    }
+    catch(const memory_limit_exceeded &) {
+        run->overBudget = true;
+    }
+    catch(...) {
+        run->failed = true;
+    }
+}
+
+}
+
+BDict::Ptr parseTorrentInParallel(const QByteArray &data, QByteArray *infoData, int minFiles)
+{
+    TORRENT_TRACE_SPAN("parseTorrentInParallel");
+
+    const char *begin = data.constData();
+    const char *end = begin + data.size();
+
+    PushParser parser(infoData ? QByteArray("info") : QByteArray());
+
+    if(data.isEmpty() || *begin != 'd')
+        throw std::runtime_error("Trying to read dictionary, but this isn't a dictionary");
+
+    // Find the entries of info/files.  If the scan fails, the data is
+    // invalid and the parser can find that out by itself.
+    const char *list = 0;
+    QVector<const char *> bounds;
+
+    try {
+        TORRENT_TRACE_SPAN("scan");
+
+        const char *info = findValue(begin, end, "info");
+        list = info ? findValue(info, end, "files") : 0;
+
+        if(list && *list == 'l') {
+            const char *p = list + 1;
+            while(p < end && *p != 'e') {
+                bounds.append(p);
+                p = skipValue(p, end);
+            }
+
+            if(p >= end)
+                throw end_of_stream();
+            bounds.append(p);
+        }
+    }
+    catch(...) {
+        bounds.clear();
+    }
+
+    const int files = bounds.count() - 1;
+    if(files < qMax(minFiles, 1)) {
+        parser.feed(begin, data.size());
+    }
+    else {
+        const int runCount = qBound(1, files / minFilesPerRun, QThread::idealThreadCount() * 4);
+        QList<FileRun> runs;
+
+        // A budget can't be shared between threads, so each run gets an
+        // even share of what the limit leaves, and what they used is
+        // charged to the parser's budget once they are done.
+        Bencode::MemoryBudget &budget = parser.memoryBudget();
+        const unsigned long long runLimit =
+            budget.limit() == 0 ? 0 : qMax<unsigned long long>((budget.limit() - budget.used()) / runCount, 1);
+
+        for(int i = 0; i < runCount; ++i) {
+            const int first = qlonglong(files) * i / runCount;
+            const int last = qlonglong(files) * (i + 1) / runCount;
+
+            FileRun run;
+            run.bounds = bounds.constData() + first;
+            run.count = last - first;
+            run.budget.setLimit(runLimit);
+            run.failed = false;
+            run.overBudget = false;
+            runs.append(run);
+        }
+
+        QList<QFuture<void> > futures;
+        for(int i = 1; i < runs.count(); ++i)
+            futures.append(QtConcurrent::run(parseRun, &runs[i]));
+
+        // Do the first run here, and the rest of the file while waiting.
+        parseRun(&runs[0]);
+
+        const char *listEnd = bounds.last() + 1;
+
+        // The runs point into this stack frame, so they must finish
+        // before any exception leaves it.
+        try {
+            parser.feed(begin, list - begin);
+        }
+        catch(...) {
+            foreach(QFuture<void> future, futures)
+                future.waitForFinished();
+            throw;
+        }
+
+        foreach(QFuture<void> future, futures)
+            future.waitForFinished();
+
+        budget.charge(sizeof(BList) + ByteStream::NodeOverhead);
+        BList::Ptr fileList(new BList);
+        foreach(const FileRun &run, runs) {
+            if(run.overBudget)
+                throw memory_limit_exceeded();
+            if(run.failed)
+                throw std::runtime_error("Error creating BList");
+
+            budget.charge(run.budget.used());
+            foreach(const BBase::Ptr &entry, run.entries)
+                fileList->append(entry);
+        }
+
+        parser.feedValue(fileList, list, listEnd - list);
+        parser.feed(listEnd, end - listEnd);
+    }
+
+    const BBase::Ptr root = parser.finish();
+    if(infoData)
+        *infoData = parser.captured();
+
+    if(!root || !root->as<BDict>())
+        return BDict::Ptr();
+
+    return boost::static_pointer_cast<BDict>(root);
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PARALLELPARSER_H
+#define TORRENT_ANALYZER_PARALLELPARSER_H
+
+#include "bdict.h"
+
+class QByteArray;
+
+/**
+ * Decodes a whole .torrent file held in memory, building the entries of
+ * a large "files" list on several threads.
+ *
+ * A quick scan first finds where each entry of info/files starts and
+ * ends.  If there are enough of them, they are split into runs which are
+ * decoded in parallel on QThreadPool::globalInstance() and put back in
+ * order, while the rest of the file is decoded on the calling thread.
+ * The result is the same tree the BDict constructor builds, and invalid
+ * data throws the same kinds of exceptions.  The tree is held to
+ * ByteStream::defaultMemoryLimit() as well, split evenly between the
+ * runs while they are decoded.
+ *
+ * This is for callers which want the whole tree.  Just to extract fields,
+ * extractTorrentFields() on a ByteStream is faster even for the biggest
+ * files lists, since it builds no tree at all.
+ *
+ * @param data the complete .torrent file
+ * @param infoData if not 0, receives the raw bytes of the "info" value,
+ *        as the BDict constructor's @p captured does
+ * @param minFiles the smallest list worth splitting up
+ */
+BDict::Ptr parseTorrentInParallel(const QByteArray &data, QByteArray *infoData = 0,
+                                  int minFiles = 4096);
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,614 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "pathquery.h"
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+#include "bytestream.h"
+
+#include <QtCore/QtAlgorithms>
+
+#include <stdexcept>
+#include <string>
+
+#include <string.h>
+
+// What one level of the document does to the set of live states.
+struct PathQuery::Transition
+{
+    Transition() : needsValue(false) { }
+
+    StateSet next;              // States for the levels below
+    QVector<int> matches;       // Queries matched at this level
+    bool needsValue;            // A predicate has to see the value first
+};
+
+struct PathQuery::Evaluation
+{
+    QList<QByteArray> path;
+    QList<Match> matches;
+    std::string scratch;
+
+    void addMatches(const QVector<int> &queries, const BBase::Ptr &value)
+    {
+        QByteArray joined;
+        for(int i = 0; i < path.count(); ++i) {
+            if(i > 0)
+                joined += '/';
+            joined += path[i];
+        }
+
+        foreach(int query, queries) {
+            Match match = { query, joined, value };
+            matches.append(match);
+        }
+    }
+};
+
+// Splits @p text at each unescaped @p separator outside square brackets.
+static QList<QByteArray> splitUnescaped(const QByteArray &text, char separator)
+{
+    QList<QByteArray> parts;
+    int start = 0, depth = 0;
+
+    for(int i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+
+        if(c == '\\')
+            ++i;
+        else if(c == '[')
+            ++depth;
+        else if(c == ']' && depth > 0)
+            --depth;
+        else if(c == separator && depth == 0) {
+            parts.append(text.mid(start, i - start));
+            start = i + 1;
+        }
+    }
+
+    parts.append(text.mid(start));
+    return parts;
+}
+
+static QByteArray unescape(const QByteArray &text)
+{
+    QByteArray result;
+    result.reserve(text.size());
+
+    for(int i = 0; i < text.size(); ++i) {
+        if(text[i] == '\\' && i + 1 < text.size())
+            ++i;
+        result += text[i];
+    }
+
+    return result;
+}
+
+// Matches @p size bytes at @p data against a '*' and '?' pattern which
+// may escape either with a backslash.
+static bool matchesPattern(const char *pattern, int patternSize, const char *data, int size)
+{
+    int p = 0, d = 0;
+    int starP = -1, starD = 0;
+
+    while(d < size) {
+        if(p < patternSize && pattern[p] == '*') {
+            starP = ++p;
+            starD = d;
+            continue;
+        }
+
+        if(p < patternSize) {
+            const bool escaped = pattern[p] == '\\' && p + 1 < patternSize;
+            const char c = escaped ? pattern[p + 1] : pattern[p];
+
+            if((!escaped && c == '?') || c == data[d]) {
+                p += escaped ? 2 : 1;
+                ++d;
+                continue;
+            }
+        }
+
+        // Backtrack, letting the last '*' swallow one more byte.
+        if(starP < 0)
+            return false;
+        p = starP;
+        d = ++starD;
+    }
+
+    while(p < patternSize && pattern[p] == '*')
+        ++p;
+
+    return p == patternSize;
+}
+
+static bool parseNumber(const QByteArray &text, qlonglong *number)
+{
+    bool ok = false;
+    *number = text.toLongLong(&ok);
+    return ok && !text.isEmpty();
+}
+
+static BBase::Ptr readValue(ByteStream &stream)
+{
+    switch(*stream) {
+        case 'l': return BBase::Ptr(new BList(stream));
+        case 'i': return BBase::Ptr(new BInt(stream));
+        case 'd': return BBase::Ptr(new BDict(stream));
+        default:  return BBase::Ptr(new BString(stream));
+    }
+}
+
+PathQuery::PathQuery()
+{
+}
+
+PathQuery::PathQuery(const QByteArray &expression)
+{
+    if(!parse(expression)) {
+        m_steps.clear();
+        m_starts.clear();
+    }
+}
+
+bool PathQuery::parse(const QByteArray &expression)
+{
+    const QList<QByteArray> queries = splitUnescaped(expression, '|');
+
+    for(int query = 0; query < queries.count(); ++query) {
+        const QList<QByteArray> steps = splitUnescaped(queries[query], '/');
+        const int first = m_steps.count();
+
+        foreach(const QByteArray &step, steps) {
+            if(!parseStep(step, query))
+                return false;
+        }
+
+        if(m_steps.last().kind == Step::Descendants) {
+            m_error = QString::fromLatin1("'**' must be followed by another step in \"%1\"")
+                .arg(QString::fromUtf8(queries[query].constData(), queries[query].size()));
+            return false;
+        }
+
+        m_steps.last().isLast = true;
+        m_starts.append(first);
+    }
+
+    return true;
+}
+
+bool PathQuery::parseStep(const QByteArray &text, int query)
+{
+    // Separate the predicates from the key.
+    int end = 0;
+    for(; end < text.size() && text[end] != '['; ++end) {
+        if(text[end] == '\\')
+            ++end;
+    }
+
+    Step step;
+    step.text = text.left(end);
+    step.index = -1;
+    step.query = query;
+    step.isLast = false;
+
+    if(step.text.isEmpty()) {
+        m_error = QString::fromLatin1("Empty step in query %1").arg(query + 1);
+        return false;
+    }
+
+    bool hasWildcards = false;
+    for(int i = 0; i < step.text.size(); ++i) {
+        if(step.text[i] == '\\')
+            ++i;
+        else if(step.text[i] == '*' || step.text[i] == '?')
+            hasWildcards = true;
+    }
+
+    bool isNumber = true;
+    for(int i = 0; i < step.text.size(); ++i)
+        isNumber = isNumber && step.text[i] >= '0' && step.text[i] <= '9';
+
+    if(step.text == "**")
+        step.kind = Step::Descendants;
+    else if(step.text == "*")
+        step.kind = Step::Any;
+    else if(hasWildcards)
+        step.kind = Step::Pattern;
+    else {
+        step.text = unescape(step.text);
+        step.kind = Step::Key;
+
+        if(isNumber && step.text.size() < 10) {
+            step.kind = Step::Index;
+            step.index = step.text.toInt();
+        }
+    }
+
+    // Each predicate is "[...]", one after the other.
+    while(end < text.size()) {
+        int close = end + 1;
+        for(; close < text.size() && text[close] != ']'; ++close) {
+            if(text[close] == '\\')
+                ++close;
+        }
+
+        if(text[end] != '[' || close >= text.size()) {
+            m_error = QString::fromLatin1("Unbalanced brackets in step \"%1\"")
+                .arg(QString::fromUtf8(text.constData(), text.size()));
+            return false;
+        }
+
+        Predicate predicate;
+        if(!parsePredicate(text.mid(end + 1, close - end - 1), predicate))
+            return false;
+
+        step.predicates.append(predicate);
+        end = close + 1;
+    }
+
+    if(step.kind == Step::Descendants && !step.predicates.isEmpty()) {
+        m_error = QString::fromLatin1("'**' can't have predicates");
+        return false;
+    }
+
+    m_steps.append(step);
+    return true;
+}
+
+bool PathQuery::parsePredicate(const QByteArray &text, Predicate &predicate)
+{
+    static const struct {
+        const char *text;
+        Predicate::Operator op;
+    } operators[] = {
+        // Two-character operators first, so that "<=" isn't taken for "<".
+        { "!=", Predicate::NotEqual },
+        { "<=", Predicate::LessEqual },
+        { ">=", Predicate::GreaterEqual },
+        { "=", Predicate::Equal },
+        { "~", Predicate::Like },
+        { "<", Predicate::Less },
+        { ">", Predicate::Greater }
+    };
+
+    // Find the first unescaped operator character.
+    int at = 0;
+    for(; at < text.size() && !(text[at] && strchr("!=<>~", text[at])); ++at) {
+        if(text[at] == '\\')
+            ++at;
+    }
+
+    predicate.key = unescape(text.left(at));
+    predicate.op = Predicate::Exists;
+    predicate.number = 0;
+    predicate.isNumber = false;
+
+    if(predicate.key.isEmpty()) {
+        m_error = QString::fromLatin1("Predicate \"[%1]\" needs a key, or '.' for the value itself")
+            .arg(QString::fromUtf8(text.constData(), text.size()));
+        return false;
+    }
+
+    if(predicate.key == ".")
+        predicate.key.clear();
+
+    if(at >= text.size())
+        return true;
+
+    for(unsigned int i = 0; i < sizeof operators / sizeof operators[0]; ++i) {
+        const int length = strlen(operators[i].text);
+
+        if(text.mid(at, length) == operators[i].text) {
+            predicate.op = operators[i].op;
+            predicate.operand = text.mid(at + length);
+            break;
+        }
+    }
+
+    if(predicate.op == Predicate::Exists) {
+        m_error = QString::fromLatin1("Unknown operator in predicate \"[%1]\"")
+            .arg(QString::fromUtf8(text.constData(), text.size()));
+        return false;
+    }
+
+    // Patterns keep their escapes for matchesPattern().
+    if(predicate.op != Predicate::Like)
+        predicate.operand = unescape(predicate.operand);
+
+    predicate.isNumber = parseNumber(predicate.operand, &predicate.number);
+
+    const bool isOrdering = predicate.op != Predicate::Equal &&
+                            predicate.op != Predicate::NotEqual &&
+                            predicate.op != Predicate::Like;
+    if(isOrdering && !predicate.isNumber) {
+        m_error = QString::fromLatin1("Predicate \"[%1]\" compares with something that isn't an integer")
+            .arg(QString::fromUtf8(text.constData(), text.size()));
+        return false;
+    }
+
+    return true;
+}
+
+// Adds @p step to @p states along with every step reachable from it
+// without consuming a level, i.e. the step after a '**'.
+void PathQuery::addState(StateSet &states, int step) const
+{
+    if(states.contains(step))
+        return;
+
+    states.append(step);
+    if(m_steps[step].kind == Step::Descendants)
+        addState(states, step + 1);
+}
+
+bool PathQuery::stepMatches(const Step &step, const char *key, int size, int index) const
+{
+    switch(step.kind) {
+        case Step::Any:
+            return true;
+
+        case Step::Index:
+            if(index >= 0)
+                return index == step.index;
+            // A dictionary key which happens to be all digits.
+            // Fall through
+
+        case Step::Key:
+            return index < 0 && size == step.text.size() &&
+                   memcmp(key, step.text.constData(), size) == 0;
+
+        case Step::Pattern:
+            return index < 0 && matchesPattern(step.text.constData(), step.text.size(), key, size);
+
+        case Step::Descendants:
+            break;
+    }
+
+    return false;
+}
+
+bool PathQuery::predicatesHold(const Step &step, const BBase::Ptr &value) const
+{
+    foreach(const Predicate &predicate, step.predicates) {
+        const BBase *subject = value.get();
+
+        if(!predicate.key.isEmpty()) {
+            const BDict *dict = value->as<BDict>();
+            subject = dict ? dict->value(predicate.key) : 0;
+        }
+
+        if(!subject)
+            return false;
+        if(predicate.op == Predicate::Exists)
+            continue;
+
+        const BInt *integer = subject->as<BInt>();
+        const BString *string = subject->as<BString>();
+        bool holds = false;
+
+        switch(predicate.op) {
+            case Predicate::Equal:
+            case Predicate::NotEqual:
+                if(integer)
+                    holds = predicate.isNumber && integer->get_value() == predicate.number;
+                else if(string)
+                    holds = string->raw_data() == predicate.operand;
+                else
+                    return false;
+
+                if(predicate.op == Predicate::NotEqual)
+                    holds = !holds;
+                break;
+
+            case Predicate::Like:
+                holds = string && matchesPattern(predicate.operand.constData(), predicate.operand.size(),
+                                                 string->raw_data().constData(), string->size());
+                break;
+
+            case Predicate::Less:         holds = integer && integer->get_value() < predicate.number; break;
+            case Predicate::LessEqual:    holds = integer && integer->get_value() <= predicate.number; break;
+            case Predicate::Greater:      holds = integer && integer->get_value() > predicate.number; break;
+            case Predicate::GreaterEqual: holds = integer && integer->get_value() >= predicate.number; break;
+
+            case Predicate::Exists:
+                break;
+        }
+
+        if(!holds)
+            return false;
+    }
+
+    return true;
+}
+
+// Moves @p from down one level, by the dictionary key @p key or the list
+// element @p index (whichever isn't -1).  @p value is the value reached,
+// which may be null if it hasn't been decoded; then result.needsValue is
+// set if a predicate has to see it.
+void PathQuery::transition(const StateSet &from, const char *key, int size, int index,
+                           const BBase::Ptr &value, Transition &result) const
+{
+    foreach(int state, from) {
+        const Step &step = m_steps[state];
+
+        if(step.kind == Step::Descendants) {
+            addState(result.next, state);
+            continue;
+        }
+
+        if(!stepMatches(step, key, size, index))
+            continue;
+
+        if(!step.predicates.isEmpty()) {
+            if(!value) {
+                result.needsValue = true;
+                return;
+            }
+
+            if(!predicatesHold(step, value))
+                continue;
+        }
+
+        if(!step.isLast)
+            addState(result.next, state + 1);
+        else if(!result.matches.contains(step.query))
+            result.matches.append(step.query);
+    }
+}
+
+QList<PathQuery::Match> PathQuery::evaluate(const BBase::Ptr &root) const
+{
+    Evaluation evaluation;
+
+    StateSet states;
+    foreach(int start, m_starts)
+        addState(states, start);
+
+    evaluateTree(root, states, evaluation);
+    return evaluation.matches;
+}
+
+QList<PathQuery::Match> PathQuery::evaluate(ByteStream &stream) const
+{
+    Evaluation evaluation;
+
+    StateSet states;
+    foreach(int start, m_starts)
+        addState(states, start);
+
+    evaluateStream(stream, states, evaluation);
+    return evaluation.matches;
+}
+
+void PathQuery::evaluateTree(const BBase::Ptr &value, const StateSet &states, Evaluation &evaluation) const
+{
+    if(states.isEmpty() || !value)
+        return;
+
+    if(value->type_id() == BBase::bDict) {
+        const BDict::Ptr dict = boost::static_pointer_cast<BDict>(value);
+        QList<QByteArray> keys;
+        for(BDictionaryIterator it = dict->iterator(); it.hasNext(); )
+            keys.append(it.next().key());
+        qSort(keys);
+
+        foreach(const QByteArray &key, keys) {
+            const BBase::Ptr child = dict->find(key);
+
+            Transition result;
+            transition(states, key.constData(), key.size(), -1, child, result);
+
+            evaluation.path.append(key);
+            evaluation.addMatches(result.matches, child);
+            evaluateTree(child, result.next, evaluation);
+            evaluation.path.removeLast();
+        }
+    }
+    else if(value->type_id() == BBase::bList) {
+        const BList::Ptr list = boost::static_pointer_cast<BList>(value);
+        for(unsigned int i = 0; i < list->count(); ++i) {
+            const BBase::Ptr child = list->index(i);
+
+            Transition result;
+            transition(states, 0, 0, i, child, result);
+
+            evaluation.path.append(QByteArray::number(i));
+            evaluation.addMatches(result.matches, child);
+            evaluateTree(child, result.next, evaluation);
+            evaluation.path.removeLast();
+        }
+    }
+}
+
+void PathQuery::evaluateStream(ByteStream &stream, const StateSet &states, Evaluation &evaluation) const
+{
+    Bencode::Decoder &decoder = stream.decoder();
+
+    if(states.isEmpty()) {
+        decoder.skipValue();
+        return;
+    }
+
+    if(*stream == 'd') {
+        Bencode::Decoder::Nesting nesting(decoder);
+        decoder.countNode(Bencode::Decoder::DictNode);
+        ++stream;
+
+        while(*stream != 'e') {
+            const Bencode::ByteSpan key = decoder.readString(evaluation.scratch);
+            matchChild(stream, states, key.data(), key.size(), -1, evaluation);
+        }
+
+        ++stream;
+    }
+    else if(*stream == 'l') {
+        Bencode::Decoder::Nesting nesting(decoder);
+        decoder.countNode(Bencode::Decoder::ListNode);
+        ++stream;
+
+        for(int i = 0; *stream != 'e'; ++i)
+            matchChild(stream, states, 0, 0, i, evaluation);
+
+        ++stream;
+    }
+    else {
+        // Nothing below a string or an integer can match.
+        decoder.skipValue();
+    }
+}
+
+// Follows the dictionary key @p key, or the list element @p index, to the
+// value at the current position of @p stream.
+void PathQuery::matchChild(ByteStream &stream, const StateSet &states, const char *key, int size,
+                           int index, Evaluation &evaluation) const
+{
+    Transition result;
+    transition(states, key, size, index, BBase::Ptr(), result);
+
+    if(result.matches.isEmpty() && result.next.isEmpty() && !result.needsValue) {
+        stream.decoder().skipValue();
+        return;
+    }
+
+    // The key is only valid until the next read, so keep it first.
+    evaluation.path.append(index < 0 ? QByteArray(key, size) : QByteArray::number(index));
+
+    if(result.matches.isEmpty() && !result.needsValue)
+        evaluateStream(stream, result.next, evaluation);
+    else {
+        // The value is needed, either because it matched or for a
+        // predicate; whatever is below it is found in the decoded tree.
+        const BBase::Ptr value = readValue(stream);
+
+        if(result.needsValue) {
+            const QByteArray path = evaluation.path.last();
+            result = Transition();
+            transition(states, index < 0 ? path.constData() : 0, path.size(), index, value, result);
+        }
+
+        evaluation.addMatches(result.matches, value);
+        evaluateTree(value, result.next, evaluation);
+    }
+
+    evaluation.path.removeLast();
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PATHQUERY_H
+#define TORRENT_ANALYZER_PATHQUERY_H
+
+#include "bbase.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class ByteStream;
+
+// Some example queries:
+//
+//   info/files/*/path                    the path of every file
+//   announce-list/0                      the first tier of trackers
+//   info/*.utf-8                         every UTF-8 variant of a key
+//   info/files/*[length>1048576]/path    the paths of files over 1 MB
+//   info/name|info/name.utf-8            both names, in one pass
+//   **/url-list                          web seeds, wherever they are
+
+/**
+ * A query picking values out of a b-encoded document by their path,
+ * compiled once into a small automaton which can then be run over a
+ * decoded tree or straight over a ByteStream.
+ *
+ * A query is a list of steps separated by '/', each matching one level
+ * of the document:
+ *
+ * @li a dictionary key, such as "info" or "piece length"
+ * @li a number, matching that element of a list (or a key of those digits)
+ * @li '*', matching every list element and dictionary value
+ * @li a pattern using '*' and '?', matching the dictionary keys it fits
+ * @li '**', matching any number of levels, including none
+ *
+ * Any step but '**' can be followed by predicates in square brackets
+ * which the value it matches must satisfy.  A predicate names a key of
+ * that value (or '.' for the value itself), optionally followed by an
+ * operator and an operand: "=" and "!=" compare strings, or integers if
+ * the value is one; "~" matches a string against a '*' and '?' pattern;
+ * "<", "<=", ">" and ">=" compare integers.  A bare key only has to be
+ * present.  A backslash takes the character after it literally.
+ *
+ * Several queries can be combined with '|' and are evaluated together in
+ * a single pass; see above for some examples.
+ */
+class PathQuery
+{
+public:
+    /**
+     * A value found by the query.
+     */
+    struct Match
+    {
+        int query;        ///< Index of the '|' alternative which matched
+        QByteArray path;  ///< Where it was found, e.g. "info/files/3/path"
+        BBase::Ptr value;
+    };
+
+    /**
+     * Creates a query matching nothing.
+     */
+    PathQuery();
+
+    /**
+     * Compiles @p expression.  If it isn't a valid query, isValid()
+     * returns false and the query matches nothing.
+     */
+    explicit PathQuery(const QByteArray &expression);
+
+    bool isValid() const { return m_error.isEmpty(); }
+
+    /**
+     * @return what is wrong with the expression, if it isn't valid.
+     */
+    QString errorString() const { return m_error; }
+
+    /**
+     * @return the number of '|' alternatives in the query.
+     */
+    int queryCount() const { return m_starts.count(); }
+
+    /**
+     * Runs the query over the decoded value @p root.  Dictionary keys
+     * are visited in sorted order, which is the order they are stored in
+     * a valid .torrent file.
+     */
+    QList<Match> evaluate(const BBase::Ptr &root) const;
+
+    /**
+     * Runs the query over the value starting at the current position of
+     * @p stream, leaving the stream just past it.  Only the values that
+     * match are decoded; everything else is skipped over.  Values which
+     * a predicate has to look into are decoded as well, so that the
+     * predicate can be checked before anything under them is matched.
+     *
+     * @throw std::runtime_error if the data is not valid b-encoding
+     */
+    QList<Match> evaluate(ByteStream &stream) const;
+
+private:
+    struct Predicate
+    {
+        enum Operator { Exists, Equal, NotEqual, Like, Less, LessEqual, Greater, GreaterEqual };
+
+        QByteArray key;   // Empty for '.'
+        Operator op;
+        QByteArray operand;
+        qlonglong number;
+        bool isNumber;    // Whether operand is an integer
+    };
+
+    struct Step
+    {
+        enum Kind { Key, Index, Any, Pattern, Descendants };
+
+        Kind kind;
+        QByteArray text;  // Key, or pattern with its escapes
+        int index;        // For Index steps
+        QVector<Predicate> predicates;
+        int query;        // Alternative the step belongs to
+        bool isLast;      // Whether matching it matches the query
+    };
+
+    typedef QVector<int> StateSet;
+    struct Transition;
+    struct Evaluation;
+
+    bool parse(const QByteArray &expression);
+    bool parseStep(const QByteArray &text, int query);
+    bool parsePredicate(const QByteArray &text, Predicate &predicate);
+
+    void addState(StateSet &states, int step) const;
+    bool stepMatches(const Step &step, const char *key, int size, int index) const;
+    bool predicatesHold(const Step &step, const BBase::Ptr &value) const;
+    void transition(const StateSet &from, const char *key, int size, int index,
+                    const BBase::Ptr &value, Transition &result) const;
+
+    void evaluateTree(const BBase::Ptr &value, const StateSet &states, Evaluation &evaluation) const;
+    void evaluateStream(ByteStream &stream, const StateSet &states, Evaluation &evaluation) const;
+    void matchChild(ByteStream &stream, const StateSet &states, const char *key, int size,
+                    int index, Evaluation &evaluation) const;
+
+    QVector<Step> m_steps;
+    StateSet m_starts;
+    QString m_error;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,483 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "piecehashindex.h"
+#include "bstring.h"
+#include "bint.h"
+
+#include <QtCore/QFuture>
+#include <QtCore/QThread>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtConcurrentRun>
+
+#include <ksavefile.h>
+#include <kdebug.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include <string.h>
+
+// File layout, all in host byte order:
+//
+//   header   magic, version, record count, offset of torrent table
+//   fanout   65537 quint64s; records whose hash starts with the 16-bit
+//            prefix p are at [fanout[p], fanout[p + 1])
+//   records  sorted PieceRecords
+//   torrents quint32 count, then per torrent a quint64 piece length,
+//            quint32 name length and the name
+static const char fileMagic[4] = { 'T', 'P', 'H', 'I' };
+static const quint32 fileVersion = 1;
+static const int fanoutSize = 65537;
+
+struct IndexHeader
+{
+    char magic[4];
+    quint32 version;
+    quint64 count;
+    quint64 torrentTableOffset;
+};
+
+static const qint64 recordsOffset = sizeof(IndexHeader) + fanoutSize * sizeof(quint64);
+
+// Records are read from and written to disk in blocks of this many.
+static const int ioBlockRecords = 4096;
+
+static int hashPrefix(const char *hash)
+{
+    return (static_cast<uchar>(hash[0]) << 8) | static_cast<uchar>(hash[1]);
+}
+
+bool PieceRecord::operator<(const PieceRecord &other) const
+{
+    const int cmp = memcmp(hash, other.hash, sizeof hash);
+    if(cmp != 0)
+        return cmp < 0;
+
+    if(torrent != other.torrent)
+        return torrent < other.torrent;
+
+    return piece < other.piece;
+}
+
+static bool writeRun(PieceRecord *begin, PieceRecord *end, const QString &fileName)
+{
+    std::sort(begin, end);
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    const qint64 size = (end - begin) * sizeof(PieceRecord);
+    return file.write(reinterpret_cast<const char *>(begin), size) == size;
+}
+
+namespace {
+
+// Buffered sequential reader over one sorted run.
+class RunReader
+{
+public:
+    explicit RunReader(const QString &fileName)
+      : m_file(fileName), m_buffer(ioBlockRecords), m_pos(0), m_size(0)
+    {
+    }
+
+    bool open()
+    {
+        return m_file.open(QIODevice::ReadOnly) && fill();
+    }
+
+    bool atEnd() const { return m_pos >= m_size; }
+    const PieceRecord &current() const { return m_buffer[m_pos]; }
+
+    bool next()
+    {
+        if(++m_pos < m_size)
+            return true;
+
+        return fill();
+    }
+
+private:
+    bool fill()
+    {
+        const qint64 read = m_file.read(reinterpret_cast<char *>(m_buffer.data()),
+                                        ioBlockRecords * sizeof(PieceRecord));
+        m_pos = 0;
+        m_size = read > 0 ? read / sizeof(PieceRecord) : 0;
+
+        return read >= 0;
+    }
+
+    QFile m_file;
+    QVector<PieceRecord> m_buffer;
+    int m_pos, m_size;
+};
+
+struct RunHead
+{
+    RunReader *reader;
+
+    // Inverted, std::priority_queue is a max-heap.
+    bool operator<(const RunHead &other) const
+    {
+        return other.reader->current() < reader->current();
+    }
+};
+
+}
+
+PieceHashIndexWriter::PieceHashIndexWriter(const QString &fileName, quint64 memoryBudget)
+  : m_fileName(fileName),
+    m_maxRecords(qMax<quint64>(ioBlockRecords, qMin<quint64>(memoryBudget / sizeof(PieceRecord), 0x7fffffff))),
+    m_failed(false)
+{
+}
+
+PieceHashIndexWriter::~PieceHashIndexWriter()
+{
+    foreach(const QString &run, m_runs)
+        QFile::remove(run);
+}
+
+quint32 PieceHashIndexWriter::addTorrent(const QByteArray &name, qulonglong pieceLength,
+                                         const QByteArray &pieces)
+{
+    QMutexLocker lock(&m_mutex);
+
+    const quint32 id = m_torrents.count();
+    Torrent torrent = { name, pieceLength };
+    m_torrents.append(torrent);
+
+    const char *hash = pieces.constData();
+    const quint32 pieceCount = pieces.size() / 20;
+
+    for(quint32 i = 0; i < pieceCount; ++i, hash += 20) {
+        if(m_records.count() >= m_maxRecords && !spill())
+            m_failed = true;
+
+        PieceRecord record;
+        memcpy(record.hash, hash, sizeof record.hash);
+        record.torrent = id;
+        record.piece = i;
+
+        m_records.append(record);
+    }
+
+    return id;
+}
+
+bool PieceHashIndexWriter::addTorrent(const QByteArray &name, const BDict::Ptr &torrent)
+{
+    BDict::Ptr info = torrent->findType<BDict>("info");
+    if(!info)
+        return false;
+
+    BString::Ptr pieces = info->findType<BString>("pieces");
+    BInt::Ptr pieceLength = info->findType<BInt>("piece length");
+
+    if(!pieces || !pieceLength || pieces->size() % 20 != 0 || pieceLength->get_value() <= 0)
+        return false;
+
+    addTorrent(name, pieceLength->get_value(), pieces->raw_data());
+    return true;
+}
+
+// Sorts the in-memory records and writes them out as one run per thread.
+// Must be called with m_mutex held.
+bool PieceHashIndexWriter::spill()
+{
+    if(m_records.isEmpty())
+        return true;
+
+    const int threads = qMax(1, QThread::idealThreadCount());
+    const int sliceSize = (m_records.count() + threads - 1) / threads;
+    PieceRecord *records = m_records.data();
+
+    QList<QFuture<bool> > results;
+    for(int start = 0; start < m_records.count(); start += sliceSize) {
+        const int end = qMin(start + sliceSize, m_records.count());
+        const QString run = m_fileName + QLatin1String(".run") + QString::number(m_runs.count());
+
+        m_runs.append(run);
+        results.append(QtConcurrent::run(writeRun, records + start, records + end, run));
+    }
+
+    bool ok = true;
+    for(int i = 0; i < results.count(); ++i)
+        ok = results[i].result() && ok;
+
+    m_records.clear();
+
+    if(!ok)
+        kWarning() << "Unable to write temporary piece index runs for" << m_fileName;
+
+    return ok;
+}
+
+bool PieceHashIndexWriter::finish()
+{
+    QMutexLocker lock(&m_mutex);
+
+    if(!spill() || m_failed)
+        return false;
+
+    KSaveFile file(m_fileName);
+    if(!file.open())
+        return false;
+
+    // Leave room for the header and fanout, which are only known once
+    // every record has gone past.
+    if(!file.seek(recordsOffset))
+        return false;
+
+    QList<RunReader *> readers;
+    std::priority_queue<RunHead> heap;
+    bool ok = true;
+
+    foreach(const QString &run, m_runs) {
+        RunReader *reader = new RunReader(run);
+        readers.append(reader);
+
+        if(!reader->open()) {
+            ok = false;
+            break;
+        }
+
+        if(!reader->atEnd()) {
+            RunHead head = { reader };
+            heap.push(head);
+        }
+    }
+
+    QVector<quint64> fanout(fanoutSize, 0);
+    QVector<PieceRecord> block;
+    block.reserve(ioBlockRecords);
+    quint64 count = 0;
+
+    while(ok && !heap.empty()) {
+        RunHead head = heap.top();
+        heap.pop();
+
+        block.append(head.reader->current());
+        ++fanout[hashPrefix(head.reader->current().hash) + 1];
+        ++count;
+
+        if(!head.reader->next())
+            ok = false;
+        else if(!head.reader->atEnd())
+            heap.push(head);
+
+        if(block.count() == ioBlockRecords || heap.empty()) {
+            const qint64 size = block.count() * sizeof(PieceRecord);
+            ok = ok && file.write(reinterpret_cast<const char *>(block.constData()), size) == size;
+            block.clear();
+        }
+    }
+
+    qDeleteAll(readers);
+
+    if(!ok) {
+        file.abort();
+        return false;
+    }
+
+    for(int i = 1; i < fanoutSize; ++i)
+        fanout[i] += fanout[i - 1];
+
+    IndexHeader header;
+    memcpy(header.magic, fileMagic, sizeof header.magic);
+    header.version = fileVersion;
+    header.count = count;
+    header.torrentTableOffset = recordsOffset + count * sizeof(PieceRecord);
+
+    const quint32 torrentCount = m_torrents.count();
+    ok = file.write(reinterpret_cast<const char *>(&torrentCount), sizeof torrentCount) == sizeof torrentCount;
+
+    foreach(const Torrent &torrent, m_torrents) {
+        const quint32 nameLength = torrent.name.size();
+
+        ok = ok &&
+            file.write(reinterpret_cast<const char *>(&torrent.pieceLength), sizeof torrent.pieceLength) == sizeof torrent.pieceLength &&
+            file.write(reinterpret_cast<const char *>(&nameLength), sizeof nameLength) == sizeof nameLength &&
+            file.write(torrent.name.constData(), nameLength) == nameLength;
+    }
+
+    const qint64 fanoutBytes = fanoutSize * sizeof(quint64);
+    ok = ok && file.seek(0) &&
+        file.write(reinterpret_cast<const char *>(&header), sizeof header) == sizeof header &&
+        file.write(reinterpret_cast<const char *>(fanout.constData()), fanoutBytes) == fanoutBytes;
+
+    if(!ok) {
+        file.abort();
+        return false;
+    }
+
+    return file.finalize();
+}
+
+// The fanout must start at 0, never go backwards and end at @p count, so
+// that find() can use any two neighbouring entries as bounds.
+static bool validFanout(const quint64 *fanout, quint64 count)
+{
+    if(fanout[0] != 0 || fanout[fanoutSize - 1] != count)
+        return false;
+
+    bool ok = true;
+    for(int i = 0; i < fanoutSize - 1; ++i)
+        ok &= fanout[i] <= fanout[i + 1];
+    return ok;
+}
+
+PieceHashIndex::PieceHashIndex()
+  : m_map(0), m_fanout(0), m_records(0), m_count(0)
+{
+}
+
+PieceHashIndex::~PieceHashIndex()
+{
+    if(m_map)
+        m_file.unmap(m_map);
+}
+
+bool PieceHashIndex::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = m_file.size();
+    if(size < recordsOffset)
+        return false;
+
+    m_map = m_file.map(0, size);
+    if(!m_map)
+        return false;
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(m_map);
+    if(memcmp(header->magic, fileMagic, sizeof header->magic) != 0 ||
+       header->version != fileVersion ||
+       header->count > quint64(size - recordsOffset) / sizeof(PieceRecord) ||
+       header->torrentTableOffset != recordsOffset + header->count * sizeof(PieceRecord) ||
+       qint64(header->torrentTableOffset + sizeof(quint32)) > size)
+    {
+        kWarning() << fileName << "is not a valid piece hash index";
+        return false;
+    }
+
+    const quint64 *fanout = reinterpret_cast<const quint64 *>(m_map + sizeof(IndexHeader));
+    if(!validFanout(fanout, header->count)) {
+        kWarning() << fileName << "is not a valid piece hash index";
+        return false;
+    }
+
+    m_count = header->count;
+    m_fanout = fanout;
+    m_records = reinterpret_cast<const PieceRecord *>(m_map + recordsOffset);
+
+    // The torrent table is small, copy it out so names can be returned
+    // as ordinary QByteArrays.
+    const uchar *pos = m_map + header->torrentTableOffset;
+    const uchar *end = m_map + size;
+
+    quint32 torrentCount;
+    memcpy(&torrentCount, pos, sizeof torrentCount);
+    pos += sizeof torrentCount;
+
+    for(quint32 i = 0; i < torrentCount; ++i) {
+        Torrent torrent;
+        quint32 nameLength;
+
+        if(end - pos < qint64(sizeof torrent.pieceLength + sizeof nameLength))
+            return false;
+
+        memcpy(&torrent.pieceLength, pos, sizeof torrent.pieceLength);
+        pos += sizeof torrent.pieceLength;
+        memcpy(&nameLength, pos, sizeof nameLength);
+        pos += sizeof nameLength;
+
+        if(end - pos < qint64(nameLength))
+            return false;
+
+        torrent.name = QByteArray(reinterpret_cast<const char *>(pos), nameLength);
+        pos += nameLength;
+
+        m_torrents.append(torrent);
+    }
+
+    return true;
+}
+
+QByteArray PieceHashIndex::torrentName(quint32 torrent) const
+{
+    return torrent < quint32(m_torrents.count()) ? m_torrents[torrent].name : QByteArray();
+}
+
+qulonglong PieceHashIndex::pieceLength(quint32 torrent) const
+{
+    return torrent < quint32(m_torrents.count()) ? m_torrents[torrent].pieceLength : 0;
+}
+
+static bool hashLess(const PieceRecord &record, const char *hash)
+{
+    return memcmp(record.hash, hash, sizeof record.hash) < 0;
+}
+
+QList<PieceHashIndex::Location> PieceHashIndex::find(const char *hash) const
+{
+    QList<Location> result;
+    if(!m_records)
+        return result;
+
+    const int prefix = hashPrefix(hash);
+    const PieceRecord *end = m_records + m_fanout[prefix + 1];
+    const PieceRecord *it = std::lower_bound(m_records + m_fanout[prefix], end, hash, hashLess);
+
+    for(; it != end && memcmp(it->hash, hash, sizeof it->hash) == 0; ++it) {
+        Location location = { it->torrent, it->piece };
+        result.append(location);
+    }
+
+    return result;
+}
+
+QHash<quint32, quint32> PieceHashIndex::sharedPieces(const QByteArray &pieces) const
+{
+    QHash<quint32, quint32> result;
+    const int pieceCount = pieces.size() / 20;
+
+    for(int i = 0; i < pieceCount; ++i) {
+        const QList<Location> locations = find(pieces.constData() + i * 20);
+
+        // Locations come sorted by torrent, only count each torrent once
+        // per piece even if it repeats the same data.
+        quint32 last = ~0U;
+        foreach(const Location &location, locations) {
+            if(location.torrent != last)
+                ++result[location.torrent];
+            last = location.torrent;
+        }
+    }
+
+    return result;
+}
+
+// vim: set et sw=4 ts=4:
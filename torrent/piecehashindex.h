@@ -0,0 +1,206 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PIECEHASHINDEX_H
+#define TORRENT_ANALYZER_PIECEHASHINDEX_H
+
+#include "bdict.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+ * One entry of a piece hash index: the SHA-1 of a piece, and where that
+ * piece was found.  Entries are sorted by hash, then torrent, then piece.
+ */
+struct PieceRecord
+{
+    char hash[20];
+    quint32 torrent;
+    quint32 piece;
+
+    bool operator<(const PieceRecord &other) const;
+};
+
+/**
+ * Builds an on-disk index mapping the SHA-1 hash of every piece of a set
+ * of torrents to the torrent and piece index it came from.  Torrents whose
+ * files line up on piece boundaries will share piece hashes, so the index
+ * can be used to find torrents with content in common.
+ *
+ * Records are gathered in memory up to a budget, then sorted on several
+ * threads and spilled to temporary runs next to the index file, which are
+ * merged into the index by finish().  This keeps memory use fixed no matter
+ * how many hashes are added.  addTorrent() may be called from several
+ * threads at once.
+ *
+ * @see PieceHashIndex
+ */
+class PieceHashIndexWriter
+{
+public:
+    /**
+     * @param fileName the index file to write
+     * @param memoryBudget how many bytes of records to hold in memory
+     *        before spilling them to disk
+     */
+    explicit PieceHashIndexWriter(const QString &fileName,
+                                  quint64 memoryBudget = 256 * 1024 * 1024);
+
+    /**
+     * Removes any temporary files left over if finish() wasn't called
+     * or failed.
+     */
+    ~PieceHashIndexWriter();
+
+    /**
+     * Adds the pieces of one torrent to the index.
+     *
+     * @param name the name to store for the torrent, usually its path
+     * @param pieceLength the size of each piece in bytes
+     * @param pieces the concatenated 20-byte piece hashes
+     * @return the identifier of the torrent in the index
+     */
+    quint32 addTorrent(const QByteArray &name, qulonglong pieceLength,
+                       const QByteArray &pieces);
+
+    /**
+     * Convenience function which adds the torrent described by the
+     * decoded .torrent file @p torrent.
+     *
+     * @return false if @p torrent has no valid "pieces" or "piece length"
+     */
+    bool addTorrent(const QByteArray &name, const BDict::Ptr &torrent);
+
+    /**
+     * Merges everything added so far into the index file.  No more
+     * torrents may be added afterwards.
+     *
+     * @return true if the index was written successfully
+     */
+    bool finish();
+
+private:
+    Q_DISABLE_COPY(PieceHashIndexWriter)
+
+    struct Torrent
+    {
+        QByteArray name;
+        qulonglong pieceLength;
+    };
+
+    bool spill();
+
+    QString m_fileName;
+    int m_maxRecords;
+    QMutex m_mutex;
+    QVector<PieceRecord> m_records;
+    QList<Torrent> m_torrents;
+    QStringList m_runs;
+    bool m_failed;
+};
+
+/**
+ * Read-only access to an index written by PieceHashIndexWriter.  The file
+ * is memory-mapped, so opening it is cheap no matter its size and lookups
+ * only touch the pages they need.  A table of the first 16 bits of each
+ * hash narrows every lookup down to a small range before binary search.
+ *
+ * It is safe to query the same index from several threads.
+ */
+class PieceHashIndex
+{
+public:
+    struct Location
+    {
+        quint32 torrent;
+        quint32 piece;
+    };
+
+    PieceHashIndex();
+    ~PieceHashIndex();
+
+    /**
+     * Maps the index in @p fileName.
+     *
+     * @return false if the file couldn't be mapped or isn't a valid index
+     */
+    bool open(const QString &fileName);
+
+    /**
+     * @return the number of piece hashes in the index.
+     */
+    quint64 count() const { return m_count; }
+
+    /**
+     * @return the number of torrents in the index.
+     */
+    quint32 torrentCount() const { return m_torrents.count(); }
+
+    /**
+     * @return the name given to @p torrent when the index was built.
+     */
+    QByteArray torrentName(quint32 torrent) const;
+
+    /**
+     * @return the piece length of @p torrent.
+     */
+    qulonglong pieceLength(quint32 torrent) const;
+
+    /**
+     * Returns every place the piece with SHA-1 hash @p hash appears.
+     *
+     * @param hash the 20 bytes of the piece hash
+     */
+    QList<Location> find(const char *hash) const;
+
+    /**
+     * Looks up every hash of @p pieces, which is laid out like the
+     * "pieces" value of a torrent, and counts how many of them each
+     * indexed torrent has.
+     *
+     * @return number of shared pieces, keyed by torrent identifier
+     */
+    QHash<quint32, quint32> sharedPieces(const QByteArray &pieces) const;
+
+private:
+    Q_DISABLE_COPY(PieceHashIndex)
+
+    struct Torrent
+    {
+        QByteArray name;
+        qulonglong pieceLength;
+    };
+
+    QFile m_file;
+    uchar *m_map;
+    const quint64 *m_fanout;
+    const PieceRecord *m_records;
+    quint64 m_count;
+    QList<Torrent> m_torrents;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
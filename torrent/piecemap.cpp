@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "piecemap.h"
+#include "bint.h"
+#include "blist.h"
+
+#include <algorithm>
+
+// Keeping the total within a qint64 means a piece index times the piece
+// length can't overflow a qulonglong either.
+static const qulonglong maxTotalLength = Q_UINT64_C(0x7fffffffffffffff);
+
+PieceMap::PieceMap()
+  : m_pieceLength(0), m_failed(false)
+{
+    m_offsets.append(0);
+}
+
+PieceMap PieceMap::fromTorrent(const BDict::Ptr &torrent)
+{
+    PieceMap map;
+
+    const BDict *info = torrent ? torrent->value<BDict>("info") : 0;
+    if(!info) {
+        map.m_failed = true;
+        return map;
+    }
+
+    const BInt *pieceLength = info->value<BInt>("piece length");
+    map.setPieceLength(pieceLength ? pieceLength->get_value() : 0);
+
+    if(const BInt *length = info->value<BInt>("length")) {
+        map.addFile(length->get_value());
+        return map;
+    }
+
+    const BList *files = info->value<BList>("files");
+    if(!files) {
+        map.m_failed = true;
+        return map;
+    }
+
+    map.reserve(files->count());
+    for(unsigned int i = 0; i < files->count() && !map.m_failed; ++i) {
+        const BDict *file = files->at<BDict>(i);
+        const BInt *length = file ? file->value<BInt>("length") : 0;
+        map.addFile(length ? length->get_value() : -1);
+    }
+
+    return map;
+}
+
+void PieceMap::setPieceLength(qlonglong pieceLength)
+{
+    m_pieceLength = pieceLength > 0 ? pieceLength : 0;
+}
+
+void PieceMap::addFile(qlonglong length)
+{
+    const qulonglong total = m_offsets.last();
+
+    if(length < 0 || qulonglong(length) > maxTotalLength - total) {
+        m_failed = true;
+        return;
+    }
+
+    m_offsets.append(total + length);
+}
+
+qulonglong PieceMap::pieceCount() const
+{
+    if(m_pieceLength == 0)
+        return 0;
+
+    const qulonglong total = totalLength();
+    return total / m_pieceLength + (total % m_pieceLength != 0);
+}
+
+PieceMap::Range PieceMap::piecesOfFile(int file) const
+{
+    const qulonglong begin = m_offsets[file];
+    const qulonglong end = m_offsets[file + 1];
+    const qulonglong first = begin / m_pieceLength;
+
+    if(begin == end)
+        return Range(first, 0);
+
+    return Range(first, (end - 1) / m_pieceLength - first + 1);
+}
+
+PieceMap::Range PieceMap::filesOfPiece(qulonglong piece) const
+{
+    const qulonglong begin = piece * m_pieceLength;
+    const qulonglong end = qMin(begin + m_pieceLength, totalLength());
+
+    const int first = fileAt(begin);
+    const int last = fileAt(end - 1);
+    return Range(first, last - first + 1);
+}
+
+int PieceMap::fileAt(qulonglong offset) const
+{
+    // The last file starting at or before offset.  Empty files share
+    // their offset with the file after them, which is the one wanted.
+    const qulonglong *begin = m_offsets.constData();
+    const qulonglong *found = std::upper_bound(begin, begin + m_offsets.count(), offset);
+    return found - begin - 1;
+}
+
+// vim: set et sw=4 ts=4:
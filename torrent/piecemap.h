@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PIECEMAP_H
+#define TORRENT_ANALYZER_PIECEMAP_H
+
+#include "bdict.h"
+
+#include <QtCore/QVector>
+
+/**
+ * Maps the files of a torrent onto its pieces.  The content of a torrent
+ * is its files laid end to end, cut into pieces of "piece length" bytes,
+ * so a piece can span several files and a file several pieces.
+ *
+ * Only the offset of each file is kept, 8 bytes a file, which is built up
+ * by addFile() in the same pass that adds the file lengths up.  Finding
+ * the pieces of a file takes a division, finding the files of a piece a
+ * binary search.  Offsets are 64-bit throughout; a map whose total length
+ * would not fit in a qint64 is invalid.
+ */
+class PieceMap
+{
+public:
+    /**
+     * A run of consecutive files or pieces.  count is 0 for an empty
+     * file, whose first piece is the one it would have started in.
+     */
+    struct Range
+    {
+        Range(qulonglong f = 0, qulonglong c = 0) : first(f), count(c) { }
+
+        qulonglong last() const { return first + count - 1; }
+
+        qulonglong first;
+        qulonglong count;
+    };
+
+    /**
+     * Creates an empty map, which is invalid until it has a piece length.
+     */
+    PieceMap();
+
+    /**
+     * Builds the map of the decoded .torrent file @p torrent, for
+     * single-file and multi-file torrents alike.  The map is invalid if
+     * "piece length" or any file length is missing or unusable.
+     */
+    static PieceMap fromTorrent(const BDict::Ptr &torrent);
+
+    /**
+     * @return whether the map has a usable piece length and every file
+     * added had a usable length.
+     */
+    bool isValid() const { return m_pieceLength > 0 && !m_failed; }
+
+    /**
+     * Sets the size of each piece.  This can come before or after the
+     * files are added, as "piece length" comes after "files" in the file.
+     * Values less than 1 make the map invalid.
+     */
+    void setPieceLength(qlonglong pieceLength);
+
+    /**
+     * Adds the next file, of @p length bytes, to the end of the content.
+     * A negative length, or one which would take the total past the
+     * range of a qint64, makes the map invalid.
+     */
+    void addFile(qlonglong length);
+
+    /**
+     * Makes room for @p count files, for callers which know the count.
+     */
+    void reserve(int count) { m_offsets.reserve(count + 1); }
+
+    int fileCount() const { return m_offsets.count() - 1; }
+    qulonglong pieceLength() const { return m_pieceLength; }
+    qulonglong totalLength() const { return m_offsets.last(); }
+
+    /**
+     * @return the number of pieces, the last of which may be short.
+     */
+    qulonglong pieceCount() const;
+
+    qulonglong fileOffset(int file) const { return m_offsets[file]; }
+    qulonglong fileLength(int file) const { return m_offsets[file + 1] - m_offsets[file]; }
+
+    /**
+     * @return the pieces holding some of @p file.  Only valid maps
+     * can be asked this.
+     */
+    Range piecesOfFile(int file) const;
+
+    /**
+     * @return the files with data in @p piece, which must be less than
+     * pieceCount().  Empty files lying between two of those are included
+     * in the range too.
+     */
+    Range filesOfPiece(qulonglong piece) const;
+
+    /**
+     * @return the file holding the byte at @p offset, which must be less
+     * than totalLength().
+     */
+    int fileAt(qulonglong offset) const;
+
+private:
+    qulonglong m_pieceLength;
+    QVector<qulonglong> m_offsets; // Start of each file, then the total
+    bool m_failed;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
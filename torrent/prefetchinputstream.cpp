@@ -0,0 +1,218 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "prefetchinputstream.h"
+#include "tracing.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <string.h>
+
+// Streams smaller than this are read directly unless
+// STRIGI_TORRENT_PREFETCH_SIZE says otherwise.  Starting a thread costs
+// about as much as reading a few hundred KB from local disk.
+static const qint64 defaultPrefetchSize = 1024 * 1024;
+
+PrefetchInputStream::PrefetchInputStream(Strigi::InputStream *input,
+                                         int bufferSize, int bufferCount)
+  : m_input(input), m_bufferSize(bufferSize), m_reader(this),
+    m_block(0), m_blockSize(0), m_offset(0), m_buffers(qMax(bufferCount, 2)),
+    m_produced(0), m_consumed(0), m_inputDone(false), m_stopping(false),
+    m_inputStatus(Strigi::Ok)
+{
+    m_size = input->size();
+    m_position = 0;
+    m_status = Strigi::Ok;
+
+    m_reader.start();
+}
+
+PrefetchInputStream::~PrefetchInputStream()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopping = true;
+        m_released.wakeAll();
+    }
+
+    m_reader.wait();
+}
+
+bool PrefetchInputStream::isWorthwhile(Strigi::InputStream *input)
+{
+    bool ok = false;
+    qint64 threshold = qgetenv("STRIGI_TORRENT_PREFETCH_SIZE").toLongLong(&ok);
+    if(!ok || threshold < 0)
+        threshold = defaultPrefetchSize;
+
+    return threshold > 0 && input->size() >= threshold;
+}
+
+int32_t PrefetchInputStream::read(const char *&start, int32_t min, int32_t max)
+{
+    if(m_status != Strigi::Ok)
+        return -1;
+
+    if(m_offset == m_blockSize && !nextBlock())
+        return m_status == Strigi::Error ? -2 : -1;
+
+    min = qMax(min, 1);
+    if(max > 0 && max < min)
+        max = min;
+
+    // The common case: the current block has enough left, which can be
+    // used where it is.
+    int32_t size = m_blockSize - m_offset;
+    if(size >= min) {
+        if(max > 0 && size > max)
+            size = max;
+
+        start = m_block + m_offset;
+        m_offset += size;
+        m_position += size;
+        return size;
+    }
+
+    // Otherwise min reaches into the blocks after this one, which are
+    // copied together up to min.  The rest of the last block is left for
+    // the next call.
+    m_joined.clear();
+    m_joined.reserve(min);
+    while(m_joined.size() < min) {
+        if(m_offset == m_blockSize && !nextBlock())
+            break;
+
+        const int taken = qMin(m_blockSize - m_offset, min - m_joined.size());
+        m_joined.append(m_block + m_offset, taken);
+        m_offset += taken;
+    }
+
+    // Running out of data is only an end of stream once what was read
+    // before it has been handed out.
+    if(m_status == Strigi::Error)
+        return -2;
+    if(m_status == Strigi::Eof)
+        m_status = Strigi::Ok;
+
+    start = m_joined.constData();
+    m_position += m_joined.size();
+    return m_joined.size();
+}
+
+// Makes the next block read ahead the current one, waiting for it if need
+// be, and hands the old one back to the reading thread.  Returns false,
+// with the status set, if the input has ended.
+bool PrefetchInputStream::nextBlock()
+{
+    QMutexLocker lock(&m_mutex);
+
+    if(m_produced == m_consumed && !m_inputDone) {
+        TORRENT_TRACE_SPAN("prefetchWait");
+        while(m_produced == m_consumed && !m_inputDone)
+            m_filled.wait(&m_mutex);
+    }
+
+    if(m_produced == m_consumed) {
+        m_status = m_inputStatus == Strigi::Error ? Strigi::Error : Strigi::Eof;
+        m_error = m_inputError;
+        return false;
+    }
+
+    // The block isn't refilled until the one after it is consumed, so it
+    // can be read without holding the lock.
+    const QByteArray &buffer = m_buffers.at(m_consumed % m_buffers.size());
+    m_block = buffer.constData();
+    m_blockSize = buffer.size();
+    m_offset = 0;
+
+    ++m_consumed;
+    m_released.wakeOne();
+
+    return true;
+}
+
+int64_t PrefetchInputStream::reset(int64_t pos)
+{
+    // Going back would need the data already handed out.
+    if(pos != m_position) {
+        m_status = Strigi::Error;
+        m_error = "PrefetchInputStream can't be reset";
+        return -2;
+    }
+
+    return m_position;
+}
+
+void PrefetchInputStream::fill()
+{
+    const int slots = m_buffers.size();
+    QMutexLocker lock(&m_mutex);
+
+    while(!m_stopping) {
+        // One buffer is always left for read() to hand out.
+        if(m_produced - m_consumed >= quint64(slots - 1)) {
+            m_released.wait(&m_mutex);
+            continue;
+        }
+
+        QByteArray &buffer = m_buffers[m_produced % slots];
+        buffer.resize(m_bufferSize);
+
+        // The slot is ours until m_produced is advanced, so the slow part
+        // happens unlocked.
+        lock.unlock();
+
+        int filled = 0;
+        int32_t nread = 0;
+        {
+            TORRENT_TRACE_SPAN("prefetchRead");
+
+            while(filled < m_bufferSize) {
+                const char *data;
+                nread = m_input->read(data, 1, m_bufferSize - filled);
+                if(nread <= 0)
+                    break;
+
+                memcpy(buffer.data() + filled, data, nread);
+                filled += nread;
+            }
+
+            TORRENT_TRACE_ARG(filled);
+        }
+
+        buffer.resize(filled);
+        lock.relock();
+
+        if(filled > 0) {
+            ++m_produced;
+            m_filled.wakeOne();
+        }
+
+        if(nread <= 0) {
+            m_inputDone = true;
+            m_inputStatus = (nread < -1) ? Strigi::Error : Strigi::Eof;
+            if(nread < -1)
+                m_inputError = m_input->error();
+
+            m_filled.wakeOne();
+            return;
+        }
+    }
+}
+
+// vim: set et sw=4 ts=4:
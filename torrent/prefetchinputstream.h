@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PREFETCHINPUTSTREAM_H
+#define TORRENT_ANALYZER_PREFETCHINPUTSTREAM_H
+
+#include <strigi/streambase.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+/**
+ * An InputStream which reads another stream ahead on a background thread,
+ * so that parsing the data already read overlaps with waiting for more.
+ * This helps with slow streams such as files on network mounts.
+ *
+ * The data is read into a fixed ring of buffers; once they are all full
+ * the reading thread waits for the parser to catch up, so memory use is
+ * bounded no matter the size of the stream.  read() hands out what is
+ * left of the current buffer, up to max bytes, straight from the ring.
+ * Only when min reaches past the end of it is the data copied, into a
+ * buffer of its own.
+ *
+ * The underlying stream is read from the background thread only, until
+ * this object is destroyed.  Only then may it be used again, e.g. to
+ * reset() it.  This stream itself can't be reset.
+ */
+class PrefetchInputStream : public Strigi::InputStream
+{
+public:
+    /**
+     * Starts reading @p input in the background.
+     *
+     * @param bufferSize size of each buffer in the ring
+     * @param bufferCount how many buffers to read ahead into
+     */
+    explicit PrefetchInputStream(Strigi::InputStream *input,
+                                 int bufferSize = 64 * 1024, int bufferCount = 8);
+
+    /**
+     * Stops the background thread, waiting for any read in progress.
+     */
+    virtual ~PrefetchInputStream();
+
+    virtual int32_t read(const char *&start, int32_t min, int32_t max);
+    virtual int64_t reset(int64_t pos);
+
+    /**
+     * @return true if @p input is known to be big enough to be worth
+     * reading on another thread.  The threshold is taken from
+     * STRIGI_TORRENT_PREFETCH_SIZE (in bytes, 0 disables prefetching).
+     */
+    static bool isWorthwhile(Strigi::InputStream *input);
+
+private:
+    Q_DISABLE_COPY(PrefetchInputStream)
+
+    class Reader : public QThread
+    {
+    public:
+        explicit Reader(PrefetchInputStream *stream) : m_stream(stream) { }
+
+    protected:
+        virtual void run() { m_stream->fill(); }
+
+    private:
+        PrefetchInputStream *m_stream;
+    };
+
+    void fill();
+    bool nextBlock();
+
+    Strigi::InputStream *m_input;
+    const int m_bufferSize;
+    Reader m_reader;
+
+    // Used by read() only.  The current block is the last one consumed,
+    // which the reading thread leaves alone until the next is.
+    const char *m_block;
+    int m_blockSize;
+    int m_offset;         // Into the current block
+    QByteArray m_joined;  // Data spanning blocks, handed out by read()
+
+    // Guards everything below.
+    QMutex m_mutex;
+    QWaitCondition m_filled;   // A buffer was filled, or the input ended
+    QWaitCondition m_released; // A buffer was handed back, or stopping
+    QVector<QByteArray> m_buffers;
+    quint64 m_produced;   // Buffers filled so far
+    quint64 m_consumed;   // Buffers handed to read() so far
+    bool m_inputDone;     // No more buffers will be filled
+    bool m_stopping;
+    Strigi::StreamStatus m_inputStatus;
+    std::string m_inputError;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
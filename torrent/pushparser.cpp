@@ -0,0 +1,304 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "pushparser.h"
+#include "bytestream.h"
+#include "bstring.h"
+#include "bint.h"
+#include "tracing.h"
+
+#include <stdexcept>
+#include <string.h>
+
+// The most room reserved up front for a string split between pieces of input.
+static const quint32 maxReserve = 16 * 1024 * 1024;
+
+// Lengths and integers with more characters than this are charged to the
+// memory budget, as the decoder does.
+static const int freeTokenSize = 64;
+
+PushParser::PushParser(const QByteArray &captureKey)
+  : m_state(ExpectValue), m_remaining(0), m_consumed(0),
+    m_captureKey(captureKey), m_capturing(false), m_captureFrom(0),
+    m_ownBudget(ByteStream::defaultMemoryLimit()), m_budget(&m_ownBudget)
+{
+}
+
+void PushParser::feed(const char *data, size_t size)
+{
+    TORRENT_TRACE_SPAN("feed");
+    TORRENT_TRACE_ARG(size);
+
+    const char *p = data;
+    const char *end = data + size;
+    m_captureFrom = data;
+
+    while(p < end && m_state != Complete) {
+        switch(m_state) {
+            case ExpectValue:
+                // The length of a string is everything up to its ':',
+                // which is left to parseLength() to accept or refuse.
+                if(startsString(*p)) {
+                    m_token.clear();
+                    m_state = StringLength;
+                    break;
+                }
+
+                ++p;
+                startValue(p[-1], p);
+                break;
+
+            case IntDigits: {
+                const char *e = static_cast<const char *>(memchr(p, 'e', end - p));
+                if(!e) {
+                    appendToken(p, end - p);
+                    p = end;
+                    break;
+                }
+
+                appendToken(p, e - p);
+                p = e + 1;
+
+                long long value;
+                if(!Bencode::parseInteger(Bencode::ByteSpan(m_token.constData(), m_token.size()), &value))
+                    throw std::runtime_error("Invalid int read");
+
+                chargeNode(sizeof(BInt));
+                finishValue(BBase::Ptr(new BInt(value)), p);
+                break;
+            }
+
+            case StringLength: {
+                const char *colon = static_cast<const char *>(memchr(p, ':', end - p));
+                if(!colon) {
+                    appendToken(p, end - p);
+                    p = end;
+                    break;
+                }
+
+                appendToken(p, colon - p);
+                p = colon + 1;
+
+                if(!Bencode::parseLength(Bencode::ByteSpan(m_token.constData(), m_token.size()), &m_remaining))
+                    throw std::runtime_error("Invalid number in string data");
+
+                // Charged before anything is copied or reserved for it.
+                m_budget->charge(m_remaining);
+
+                // Most strings are entirely within this piece of input
+                // and can be copied in one go.
+                if(m_remaining <= static_cast<size_t>(end - p)) {
+                    p += m_remaining;
+                    finishString(QByteArray(p - m_remaining, m_remaining), p);
+                }
+                else {
+                    // Don't trust the length too far before seeing the data.
+                    m_string.reserve(qMin<quint32>(m_remaining, maxReserve));
+                    m_state = StringData;
+                }
+                break;
+            }
+
+            case StringData: {
+                const quint32 available = qMin<size_t>(m_remaining, end - p);
+                m_string.append(p, available);
+                p += available;
+                m_remaining -= available;
+
+                if(m_remaining == 0) {
+                    finishString(m_string, p);
+                    m_string = QByteArray();
+                }
+                break;
+            }
+
+            case Complete:
+                break;
+        }
+    }
+
+    m_consumed += p - data;
+
+    if(m_capturing)
+        appendCapture(m_captureFrom, p - m_captureFrom);
+}
+
+void PushParser::feedValue(const BBase::Ptr &value, const char *raw, size_t size)
+{
+    if(m_state != ExpectValue)
+        throw std::logic_error("feedValue() called in the middle of a value");
+
+    if(!m_stack.isEmpty() && m_stack.last().dict && !m_stack.last().haveKey)
+        throw std::logic_error("feedValue() called where a key was expected");
+
+    m_consumed += size;
+    m_captureFrom = raw;
+    finishValue(value, raw + size);
+
+    if(m_capturing)
+        appendCapture(raw, size);
+}
+
+BBase::Ptr PushParser::finish()
+{
+    if(m_state != Complete)
+        throw end_of_stream();
+
+    return m_root;
+}
+
+// The stack is on the heap, but the tree isn't destroyed or written out
+// without recursion, so it is held to the same depth as ByteStream input.
+void PushParser::checkDepth() const
+{
+    if(m_stack.count() >= Bencode::Decoder::maxDepth)
+        throw std::runtime_error("Values are nested too deeply");
+}
+
+void PushParser::chargeNode(size_t size)
+{
+    m_budget->charge(size + ByteStream::NodeOverhead);
+}
+
+void PushParser::appendToken(const char *data, size_t size)
+{
+    const size_t free = qMax(freeTokenSize - m_token.size(), 0);
+    if(size > free)
+        m_budget->charge(size - free);
+
+    m_token.append(data, size);
+}
+
+void PushParser::appendCapture(const char *data, size_t size)
+{
+    m_budget->charge(size);
+    m_captured.append(data, size);
+}
+
+// Like the pull parser, anything which doesn't start another kind of value
+// is taken for the length of a string, even if it isn't a digit.
+bool PushParser::startsString(char c) const
+{
+    // Keys are always strings, so there only the end of the dictionary
+    // is anything else.
+    const Frame *top = m_stack.isEmpty() ? 0 : &m_stack.last();
+    if(top && top->dict && !top->haveKey)
+        return c != 'e';
+
+    return c != 'i' && c != 'l' && c != 'd' && c != 'e';
+}
+
+// @p end is just past @p c, where the value ends if @p c completes one.
+// @p c is one of the characters startsString() doesn't accept.
+void PushParser::startValue(char c, const char *end)
+{
+    Frame *top = m_stack.isEmpty() ? 0 : &m_stack.last();
+
+    switch(c) {
+        case 'i':
+            m_token.clear();
+            m_state = IntDigits;
+            break;
+
+        case 'l': {
+            checkDepth();
+            chargeNode(sizeof(BList));
+            Frame frame;
+            frame.list = BList::Ptr(new BList);
+            frame.haveKey = false;
+            m_stack.append(frame);
+            break;
+        }
+
+        case 'd': {
+            checkDepth();
+            chargeNode(sizeof(BDict));
+            Frame frame;
+            frame.dict = BDict::Ptr(new BDict);
+            frame.haveKey = false;
+            m_stack.append(frame);
+            break;
+        }
+
+        case 'e': {
+            // Only ends a list, or a dictionary between entries.
+            if(!top || (top->dict && top->haveKey))
+                throw std::runtime_error("Unexpected end of container");
+
+            BBase::Ptr container;
+            if(top->list)
+                container = top->list;
+            else
+                container = top->dict;
+
+            m_stack.removeLast();
+            finishValue(container, end);
+            break;
+        }
+    }
+}
+
+void PushParser::finishString(const QByteArray &data, const char *end)
+{
+    m_state = ExpectValue;
+
+    Frame *top = m_stack.isEmpty() ? 0 : &m_stack.last();
+    if(top && top->dict && !top->haveKey) {
+        top->key = data;
+        top->haveKey = true;
+
+        if(m_stack.count() == 1 && !m_captureKey.isEmpty() && data == m_captureKey) {
+            m_captured.clear();
+            m_capturing = true;
+            m_captureFrom = end;
+        }
+        return;
+    }
+
+    chargeNode(sizeof(BString));
+    finishValue(BBase::Ptr(new BString(data)), end);
+}
+
+void PushParser::finishValue(const BBase::Ptr &value, const char *end)
+{
+    m_state = ExpectValue;
+
+    if(m_stack.isEmpty()) {
+        m_root = value;
+        m_state = Complete;
+        return;
+    }
+
+    Frame &top = m_stack.last();
+    if(top.list) {
+        top.list->append(value);
+        return;
+    }
+
+    top.dict->insert(top.key, value);
+    top.key.clear();
+    top.haveKey = false;
+
+    // The captured value has just been stored in the top-level dictionary.
+    if(m_capturing && m_stack.count() == 1) {
+        appendCapture(m_captureFrom, end - m_captureFrom);
+        m_capturing = false;
+    }
+}
+
+// vim: set et sw=4 ts=4:
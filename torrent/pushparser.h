@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_PUSHPARSER_H
+#define TORRENT_ANALYZER_PUSHPARSER_H
+
+#include "bbase.h"
+#include "blist.h"
+#include "bdict.h"
+#include "core/memorybudget.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+
+#include <stddef.h>
+
+/**
+ * Decodes b-encoded data handed to it in pieces, for callers which can't
+ * block waiting for input the way ByteStream does (network transfers,
+ * event loops, pipes and the like).
+ *
+ * Data can be split anywhere, even inside a string length or an integer:
+ * the parser keeps its place between calls to feed().  It builds the same
+ * tree of BBase objects as the ByteStream-based constructors, and throws
+ * the same exceptions: std::runtime_error as soon as invalid data is
+ * seen, and end_of_stream from finish() if the data stopped short.  Like
+ * those constructors, anything after the end of the first value is
+ * ignored.
+ *
+ * Containers are kept on an explicit stack rather than by recursion, but
+ * nesting is still limited to Bencode::Decoder::maxDepth.  Nodes, string
+ * data and captures are charged to a Bencode::MemoryBudget, limited to
+ * ByteStream::defaultMemoryLimit() as a ByteStream's is, and
+ * memory_limit_exceeded is thrown once that is used up.
+ */
+class PushParser
+{
+public:
+    /**
+     * @param captureKey if not empty, the raw bytes of the value stored
+     *        under this key in the top-level dictionary are kept, as for
+     *        the BDict constructor.  See captured().
+     */
+    explicit PushParser(const QByteArray &captureKey = QByteArray());
+
+    /**
+     * Decodes the next @p size bytes of input.
+     *
+     * An exception is thrown if the data is not valid b-encoding, after
+     * which the parser must not be fed again.
+     */
+    void feed(const char *data, size_t size);
+
+    /**
+     * Convenience overload for a whole QByteArray.
+     */
+    void feed(const QByteArray &data) { feed(data.constData(), data.size()); }
+
+    /**
+     * Takes @p value, decoded by some other means from the @p size bytes
+     * at @p raw, as the next value in the input, as if those bytes had
+     * been fed.  This lets large parts of the input be decoded elsewhere,
+     * e.g. on other threads.  @p raw is only used for captures.
+     *
+     * The parser must be between values, and not expecting a dictionary
+     * key, or std::logic_error is thrown.
+     */
+    void feedValue(const BBase::Ptr &value, const char *raw, size_t size);
+
+    /**
+     * Signals the end of the input.
+     *
+     * @return the decoded value
+     * @throw end_of_stream if the input ended in the middle of a value
+     */
+    BBase::Ptr finish();
+
+    /**
+     * @return true once a whole value has been decoded.  Any further
+     * input is ignored.
+     */
+    bool isComplete() const { return m_state == Complete; }
+
+    /**
+     * @return the raw bytes of the value under the capture key given to
+     * the constructor, if one was found.
+     */
+    QByteArray captured() const { return m_captured; }
+
+    /**
+     * @return how many bytes of input have been decoded, not counting
+     * anything after the end of the value.
+     */
+    quint64 bytesConsumed() const { return m_consumed; }
+
+    /**
+     * @return what has been charged for the value so far, and its limit.
+     */
+    Bencode::MemoryBudget &memoryBudget() { return *m_budget; }
+
+    /**
+     * Charges @p budget, which must outlive the parser, instead of the
+     * parser's own budget.  Several parsers can then share one, as long
+     * as they are used on the same thread.
+     */
+    void setMemoryBudget(Bencode::MemoryBudget *budget) { m_budget = budget; }
+
+private:
+    Q_DISABLE_COPY(PushParser)
+
+    enum State {
+        ExpectValue,  // Between values
+        IntDigits,    // After 'i', before 'e'
+        StringLength, // In the length prefix of a string
+        StringData,   // In the bytes of a string
+        Complete      // Finished the top-level value
+    };
+
+    struct Frame
+    {
+        BList::Ptr list;
+        BDict::Ptr dict;
+        QByteArray key;
+        bool haveKey;
+    };
+
+    void checkDepth() const;
+    bool startsString(char c) const;
+    void chargeNode(size_t size);
+    void appendToken(const char *data, size_t size);
+    void appendCapture(const char *data, size_t size);
+    void startValue(char c, const char *end);
+    void finishString(const QByteArray &data, const char *end);
+    void finishValue(const BBase::Ptr &value, const char *end);
+
+    State m_state;
+    QByteArray m_token;     // Digits of an integer or string length
+    QByteArray m_string;    // String data split between calls to feed()
+    quint32 m_remaining;    // String bytes still to come
+    QVector<Frame> m_stack; // Open containers, innermost last
+    BBase::Ptr m_root;
+    quint64 m_consumed;
+
+    QByteArray m_captureKey;
+    QByteArray m_captured;
+    bool m_capturing;
+    const char *m_captureFrom; // Start of capture in the current input
+
+    Bencode::MemoryBudget m_ownBudget;
+    Bencode::MemoryBudget *m_budget;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,60 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_QTSINKS_H
+#define TORRENT_ANALYZER_QTSINKS_H
+
+#include "core/bytesink.h"
+
+#include <QtCore/QByteArray>
+
+class QIODevice;
+
+/**
+ * A Bencode::ByteSink appending to a QByteArray, which must outlive it.
+ */
+class ByteArraySink : public Bencode::ByteSink
+{
+public:
+    explicit ByteArraySink(QByteArray &data) : m_data(data) { }
+
+    virtual bool write(const char *data, std::size_t size);
+    virtual void reserve(std::size_t size);
+
+private:
+    QByteArray &m_data;
+};
+
+/**
+ * A Bencode::ByteSink writing to a QIODevice, which must be open for
+ * writing and outlive it.
+ */
+class DeviceSink : public Bencode::ByteSink
+{
+public:
+    explicit DeviceSink(QIODevice &device) : m_device(device) { }
+
+    virtual bool write(const char *data, std::size_t size);
+
+private:
+    QIODevice &m_device;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "resume_analyzer.h"
+#include "resume_analyzer_factory.h"
+#include "torrent_analyzer.h"
+#include "bytestream.h"
+#include "tracing.h"
+#include "utf8.h"
+
+#include <strigi/analysisresult.h>
+#include <strigi/streambase.h>
+
+#include <QtCore/QByteArray>
+
+ResumeThroughAnalyzer::ResumeThroughAnalyzer(const ResumeThroughAnalyzerFactory *f)
+  : m_factory(f)
+{
+}
+
+Strigi::InputStream *ResumeThroughAnalyzer::connectInputStream(Strigi::InputStream *input)
+{
+    if(!input)
+        return input;
+
+    // Anything else is left to the torrent analyzer, rather than every
+    // b-encoded file being read twice.
+    const std::string &fileName = m_analysisResult->fileName();
+    if(!isResumeFileName(QByteArray(fileName.data(), fileName.size())))
+        return input;
+
+    TORRENT_TRACE_SPAN("analyzeResume");
+    TORRENT_TRACE_DETAIL(m_analysisResult->path().c_str());
+
+    m_stats = AnalyzerStats();
+    m_stats.add(AnalyzerStats::ResumeFilesSeen);
+
+    // Entries are handed over as they are read, so the stream is read a
+    // block at a time however big the file is.
+    ByteStream stream(input);
+
+    try {
+        ++stream; // Read first character
+
+        if(*stream == 'd' && extractResumeEntries(stream, *this) != NotResumeData)
+            m_stats.add(AnalyzerStats::ResumeFilesAnalyzed);
+        else
+            m_stats.add(AnalyzerStats::ResumeFilesRejected);
+    }
+    // Don't allow exceptions to propagate out
+    catch(...) {
+        m_stats.add(AnalyzerStats::ExceptionsCaught);
+        m_stats.add(AnalyzerStats::ResumeFilesRejected);
+    }
+
+    m_stats.add(AnalyzerStats::BytesRead, stream.bytesRead());
+    m_stats.add(AnalyzerStats::BufferRefills, stream.refillCount());
+    AnalyzerStats::record(m_stats);
+
+    {
+        TORRENT_TRACE_SPAN("reset");
+        input->reset(0); // Reposition to beginning
+    }
+
+    return input;
+}
+
+void ResumeThroughAnalyzer::addEntry(const ResumeEntry &entry)
+{
+    TORRENT_TRACE_SPAN("addEntry");
+
+    // Every field gets a value for every entry, so that the n-th values
+    // of each belong together.
+    const QByteArray name = Utf8::fromLegacy(entry.name);
+    const QByteArray savePath = Utf8::fromLegacy(entry.savePath);
+    const QByteArray infoHash = entry.infoHash.toHex();
+
+    m_analysisResult->addValue(m_factory->nameField, name.constData(), name.size());
+    m_analysisResult->addValue(m_factory->savePath, savePath.constData(), savePath.size());
+    m_analysisResult->addValue(m_factory->infoHash, infoHash.constData(), infoHash.size());
+    addIntegerValue(m_analysisResult, m_factory->size, entry.totalBytes);
+    m_analysisResult->addValue(m_factory->completion, entry.completion());
+
+    m_stats.add(AnalyzerStats::ResumeEntries);
+    m_stats.add(AnalyzerStats::FieldsEmitted, 5);
+}
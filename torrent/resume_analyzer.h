@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef RESUME_ANALYZER_H
+#define RESUME_ANALYZER_H
+
+#include <strigi/streamthroughanalyzer.h>
+
+#include "analyzerstats.h"
+#include "resumedata.h"
+
+class ResumeThroughAnalyzerFactory;
+
+/**
+ * Indexes the resume data BitTorrent clients keep their state in, with
+ * one value of each field per torrent, in the order of the file.  Only
+ * streams named like resume data are read, see isResumeFileName().
+ */
+class ResumeThroughAnalyzer : public Strigi::StreamThroughAnalyzer,
+                              private ResumeEntrySink
+{
+public:
+    ResumeThroughAnalyzer(const ResumeThroughAnalyzerFactory *f);
+
+    virtual const char *name() const { return "ResumeThroughAnalyzer"; }
+    virtual bool isReadyWithStream() { return true; }
+
+    virtual Strigi::InputStream *connectInputStream(Strigi::InputStream *input);
+
+    virtual void setIndexable(Strigi::AnalysisResult *result) {
+        m_analysisResult = result;
+    }
+
+private:
+    // ResumeEntrySink
+    virtual void addEntry(const ResumeEntry &entry);
+
+    const ResumeThroughAnalyzerFactory *m_factory;
+    Strigi::AnalysisResult *m_analysisResult;
+    AnalyzerStats m_stats; // Of the stream being analyzed
+};
+
+#endif
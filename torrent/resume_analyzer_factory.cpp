@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "resume_analyzer_factory.h"
+#include "resume_analyzer.h"
+
+// One value of each per torrent, see ResumeThroughAnalyzer.
+const std::string ResumeThroughAnalyzerFactory::nameFieldName
+("torrent.resume.name");
+const std::string ResumeThroughAnalyzerFactory::savePathFieldName
+("torrent.resume.savepath");
+const std::string ResumeThroughAnalyzerFactory::infoHashFieldName
+("torrent.resume.infohash");
+const std::string ResumeThroughAnalyzerFactory::sizeFieldName
+("torrent.resume.size");
+const std::string ResumeThroughAnalyzerFactory::completionFieldName
+("torrent.resume.completion");
+
+ResumeThroughAnalyzerFactory::ResumeThroughAnalyzerFactory()
+  : nameField(0), savePath(0), infoHash(0), size(0), completion(0)
+{
+}
+
+void ResumeThroughAnalyzerFactory::registerFields(Strigi::FieldRegister &fields)
+{
+    nameField  = fields.registerField(nameFieldName);
+    savePath   = fields.registerField(savePathFieldName);
+    infoHash   = fields.registerField(infoHashFieldName);
+    size       = fields.registerField(sizeFieldName);
+    completion = fields.registerField(completionFieldName);
+}
+
+Strigi::StreamThroughAnalyzer *ResumeThroughAnalyzerFactory::newInstance() const
+{
+    return new ResumeThroughAnalyzer(this);
+}
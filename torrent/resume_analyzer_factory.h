@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef RESUME_ANALYZER_FACTORY
+#define RESUME_ANALYZER_FACTORY
+
+#include <strigi/streamthroughanalyzer.h>
+#include <strigi/fieldtypes.h>
+
+#include <string>
+
+class ResumeThroughAnalyzerFactory : public Strigi::StreamThroughAnalyzerFactory
+{
+    friend class ResumeThroughAnalyzer;
+
+public:
+    ResumeThroughAnalyzerFactory();
+
+private:
+
+    static const std::string nameFieldName;
+    static const std::string savePathFieldName;
+    static const std::string infoHashFieldName;
+    static const std::string sizeFieldName;
+    static const std::string completionFieldName;
+
+    const Strigi::RegisteredField *nameField;
+    const Strigi::RegisteredField *savePath;
+    const Strigi::RegisteredField *infoHash;
+    const Strigi::RegisteredField *size;
+    const Strigi::RegisteredField *completion;
+
+    const char *name() const {
+        return "ResumeThroughAnalyzer";
+    }
+
+    Strigi::StreamThroughAnalyzer *newInstance() const;
+    void registerFields(Strigi::FieldRegister &fields);
+};
+
+#endif
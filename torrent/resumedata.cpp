@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "resumedata.h"
+#include "bytestream.h"
+#include "tracing.h"
+
+#include <stdexcept>
+#include <string>
+
+// Bitfields are counted in blocks of at most this, so that one straddling
+// two reads is never copied whole.
+static const unsigned int pieceBlockSize = 64 * 1024;
+
+ResumeEntry::ResumeEntry()
+{
+    clear();
+}
+
+void ResumeEntry::clear()
+{
+    name.clear();
+    savePath.clear();
+    infoHash.clear();
+    totalBytes = -1;
+    downloaded = -1;
+    uploaded = -1;
+    completedOn = -1;
+    piecesHave = -1;
+    pieceSlots = -1;
+}
+
+double ResumeEntry::completion() const
+{
+    if(completedOn > 0)
+        return 1.0;
+    if(pieceSlots <= 0)
+        return -1.0;
+
+    return double(piecesHave) / double(pieceSlots);
+}
+
+ResumeEntrySink::~ResumeEntrySink()
+{
+}
+
+bool isResumeFileName(const QByteArray &fileName)
+{
+    const QByteArray name = fileName.toLower();
+    return name == "resume.dat" || name.startsWith("resume.dat.") || name.endsWith(".fastresume");
+}
+
+// The keys of both formats are read by the same code, since they hardly
+// overlap: µTorrent's on the left, libtorrent's on the right.
+//
+//                 name              string
+//   path          save_path         string
+//   info          info-hash         20-byte string
+//   downloaded    total_downloaded  integer
+//   uploaded      total_uploaded    integer
+//   completed_on  completed_time    integer
+//   have          pieces            bitfield / a byte per piece
+//                 file_sizes        list of [size, mtime] lists
+namespace {
+
+struct ResumeReader
+{
+    explicit ResumeReader(ByteStream &s) : stream(s), decoder(s.decoder()) { }
+
+    ByteStream &stream;
+    Bencode::Decoder &decoder;
+    std::string scratch;
+};
+
+bool isStringStart(char c)
+{
+    return c != 'l' && c != 'i' && c != 'd' && c != 'e';
+}
+
+void readString(ResumeReader &reader, QByteArray &value)
+{
+    if(isStringStart(reader.decoder.current()))
+        reader.stream.readString(value);
+    else {
+        value.clear();
+        reader.decoder.skipValue();
+    }
+}
+
+void readInt(ResumeReader &reader, qlonglong &value)
+{
+    if(reader.decoder.current() == 'i')
+        value = reader.decoder.readInt();
+    else
+        reader.decoder.skipValue();
+}
+
+int bitsSet(unsigned char byte)
+{
+    int count = 0;
+    for(; byte; byte &= byte - 1)
+        ++count;
+    return count;
+}
+
+// Counts the pieces in the string at the current position: set bits if
+// @p isBitfield, otherwise bytes with their lowest bit set.
+void countPieces(ResumeReader &reader, bool isBitfield, ResumeEntry &entry)
+{
+    Bencode::Decoder &decoder = reader.decoder;
+
+    if(!isStringStart(decoder.current())) {
+        decoder.skipValue();
+        return;
+    }
+
+    unsigned int left = decoder.readLength();
+    qlonglong have = 0;
+
+    entry.pieceSlots = isBitfield ? 8 * qlonglong(left) : qlonglong(left);
+
+    while(left > 0) {
+        const unsigned int count = left < pieceBlockSize ? left : pieceBlockSize;
+        const Bencode::ByteSpan block = decoder.readBytes(count, reader.scratch);
+
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(block.data());
+        const unsigned char *end = p + block.size();
+        if(isBitfield) {
+            for(; p < end; ++p)
+                have += bitsSet(*p);
+        }
+        else {
+            for(; p < end; ++p)
+                have += *p & 1;
+        }
+
+        left -= count;
+    }
+
+    entry.piecesHave = have;
+}
+
+// Adds up the first element of each list in the list at the current
+// position.  The total is only kept if every file has a size.
+void sumFileSizes(ResumeReader &reader, ResumeEntry &entry)
+{
+    Bencode::Decoder &decoder = reader.decoder;
+
+    if(decoder.current() != 'l') {
+        decoder.skipValue();
+        return;
+    }
+
+    Bencode::Decoder::Nesting nesting(decoder);
+    decoder.countNode(Bencode::Decoder::ListNode);
+    decoder.advance();
+
+    qlonglong total = 0;
+    bool allHaveSize = true;
+
+    while(decoder.current() != 'e') {
+        if(decoder.current() != 'l') {
+            allHaveSize = false;
+            decoder.skipValue();
+            continue;
+        }
+
+        Bencode::Decoder::Nesting fileNesting(decoder);
+        decoder.countNode(Bencode::Decoder::ListNode);
+        decoder.advance();
+
+        if(decoder.current() == 'i') {
+            const qlonglong size = decoder.readInt();
+            if(size >= 0 && total <= Q_INT64_C(0x7fffffffffffffff) - size)
+                total += size;
+            else
+                allHaveSize = false;
+        }
+        else
+            allHaveSize = false;
+
+        while(decoder.current() != 'e')
+            decoder.skipValue();
+        decoder.advance();
+    }
+
+    decoder.advance();
+
+    if(allHaveSize)
+        entry.totalBytes = total;
+}
+
+// Reads the value of @p key into @p entry if it is one of the keys above,
+// otherwise skips it.
+void readField(ResumeReader &reader, const Bencode::ByteSpan &key, ResumeEntry &entry)
+{
+    if(key == "name")
+        readString(reader, entry.name);
+    else if(key == "path" || key == "save_path")
+        readString(reader, entry.savePath);
+    else if(key == "info" || key == "info-hash") {
+        readString(reader, entry.infoHash);
+        if(entry.infoHash.size() != 20)
+            entry.infoHash.clear();
+    }
+    else if(key == "downloaded" || key == "total_downloaded")
+        readInt(reader, entry.downloaded);
+    else if(key == "uploaded" || key == "total_uploaded")
+        readInt(reader, entry.uploaded);
+    else if(key == "completed_on" || key == "completed_time")
+        readInt(reader, entry.completedOn);
+    else if(key == "have")
+        countPieces(reader, true, entry);
+    else if(key == "pieces")
+        countPieces(reader, false, entry);
+    else if(key == "file_sizes")
+        sumFileSizes(reader, entry);
+    else
+        reader.decoder.skipValue();
+}
+
+// Reads the dictionary at the current position into @p entry.
+void readEntry(ResumeReader &reader, ResumeEntry &entry)
+{
+    TORRENT_TRACE_SPAN("readEntry");
+
+    Bencode::Decoder &decoder = reader.decoder;
+    Bencode::Decoder::Nesting nesting(decoder);
+
+    decoder.countNode(Bencode::Decoder::DictNode);
+    decoder.advance();
+
+    while(decoder.current() != 'e') {
+        // The key is only looked at before the value is read, so it may
+        // point into the scratch space the value reuses.
+        const Bencode::ByteSpan key = decoder.readString(reader.scratch);
+        readField(reader, key, entry);
+    }
+
+    decoder.advance();
+}
+
+}
+
+ResumeFormat extractResumeEntries(ByteStream &stream, ResumeEntrySink &sink)
+{
+    TORRENT_TRACE_SPAN("extractResumeEntries");
+
+    Bencode::Decoder &decoder = stream.decoder();
+    if(decoder.current() != 'd')
+        throw std::runtime_error("Trying to read dictionary, but this isn't a dictionary");
+
+    Bencode::Decoder::Nesting nesting(decoder);
+    decoder.countNode(Bencode::Decoder::DictNode);
+    decoder.advance();
+
+    ResumeReader reader(stream);
+    ResumeEntry fastResume, entry;
+    QByteArray key, format;
+    int entries = 0;
+
+    Bencode::MemoryBudget &budget = stream.memoryBudget();
+
+    while(decoder.current() != 'e') {
+        const quint64 used = budget.used();
+
+        stream.readString(key);
+        const Bencode::ByteSpan keySpan(key.constData(), key.size());
+
+        if(decoder.current() == 'd') {
+            entry.clear();
+            entry.name = key;
+            readEntry(reader, entry);
+
+            if(!entry.infoHash.isEmpty()) {
+                sink.addEntry(entry);
+                ++entries;
+            }
+        }
+        else if(keySpan == "file-format")
+            readString(reader, format);
+        else
+            readField(reader, keySpan, fastResume);
+
+        // Strings are read into the same buffers over and over, so what
+        // an entry charged is free again once it is done with.  A
+        // .fastresume keeps its top-level values, but those are few.
+        budget.release(budget.used() - used);
+    }
+
+    decoder.advance();
+
+    if(format == "libtorrent resume file") {
+        sink.addEntry(fastResume);
+        return FastResume;
+    }
+
+    return entries > 0 ? ResumeDat : NotResumeData;
+}
+
+// vim: set et sw=4 ts=4:
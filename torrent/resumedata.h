@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_RESUMEDATA_H
+#define TORRENT_ANALYZER_RESUMEDATA_H
+
+#include <QtCore/QByteArray>
+
+class ByteStream;
+
+/**
+ * A summary of one torrent in a BitTorrent client's resume data.  Values
+ * the file doesn't give are left empty or -1.
+ */
+struct ResumeEntry
+{
+    ResumeEntry();
+
+    /**
+     * Empties every value, keeping the memory of the strings.
+     */
+    void clear();
+
+    /**
+     * @return how much of the torrent the client has, from 0 to 1, or -1
+     * if the file doesn't say.  A torrent marked as completed counts as
+     * 1 whatever its pieces say, since a bitfield has room for up to 7
+     * pieces more than the torrent has.
+     */
+    double completion() const;
+
+    QByteArray name;       /**< resume.dat key (a .torrent file name), or a .fastresume "name" */
+    QByteArray savePath;   /**< Where the content is saved, as written in the file */
+    QByteArray infoHash;   /**< The 20-byte SHA-1 info-hash, not hex-encoded */
+    qlonglong totalBytes;  /**< Sum of the file sizes */
+    qlonglong downloaded;  /**< Bytes downloaded over the torrent's lifetime */
+    qlonglong uploaded;    /**< Bytes uploaded over the torrent's lifetime */
+    qlonglong completedOn; /**< Seconds since the epoch, 0 if not completed */
+    qlonglong piecesHave;  /**< Pieces the client has */
+    qlonglong pieceSlots;  /**< Pieces the file has room to record */
+};
+
+/**
+ * Receives the entries found by extractResumeEntries().
+ */
+class ResumeEntrySink
+{
+public:
+    virtual ~ResumeEntrySink();
+
+    /**
+     * Adds one torrent.  @p entry is reused for the next one once this
+     * returns.
+     */
+    virtual void addEntry(const ResumeEntry &entry) = 0;
+};
+
+/**
+ * The kinds of resume data extractResumeEntries() recognizes.
+ */
+enum ResumeFormat {
+    NotResumeData, /**< Neither of the formats below. */
+    FastResume,    /**< libtorrent's .fastresume, one torrent per file. */
+    ResumeDat      /**< µTorrent's resume.dat, a dictionary of torrents. */
+};
+
+/**
+ * Decodes a client's resume data from @p stream and hands a summary of
+ * each torrent in it to @p sink.  @p stream should already be positioned
+ * at the first character.
+ *
+ * A .fastresume file is recognized by its "file-format" of "libtorrent
+ * resume file", and its one entry is added once the whole file is read.
+ * A resume.dat entry is any dictionary at the top level with a 20-byte
+ * info-hash under "info", and is added as soon as it has been read.
+ *
+ * Only the values of the summary are kept, and piece bitfields are
+ * counted a block at a time as they are read, so the memory used doesn't
+ * grow with the number of torrents or pieces.
+ *
+ * An exception is thrown if the data is not a valid b-encoded dictionary.
+ *
+ * @return the format found
+ */
+ResumeFormat extractResumeEntries(ByteStream &stream, ResumeEntrySink &sink);
+
+/**
+ * @return true if @p fileName is that of a resume data file: resume.dat
+ * (and its backups, such as resume.dat.old) or anything ending in
+ * .fastresume.  Only these are read by the resume analyzer, and the
+ * torrent analyzer leaves them alone.
+ */
+bool isResumeFileName(const QByteArray &fileName);
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,135 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "analyzerstats.h"
+#include "resume_analyzer_factory.h"
+#include "torrent_analyzer_factory.h"
+
+#include <strigi/analysisresult.h>
+#include <strigi/analyzerconfiguration.h>
+#include <strigi/indexwriter.h>
+#include <strigi/streamanalyzer.h>
+#include <strigi/stringstream.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+class AnalyzerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testTorrent();
+    void testResumeFileSkipped();
+};
+
+/**
+ * Counts the values added to it and keeps nothing else.
+ */
+class CountingIndexWriter : public Strigi::IndexWriter
+{
+public:
+    CountingIndexWriter() : values(0) { }
+
+    virtual void deleteEntries(const std::vector<std::string> &) { }
+    virtual void deleteAllEntries() { }
+
+    int values;
+
+protected:
+    virtual void startAnalysis(const Strigi::AnalysisResult *) { }
+    virtual void addText(const Strigi::AnalysisResult *, const char *, int32_t) { }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const std::string &) { ++values; }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const unsigned char *, uint32_t) { ++values; }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, int32_t) { ++values; }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, uint32_t) { ++values; }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *, double) { ++values; }
+    virtual void addValue(const Strigi::AnalysisResult *, const Strigi::RegisteredField *,
+                          const std::string &, const std::string &) { ++values; }
+    virtual void addTriplet(const std::string &, const std::string &, const std::string &) { }
+    virtual void finishAnalysis(const Strigi::AnalysisResult *) { }
+};
+
+// A valid torrent, which the torrent analyzer would take fields from
+// whatever it was called.
+static const QByteArray torrentData(
+    "d8:announce27:http://tracker.example.org/4:infod6:lengthi1000e4:name4:test"
+    "12:piece lengthi16384e6:pieces20:xxxxxxxxxxxxxxxxxxxxee");
+
+// Runs the analyzer from @p factory on torrentData as if it had been
+// found at @p path.
+//
+// @return the number of values it added
+static int analyze(Strigi::StreamThroughAnalyzerFactory &factory, const char *path)
+{
+    Strigi::AnalyzerConfiguration configuration;
+    Strigi::StreamAnalyzer streamAnalyzer(configuration);
+    factory.registerFields(configuration.fieldRegister());
+
+    CountingIndexWriter writer;
+    Strigi::StringInputStream stream(torrentData.constData(), torrentData.size(), false);
+    Strigi::AnalysisResult result(path, 0, writer, streamAnalyzer);
+
+    Strigi::StreamThroughAnalyzer *analyzer = factory.newInstance();
+    analyzer->setIndexable(&result);
+    analyzer->connectInputStream(&stream);
+    delete analyzer;
+
+    return writer.values;
+}
+
+void AnalyzerTest::testTorrent()
+{
+    TorrentThroughAnalyzerFactory factory;
+    const quint64 seen = AnalyzerStats::collect().counter(AnalyzerStats::StreamsSeen);
+
+    QVERIFY(analyze(factory, "/test/test.torrent") > 0);
+    QCOMPARE(AnalyzerStats::collect().counter(AnalyzerStats::StreamsSeen), seen + 1);
+}
+
+void AnalyzerTest::testResumeFileSkipped()
+{
+    TorrentThroughAnalyzerFactory torrentFactory;
+    ResumeThroughAnalyzerFactory resumeFactory;
+    const char *const paths[] = {
+        "/test/resume.dat",
+        "/test/RESUME.DAT.old",
+        "/test/0123456789abcdef.fastresume"
+    };
+
+    for(unsigned i = 0; i < sizeof paths / sizeof *paths; ++i) {
+        const AnalyzerStats before = AnalyzerStats::collect();
+
+        QCOMPARE(analyze(torrentFactory, paths[i]), 0);
+        analyze(resumeFactory, paths[i]);
+
+        const AnalyzerStats after = AnalyzerStats::collect();
+        QCOMPARE(after.counter(AnalyzerStats::StreamsSeen),
+                 before.counter(AnalyzerStats::StreamsSeen));
+        QCOMPARE(after.counter(AnalyzerStats::ResumeFilesSeen),
+                 before.counter(AnalyzerStats::ResumeFilesSeen) + 1);
+    }
+}
+
+QTEST_KDEMAIN_CORE(AnalyzerTest)
+
+#include "analyzertest.moc"
@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "bytestream.h"
+
+#include "core/bytespan.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+class ByteStreamTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testStringInside();
+    void testStringAtEnd();
+};
+
+// Whether @p value is a view of @p data rather than a copy.
+static bool pointsInto(const QByteArray &value, const QByteArray &data)
+{
+    return value.constData() >= data.constData()
+        && value.constData() + value.size() <= data.constData() + data.size();
+}
+
+void ByteStreamTest::testStringInside()
+{
+    const QByteArray data("l4:spame");
+    ByteStream stream(Bencode::ByteSpan(data.constData(), data.size()));
+
+    ++stream;
+    ++stream;
+    QByteArray value;
+    stream.readString(value);
+
+    QCOMPARE(value, QByteArray("spam"));
+    QVERIFY(pointsInto(value, data));
+}
+
+void ByteStreamTest::testStringAtEnd()
+{
+    // Ending with the data, the string is copied by the decoder, so the
+    // view mustn't be taken from where that copy is.
+    const QByteArray data("d4:name4:spam");
+    ByteStream stream(Bencode::ByteSpan(data.constData(), data.size()));
+
+    ++stream;
+    ++stream;
+    QByteArray value;
+    stream.readString(value);
+    QCOMPARE(value, QByteArray("name"));
+
+    stream.readString(value);
+    QCOMPARE(value, QByteArray("spam"));
+    QVERIFY(pointsInto(value, data));
+}
+
+QTEST_KDEMAIN_CORE(ByteStreamTest)
+
+#include "bytestreamtest.moc"
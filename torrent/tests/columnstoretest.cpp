@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "columnstore.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QTemporaryFile>
+
+#include <qtest_kde.h>
+
+class ColumnStoreTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAppend();
+    void testPartialFirstSegment();
+    void testPartialHeader();
+    void testPartialLastSegment();
+    void testNotAStore();
+};
+
+static TorrentRecord makeRecord(int i)
+{
+    TorrentRecord record;
+    record.infoHash[0] = char(i);
+    record.name = "torrent " + QByteArray::number(i);
+    record.tracker = i % 2 ? "tracker.example.org" : "";
+    record.length = i * 1000;
+    record.numFiles = i;
+    return record;
+}
+
+// Writes @p count records to @p fileName, appending to what is there.
+static bool writeRecords(const QString &fileName, int count)
+{
+    ColumnStoreWriter writer(fileName);
+    if(!writer.open())
+        return false;
+
+    for(int i = 0; i < count; ++i)
+        writer.add(makeRecord(i));
+
+    return writer.finish();
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return file.readAll();
+}
+
+static bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+           file.write(data) == data.size();
+}
+
+static quint64 rowCount(const QString &fileName)
+{
+    ColumnStore store;
+    return store.open(fileName) ? store.rowCount() : quint64(-1);
+}
+
+void ColumnStoreTest::testAppend()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+
+    QVERIFY(writeRecords(file.fileName(), 3));
+    QVERIFY(writeRecords(file.fileName(), 2));
+
+    ColumnStore store;
+    QVERIFY(store.open(file.fileName()));
+    QCOMPARE(store.segments().count(), 2);
+    QCOMPARE(store.rowCount(), quint64(5));
+    QCOMPARE(store.segments().at(1).name(1), QByteArray("torrent 1"));
+}
+
+void ColumnStoreTest::testPartialFirstSegment()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeRecords(file.fileName(), 3));
+
+    // As if the first export had crashed in the middle of its segment.
+    const QByteArray whole = readFile(file.fileName());
+    QVERIFY(writeFile(file.fileName(), whole.left(whole.size() / 2)));
+
+    QVERIFY(writeRecords(file.fileName(), 2));
+    QCOMPARE(rowCount(file.fileName()), quint64(2));
+}
+
+void ColumnStoreTest::testPartialHeader()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeRecords(file.fileName(), 3));
+
+    // Not even the version made it out.
+    const QByteArray whole = readFile(file.fileName());
+    QVERIFY(writeFile(file.fileName(), whole.left(3)));
+
+    QVERIFY(writeRecords(file.fileName(), 2));
+    QCOMPARE(rowCount(file.fileName()), quint64(2));
+}
+
+void ColumnStoreTest::testPartialLastSegment()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeRecords(file.fileName(), 3));
+    const int firstSize = readFile(file.fileName()).size();
+    QVERIFY(writeRecords(file.fileName(), 4));
+
+    const QByteArray whole = readFile(file.fileName());
+    QVERIFY(writeFile(file.fileName(), whole.left(firstSize + 10)));
+
+    QVERIFY(writeRecords(file.fileName(), 2));
+    QCOMPARE(rowCount(file.fileName()), quint64(5));
+}
+
+void ColumnStoreTest::testNotAStore()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+
+    const QByteArray data("d8:announce3:urle");
+    QVERIFY(writeFile(file.fileName(), data));
+
+    ColumnStoreWriter writer(file.fileName());
+    QVERIFY(!writer.open());
+    QCOMPARE(readFile(file.fileName()), data);
+}
+
+QTEST_KDEMAIN_CORE(ColumnStoreTest)
+
+#include "columnstoretest.moc"
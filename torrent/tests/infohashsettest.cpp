@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "infohashset.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+class InfoHashSetTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDuplicate();
+    void testPathCapacity();
+};
+
+// A made up SHA-1 info-hash, different for every @p n.
+static QByteArray infoHash(int n)
+{
+    QByteArray hash(20, '\0');
+    hash[0] = char(n);
+    hash[1] = char(n >> 8);
+    hash[7] = 1;
+    return hash;
+}
+
+void InfoHashSetTest::testDuplicate()
+{
+    InfoHashSet set(16, 1024);
+
+    QByteArray original;
+    QVERIFY(!set.insert(infoHash(1), "/a.torrent"));
+    QVERIFY(!set.insert(infoHash(1), "/a.torrent"));
+    QVERIFY(set.insert(infoHash(1), "/b.torrent", &original));
+    QCOMPARE(original, QByteArray("/a.torrent"));
+    QCOMPARE(set.count(), 1U);
+}
+
+void InfoHashSetTest::testPathCapacity()
+{
+    // Room for three paths of 10 bytes and their 0 bytes, no more,
+    // however many hashes the table could take.
+    InfoHashSet set(1000, 33);
+
+    for(int i = 0; i < 5; ++i)
+        QVERIFY(!set.insert(infoHash(i), "/" + QByteArray::number(i) + ".torrent"));
+    QCOMPARE(set.count(), 3U);
+
+    // Hashes that didn't fit aren't known, those that did still are.
+    QVERIFY(!set.insert(infoHash(4), "/copy.torrent"));
+    QVERIFY(set.insert(infoHash(2), "/copy.torrent"));
+}
+
+QTEST_KDEMAIN_CORE(InfoHashSetTest)
+
+#include "infohashsettest.moc"
@@ -0,0 +1,187 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "bdict.h"
+#include "bytestream.h"
+#include "parallelparser.h"
+#include "pushparser.h"
+#include "torrentfields.h"
+
+#include <strigi/stringstream.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+class MemoryLimitTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testWithinLimit();
+    void testTree();
+    void testPushParser();
+    void testParallel();
+    void testExtraction();
+};
+
+// Low enough that the nodes of bigTorrent() go over it, though its
+// strings alone don't.
+static const quint64 memoryLimit = 16 * 1024 * 1024;
+
+static QByteArray makeTorrent(int files)
+{
+    QByteArray data("d8:announce27:http://tracker.example.org/4:infod5:filesl");
+
+    for(int i = 0; i < files; ++i) {
+        const QByteArray name = "file" + QByteArray::number(i).rightJustified(6, '0');
+        data += "d6:lengthi" + QByteArray::number(i + 1) + "e4:pathl" +
+                QByteArray::number(name.size()) + ':' + name + "ee";
+    }
+
+    data += "e4:name4:test12:piece lengthi16384e6:pieces20:";
+    data += QByteArray(20, 'x');
+    data += "ee";
+    return data;
+}
+
+// Over 4 MB, the size at which the analyzer once went through
+// parseTorrentInParallel().
+static QByteArray bigTorrent()
+{
+    static const QByteArray data = makeTorrent(200000);
+    return data;
+}
+
+class CountingSink : public TorrentFieldSink
+{
+public:
+    CountingSink() : values(0) { }
+
+    virtual void addValue(Field, const QByteArray &) { ++values; }
+    virtual void addValue(Field, qlonglong) { ++values; }
+
+    int values;
+};
+
+static bool parsesTree(const QByteArray &data)
+{
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    ByteStream stream(&input);
+    QByteArray infoData;
+
+    try {
+        ++stream;
+        BDict dict(stream, "info", &infoData);
+        return true;
+    }
+    catch(const memory_limit_exceeded &) {
+        return false;
+    }
+}
+
+static bool parsesPushed(const QByteArray &data)
+{
+    PushParser parser("info");
+
+    try {
+        for(int i = 0; i < data.size(); i += 4096)
+            parser.feed(data.mid(i, 4096));
+        return bool(parser.finish());
+    }
+    catch(const memory_limit_exceeded &) {
+        return false;
+    }
+}
+
+static bool parsesInParallel(const QByteArray &data)
+{
+    QByteArray infoData;
+
+    try {
+        return bool(parseTorrentInParallel(data, &infoData, 16));
+    }
+    catch(const memory_limit_exceeded &) {
+        return false;
+    }
+}
+
+// Extracts the fields with at most @p limit bytes in use.
+static bool extracts(const QByteArray &data, quint64 limit)
+{
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    ByteStream stream(&input);
+    stream.memoryBudget().setLimit(limit);
+    CountingSink sink;
+
+    try {
+        ++stream;
+        return extractTorrentFields(stream, sink) == FieldsExtracted && sink.values > 0;
+    }
+    catch(const memory_limit_exceeded &) {
+        return false;
+    }
+}
+
+void MemoryLimitTest::initTestCase()
+{
+    qputenv("STRIGI_TORRENT_MEMORY_LIMIT", QByteArray::number(memoryLimit));
+    QCOMPARE(ByteStream::defaultMemoryLimit(), memoryLimit);
+    QVERIFY(bigTorrent().size() > 4 * 1024 * 1024);
+}
+
+void MemoryLimitTest::testWithinLimit()
+{
+    const QByteArray data = makeTorrent(1000);
+
+    QVERIFY(parsesTree(data));
+    QVERIFY(parsesPushed(data));
+    QVERIFY(parsesInParallel(data));
+    QVERIFY(extracts(data, memoryLimit));
+}
+
+void MemoryLimitTest::testTree()
+{
+    QVERIFY(!parsesTree(bigTorrent()));
+}
+
+void MemoryLimitTest::testPushParser()
+{
+    QVERIFY(!parsesPushed(bigTorrent()));
+}
+
+void MemoryLimitTest::testParallel()
+{
+    QVERIFY(!parsesInParallel(bigTorrent()));
+}
+
+void MemoryLimitTest::testExtraction()
+{
+    const QByteArray data = bigTorrent();
+
+    // No tree is built, so this is well within the limit the trees go
+    // over, but the info dictionary is still kept to be hashed.
+    QVERIFY(extracts(data, memoryLimit));
+    QVERIFY(!extracts(data, data.size() / 2));
+}
+
+QTEST_KDEMAIN_CORE(MemoryLimitTest)
+
+#include "memorylimittest.moc"
@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "piecehashindex.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QTemporaryFile>
+
+#include <qtest_kde.h>
+
+class PieceHashIndexTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testFind();
+    void testFanoutNotFromZero();
+    void testFanoutBackwards();
+    void testFanoutPastCount();
+};
+
+// The fanout follows the header: magic, version, record count and the
+// offset of the torrent table.
+static const qint64 fanoutOffset = 4 + 4 + 8 + 8;
+
+static QByteArray makePieces(int count, char seed)
+{
+    QByteArray pieces;
+    for(int i = 0; i < count; ++i) {
+        QByteArray hash(20, seed);
+        hash[0] = char(i * 37);
+        hash[1] = char(i);
+        pieces += hash;
+    }
+
+    return pieces;
+}
+
+static bool writeIndex(const QString &fileName)
+{
+    PieceHashIndexWriter writer(fileName);
+    writer.addTorrent("a.torrent", 16384, makePieces(50, 'a'));
+    writer.addTorrent("b.torrent", 32768, makePieces(30, 'b'));
+    return writer.finish();
+}
+
+// Overwrites fanout entry @p entry of the index in @p fileName.
+static bool setFanout(const QString &fileName, int entry, quint64 value)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadWrite) &&
+           file.seek(fanoutOffset + entry * qint64(sizeof value)) &&
+           file.write(reinterpret_cast<const char *>(&value), sizeof value) == sizeof value;
+}
+
+void PieceHashIndexTest::testFind()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeIndex(file.fileName()));
+
+    PieceHashIndex index;
+    QVERIFY(index.open(file.fileName()));
+    QCOMPARE(index.count(), quint64(80));
+    QCOMPARE(index.torrentCount(), quint32(2));
+
+    const QByteArray pieces = makePieces(30, 'b');
+    const QList<PieceHashIndex::Location> found = index.find(pieces.constData() + 7 * 20);
+    QCOMPARE(found.count(), 1);
+    QCOMPARE(index.torrentName(found.first().torrent), QByteArray("b.torrent"));
+    QCOMPARE(found.first().piece, quint32(7));
+}
+
+void PieceHashIndexTest::testFanoutNotFromZero()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeIndex(file.fileName()));
+    QVERIFY(setFanout(file.fileName(), 0, 1));
+
+    PieceHashIndex index;
+    QVERIFY(!index.open(file.fileName()));
+}
+
+void PieceHashIndexTest::testFanoutBackwards()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeIndex(file.fileName()));
+    QVERIFY(setFanout(file.fileName(), 1000, Q_UINT64_C(0xffffffffffff)));
+
+    PieceHashIndex index;
+    QVERIFY(!index.open(file.fileName()));
+}
+
+void PieceHashIndexTest::testFanoutPastCount()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(writeIndex(file.fileName()));
+    QVERIFY(setFanout(file.fileName(), 65536, 81));
+
+    PieceHashIndex index;
+    QVERIFY(!index.open(file.fileName()));
+}
+
+QTEST_KDEMAIN_CORE(PieceHashIndexTest)
+
+#include "piecehashindextest.moc"
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "prefetchinputstream.h"
+
+#include <strigi/stringstream.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+class PrefetchInputStreamTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSmallMax();
+    void testMinAcrossBlocks();
+    void testMinPastEnd();
+};
+
+// Data which shows where any byte went missing or came twice.
+static QByteArray makeData(int size)
+{
+    QByteArray data(size, '\0');
+    for(int i = 0; i < size; ++i)
+        data[i] = char(i * 7 + i / 251);
+
+    return data;
+}
+
+// Reads all of @p stream with the given min and max, checking that no
+// read returns more than max.
+static QByteArray readAll(Strigi::InputStream &stream, int32_t min, int32_t max)
+{
+    QByteArray result;
+    const char *start;
+    int32_t count;
+
+    while((count = stream.read(start, min, max)) > 0) {
+        if(max > 0 && count > max)
+            return QByteArray("read returned more than max");
+        result.append(start, count);
+    }
+
+    return result;
+}
+
+void PrefetchInputStreamTest::testSmallMax()
+{
+    const QByteArray data = makeData(100000);
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    PrefetchInputStream stream(&input, 4096, 3);
+
+    QCOMPARE(readAll(stream, 1, 7), data);
+    QCOMPARE(stream.position(), qint64(data.size()));
+    QCOMPARE(stream.status(), Strigi::Eof);
+}
+
+void PrefetchInputStreamTest::testMinAcrossBlocks()
+{
+    const QByteArray data = makeData(100000);
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    PrefetchInputStream stream(&input, 4096, 3);
+
+    // Start part way into a block, so that every later read spans two
+    // or three of them.
+    const char *start;
+    QCOMPARE(stream.read(start, 1, 1000), int32_t(1000));
+
+    QByteArray result(start, 1000);
+    int32_t count;
+    while((count = stream.read(start, 10000, 10000)) > 0) {
+        if(result.size() + 10000 <= data.size())
+            QCOMPARE(count, int32_t(10000));
+        result.append(start, count);
+    }
+
+    QCOMPARE(result, data);
+}
+
+void PrefetchInputStreamTest::testMinPastEnd()
+{
+    const QByteArray data = makeData(5000);
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    PrefetchInputStream stream(&input, 4096, 3);
+
+    // Asking for more than there is gets what there is, then the end.
+    const char *start;
+    QCOMPARE(stream.read(start, 8000, 0), int32_t(data.size()));
+    QCOMPARE(QByteArray(start, data.size()), data);
+    QCOMPARE(stream.read(start, 1, 0), int32_t(-1));
+}
+
+QTEST_KDEMAIN_CORE(PrefetchInputStreamTest)
+
+#include "prefetchinputstreamtest.moc"
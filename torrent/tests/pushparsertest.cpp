@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+#include "bytestream.h"
+#include "parallelparser.h"
+#include "pushparser.h"
+
+#include <strigi/stringstream.h>
+
+#include <QtCore/QBuffer>
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <qtest_kde.h>
+
+#include <stdexcept>
+
+class PushParserTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSameAsPullParser();
+    void testParallelSameAsPullParser();
+};
+
+// Lengths the pull parser accepts although they don't start with a
+// digit, and others which it refuses, in every position.
+static const char *const inputs[] = {
+    "d+4:name4:spame",
+    "l 3:abce",
+    "d4:name +4:spam4:sizei3ee",
+    "d\t\n4:infod+6:lengthi1eee",
+    "l3:abc+0:e",
+    "d:4:spame",
+    "dx:abe",
+    "d4:namex:abe",
+    "l-1:ae",
+    "d4:name4:spam",
+    "d+4:name"
+};
+
+// What a parse came to: the tree written out again, or the kind of
+// exception thrown.
+static QByteArray outcome(BBase *value)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    value->writeToDevice(buffer);
+    return data;
+}
+
+static QByteArray pullParse(const QByteArray &data)
+{
+    Strigi::StringInputStream input(data.constData(), data.size(), false);
+    ByteStream stream(&input);
+
+    try {
+        ++stream;
+        switch(*stream) {
+            case 'd': { BDict dict(stream); return outcome(&dict); }
+            case 'l': { BList list(stream); return outcome(&list); }
+            case 'i': { BInt value(stream); return outcome(&value); }
+            default: { BString string(stream); return outcome(&string); }
+        }
+    }
+    catch(const end_of_stream &) {
+        return "end of stream";
+    }
+    catch(const std::runtime_error &) {
+        return "invalid";
+    }
+}
+
+// Feeds @p data to a PushParser @p pieceSize bytes at a time.
+static QByteArray pushParse(const QByteArray &data, int pieceSize)
+{
+    PushParser parser;
+
+    try {
+        for(int i = 0; i < data.size(); i += pieceSize)
+            parser.feed(data.mid(i, pieceSize));
+        return outcome(parser.finish().get());
+    }
+    catch(const end_of_stream &) {
+        return "end of stream";
+    }
+    catch(const std::runtime_error &) {
+        return "invalid";
+    }
+}
+
+void PushParserTest::testSameAsPullParser()
+{
+    for(unsigned i = 0; i < sizeof inputs / sizeof *inputs; ++i) {
+        const QByteArray data(inputs[i]);
+        const QByteArray expected = pullParse(data);
+
+        QCOMPARE(pushParse(data, data.size()), expected);
+        QCOMPARE(pushParse(data, 1), expected);
+    }
+
+    QCOMPARE(pullParse("d+4:name4:spame"), QByteArray("d4:name4:spame"));
+}
+
+void PushParserTest::testParallelSameAsPullParser()
+{
+    // Enough file entries to be split up, with lengths and keys written
+    // in every way the pull parser accepts.
+    QByteArray data("d 4:infod5:filesl");
+    for(int i = 0; i < 100; ++i)
+        data += "d+6:lengthi" + QByteArray::number(i) + "e4:pathl 4:file+1:" + char('a' + i % 26) + "ee";
+    data += "e+4:name4:testee";
+
+    const QByteArray expected = pullParse(data);
+    QVERIFY(expected != "invalid");
+
+    QByteArray infoData;
+    const BDict::Ptr dict = parseTorrentInParallel(data, &infoData, 16);
+    QVERIFY(dict);
+    QCOMPARE(outcome(dict.get()), expected);
+    QVERIFY(infoData.startsWith("d5:filesl"));
+}
+
+QTEST_KDEMAIN_CORE(PushParserTest)
+
+#include "pushparsertest.moc"
@@ -0,0 +1,700 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-columns: exports the fields of .torrent files to a column store
+// and runs aggregate reports over it, which takes seconds where parsing
+// the files again would take hours.
+//
+//   torrent-columns export [-j threads] <store> <path>...
+//   torrent-columns query [-j threads] [--where <condition>]...
+//                         [--group-by <column>] <store>
+//
+// export appends to the store, parsing each file with the analyzer's
+// extractor.  A condition is a column, an operator (= != < <= > >=) and
+// a value, as in 'length>=1073741824' or 'tracker=tracker.example.org'.
+// The columns are:
+//
+//   length        total size of the content
+//   files         number of files
+//   piece-length
+//   created       creation date, as seconds since the epoch or a UTC date
+//                 YYYY-MM-DD or YYYY-MM; torrents without one never match
+//   tracker       host of the announce URL, = and != only; empty for none
+//   year, month   of the creation date, for --group-by only
+//
+// Each group is written as a line of the group, the number of torrents,
+// their total length and their total number of files, separated by tabs.
+
+#include "torrentfile.h"
+#include "bytestream.h"
+#include "columnstore.h"
+#include "extractionplan.h"
+#include "torrentfields.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+
+#include <functional>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Export
+
+// Fills a TorrentRecord from the analyzer's fields.  The strings may point
+// into the mapped file, so they are copied.
+class RecordSink : public TorrentFieldSink
+{
+public:
+    explicit RecordSink(TorrentRecord &record) : m_record(record) { }
+
+    virtual void addValue(Field field, const QByteArray &value)
+    {
+        switch(field) {
+            case Announce:
+                m_record.tracker = ColumnStore::trackerOf(value);
+                break;
+            case Name:
+                m_record.name = QByteArray(value.constData(), value.size());
+                break;
+            case InfoHash: {
+                const QByteArray digest = QByteArray::fromHex(value);
+                memcpy(m_record.infoHash, digest.constData(), qMin(digest.size(), 20));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    virtual void addValue(Field field, qlonglong value)
+    {
+        switch(field) {
+            case CreationDate: m_record.creationDate = value; break;
+            case Length:       m_record.length = value; break;
+            case NumFiles:     m_record.numFiles = value; break;
+            case PieceLength:  m_record.pieceLength = value; break;
+            default:           break;
+        }
+    }
+
+private:
+    TorrentRecord &m_record;
+};
+
+class ExportJob : public QRunnable
+{
+public:
+    ExportJob(ColumnStoreWriter *writer, const ExtractionPlan *plan, const QString &path)
+      : m_writer(writer), m_plan(plan), m_path(path)
+    {
+    }
+
+    virtual void run()
+    {
+        MappedFile mapping;
+        QByteArray buffer;
+        Bencode::ByteSpan data;
+        TorrentRecord record;
+        RecordSink sink(record);
+
+        try {
+            if(!TorrentFile::read(m_path, mapping, buffer, data))
+                throw std::runtime_error("Unable to read file");
+
+            ByteStream stream(data);
+            ++stream; // Read first character
+            if(extractTorrentFields(stream, sink, *m_plan) != FieldsExtracted)
+                throw std::runtime_error("Not a torrent");
+        }
+        catch(...) {
+            fprintf(stderr, "Skipping %s: not a valid torrent\n", QFile::encodeName(m_path).constData());
+            return;
+        }
+
+        m_writer->add(record);
+    }
+
+private:
+    ColumnStoreWriter *m_writer;
+    const ExtractionPlan *m_plan;
+    QString m_path;
+};
+
+// Query
+
+enum Column {
+    NoColumn,
+    LengthColumn,
+    FilesColumn,
+    PieceLengthColumn,
+    CreatedColumn,
+    TrackerColumn,
+    YearColumn,
+    MonthColumn
+};
+
+enum Operator {
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual
+};
+
+struct Condition
+{
+    Column column;
+    Operator op;
+    qint64 value;
+    QByteArray tracker;
+};
+
+Column parseColumn(const QByteArray &name)
+{
+    static const char *const names[] = {
+        "", "length", "files", "piece-length", "created", "tracker", "year", "month"
+    };
+
+    for(int i = 1; i <= MonthColumn; ++i) {
+        if(name == names[i])
+            return Column(i);
+    }
+
+    return NoColumn;
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar,
+// and back again.
+qint64 daysFromCivil(qint64 year, int month, int day)
+{
+    year -= month <= 2;
+    const qint64 era = (year >= 0 ? year : year - 399) / 400;
+    const qint64 yearOfEra = year - era * 400;
+    const qint64 dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const qint64 dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+inline void civilFromSeconds(qint64 seconds, qint64 *year, int *month)
+{
+    qint64 days = seconds / 86400;
+    if(seconds % 86400 < 0)
+        --days;
+
+    days += 719468;
+    const qint64 era = (days >= 0 ? days : days - 146096) / 146097;
+    const qint64 dayOfEra = days - era * 146097;
+    const qint64 yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const qint64 dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const qint64 monthIndex = (5 * dayOfYear + 2) / 153;
+
+    *month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    *year = yearOfEra + era * 400 + (*month <= 2);
+}
+
+// Seconds since the epoch, YYYY-MM-DD or YYYY-MM.
+bool parseDate(const QByteArray &text, qint64 *seconds)
+{
+    bool ok = false;
+    *seconds = text.toLongLong(&ok);
+    if(ok)
+        return true;
+
+    const QList<QByteArray> parts = text.split('-');
+    if(parts.count() < 2 || parts.count() > 3)
+        return false;
+
+    bool yearOk, monthOk, dayOk = true;
+    const qint64 year = parts[0].toLongLong(&yearOk);
+    const int month = parts[1].toInt(&monthOk);
+    const int day = parts.count() > 2 ? parts[2].toInt(&dayOk) : 1;
+
+    if(!yearOk || !monthOk || !dayOk || month < 1 || month > 12 || day < 1 || day > 31 ||
+       year < -1000000 || year > 1000000)
+    {
+        return false;
+    }
+
+    *seconds = daysFromCivil(year, month, day) * 86400;
+    return true;
+}
+
+bool parseCondition(const char *text, Condition *condition)
+{
+    static const struct { const char *text; Operator op; } operators[] = {
+        { "<=", LessEqual }, { ">=", GreaterEqual }, { "!=", NotEqual },
+        { "=", Equal }, { "<", Less }, { ">", Greater }
+    };
+
+    const char *opStart = strpbrk(text, "=!<>");
+    if(!opStart)
+        return false;
+
+    int i = 0;
+    while(strncmp(opStart, operators[i].text, strlen(operators[i].text)) != 0)
+        if(++i == int(sizeof operators / sizeof operators[0]))
+            return false;
+
+    condition->column = parseColumn(QByteArray(text, opStart - text).trimmed());
+    condition->op = operators[i].op;
+
+    const QByteArray value = QByteArray(opStart + strlen(operators[i].text)).trimmed();
+    bool ok = false;
+
+    switch(condition->column) {
+        case LengthColumn:
+        case FilesColumn:
+        case PieceLengthColumn:
+            condition->value = value.toLongLong(&ok);
+            return ok;
+        case CreatedColumn:
+            return parseDate(value, &condition->value);
+        case TrackerColumn:
+            condition->tracker = value.toLower();
+            return condition->op == Equal || condition->op == NotEqual;
+        default:
+            return false;
+    }
+}
+
+// Rows are scanned in blocks small enough for the selection and group
+// keys to stay in the L1 cache, and handed out to threads in morsels of
+// many blocks.
+const int blockRows = 1024;
+const quint32 morselRows = 64 * blockRows;
+
+// A tracker id that no row has, for trackers a segment doesn't have.
+const quint32 AbsentTracker = 0xfffffffe;
+
+struct Aggregate
+{
+    Aggregate() : torrents(0), bytes(0), files(0) { }
+
+    void merge(const Aggregate &other)
+    {
+        torrents += other.torrents;
+        bytes += other.bytes;
+        files += other.files;
+    }
+
+    quint64 torrents;
+    qint64 bytes;
+    qint64 files;
+};
+
+typedef QHash<qint64, Aggregate> Groups;
+
+// What a segment's tracker ids mean to the query.
+struct SegmentTrackers
+{
+    QVector<quint32> conditionIds;  // Per condition, the id of its tracker
+    QVector<qint64> groupKeys;      // Per id, the group; NoTracker is last
+};
+
+struct Morsel
+{
+    int segment;
+    quint32 begin, end;
+};
+
+struct Query
+{
+    const ColumnStore *store;
+    QList<Condition> conditions;
+    Column groupBy;
+    QList<SegmentTrackers> trackers; // By segment
+    QList<Morsel> morsels;
+    QAtomicInt nextMorsel;
+};
+
+// The filters are written as plain loops over the column arrays, with the
+// comparison fixed for the whole loop, which compilers turn into vector
+// code.  Selection is a byte per row rather than a branch per row.
+template<class T, class Compare>
+void filterRows(const T *values, int count, qint64 bound, uchar *selected, Compare compare)
+{
+    for(int i = 0; i < count; ++i)
+        selected[i] &= compare(qint64(values[i]), bound);
+}
+
+template<class T>
+void filterRows(const T *values, int count, Operator op, qint64 bound, uchar *selected)
+{
+    switch(op) {
+        case Equal:        filterRows(values, count, bound, selected, std::equal_to<qint64>()); break;
+        case NotEqual:     filterRows(values, count, bound, selected, std::not_equal_to<qint64>()); break;
+        case Less:         filterRows(values, count, bound, selected, std::less<qint64>()); break;
+        case LessEqual:    filterRows(values, count, bound, selected, std::less_equal<qint64>()); break;
+        case Greater:      filterRows(values, count, bound, selected, std::greater<qint64>()); break;
+        case GreaterEqual: filterRows(values, count, bound, selected, std::greater_equal<qint64>()); break;
+    }
+}
+
+void scanBlock(const Query &query, int segmentIndex, quint32 begin, int count, Groups &groups)
+{
+    const ColumnStore::Segment &segment = query.store->segments()[segmentIndex];
+    const SegmentTrackers &trackers = query.trackers[segmentIndex];
+
+    uchar selected[blockRows];
+    qint64 keys[blockRows];
+    memset(selected, 1, count);
+
+    for(int c = 0; c < query.conditions.count(); ++c) {
+        const Condition &condition = query.conditions[c];
+
+        switch(condition.column) {
+            case LengthColumn:
+                filterRows(segment.length + begin, count, condition.op, condition.value, selected);
+                break;
+            case FilesColumn:
+                filterRows(segment.numFiles + begin, count, condition.op, condition.value, selected);
+                break;
+            case PieceLengthColumn:
+                filterRows(segment.pieceLength + begin, count, condition.op, condition.value, selected);
+                break;
+            case CreatedColumn:
+                filterRows(segment.creationDate + begin, count, NotEqual, ColumnStore::NoDate, selected);
+                filterRows(segment.creationDate + begin, count, condition.op, condition.value, selected);
+                break;
+            case TrackerColumn:
+                filterRows(segment.tracker + begin, count, condition.op, trackers.conditionIds[c], selected);
+                break;
+            default:
+                break;
+        }
+    }
+
+    switch(query.groupBy) {
+        case NoColumn:
+            memset(keys, 0, count * sizeof(qint64));
+            break;
+        case FilesColumn:
+            for(int i = 0; i < count; ++i)
+                keys[i] = segment.numFiles[begin + i];
+            break;
+        case PieceLengthColumn:
+            memcpy(keys, segment.pieceLength + begin, count * sizeof(qint64));
+            break;
+        case TrackerColumn:
+            for(int i = 0; i < count; ++i)
+                keys[i] = trackers.groupKeys[qMin(segment.tracker[begin + i], segment.trackerCount)];
+            break;
+        case YearColumn:
+        case MonthColumn:
+            for(int i = 0; i < count; ++i) {
+                const qint64 date = segment.creationDate[begin + i];
+                if(date == ColumnStore::NoDate || !selected[i]) {
+                    keys[i] = ColumnStore::NoDate;
+                    continue;
+                }
+
+                qint64 year;
+                int month;
+                civilFromSeconds(date, &year, &month);
+                keys[i] = query.groupBy == YearColumn ? year : year * 12 + month - 1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Rows of a group tend to come together, so the last group found is
+    // tried before the hash.
+    Aggregate *current = 0;
+    qint64 currentKey = 0;
+
+    for(int i = 0; i < count; ++i) {
+        if(!selected[i])
+            continue;
+
+        if(!current || keys[i] != currentKey) {
+            currentKey = keys[i];
+            current = &groups[currentKey];
+        }
+
+        ++current->torrents;
+        current->bytes += segment.length[begin + i];
+        current->files += segment.numFiles[begin + i];
+    }
+}
+
+class ScanWorker : public QThread
+{
+public:
+    explicit ScanWorker(Query &query) : m_query(query) { }
+
+    Groups groups;
+
+protected:
+    virtual void run()
+    {
+        for(;;) {
+            const int index = m_query.nextMorsel.fetchAndAddRelaxed(1);
+            if(index >= m_query.morsels.count())
+                break;
+
+            const Morsel &morsel = m_query.morsels[index];
+            for(quint32 row = morsel.begin; row < morsel.end; row += blockRows)
+                scanBlock(m_query, morsel.segment, row, qMin<quint32>(blockRows, morsel.end - row), groups);
+        }
+    }
+
+private:
+    Query &m_query;
+};
+
+QByteArray groupLabel(Column groupBy, qint64 key, const QList<QByteArray> &trackerNames)
+{
+    switch(groupBy) {
+        case NoColumn:
+            return "all";
+        case TrackerColumn:
+            return key < 0 ? QByteArray("(none)") : trackerNames[key];
+        case YearColumn:
+        case MonthColumn: {
+            if(key == ColumnStore::NoDate)
+                return "(unknown)";
+            if(groupBy == YearColumn)
+                return QByteArray::number(key);
+
+            qint64 year = key / 12;
+            qint64 month = key % 12;
+            if(month < 0) {
+                month += 12;
+                --year;
+            }
+
+            char label[32];
+            snprintf(label, sizeof label, "%lld-%02d", (long long) year, int(month + 1));
+            return label;
+        }
+        default:
+            return QByteArray::number(key);
+    }
+}
+
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: torrent-columns export [-j threads] <store> <path>...\n"
+            "       torrent-columns query [-j threads] [--where <condition>]...\n"
+            "                             [--group-by <column>] <store>\n");
+    exit(1);
+}
+
+static int exportFiles(int argc, char **argv)
+{
+    int threads = QThread::idealThreadCount();
+    int i = 0;
+
+    for(; i < argc && argv[i][0] == '-'; i += 2) {
+        if(i + 1 >= argc)
+            usage();
+
+        if(strcmp(argv[i], "-j") == 0)
+            threads = atoi(argv[i + 1]);
+        else
+            usage();
+    }
+
+    if(argc - i < 2 || threads < 1)
+        usage();
+
+    const QString storeFile = QFile::decodeName(argv[i++]);
+    QStringList paths;
+    for(; i < argc; ++i)
+        paths.append(QFile::decodeName(argv[i]));
+
+    ColumnStoreWriter writer(storeFile);
+    if(!writer.open()) {
+        fprintf(stderr, "Unable to open %s\n", QFile::encodeName(storeFile).constData());
+        return 1;
+    }
+
+    // Every copy of a torrent is kept, and nothing needs the comment.
+    const ExtractionPlan plan("-duplicate of; -comment");
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    foreach(const QString &path, TorrentFile::find(paths))
+        pool.start(new ExportJob(&writer, &plan, path));
+
+    pool.waitForDone();
+
+    if(!writer.finish()) {
+        fprintf(stderr, "Unable to write %s\n", QFile::encodeName(storeFile).constData());
+        return 1;
+    }
+
+    return 0;
+}
+
+static int query(int argc, char **argv)
+{
+    int threads = QThread::idealThreadCount();
+    const char *groupByName = "group";
+    Query scan;
+    scan.groupBy = NoColumn;
+    int i = 0;
+
+    for(; i < argc && argv[i][0] == '-'; i += 2) {
+        if(i + 1 >= argc)
+            usage();
+
+        if(strcmp(argv[i], "-j") == 0)
+            threads = atoi(argv[i + 1]);
+        else if(strcmp(argv[i], "--where") == 0) {
+            Condition condition;
+            if(!parseCondition(argv[i + 1], &condition)) {
+                fprintf(stderr, "Invalid condition: %s\n", argv[i + 1]);
+                return 1;
+            }
+            scan.conditions.append(condition);
+        }
+        else if(strcmp(argv[i], "--group-by") == 0) {
+            groupByName = argv[i + 1];
+            scan.groupBy = parseColumn(groupByName);
+            if(scan.groupBy == NoColumn || scan.groupBy == LengthColumn || scan.groupBy == CreatedColumn) {
+                fprintf(stderr, "Can't group by %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else
+            usage();
+    }
+
+    if(argc - i != 1 || threads < 1)
+        usage();
+
+    ColumnStore store;
+    if(!store.open(QFile::decodeName(argv[i]))) {
+        fprintf(stderr, "Unable to open %s\n", argv[i]);
+        return 1;
+    }
+
+    scan.store = &store;
+
+    // Trackers are numbered per segment, so work out what each segment's
+    // ids stand for.  Groups are numbered in name order, so that they
+    // come out sorted.
+    QMap<QByteArray, qint64> trackerGroups;
+    foreach(const ColumnStore::Segment &segment, store.segments()) {
+        for(quint32 id = 0; id < segment.trackerCount; ++id)
+            trackerGroups.insert(segment.trackerName(id), 0);
+    }
+
+    QList<QByteArray> trackerNames = trackerGroups.keys();
+    for(int group = 0; group < trackerNames.count(); ++group)
+        trackerGroups[trackerNames[group]] = group;
+
+    for(int s = 0; s < store.segments().count(); ++s) {
+        const ColumnStore::Segment &segment = store.segments()[s];
+        SegmentTrackers trackers;
+
+        QHash<QByteArray, quint32> ids;
+        for(quint32 id = 0; id < segment.trackerCount; ++id) {
+            const QByteArray name = segment.trackerName(id);
+            ids.insert(name, id);
+            trackers.groupKeys.append(trackerGroups.value(name));
+        }
+        trackers.groupKeys.append(-1); // NoTracker
+
+        foreach(const Condition &condition, scan.conditions) {
+            if(condition.column != TrackerColumn)
+                trackers.conditionIds.append(0);
+            else if(condition.tracker.isEmpty())
+                trackers.conditionIds.append(ColumnStore::NoTracker);
+            else
+                trackers.conditionIds.append(ids.value(condition.tracker, AbsentTracker));
+        }
+
+        scan.trackers.append(trackers);
+
+        for(quint32 row = 0; row < segment.rows; row += morselRows) {
+            const Morsel morsel = { s, row, qMin(row + morselRows, segment.rows) };
+            scan.morsels.append(morsel);
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<ScanWorker *> workers;
+    for(int t = 0; t < qMin(threads, qMax(scan.morsels.count(), 1)); ++t) {
+        workers.append(new ScanWorker(scan));
+        workers.last()->start();
+    }
+
+    QMap<qint64, Aggregate> groups;
+    foreach(ScanWorker *worker, workers) {
+        worker->wait();
+        for(Groups::const_iterator it = worker->groups.constBegin(); it != worker->groups.constEnd(); ++it)
+            groups[it.key()].merge(it.value());
+    }
+
+    qDeleteAll(workers);
+
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    printf("# %s\ttorrents\tbytes\tfiles\n", groupByName);
+    for(QMap<qint64, Aggregate>::const_iterator it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        printf("%s\t%llu\t%lld\t%lld\n", groupLabel(scan.groupBy, it.key(), trackerNames).constData(),
+               (unsigned long long) it.value().torrents, (long long) it.value().bytes,
+               (long long) it.value().files);
+    }
+
+    fprintf(stderr, "rows: %llu in %d segments, %.3f s, %.1f M rows/s\n",
+            (unsigned long long) store.rowCount(), store.segments().count(), elapsed / 1e9,
+            store.rowCount() / qMax(elapsed / 1e3, 1.0));
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+        usage();
+
+    if(strcmp(argv[1], "export") == 0)
+        return exportFiles(argc - 2, argv + 2);
+    if(strcmp(argv[1], "query") == 0)
+        return query(argc - 2, argv + 2);
+
+    usage();
+    return 1;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,374 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-inspect: decodes .torrent files on a pool of threads and writes
+// the fields the Strigi analyzer would extract from each as one JSON
+// object per line.  Throughput and per-file latency are reported on
+// stderr at the end, which makes this the reference harness for parser
+// performance work as well.  --file-pieces adds the pieces each file
+// lies in, as "filePieces": [[first, last], ...].
+//
+//   torrent-inspect [-j threads] [-o output] [--no-dedup] [--file-pieces] <path>...
+
+#include "torrentfile.h"
+#include "json.h"
+#include "bytestream.h"
+#include "extractionplan.h"
+#include "infohashset.h"
+#include "piecemap.h"
+#include "torrentfields.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QtAlgorithms>
+
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Output is collected per worker and written in blocks of about this size.
+const int outputBlockSize = 64 * 1024;
+
+/**
+ * Hands out file indices to the workers.  Each worker starts with its own
+ * contiguous share of the files and takes from the front of it; a worker
+ * which runs out steals from the back of another worker's share, so one
+ * worker stuck on a few huge files doesn't hold up the whole run.
+ */
+class WorkQueue
+{
+public:
+    WorkQueue(int itemCount, int workers)
+      : m_shares(workers)
+    {
+        for(int i = 0; i < workers; ++i) {
+            m_shares[i] = new Share;
+
+            const int first = qlonglong(itemCount) * i / workers;
+            const int last = qlonglong(itemCount) * (i + 1) / workers;
+            for(int item = first; item < last; ++item)
+                m_shares[i]->items.append(item);
+        }
+    }
+
+    ~WorkQueue()
+    {
+        qDeleteAll(m_shares);
+    }
+
+    bool take(int worker, int *item)
+    {
+        Share *own = m_shares[worker];
+        {
+            QMutexLocker lock(&own->mutex);
+            if(!own->items.isEmpty()) {
+                *item = own->items.takeFirst();
+                return true;
+            }
+        }
+
+        for(int i = 1; i < m_shares.count(); ++i) {
+            Share *victim = m_shares[(worker + i) % m_shares.count()];
+
+            QMutexLocker lock(&victim->mutex);
+            if(!victim->items.isEmpty()) {
+                *item = victim->items.takeLast();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    struct Share
+    {
+        QMutex mutex;
+        QList<int> items;
+    };
+
+    QVector<Share *> m_shares;
+};
+
+/**
+ * Writes the extracted fields as a JSON object.
+ */
+class JsonFieldSink : public TorrentFieldSink
+{
+public:
+    JsonFieldSink(QByteArray &out, InfoHashSet *infoHashes, const QByteArray &path)
+      : m_out(out), m_infoHashes(infoHashes), m_path(path)
+    {
+    }
+
+    virtual void addValue(Field field, const QByteArray &value)
+    {
+        appendKey(field);
+        Json::appendString(m_out, value);
+    }
+
+    virtual void addValue(Field field, qlonglong value)
+    {
+        appendKey(field);
+        m_out.append(QByteArray::number(value));
+    }
+
+    virtual void addPieceMap(const PieceMap &map)
+    {
+        appendKey(FilePieces);
+        m_out.append('[');
+        for(int i = 0; i < map.fileCount(); ++i) {
+            const PieceMap::Range pieces = map.piecesOfFile(i);
+            m_out.append(i > 0 ? ",[" : "[");
+            m_out.append(QByteArray::number(pieces.first));
+            m_out.append(',');
+            m_out.append(QByteArray::number(qlonglong(pieces.first + pieces.count) - 1));
+            m_out.append(']');
+        }
+        m_out.append(']');
+    }
+
+    virtual bool isDuplicate(const QByteArray &infoHash, QByteArray &original)
+    {
+        return m_infoHashes && m_infoHashes->insert(infoHash, m_path, &original);
+    }
+
+private:
+    void appendKey(Field field)
+    {
+        static const char *const keys[] = {
+            "announce", "creationDate", "length", "numFiles", "name",
+            "pieceLength", "comment", "infoHash", "duplicateOf", "filePieces"
+        };
+
+        m_out.append(",\"");
+        m_out.append(keys[field]);
+        m_out.append("\":");
+    }
+
+    QByteArray &m_out;
+    InfoHashSet *m_infoHashes;
+    const QByteArray &m_path;
+};
+
+struct Run
+{
+    QStringList files;
+    WorkQueue *queue;
+    InfoHashSet *infoHashes;
+    const ExtractionPlan *plan;
+    FILE *output;
+    QMutex outputMutex;
+};
+
+class Worker : public QThread
+{
+public:
+    Worker(Run &run, int id)
+      : m_run(run), m_id(id), m_bytes(0), m_errors(0)
+    {
+    }
+
+    QVector<qint64> latencies;  // nanoseconds
+
+    qint64 bytes() const { return m_bytes; }
+    int errors() const { return m_errors; }
+
+protected:
+    virtual void run()
+    {
+        QByteArray out;
+        QElapsedTimer timer;
+        int item;
+
+        while(m_run.queue->take(m_id, &item)) {
+            const QString &path = m_run.files[item];
+            const QByteArray encodedPath(QFile::encodeName(path));
+
+            timer.start();
+
+            const int lineStart = out.size();
+            out.append("{\"path\":");
+            Json::appendString(out, encodedPath);
+
+            // The sink copies what it is given, so the file can be
+            // parsed where it is mapped.
+            MappedFile mapping;
+            QByteArray buffer;
+            Bencode::ByteSpan data;
+            JsonFieldSink sink(out, m_run.infoHashes, encodedPath);
+
+            try {
+                if(!TorrentFile::read(path, mapping, buffer, data))
+                    throw std::runtime_error("Unable to read file");
+
+                ByteStream stream(data);
+                ++stream; // Read first character
+                extractTorrentFields(stream, sink, *m_run.plan);
+            }
+            catch(...) {
+                out.truncate(lineStart);
+                out.append("{\"path\":");
+                Json::appendString(out, encodedPath);
+                out.append(",\"error\":true");
+                ++m_errors;
+            }
+
+            out.append("}\n");
+
+            latencies.append(timer.nsecsElapsed());
+            m_bytes += data.size();
+
+            if(out.size() >= outputBlockSize)
+                flush(out);
+        }
+
+        flush(out);
+    }
+
+private:
+    void flush(QByteArray &out)
+    {
+        QMutexLocker lock(&m_run.outputMutex);
+        fwrite(out.constData(), 1, out.size(), m_run.output);
+        out.clear();
+    }
+
+    Run &m_run;
+    int m_id;
+    qint64 m_bytes;
+    int m_errors;
+};
+
+}
+
+static void usage()
+{
+    fprintf(stderr, "Usage: torrent-inspect [-j threads] [-o output] [--no-dedup] [--file-pieces] <path>...\n");
+    exit(1);
+}
+
+static double percentile(const QVector<qint64> &sorted, double p)
+{
+    if(sorted.isEmpty())
+        return 0;
+
+    const int index = qMin(sorted.count() - 1, int(p * sorted.count()));
+    return sorted[index] / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = QThread::idealThreadCount();
+    const char *outputName = 0;
+    bool dedup = true;
+    bool filePieces = false;
+    QStringList paths;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outputName = argv[++i];
+        else if(strcmp(argv[i], "--no-dedup") == 0)
+            dedup = false;
+        else if(strcmp(argv[i], "--file-pieces") == 0)
+            filePieces = true;
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            paths.append(QFile::decodeName(argv[i]));
+    }
+
+    if(paths.isEmpty() || threads < 1)
+        usage();
+
+    Run run;
+    run.files = TorrentFile::find(paths);
+    run.output = outputName ? fopen(outputName, "w") : stdout;
+
+    if(!run.output) {
+        fprintf(stderr, "Unable to open %s\n", outputName);
+        return 1;
+    }
+
+    WorkQueue queue(run.files.count(), threads);
+    // Only these files are ever recorded, so their paths are all the set
+    // needs room for.
+    quint64 pathData = 0;
+    foreach(const QString &file, run.files)
+        pathData += QFile::encodeName(file).size() + 1;
+
+    InfoHashSet infoHashes(qMax(run.files.count(), 1), quint32(qMin(pathData, Q_UINT64_C(0xffffffff))));
+    const ExtractionPlan plan(filePieces ? "+file pieces" : "");
+    run.queue = &queue;
+    run.plan = &plan;
+    run.infoHashes = dedup ? &infoHashes : 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<Worker *> workers;
+    for(int i = 0; i < threads; ++i) {
+        workers.append(new Worker(run, i));
+        workers.last()->start();
+    }
+
+    QVector<qint64> latencies;
+    qint64 bytes = 0;
+    int errors = 0;
+
+    foreach(Worker *worker, workers) {
+        worker->wait();
+        latencies += worker->latencies;
+        bytes += worker->bytes();
+        errors += worker->errors();
+    }
+
+    const double seconds = qMax(timer.nsecsElapsed() / 1e9, 1e-9);
+    qDeleteAll(workers);
+
+    if(outputName)
+        fclose(run.output);
+    else
+        fflush(stdout);
+
+    qSort(latencies);
+
+    fprintf(stderr, "files: %d (%d errors), %.1f MB in %.3f s, %.1f files/s, %.2f MB/s\n",
+            latencies.count(), errors, bytes / 1e6, seconds,
+            latencies.count() / seconds, bytes / 1e6 / seconds);
+    fprintf(stderr, "latency (ms): p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+            percentile(latencies, 0.5), percentile(latencies, 0.9),
+            percentile(latencies, 0.99), percentile(latencies, 0.999),
+            latencies.isEmpty() ? 0.0 : latencies.last() / 1e6);
+
+    return errors ? 2 : 0;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-json: converts a b-encoded file to JSON in one pass, or JSON
+// written that way back to canonical b-encoding with --reverse.  Output
+// goes to standard output.
+//
+//   torrent-json [--hex | --base64 | --elide] [--canonical] <file>
+//   torrent-json --reverse <file.json>
+
+#include "bytestream.h"
+#include "jsontranscoder.h"
+
+#include <strigi/fileinputstream.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: torrent-json [--hex | --base64 | --elide] [--canonical] <file>\n"
+            "       torrent-json --reverse <file.json>\n");
+    exit(1);
+}
+
+static int reverse(const char *fileName, QFile &output)
+{
+    QFile input(QFile::decodeName(fileName));
+    if(!input.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Unable to read %s\n", fileName);
+        return 1;
+    }
+
+    QString error;
+    if(!Json::toBencode(input.readAll(), output, &error)) {
+        fprintf(stderr, "%s: %s\n", fileName,
+                error.isEmpty() ? "unable to write output" : error.toLocal8Bit().constData());
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Json::TranscodeOptions options;
+    bool toBencode = false;
+    int i = 1;
+
+    for(; i < argc - 1; ++i) {
+        if(strcmp(argv[i], "--hex") == 0)
+            options.binary = Json::HexEncoding;
+        else if(strcmp(argv[i], "--base64") == 0)
+            options.binary = Json::Base64Encoding;
+        else if(strcmp(argv[i], "--elide") == 0)
+            options.binary = Json::ElideBinary;
+        else if(strcmp(argv[i], "--canonical") == 0)
+            options.canonical = true;
+        else if(strcmp(argv[i], "--reverse") == 0)
+            toBencode = true;
+        else
+            usage();
+    }
+
+    if(i != argc - 1)
+        usage();
+
+    QFile output;
+    if(!output.open(stdout, QIODevice::WriteOnly)) {
+        fprintf(stderr, "Unable to write to standard output\n");
+        return 1;
+    }
+
+    if(toBencode)
+        return reverse(argv[i], output);
+
+    Strigi::FileInputStream input(argv[i]);
+    if(input.status() != Strigi::Ok) {
+        fprintf(stderr, "Unable to read %s\n", argv[i]);
+        return 1;
+    }
+
+    ByteStream stream(&input);
+
+    try {
+        ++stream; // Read first character
+
+        if(!Json::fromBencode(stream, output, options)) {
+            fprintf(stderr, "Unable to write output\n");
+            return 1;
+        }
+    }
+    catch(const std::exception &e) {
+        fprintf(stderr, "\n%s: %s, after reading %lld bytes\n", argv[i], e.what(), stream.bytesRead());
+        return 1;
+    }
+
+    output.write("\n", 1);
+    return 0;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-pieceindex: builds and queries piece hash indexes, to find
+// torrents that share content.
+//
+//   torrent-pieceindex build [-j threads] [-m megabytes] <index> <path>...
+//   torrent-pieceindex query <index> <file.torrent>...
+
+#include "torrentfile.h"
+#include "piecehashindex.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtAlgorithms>
+
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// All the index needs from a torrent; everything else in the file is
+// skipped over without being decoded.
+struct PieceHashes
+{
+    struct Info
+    {
+        Info() : pieceLength(0) { }
+
+        long long pieceLength;
+        std::string pieces;
+    };
+
+    Info info;
+};
+
+}
+
+namespace Bencode {
+
+template<>
+struct Schema<PieceHashes::Info>
+{
+    template<class Visitor>
+    static void fields(Visitor &v, PieceHashes::Info &info)
+    {
+        v("piece length", info.pieceLength, RequiredField);
+        v("pieces", info.pieces, RequiredField);
+    }
+};
+
+template<>
+struct Schema<PieceHashes>
+{
+    template<class Visitor>
+    static void fields(Visitor &v, PieceHashes &torrent)
+    {
+        v("info", torrent.info, RequiredField);
+    }
+};
+
+}
+
+namespace {
+
+// Loads the piece hashes of the torrent at @p path, printing why it is
+// being skipped if they can't be used.
+bool loadPieceHashes(const QString &path, PieceHashes &torrent)
+{
+    QString error;
+
+    if(!TorrentFile::load(path, torrent, &error)) {
+        fprintf(stderr, "Skipping %s: %s\n", QFile::encodeName(path).constData(), error.toLocal8Bit().constData());
+        return false;
+    }
+
+    if(torrent.info.pieceLength <= 0 || torrent.info.pieces.size() % 20 != 0) {
+        fprintf(stderr, "Skipping %s: invalid piece hashes\n", QFile::encodeName(path).constData());
+        return false;
+    }
+
+    return true;
+}
+
+class AddTorrentJob : public QRunnable
+{
+public:
+    AddTorrentJob(PieceHashIndexWriter *writer, const QString &path)
+      : m_writer(writer), m_path(path)
+    {
+    }
+
+    virtual void run()
+    {
+        PieceHashes torrent;
+
+        if(loadPieceHashes(m_path, torrent)) {
+            const PieceHashes::Info &info = torrent.info;
+            m_writer->addTorrent(QFile::encodeName(m_path), info.pieceLength,
+                                 QByteArray(info.pieces.data(), info.pieces.size()));
+        }
+    }
+
+private:
+    PieceHashIndexWriter *m_writer;
+    QString m_path;
+};
+
+struct Match
+{
+    quint32 torrent;
+    quint32 pieces;
+
+    bool operator<(const Match &other) const
+    {
+        return pieces > other.pieces;
+    }
+};
+
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: torrent-pieceindex build [-j threads] [-m megabytes] <index> <path>...\n"
+            "       torrent-pieceindex query <index> <file.torrent>...\n");
+    exit(1);
+}
+
+static int build(int argc, char **argv)
+{
+    int threads = QThread::idealThreadCount();
+    quint64 memory = 256;
+    int i = 0;
+
+    for(; i < argc && argv[i][0] == '-'; i += 2) {
+        if(i + 1 >= argc)
+            usage();
+
+        if(strcmp(argv[i], "-j") == 0)
+            threads = atoi(argv[i + 1]);
+        else if(strcmp(argv[i], "-m") == 0)
+            memory = strtoull(argv[i + 1], 0, 10);
+        else
+            usage();
+    }
+
+    if(argc - i < 2 || threads < 1 || memory < 1)
+        usage();
+
+    const QString indexFile = QFile::decodeName(argv[i++]);
+    QStringList paths;
+    for(; i < argc; ++i)
+        paths.append(QFile::decodeName(argv[i]));
+
+    PieceHashIndexWriter writer(indexFile, memory * 1024 * 1024);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    foreach(const QString &path, TorrentFile::find(paths))
+        pool.start(new AddTorrentJob(&writer, path));
+
+    pool.waitForDone();
+
+    if(!writer.finish()) {
+        fprintf(stderr, "Unable to write %s\n", QFile::encodeName(indexFile).constData());
+        return 1;
+    }
+
+    return 0;
+}
+
+static int query(int argc, char **argv)
+{
+    if(argc < 2)
+        usage();
+
+    PieceHashIndex index;
+    if(!index.open(QFile::decodeName(argv[0]))) {
+        fprintf(stderr, "Unable to open %s\n", argv[0]);
+        return 1;
+    }
+
+    for(int i = 1; i < argc; ++i) {
+        PieceHashes torrent;
+        if(!loadPieceHashes(QFile::decodeName(argv[i]), torrent))
+            continue;
+
+        const std::string &pieces = torrent.info.pieces;
+        const QHash<quint32, quint32> shared =
+            index.sharedPieces(QByteArray::fromRawData(pieces.data(), pieces.size()));
+
+        QList<Match> matches;
+        for(QHash<quint32, quint32>::const_iterator it = shared.constBegin(); it != shared.constEnd(); ++it) {
+            Match match = { it.key(), it.value() };
+            matches.append(match);
+        }
+
+        qSort(matches);
+
+        printf("%s: %d pieces\n", argv[i], int(pieces.size() / 20));
+        foreach(const Match &match, matches)
+            printf("  %u\t%s\n", match.pieces, index.torrentName(match.torrent).constData());
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+        usage();
+
+    if(strcmp(argv[1], "build") == 0)
+        return build(argc - 2, argv + 2);
+    if(strcmp(argv[1], "query") == 0)
+        return query(argc - 2, argv + 2);
+
+    usage();
+    return 1;
+}
+
+// vim: set et sw=4 ts=4:
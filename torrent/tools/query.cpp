@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// torrent-query: runs a PathQuery over .torrent files and writes each
+// value found as one JSON object per line, e.g.
+//
+//   torrent-query 'info/files/*[length>1048576]/path' ~/torrents
+//
+// The query is evaluated on the stream by default, or over the decoded
+// tree with --tree.  Strings which aren't UTF-8 are written in hex.
+//
+//   torrent-query [--tree] <query> <path>...
+
+#include "torrentfile.h"
+#include "bdict.h"
+#include "bint.h"
+#include "blist.h"
+#include "bstring.h"
+#include "bvisitor.h"
+#include "bytestream.h"
+#include "json.h"
+#include "pathquery.h"
+#include "utf8.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QtAlgorithms>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage()
+{
+    fprintf(stderr, "Usage: torrent-query [--tree] <query> <path>...\n");
+    exit(1);
+}
+
+// Writes a decoded value as JSON.
+struct JsonWriter : public BVisitor<void>
+{
+    explicit JsonWriter(QByteArray &o) : out(o) { }
+
+    void operator()(const BString &string)
+    {
+        if(Utf8::isValid(string.raw_data()))
+            Json::appendString(out, string.raw_data());
+        else {
+            out += "{\"hex\":\"";
+            out += string.raw_data().toHex();
+            out += "\"}";
+        }
+    }
+
+    void operator()(const BInt &integer)
+    {
+        out += QByteArray::number(integer.get_value());
+    }
+
+    void operator()(const BList &list)
+    {
+        out += '[';
+        for(unsigned int i = 0; i < list.count(); ++i) {
+            if(i > 0)
+                out += ',';
+            list.at(i)->visit(*this);
+        }
+        out += ']';
+    }
+
+    void operator()(const BDict &dict)
+    {
+        QList<QByteArray> keys;
+        for(BDictionaryIterator it = dict.iterator(); it.hasNext(); )
+            keys.append(it.next().key());
+        qSort(keys);
+
+        out += '{';
+        for(int i = 0; i < keys.count(); ++i) {
+            if(i > 0)
+                out += ',';
+            Json::appendString(out, keys[i]);
+            out += ':';
+            dict.value(keys[i])->visit(*this);
+        }
+        out += '}';
+    }
+
+    QByteArray &out;
+};
+
+static void appendValue(QByteArray &out, const BBase::Ptr &value)
+{
+    if(!value) {
+        out += "null";
+        return;
+    }
+
+    JsonWriter writer(out);
+    value->visit(writer);
+}
+
+// Runs @p query over the file at @p path, returning false if it couldn't
+// be read or decoded.
+static bool runQuery(const PathQuery &query, const QString &path, bool overTree,
+                     QList<PathQuery::Match> &matches)
+{
+    if(overTree) {
+        BDict::Ptr torrent = TorrentFile::load(path);
+        if(!torrent)
+            return false;
+
+        matches = query.evaluate(torrent);
+        return true;
+    }
+
+    MappedFile mapping;
+    QByteArray buffer;
+    Bencode::ByteSpan data;
+    if(!TorrentFile::read(path, mapping, buffer, data))
+        return false;
+
+    // Matches are decoded into BBase values of their own, so nothing
+    // refers to the file's contents once this returns.
+    ByteStream stream(data);
+
+    try {
+        ++stream; // Read first character
+        matches = query.evaluate(stream);
+        return true;
+    }
+    catch(...) {
+        return false;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool overTree = false;
+    int i = 1;
+
+    if(i < argc && strcmp(argv[i], "--tree") == 0) {
+        overTree = true;
+        ++i;
+    }
+
+    if(argc - i < 2)
+        usage();
+
+    const PathQuery query(argv[i++]);
+    if(!query.isValid()) {
+        fprintf(stderr, "Invalid query: %s\n", query.errorString().toLocal8Bit().constData());
+        return 1;
+    }
+
+    QStringList paths;
+    for(; i < argc; ++i)
+        paths.append(QFile::decodeName(argv[i]));
+
+    int failures = 0;
+
+    foreach(const QString &path, TorrentFile::find(paths)) {
+        QList<PathQuery::Match> matches;
+
+        if(!runQuery(query, path, overTree, matches)) {
+            fprintf(stderr, "Skipping %s: not a valid torrent\n", QFile::encodeName(path).constData());
+            ++failures;
+            continue;
+        }
+
+        QByteArray out;
+        foreach(const PathQuery::Match &match, matches) {
+            out += "{\"file\":";
+            Json::appendString(out, QFile::encodeName(path));
+            out += ",\"query\":";
+            out += QByteArray::number(match.query);
+            out += ",\"path\":";
+            Json::appendString(out, match.path);
+            out += ",\"value\":";
+            appendValue(out, match.value);
+            out += "}\n";
+        }
+
+        fwrite(out.constData(), 1, out.size(), stdout);
+    }
+
+    return failures > 0 ? 2 : 0;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "torrentfile.h"
+#include "bytestream.h"
+
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QtAlgorithms>
+
+#include <stdexcept>
+
+BDict::Ptr TorrentFile::load(const QString &path)
+{
+    // Read rather than mapped: the tree decodes its values long after
+    // loading, when a mapping of a file that has since been truncated
+    // would fault instead of failing.
+    QByteArray data;
+    if(!read(path, data))
+        return BDict::Ptr();
+
+    try {
+        return BDict::parseLazily(LazyData::Ptr(new LazyData(data)));
+    }
+    catch(...) {
+        return BDict::Ptr();
+    }
+}
+
+bool TorrentFile::read(const QString &path, QByteArray &data)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    data = file.readAll();
+    return file.error() == QFile::NoError;
+}
+
+bool TorrentFile::read(const QString &path, MappedFile &mapping, QByteArray &buffer,
+                       Bencode::ByteSpan &data)
+{
+    if(MappedFile::isWorthwhile(QFileInfo(path).size()) && mapping.map(path)) {
+        data = mapping.data();
+        return true;
+    }
+
+    if(!read(path, buffer))
+        return false;
+
+    data = Bencode::ByteSpan(buffer.constData(), buffer.size());
+    return true;
+}
+
+QStringList TorrentFile::find(const QStringList &paths)
+{
+    QStringList files;
+
+    foreach(const QString &path, paths) {
+        if(!QFileInfo(path).isDir()) {
+            files.append(path);
+            continue;
+        }
+
+        QDirIterator it(path, QStringList() << QLatin1String("*.torrent"),
+                        QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+        while(it.hasNext())
+            files.append(it.next());
+    }
+
+    qSort(files);
+    return files;
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,104 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_TOOLS_TORRENTFILE_H
+#define TORRENT_TOOLS_TORRENTFILE_H
+
+#include "bdict.h"
+#include "mappedfile.h"
+#include "core/bytesource.h"
+#include "core/schema.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QStringList>
+
+/**
+ * Helpers shared by the command line tools.
+ */
+namespace TorrentFile
+{
+    /**
+     * Decodes the .torrent file at @p path, lazily: values are only
+     * decoded once they are used (see BDict::parseLazily()), so the tree
+     * must stay on one thread.  The file is read into memory, not mapped,
+     * so decoding later can't fail whatever happens to it meanwhile.
+     *
+     * @return the top-level dictionary, or a null pointer if the file
+     *         couldn't be read or isn't b-encoded.
+     */
+    BDict::Ptr load(const QString &path);
+
+    /**
+     * Reads the whole file at @p path into @p data.
+     *
+     * @return false if the file couldn't be read
+     */
+    bool read(const QString &path, QByteArray &data);
+
+    /**
+     * Makes the contents of the file at @p path available as @p data,
+     * by mapping it into @p mapping if it is big enough to be worth it
+     * and otherwise by reading it into @p buffer.
+     *
+     * @return false if the file couldn't be read
+     */
+    bool read(const QString &path, MappedFile &mapping, QByteArray &buffer,
+              Bencode::ByteSpan &data);
+
+    /**
+     * Decodes the .torrent file at @p path straight into @p value, which
+     * must have a Bencode::Schema, without building a BDict first.
+     *
+     * @param error set to the reason, if the file is rejected
+     * @return false if the file couldn't be read or doesn't fit the schema
+     */
+    template<class T>
+    bool load(const QString &path, T &value, QString *error = 0)
+    {
+        MappedFile mapping;
+        QByteArray buffer;
+        Bencode::ByteSpan data;
+        if(!read(path, mapping, buffer, data)) {
+            if(error)
+                *error = QLatin1String("could not be read");
+            return false;
+        }
+
+        Bencode::MemorySource source(data);
+
+        try {
+            Bencode::decode(source, value);
+            return true;
+        }
+        catch(const Bencode::SchemaError &e) {
+            if(error)
+                *error = QString::fromUtf8(e.what());
+            return false;
+        }
+    }
+
+    /**
+     * Expands @p paths, which may name .torrent files or directories to
+     * be searched recursively for them, into a sorted list of files.
+     */
+    QStringList find(const QStringList &paths);
+}
+
+#endif
+
+// vim: set et sw=4 ts=4:
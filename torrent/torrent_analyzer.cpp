@@ -18,17 +18,24 @@
  */
 #include "torrent_analyzer.h"
 #include "torrent_analyzer_factory.h"
-#include "bdict.h"
+#include "analyzerstats.h"
 #include "bytestream.h"
-#include "blist.h"
-#include "bstring.h"
-#include "bint.h"
+#include "piecemap.h"
+#include "prefetchinputstream.h"
+#include "resume_analyzer_factory.h"
+#include "resumedata.h"
+#include "tracing.h"
 
 #include <strigi/analyzerplugin.h>
 #include <strigi/streamthroughanalyzer.h>
 #include <strigi/analysisresult.h>
 #include <strigi/streambase.h>
 
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+
+#include <boost/scoped_ptr.hpp>
+
 #include <stdexcept>
 #include <string>
 
@@ -38,97 +45,203 @@ public:
     streamThroughAnalyzerFactories() const {
         std::list<Strigi::StreamThroughAnalyzerFactory*> factories;
         factories.push_back(new TorrentThroughAnalyzerFactory);
+        factories.push_back(new ResumeThroughAnalyzerFactory);
         return factories;
     }
 };
 
 STRIGI_ANALYZER_FACTORY(TorrentFactory)
 
-static qulonglong filesLength(const BList::Ptr &list)
+TorrentThroughAnalyzer::TorrentThroughAnalyzer(const TorrentThroughAnalyzerFactory *f)
+  : m_factory(f)
 {
-    qulonglong length = 0;
+}
 
-    for(unsigned int i = 0; i < list->count(); ++i) {
-        BDict::Ptr fileDict = list->indexType<BDict>(i);
-        if(!fileDict)
-            return 0;
+Strigi::InputStream *TorrentThroughAnalyzer::connectInputStream(Strigi::InputStream *input)
+{
+    if(!input)
+        return input;
 
-        BInt::Ptr fileLength = fileDict->findType<BInt>("length");
-        if(!fileLength)
-            return 0;
+    // Resume data is left to the resume analyzer, which sees only those
+    // files, so that none is read by both.
+    const std::string &fileName = m_analysisResult->fileName();
+    if(isResumeFileName(QByteArray(fileName.data(), fileName.size())))
+        return input;
+
+    TORRENT_TRACE_SPAN("analyze");
+    TORRENT_TRACE_DETAIL(m_analysisResult->path().c_str());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    m_stats = AnalyzerStats();
+    m_stats.add(AnalyzerStats::StreamsSeen);
 
-        length += fileLength->get_value();
+    // Files aren't mapped, even when they could be: a client rewriting a
+    // torrent while it is parsed would then kill the indexer with SIGBUS.
+    // Big files are read ahead on another thread instead, so that a slow
+    // stream doesn't leave the parser idle.
+    boost::scoped_ptr<ByteStream> streamHolder;
+    boost::scoped_ptr<PrefetchInputStream> prefetch;
+
+    if(PrefetchInputStream::isWorthwhile(input)) {
+        prefetch.reset(new PrefetchInputStream(input));
+        streamHolder.reset(new ByteStream(prefetch.get()));
+        m_stats.add(AnalyzerStats::StreamsPrefetched);
     }
+    else
+        streamHolder.reset(new ByteStream(input));
 
-    return length;
-}
+    ByteStream &stream = *streamHolder;
 
-TorrentThroughAnalyzer::TorrentThroughAnalyzer(const TorrentThroughAnalyzerFactory *f)
-  : m_factory(f)
-{
+    try {
+        ++stream; // Read first character
+
+        if(*stream != 'd')
+            m_stats.add(AnalyzerStats::RejectedNotDictionary);
+        else {
+            // Only the values of interest are decoded, whatever the size,
+            // so this beats building the tree even on several threads.
+            const ExtractionResult result = extractTorrentFields(stream, *this, m_factory->plan);
+
+            switch(result) {
+                case FieldsExtracted:
+                    m_stats.add(AnalyzerStats::StreamsAnalyzed);
+                    break;
+                case DuplicateTorrent:
+                    m_stats.add(AnalyzerStats::StreamsDuplicate);
+                    break;
+                case MissingInfo:
+                    m_stats.add(AnalyzerStats::RejectedNoInfo);
+                    break;
+                case MissingLength:
+                    m_stats.add(AnalyzerStats::RejectedNoLength);
+                    break;
+            }
+        }
+    }
+    // Don't allow exceptions to propagate out
+    catch(const end_of_stream &) {
+        m_stats.add(AnalyzerStats::ExceptionsCaught);
+        m_stats.add(stream.bytesRead() > 0 ? AnalyzerStats::RejectedTruncated
+                                           : AnalyzerStats::RejectedEmpty);
+    }
+    catch(const memory_limit_exceeded &) {
+        m_stats.add(AnalyzerStats::ExceptionsCaught);
+        m_stats.add(AnalyzerStats::RejectedMemoryLimit);
+    }
+    catch(...) {
+        m_stats.add(AnalyzerStats::ExceptionsCaught);
+        m_stats.add(AnalyzerStats::RejectedMalformed);
+    }
+
+    m_stats.add(AnalyzerStats::BytesRead, stream.bytesRead());
+    m_stats.add(AnalyzerStats::BufferRefills, stream.refillCount());
+    m_stats.add(AnalyzerStats::StringNodes, stream.nodeCount(BBase::bString));
+    m_stats.add(AnalyzerStats::IntNodes, stream.nodeCount(BBase::bInt));
+    m_stats.add(AnalyzerStats::ListNodes, stream.nodeCount(BBase::bList));
+    m_stats.add(AnalyzerStats::DictNodes, stream.nodeCount(BBase::bDict));
+    m_stats.addParseTime(timer.nsecsElapsed());
+    m_stats.addParseMemory(stream.peakMemory());
+    AnalyzerStats::record(m_stats);
+
+    // The reading thread must be finished with the input before it can
+    // be used again.
+    prefetch.reset();
+
+    {
+        TORRENT_TRACE_SPAN("reset");
+        input->reset(0); // Reposition to beginning
+    }
+
+    return input;
 }
 
-Strigi::InputStream *TorrentThroughAnalyzer::connectInputStream(Strigi::InputStream *input)
+const Strigi::RegisteredField *TorrentThroughAnalyzer::registeredField(Field field) const
 {
-    ByteStream stream(input);
-    ++stream; // Read first character
+    switch(field) {
+        case Announce:     return m_factory->announce;
+        case CreationDate: return m_factory->creationDate;
+        case Length:       return m_factory->length;
+        case NumFiles:     return m_factory->numFiles;
+        case Name:         return m_factory->nameField;
+        case PieceLength:  return m_factory->pieceLength;
+        case Comment:      return m_factory->comment;
+        case InfoHash:     return m_factory->infoHash;
+        case DuplicateOf:  return m_factory->duplicateOf;
+        case FilePieces:   return 0; // Added through addPieceMap()
+    }
 
-    try {
-        BDict::Ptr dict(new BDict(stream));
-        input->reset(0); // Reposition to beginning
+    return 0;
+}
 
-        BString::Ptr announce = dict->findType<BString>("announce");
-        if(announce)
-            m_analysisResult->addValue(m_factory->announce, announce->raw_data().constData());
+// Lengths of content of 4 GB and up are the usual values too big for
+// 32 bits.
+void addIntegerValue(Strigi::AnalysisResult *result, const Strigi::RegisteredField *field,
+                     qlonglong value)
+{
+    if(value >= 0 && value <= Q_INT64_C(0xffffffff))
+        result->addValue(field, uint32_t(value));
+    else if(value < 0 && value >= -Q_INT64_C(0x80000000))
+        result->addValue(field, int32_t(value));
+    else
+        result->addValue(field, double(value));
+}
 
-        BInt::Ptr creationDate = dict->findType<BInt>("creation date");
-        if(creationDate)
-            m_analysisResult->addValue(m_factory->creationDate, (uint32_t) creationDate->get_value());
+void TorrentThroughAnalyzer::addValue(Field field, const QByteArray &value)
+{
+    TORRENT_TRACE_SPAN("addValue");
+    TORRENT_TRACE_ARG(field);
 
-        BDict::Ptr info = dict->findType<BDict>("info");
-        if(!info)
-            return input;
+    m_stats.add(AnalyzerStats::FieldsEmitted);
+    m_analysisResult->addValue(registeredField(field), value.constData(), value.size());
+}
 
-        int numFiles = 1;
-        qulonglong length = 0;
+void TorrentThroughAnalyzer::addPathValue(int path, const QByteArray &value)
+{
+    TORRENT_TRACE_SPAN("addValue");
+    TORRENT_TRACE_ARG(path);
 
-        if(info->contains("length")) {
-            // Only 1 file
-            BInt::Ptr bLength = info->findType<BInt>("length");
-            if (!bLength)
-                return input;
-            length = bLength->get_value();
-        }
-        else {
-            BList::Ptr fileList = info->findType<BList>("files");
-            if(!fileList)
-                return input;
+    m_stats.add(AnalyzerStats::FieldsEmitted);
+    m_analysisResult->addValue(m_factory->pathFields[path], value.constData(), value.size());
+}
 
-            numFiles = fileList->count();
-            length = filesLength(fileList);
-        }
+void TorrentThroughAnalyzer::addValue(Field field, qlonglong value)
+{
+    TORRENT_TRACE_SPAN("addValue");
+    TORRENT_TRACE_ARG(field);
 
-        m_analysisResult->addValue(m_factory->length, (uint32_t)length);
-        m_analysisResult->addValue(m_factory->numFiles, (uint32_t)numFiles);
+    m_stats.add(AnalyzerStats::FieldsEmitted);
+    addIntegerValue(m_analysisResult, registeredField(field), value);
+}
 
-        BString::Ptr name = info->findType<BString>("name");
-        if(name)
-            m_analysisResult->addValue(m_factory->nameField, name->raw_data().constData());
+void TorrentThroughAnalyzer::addPathValue(int path, qlonglong value)
+{
+    TORRENT_TRACE_SPAN("addValue");
+    TORRENT_TRACE_ARG(path);
 
-        BInt::Ptr pieceLength = info->findType<BInt>("piece length");
-        if(pieceLength)
-            m_analysisResult->addValue(m_factory->pieceLength, (uint32_t)pieceLength->get_value());
+    m_stats.add(AnalyzerStats::FieldsEmitted);
+    addIntegerValue(m_analysisResult, m_factory->pathFields[path], value);
+}
 
-        BString::Ptr comment = info->findType<BString>("comment");
-        if(comment)
-            m_analysisResult->addValue(m_factory->comment, comment->raw_data().constData());
-    }
-    // Don't allow exceptions to propagate out
-    catch(...) {
-        input->reset(0);
-        return input;
+void TorrentThroughAnalyzer::addPieceMap(const PieceMap &map)
+{
+    TORRENT_TRACE_SPAN("addPieceMap");
+    TORRENT_TRACE_ARG(map.fileCount());
+
+    // One value of each field per file, in file order.  An empty file
+    // gets a last piece one before its first.
+    for(int i = 0; i < map.fileCount(); ++i) {
+        const PieceMap::Range pieces = map.piecesOfFile(i);
+        addIntegerValue(m_analysisResult, m_factory->fileFirstPiece, pieces.first);
+        addIntegerValue(m_analysisResult, m_factory->fileLastPiece, qlonglong(pieces.first + pieces.count) - 1);
     }
 
-    input->reset(0);
-    return input;
+    m_stats.add(AnalyzerStats::FieldsEmitted, 2 * map.fileCount());
+}
+
+bool TorrentThroughAnalyzer::isDuplicate(const QByteArray &infoHash, QByteArray &original)
+{
+    TORRENT_TRACE_SPAN("isDuplicate");
+    return m_factory->isDuplicate(infoHash, m_analysisResult->path(), original);
 }
@@ -21,9 +21,26 @@
 
 #include <strigi/streamthroughanalyzer.h>
 
+#include "analyzerstats.h"
+#include "torrentfields.h"
+
 class TorrentThroughAnalyzerFactory;
 
-class TorrentThroughAnalyzer : public Strigi::StreamThroughAnalyzer
+namespace Strigi {
+    class AnalysisResult;
+    class RegisteredField;
+}
+
+/**
+ * Adds the integer @p value to @p field of @p result.  Strigi has no
+ * 64-bit integer values, so anything outside 32 bits is added as a
+ * double, which holds it exactly up to 2^53.
+ */
+void addIntegerValue(Strigi::AnalysisResult *result, const Strigi::RegisteredField *field,
+                     qlonglong value);
+
+class TorrentThroughAnalyzer : public Strigi::StreamThroughAnalyzer,
+                               private TorrentFieldSink
 {
 public:
     TorrentThroughAnalyzer(const TorrentThroughAnalyzerFactory *f);
@@ -38,8 +55,19 @@ public:
     }
 
 private:
+    const Strigi::RegisteredField *registeredField(Field field) const;
+
+    // TorrentFieldSink
+    virtual void addValue(Field field, const QByteArray &value);
+    virtual void addValue(Field field, qlonglong value);
+    virtual void addPathValue(int path, const QByteArray &value);
+    virtual void addPathValue(int path, qlonglong value);
+    virtual void addPieceMap(const PieceMap &map);
+    virtual bool isDuplicate(const QByteArray &infoHash, QByteArray &original);
+
     const TorrentThroughAnalyzerFactory *m_factory;
     Strigi::AnalysisResult *m_analysisResult;
+    AnalyzerStats m_stats; // Of the stream being analyzed
 };
 
 #endif
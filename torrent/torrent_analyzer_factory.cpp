@@ -18,9 +18,64 @@
  */
 #include "torrent_analyzer_factory.h"
 #include "torrent_analyzer.h"
+#include "infohashset.h"
+#include "tracing.h"
 
 #include <strigi/analysisresult.h>
 
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include <kdebug.h>
+#include <kglobal.h>
+
+// The info-hash set is shared between all analyzers in the process so
+// that duplicates are found no matter which indexing thread saw the
+// original.  STRIGI_TORRENT_INFOHASH_DB names a file to keep it in
+// between runs, and STRIGI_TORRENT_INFOHASH_CAPACITY limits how many
+// hashes are kept (0 disables duplicate detection).
+//
+// Each hash takes 17 to 35 bytes of table and filter plus its path and a
+// 0 byte, so the paths are most of it.  STRIGI_TORRENT_INFOHASH_PATH_DATA
+// limits the bytes they may take.  At the default of 64 MB and paths of
+// around 100 bytes, that is reached after some 650,000 torrents, long
+// before the default capacity, and the whole set stays under 100 MB.
+static const quint32 defaultInfoHashCapacity = 8 * 1024 * 1024;
+static const quint32 defaultInfoHashPathData = 64 * 1024 * 1024;
+
+static quint32 infoHashCapacity()
+{
+    bool ok = false;
+    const quint32 capacity = qgetenv("STRIGI_TORRENT_INFOHASH_CAPACITY").toUInt(&ok);
+
+    return ok ? capacity : defaultInfoHashCapacity;
+}
+
+static quint32 infoHashPathData()
+{
+    bool ok = false;
+    const quint32 pathData = qgetenv("STRIGI_TORRENT_INFOHASH_PATH_DATA").toUInt(&ok);
+
+    return ok ? pathData : defaultInfoHashPathData;
+}
+
+struct InfoHashCache
+{
+    InfoHashCache()
+      : fileName(QFile::decodeName(qgetenv("STRIGI_TORRENT_INFOHASH_DB"))),
+        set(infoHashCapacity(), infoHashPathData())
+    {
+        if(!fileName.isEmpty())
+            set.load(fileName);
+    }
+
+    QString fileName;
+    InfoHashSet set;
+};
+
+K_GLOBAL_STATIC(InfoHashCache, infoHashCache)
+
 const std::string TorrentThroughAnalyzerFactory::announceFieldName
 ("http://freedesktop.org/standards/xesam/1.0/core#RemoteResource");
 const std::string TorrentThroughAnalyzerFactory::creationDateFieldName
@@ -35,19 +90,100 @@ const std::string TorrentThroughAnalyzerFactory::pieceLengthFieldName
 (Strigi::FieldRegister::sizeFieldName);
 const std::string TorrentThroughAnalyzerFactory::commentFieldName
 ("http://freedesktop.org/standards/xesam/1.0/core#comment");
+const std::string TorrentThroughAnalyzerFactory::infoHashFieldName
+("http://freedesktop.org/standards/xesam/1.0/core#sha1Hash");
+const std::string TorrentThroughAnalyzerFactory::duplicateOfFieldName
+("http://freedesktop.org/standards/xesam/1.0/core#derivedFrom");
+const std::string TorrentThroughAnalyzerFactory::fileFirstPieceFieldName
+("torrent.file.firstpiece");
+const std::string TorrentThroughAnalyzerFactory::fileLastPieceFieldName
+("torrent.file.lastpiece");
+
+// STRIGI_TORRENT_STATS=log sends the statistics to the debug log when the
+// factory is destroyed, any other value names a file to append them to.
+static void dumpStatistics(const AnalyzerStats &stats)
+{
+    const QByteArray target = qgetenv("STRIGI_TORRENT_STATS");
+    if(target.isEmpty())
+        return;
+
+    if(target == "log") {
+        kDebug() << "Torrent analyzer statistics:\n" << stats.toText().constData();
+        return;
+    }
+
+    QFile file(QFile::decodeName(target));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        kWarning() << "Unable to write torrent analyzer statistics to" << file.fileName();
+        return;
+    }
+
+    file.write(stats.toText());
+    file.write("\n");
+}
+
+TorrentThroughAnalyzerFactory::TorrentThroughAnalyzerFactory()
+  : announce(0), creationDate(0), length(0), numFiles(0), nameField(0),
+    pieceLength(0), comment(0), infoHash(0), duplicateOf(0), fileFirstPiece(0),
+    fileLastPiece(0),
+    plan(ExtractionPlan::fromConfiguration())
+{
+}
+
+TorrentThroughAnalyzerFactory::~TorrentThroughAnalyzerFactory()
+{
+    if(!infoHashCache.isDestroyed() && !infoHashCache->fileName.isEmpty())
+        infoHashCache->set.save(infoHashCache->fileName);
+
+    dumpStatistics(statistics());
+
+    if(Tracing::isEnabled() && !Tracing::write(Tracing::traceFileName()))
+        kWarning() << "Unable to write torrent analyzer trace to" << Tracing::traceFileName();
+}
+
+AnalyzerStats TorrentThroughAnalyzerFactory::statistics() const
+{
+    return AnalyzerStats::collect();
+}
+
+// Fields dropped from the plan aren't registered, and stay 0.
+static const Strigi::RegisteredField *registerField(Strigi::FieldRegister &fields,
+                                                    const ExtractionPlan &plan,
+                                                    TorrentFieldSink::Field field,
+                                                    const std::string &name)
+{
+    return plan.isEnabled(field) ? fields.registerField(name) : 0;
+}
 
 void TorrentThroughAnalyzerFactory::registerFields(Strigi::FieldRegister &fields)
 {
-    announce     = fields.registerField(announceFieldName);
-    creationDate = fields.registerField(creationDateFieldName);
-    length       = fields.registerField(lengthFieldName);
-    numFiles     = fields.registerField(numFilesFieldName);
-    nameField    = fields.registerField(nameFieldName);
-    pieceLength  = fields.registerField(pieceLengthFieldName);
-    comment      = fields.registerField(commentFieldName);
+    announce     = registerField(fields, plan, TorrentFieldSink::Announce, announceFieldName);
+    creationDate = registerField(fields, plan, TorrentFieldSink::CreationDate, creationDateFieldName);
+    length       = registerField(fields, plan, TorrentFieldSink::Length, lengthFieldName);
+    numFiles     = registerField(fields, plan, TorrentFieldSink::NumFiles, numFilesFieldName);
+    nameField    = registerField(fields, plan, TorrentFieldSink::Name, nameFieldName);
+    pieceLength  = registerField(fields, plan, TorrentFieldSink::PieceLength, pieceLengthFieldName);
+    comment      = registerField(fields, plan, TorrentFieldSink::Comment, commentFieldName);
+    infoHash     = registerField(fields, plan, TorrentFieldSink::InfoHash, infoHashFieldName);
+    duplicateOf  = registerField(fields, plan, TorrentFieldSink::DuplicateOf, duplicateOfFieldName);
+    fileFirstPiece = registerField(fields, plan, TorrentFieldSink::FilePieces, fileFirstPieceFieldName);
+    fileLastPiece  = registerField(fields, plan, TorrentFieldSink::FilePieces, fileLastPieceFieldName);
+
+    pathFields.clear();
+    for(int i = 0; i < plan.pathCount(); ++i) {
+        const QByteArray name = plan.pathFieldName(i);
+        pathFields.append(fields.registerField(std::string(name.constData(), name.size())));
+    }
 }
 
 Strigi::StreamThroughAnalyzer *TorrentThroughAnalyzerFactory::newInstance() const
 {
     return new TorrentThroughAnalyzer(this);
 }
+
+bool TorrentThroughAnalyzerFactory::isDuplicate(const QByteArray &infoHash,
+                                                const std::string &path,
+                                                QByteArray &original) const
+{
+    return infoHashCache->set.insert(infoHash, QByteArray(path.data(), path.size()), &original);
+}
@@ -25,10 +25,38 @@
 
 #include <string>
 
+#include "analyzerstats.h"
+#include "extractionplan.h"
+
+#include <QtCore/QVector>
+
+class QByteArray;
+
 class TorrentThroughAnalyzerFactory : public Strigi::StreamThroughAnalyzerFactory
 {
     friend class TorrentThroughAnalyzer;
 
+public:
+    /**
+     * Loads the fields to extract from STRIGI_TORRENT_FIELDS, see
+     * ExtractionPlan.
+     */
+    TorrentThroughAnalyzerFactory();
+
+    /**
+     * Saves the info-hash set, and writes out the statistics and trace
+     * if STRIGI_TORRENT_STATS or STRIGI_TORRENT_TRACE are set.
+     */
+    virtual ~TorrentThroughAnalyzerFactory();
+
+    /**
+     * @return statistics for every stream analyzed in this process so far,
+     * by analyzers from any factory.
+     */
+    AnalyzerStats statistics() const;
+
+private:
+
     static const std::string announceFieldName;
     static const std::string creationDateFieldName;
     static const std::string lengthFieldName;
@@ -36,6 +64,10 @@ class TorrentThroughAnalyzerFactory : public Strigi::StreamThroughAnalyzerFactor
     static const std::string nameFieldName;
     static const std::string pieceLengthFieldName;
     static const std::string commentFieldName;
+    static const std::string infoHashFieldName;
+    static const std::string duplicateOfFieldName;
+    static const std::string fileFirstPieceFieldName;
+    static const std::string fileLastPieceFieldName;
 
     const Strigi::RegisteredField *announce;
     const Strigi::RegisteredField *creationDate;
@@ -44,6 +76,13 @@ class TorrentThroughAnalyzerFactory : public Strigi::StreamThroughAnalyzerFactor
     const Strigi::RegisteredField *nameField;
     const Strigi::RegisteredField *pieceLength;
     const Strigi::RegisteredField *comment;
+    const Strigi::RegisteredField *infoHash;
+    const Strigi::RegisteredField *duplicateOf;
+    const Strigi::RegisteredField *fileFirstPiece;
+    const Strigi::RegisteredField *fileLastPiece;
+    QVector<const Strigi::RegisteredField *> pathFields; // By plan path index
+
+    const ExtractionPlan plan;
 
     const char *name() const {
         return "TorrentThroughAnalyzer";
@@ -51,6 +90,17 @@ class TorrentThroughAnalyzerFactory : public Strigi::StreamThroughAnalyzerFactor
 
     Strigi::StreamThroughAnalyzer *newInstance() const;
     void registerFields(Strigi::FieldRegister &fields);
+
+    /**
+     * Records the torrent with the given SHA-1 @p infoHash as found at
+     * @p path, in a set shared by every analyzer in the process.
+     *
+     * @param original set to the path the torrent was first seen at, if
+     *        it is a duplicate
+     * @return true if the same torrent was already seen at another path.
+     */
+    bool isDuplicate(const QByteArray &infoHash, const std::string &path,
+                     QByteArray &original) const;
 };
 
 #endif
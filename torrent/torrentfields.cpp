@@ -0,0 +1,744 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "torrentfields.h"
+#include "bdict.h"
+#include "bytestream.h"
+#include "blist.h"
+#include "bstring.h"
+#include "bint.h"
+#include "bvisitor.h"
+#include "extractionplan.h"
+#include "piecemap.h"
+#include "torrentkeys.h"
+#include "tracing.h"
+#include "utf8.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QTextCodec>
+#include <QtCore/QtAlgorithms>
+
+#include <kglobal.h>
+
+#include <stdexcept>
+#include <string>
+
+TorrentFieldSink::~TorrentFieldSink()
+{
+}
+
+void TorrentFieldSink::addPathValue(int, const QByteArray &)
+{
+}
+
+void TorrentFieldSink::addPathValue(int, qlonglong)
+{
+}
+
+void TorrentFieldSink::addPieceMap(const PieceMap &)
+{
+}
+
+bool TorrentFieldSink::isDuplicate(const QByteArray &, QByteArray &)
+{
+    return false;
+}
+
+// Fields are extracted in two steps: the values they come from are
+// gathered into typed slots, either straight from the stream or from an
+// already decoded tree, and then emitted from the slots.  Where a key
+// appears more than once the last copy wins, as it does in BDict.  Both
+// walks follow the trie of an ExtractionPlan, which says which slot each
+// value goes to and which extra fields it belongs to.
+namespace {
+
+struct StringSlot
+{
+    StringSlot() : isString(false) { }
+
+    bool isString;    // The last value under the key was a string
+    QByteArray value;
+};
+
+struct IntSlot
+{
+    IntSlot() : present(false), isInt(false), value(0) { }
+
+    bool present;     // The key was there at all
+    bool isInt;       // The last value under the key was an integer
+    qlonglong value;
+};
+
+struct InfoSlots
+{
+    InfoSlots() : filesIsList(false), numFiles(0), filesLength(0) { }
+
+    StringSlot name, nameUtf8, comment, commentUtf8;
+    IntSlot length, pieceLength;
+
+    bool filesIsList;
+    int numFiles;
+    qulonglong filesLength; // 0 unless every entry has an integer length
+    PieceMap fileMap;       // Only built if FilePieces is enabled
+};
+
+// A value for one of the plan's extra fields.
+struct PathValue
+{
+    int path;
+    bool isInt;
+    qlonglong number;
+    QByteArray text;
+};
+
+struct TorrentSlots
+{
+    TorrentSlots() : infoIsDict(false), fileLength(0) { }
+
+    StringSlot announce, announceUtf8, encoding;
+    IntSlot creationDate;
+
+    bool infoIsDict;
+    InfoSlots info;
+
+    IntSlot *fileLength; // Of the file entry being read, if any
+
+    QList<PathValue> pathValues;
+};
+
+StringSlot *stringSlot(TorrentSlots &slots, ExtractionPlan::Slot slot)
+{
+    switch(slot) {
+        case ExtractionPlan::AnnounceSlot:     return &slots.announce;
+        case ExtractionPlan::AnnounceUtf8Slot: return &slots.announceUtf8;
+        case ExtractionPlan::EncodingSlot:     return &slots.encoding;
+        case ExtractionPlan::NameSlot:         return &slots.info.name;
+        case ExtractionPlan::NameUtf8Slot:     return &slots.info.nameUtf8;
+        case ExtractionPlan::CommentSlot:      return &slots.info.comment;
+        case ExtractionPlan::CommentUtf8Slot:  return &slots.info.commentUtf8;
+        default:                               return 0;
+    }
+}
+
+IntSlot *intSlot(TorrentSlots &slots, ExtractionPlan::Slot slot)
+{
+    switch(slot) {
+        case ExtractionPlan::CreationDateSlot: return &slots.creationDate;
+        case ExtractionPlan::LengthSlot:       return &slots.info.length;
+        case ExtractionPlan::PieceLengthSlot:  return &slots.info.pieceLength;
+        case ExtractionPlan::FileLengthSlot:   return slots.fileLength;
+        default:                               return 0;
+    }
+}
+
+void addPathValues(TorrentSlots &slots, const ExtractionPlan::Node &node, const QByteArray &text)
+{
+    PathValue value;
+    value.isInt = false;
+    value.number = 0;
+    value.text = text;
+
+    foreach(int path, node.paths) {
+        value.path = path;
+        slots.pathValues.append(value);
+    }
+}
+
+void addPathValues(TorrentSlots &slots, const ExtractionPlan::Node &node, qlonglong number)
+{
+    PathValue value;
+    value.isInt = true;
+    value.number = number;
+
+    foreach(int path, node.paths) {
+        value.path = path;
+        slots.pathValues.append(value);
+    }
+}
+
+// Filling slots from a tree
+
+struct TreeWalk
+{
+    TreeWalk(const ExtractionPlan &p, TorrentSlots &s) : plan(p), slots(s) { }
+
+    const ExtractionPlan &plan;
+    TorrentSlots &slots;
+};
+
+void walkTree(TreeWalk &walk, const ExtractionPlan::Node &node, const BBase &value);
+
+void fillSlot(StringSlot &slot, const BBase &value)
+{
+    const BString *string = value.as<BString>();
+    slot.isString = string;
+    slot.value = string ? string->raw_data() : QByteArray();
+}
+
+void fillSlot(IntSlot &slot, const BBase &value)
+{
+    const BInt *integer = value.as<BInt>();
+    slot.present = true;
+    slot.isInt = integer;
+    slot.value = integer ? integer->get_value() : 0;
+}
+
+void walkTreeDict(TreeWalk &walk, const ExtractionPlan::Node &node, const BDict &dict)
+{
+    // Without a wildcard only the keys in the trie matter, so they can
+    // be looked up directly.  Otherwise go through every key.  BDict
+    // doesn't keep the order of the file, so they are sorted, which only
+    // matches the file if it was canonically encoded.
+    if(node.wildcard < 0) {
+        for(int i = 0; i < node.children.count(); ++i) {
+            const ExtractionPlan::Node &child = walk.plan.node(node.children[i]);
+            if(const BBase *value = dict.value(child.key))
+                walkTree(walk, child, *value);
+        }
+        return;
+    }
+
+    QList<QByteArray> keys;
+    BDictionaryIterator it = dict.iterator();
+    while(it.hasNext())
+        keys.append(it.next().key());
+    qSort(keys);
+
+    foreach(const QByteArray &key, keys) {
+        const int child = walk.plan.child(node, lookupTorrentKey(key.constData(), key.size()),
+                                          key.constData(), key.size());
+        walkTree(walk, walk.plan.node(child), *dict.value(key));
+    }
+}
+
+void walkTreeFiles(TreeWalk &walk, const ExtractionPlan::Node &node, const BBase &value)
+{
+    InfoSlots &info = walk.slots.info;
+    const BList *list = value.as<BList>();
+
+    info.filesIsList = list;
+    info.numFiles = list ? list->count() : 0;
+    info.filesLength = 0;
+    info.fileMap = PieceMap();
+
+    if(!list)
+        return;
+
+    const bool mapFiles = walk.plan.isEnabled(TorrentFieldSink::FilePieces);
+    if(mapFiles)
+        info.fileMap.reserve(list->count());
+
+    bool allHaveLength = true;
+    for(unsigned int i = 0; i < list->count(); ++i) {
+        IntSlot length;
+
+        if(node.wildcard >= 0) {
+            walk.slots.fileLength = &length;
+            walkTree(walk, walk.plan.node(node.wildcard), *list->at(i));
+            walk.slots.fileLength = 0;
+        }
+
+        if(length.isInt)
+            info.filesLength += length.value;
+        else
+            allHaveLength = false;
+
+        if(mapFiles)
+            info.fileMap.addFile(length.isInt ? length.value : -1);
+    }
+
+    if(!allHaveLength)
+        info.filesLength = 0;
+}
+
+// Follows the trie below a node without a slot of its own, into
+// dictionaries and lists or out to the extra fields ending there.
+struct TreeStep : public BVisitor<void>
+{
+    TreeStep(TreeWalk &w, const ExtractionPlan::Node &n) : walk(w), node(n) { }
+
+    void operator()(const BString &string)
+    {
+        if(!node.paths.isEmpty())
+            addPathValues(walk.slots, node, string.raw_data());
+    }
+
+    void operator()(const BInt &integer)
+    {
+        if(!node.paths.isEmpty())
+            addPathValues(walk.slots, node, integer.get_value());
+    }
+
+    void operator()(const BList &list)
+    {
+        if(node.wildcard < 0)
+            return;
+
+        for(unsigned int i = 0; i < list.count(); ++i)
+            walkTree(walk, walk.plan.node(node.wildcard), *list.at(i));
+    }
+
+    void operator()(const BDict &dict)
+    {
+        walkTreeDict(walk, node, dict);
+    }
+
+    TreeWalk &walk;
+    const ExtractionPlan::Node &node;
+};
+
+void walkTree(TreeWalk &walk, const ExtractionPlan::Node &node, const BBase &value)
+{
+    if(StringSlot *slot = stringSlot(walk.slots, node.slot)) {
+        fillSlot(*slot, value);
+        if(!node.paths.isEmpty() && slot->isString)
+            addPathValues(walk.slots, node, slot->value);
+        return;
+    }
+
+    if(IntSlot *slot = intSlot(walk.slots, node.slot)) {
+        fillSlot(*slot, value);
+        if(!node.paths.isEmpty() && slot->isInt)
+            addPathValues(walk.slots, node, slot->value);
+        return;
+    }
+
+    if(node.slot == ExtractionPlan::InfoSlot) {
+        const BDict *dict = value.as<BDict>();
+        walk.slots.infoIsDict = dict;
+        walk.slots.info = InfoSlots();
+
+        if(dict)
+            walkTreeDict(walk, node, *dict);
+        return;
+    }
+
+    if(node.slot == ExtractionPlan::FilesSlot) {
+        walkTreeFiles(walk, node, value);
+        return;
+    }
+
+    TreeStep step(walk, node);
+    value.visit(step);
+}
+
+// Filling slots straight from the stream.  The decoder accepts and
+// rejects exactly what the BBase constructors do, without building
+// anything for the values nobody asked for.  Keys are looked up in place
+// wherever they don't straddle two blocks of input.
+
+struct StreamWalk
+{
+    StreamWalk(ByteStream &s, const ExtractionPlan &p, TorrentSlots &sl, QByteArray &info)
+      : stream(s), decoder(s.decoder()), plan(p), slots(sl), infoData(info)
+    {
+    }
+
+    ByteStream &stream;
+    Bencode::Decoder &decoder;
+    const ExtractionPlan &plan;
+    TorrentSlots &slots;
+    QByteArray &infoData;
+    std::string scratch; // For keys split between blocks
+};
+
+void walkStream(StreamWalk &walk, const ExtractionPlan::Node &node);
+
+bool isStringStart(char c)
+{
+    return c != 'l' && c != 'i' && c != 'd';
+}
+
+void readSlot(ByteStream &stream, StringSlot &slot)
+{
+    Bencode::Decoder &decoder = stream.decoder();
+    slot.isString = isStringStart(decoder.current());
+
+    if(slot.isString)
+        stream.readString(slot.value);
+    else {
+        slot.value.clear();
+        decoder.skipValue();
+    }
+}
+
+void readSlot(Bencode::Decoder &decoder, IntSlot &slot)
+{
+    slot.present = true;
+    slot.isInt = (decoder.current() == 'i');
+
+    if(slot.isInt)
+        slot.value = decoder.readInt();
+    else {
+        slot.value = 0;
+        decoder.skipValue();
+    }
+}
+
+void walkStreamDict(StreamWalk &walk, const ExtractionPlan::Node &node)
+{
+    Bencode::Decoder &decoder = walk.decoder;
+    Bencode::Decoder::Nesting nesting(decoder);
+
+    decoder.countNode(Bencode::Decoder::DictNode);
+    decoder.advance();
+
+    while(decoder.current() != 'e') {
+        const Bencode::ByteSpan key = decoder.readString(walk.scratch);
+        const int child = walk.plan.child(node, lookupTorrentKey(key.data(), int(key.size())),
+                                          key.data(), int(key.size()));
+
+        if(child < 0)
+            decoder.skipValue();
+        else
+            walkStream(walk, walk.plan.node(child));
+    }
+
+    decoder.advance();
+}
+
+void walkStreamInfo(StreamWalk &walk, const ExtractionPlan::Node &node)
+{
+    // Keep the raw bytes for the info-hash, if anything needs it.
+    const bool capture = walk.plan.isEnabled(TorrentFieldSink::InfoHash) ||
+                         walk.plan.isEnabled(TorrentFieldSink::DuplicateOf);
+    if(capture)
+        walk.stream.beginCapture();
+
+    walk.slots.infoIsDict = (walk.decoder.current() == 'd');
+    walk.slots.info = InfoSlots();
+
+    if(walk.slots.infoIsDict)
+        walkStreamDict(walk, node);
+    else
+        walk.decoder.skipValue();
+
+    if(capture)
+        walk.infoData = walk.stream.endCapture();
+}
+
+void walkStreamFiles(StreamWalk &walk, const ExtractionPlan::Node &node)
+{
+    Bencode::Decoder &decoder = walk.decoder;
+    InfoSlots &info = walk.slots.info;
+
+    info.filesIsList = (decoder.current() == 'l');
+    info.numFiles = 0;
+    info.filesLength = 0;
+    info.fileMap = PieceMap();
+
+    if(!info.filesIsList) {
+        decoder.skipValue();
+        return;
+    }
+
+    Bencode::Decoder::Nesting nesting(decoder);
+    decoder.countNode(Bencode::Decoder::ListNode);
+    decoder.advance();
+
+    const bool mapFiles = walk.plan.isEnabled(TorrentFieldSink::FilePieces);
+    bool allHaveLength = true;
+    while(decoder.current() != 'e') {
+        ++info.numFiles;
+
+        if(node.wildcard < 0) {
+            decoder.skipValue();
+            continue;
+        }
+
+        IntSlot length;
+        walk.slots.fileLength = &length;
+        walkStream(walk, walk.plan.node(node.wildcard));
+        walk.slots.fileLength = 0;
+
+        if(length.isInt)
+            info.filesLength += length.value;
+        else
+            allHaveLength = false;
+
+        if(mapFiles)
+            info.fileMap.addFile(length.isInt ? length.value : -1);
+    }
+
+    decoder.advance();
+
+    if(!allHaveLength)
+        info.filesLength = 0;
+}
+
+void walkStream(StreamWalk &walk, const ExtractionPlan::Node &node)
+{
+    Bencode::Decoder &decoder = walk.decoder;
+
+    if(StringSlot *slot = stringSlot(walk.slots, node.slot)) {
+        readSlot(walk.stream, *slot);
+        if(!node.paths.isEmpty() && slot->isString)
+            addPathValues(walk.slots, node, slot->value);
+        return;
+    }
+
+    if(IntSlot *slot = intSlot(walk.slots, node.slot)) {
+        readSlot(decoder, *slot);
+        if(!node.paths.isEmpty() && slot->isInt)
+            addPathValues(walk.slots, node, slot->value);
+        return;
+    }
+
+    if(node.slot == ExtractionPlan::InfoSlot) {
+        walkStreamInfo(walk, node);
+        return;
+    }
+
+    if(node.slot == ExtractionPlan::FilesSlot) {
+        walkStreamFiles(walk, node);
+        return;
+    }
+
+    switch(decoder.current()) {
+        case 'd':
+            if(node.children.isEmpty() && node.wildcard < 0)
+                decoder.skipValue();
+            else
+                walkStreamDict(walk, node);
+            break;
+
+        case 'l':
+            if(node.wildcard < 0)
+                decoder.skipValue();
+            else {
+                Bencode::Decoder::Nesting nesting(decoder);
+                decoder.countNode(Bencode::Decoder::ListNode);
+                decoder.advance();
+                while(decoder.current() != 'e')
+                    walkStream(walk, walk.plan.node(node.wildcard));
+                decoder.advance();
+            }
+            break;
+
+        case 'i':
+            if(!node.paths.isEmpty())
+                addPathValues(walk.slots, node, decoder.readInt());
+            else
+                decoder.skipValue();
+            break;
+
+        default:
+            if(!node.paths.isEmpty()) {
+                QByteArray text;
+                walk.stream.readString(text);
+                addPathValues(walk.slots, node, text);
+            }
+            else
+                decoder.skipValue();
+    }
+}
+
+// Emitting fields from the slots
+
+QByteArray sha1(const QByteArray &data)
+{
+    TORRENT_TRACE_SPAN("sha1");
+    TORRENT_TRACE_ARG(data.size());
+
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+// Converts the text in @p slot to UTF-8.  Newer clients store a UTF-8
+// copy under "<key>.utf-8" (@p utf8), which is preferred when it really
+// is UTF-8.  Otherwise the torrent's "encoding" (@p codec) tells how the
+// text was encoded, if it's given at all.
+bool textValue(const StringSlot &utf8, const StringSlot &slot, QTextCodec *codec,
+               QByteArray *text)
+{
+    if(utf8.isString && Utf8::isValid(utf8.value)) {
+        *text = utf8.value;
+        return true;
+    }
+
+    if(!slot.isString)
+        return false;
+
+    *text = Utf8::fromLegacy(slot.value, codec);
+    return true;
+}
+
+// Returns the codec named by the torrent's "encoding", or 0 if the text
+// should be treated as UTF-8.
+QTextCodec *legacyCodec(const StringSlot &encoding)
+{
+    if(!encoding.isString)
+        return 0;
+
+    QTextCodec *codec = QTextCodec::codecForName(encoding.value);
+    if(!codec || codec->mibEnum() == 106) // UTF-8
+        return 0;
+
+    return codec;
+}
+
+// Multi-file torrents had their map built while the files were read,
+// single-file ones only need one file adding.
+void emitPieceMap(const InfoSlots &info, TorrentFieldSink &sink)
+{
+    PieceMap map;
+    if(info.length.present)
+        map.addFile(info.length.value);
+    else
+        map = info.fileMap;
+
+    map.setPieceLength(info.pieceLength.isInt ? info.pieceLength.value : 0);
+
+    if(map.isValid())
+        sink.addPieceMap(map);
+}
+
+ExtractionResult emitBuiltinFields(const ExtractionPlan &plan, const TorrentSlots &slots,
+                                   const QByteArray &infoData, TorrentFieldSink &sink)
+{
+    QTextCodec *codec = legacyCodec(slots.encoding);
+    QByteArray text;
+
+    if(textValue(slots.announceUtf8, slots.announce, codec, &text))
+        sink.addValue(TorrentFieldSink::Announce, text);
+
+    if(slots.creationDate.isInt)
+        sink.addValue(TorrentFieldSink::CreationDate, slots.creationDate.value);
+
+    if(!slots.infoIsDict)
+        return MissingInfo;
+
+    const InfoSlots &info = slots.info;
+
+    // The info-hash is the SHA-1 of the "info" value exactly as it
+    // appears in the file.  Copies of a torrent we've already seen
+    // elsewhere just get pointed at it instead of being fully analyzed.
+    const bool checkDuplicate = plan.isEnabled(TorrentFieldSink::DuplicateOf);
+    QByteArray digest, infoHash, original;
+
+    if(checkDuplicate || plan.isEnabled(TorrentFieldSink::InfoHash)) {
+        digest = sha1(infoData);
+        infoHash = digest.toHex();
+    }
+
+    if(plan.isEnabled(TorrentFieldSink::InfoHash))
+        sink.addValue(TorrentFieldSink::InfoHash, infoHash);
+
+    if(textValue(info.nameUtf8, info.name, codec, &text))
+        sink.addValue(TorrentFieldSink::Name, text);
+
+    if(checkDuplicate && sink.isDuplicate(digest, original)) {
+        sink.addValue(TorrentFieldSink::DuplicateOf, original);
+        return DuplicateTorrent;
+    }
+
+    int numFiles = 1;
+    qulonglong length = 0;
+
+    if(info.length.present) {
+        // Only 1 file
+        if(!info.length.isInt)
+            return MissingLength;
+        length = info.length.value;
+    }
+    else {
+        if(!info.filesIsList)
+            return MissingLength;
+
+        numFiles = info.numFiles;
+        length = info.filesLength;
+    }
+
+    if(plan.isEnabled(TorrentFieldSink::Length))
+        sink.addValue(TorrentFieldSink::Length, qlonglong(length));
+    if(plan.isEnabled(TorrentFieldSink::NumFiles))
+        sink.addValue(TorrentFieldSink::NumFiles, qlonglong(numFiles));
+
+    if(info.pieceLength.isInt && plan.isEnabled(TorrentFieldSink::PieceLength))
+        sink.addValue(TorrentFieldSink::PieceLength, info.pieceLength.value);
+
+    if(plan.isEnabled(TorrentFieldSink::FilePieces))
+        emitPieceMap(info, sink);
+
+    if(textValue(info.commentUtf8, info.comment, codec, &text))
+        sink.addValue(TorrentFieldSink::Comment, text);
+
+    return FieldsExtracted;
+}
+
+ExtractionResult emitFields(const ExtractionPlan &plan, const TorrentSlots &slots,
+                            const QByteArray &infoData, TorrentFieldSink &sink)
+{
+    const ExtractionResult result = emitBuiltinFields(plan, slots, infoData, sink);
+
+    // Duplicates only get pointed at the original.
+    if(result == DuplicateTorrent)
+        return result;
+
+    foreach(const PathValue &value, slots.pathValues) {
+        if(value.isInt)
+            sink.addPathValue(value.path, value.number);
+        else
+            sink.addPathValue(value.path, value.text);
+    }
+
+    return result;
+}
+
+}
+
+K_GLOBAL_STATIC(ExtractionPlan, defaultPlan)
+
+ExtractionResult extractTorrentFields(ByteStream &stream, TorrentFieldSink &sink)
+{
+    return extractTorrentFields(stream, sink, *defaultPlan);
+}
+
+ExtractionResult extractTorrentFields(ByteStream &stream, TorrentFieldSink &sink,
+                                      const ExtractionPlan &plan)
+{
+    TORRENT_TRACE_SPAN("extract");
+
+    if(stream.decoder().current() != 'd')
+        throw std::runtime_error("Trying to read dictionary, but this isn't a dictionary");
+
+    TorrentSlots slots;
+    QByteArray infoData;
+    StreamWalk walk(stream, plan, slots, infoData);
+    walkStreamDict(walk, plan.root());
+
+    return emitFields(plan, slots, infoData, sink);
+}
+
+ExtractionResult extractTorrentFields(const BDict::Ptr &dict, const QByteArray &infoData,
+                                      TorrentFieldSink &sink)
+{
+    return extractTorrentFields(dict, infoData, sink, *defaultPlan);
+}
+
+ExtractionResult extractTorrentFields(const BDict::Ptr &dict, const QByteArray &infoData,
+                                      TorrentFieldSink &sink, const ExtractionPlan &plan)
+{
+    TorrentSlots slots;
+    TreeWalk walk(plan, slots);
+    walkTreeDict(walk, plan.root(), *dict);
+
+    return emitFields(plan, slots, infoData, sink);
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_FIELDS_H
+#define TORRENT_ANALYZER_FIELDS_H
+
+#include "bdict.h"
+
+#include <QtGlobal>
+
+class ByteStream;
+class ExtractionPlan;
+class PieceMap;
+class QByteArray;
+
+/**
+ * Receives the fields extracted from a .torrent file by
+ * extractTorrentFields().  The Strigi analyzer implements this to add
+ * the fields to its AnalysisResult, other users can implement it to
+ * do something else with them.
+ */
+class TorrentFieldSink
+{
+public:
+    /**
+     * The fields which can be extracted.  See RETURNED_ITEMS for their
+     * meanings.
+     */
+    enum Field {
+        Announce,     /**< String */
+        CreationDate, /**< Integer, seconds since the epoch */
+        Length,       /**< Integer, total size of the content */
+        NumFiles,     /**< Integer */
+        Name,         /**< String */
+        PieceLength,  /**< Integer */
+        Comment,      /**< String */
+        InfoHash,     /**< String, hex-encoded */
+        DuplicateOf,  /**< String, where the torrent was first seen */
+        FilePieces    /**< PieceMap, see addPieceMap(); off by default */
+    };
+
+    virtual ~TorrentFieldSink();
+
+    /**
+     * Adds a string field.  Text fields (Announce, Name and Comment) have
+     * already been converted to valid UTF-8, which may contain zero bytes.
+     */
+    virtual void addValue(Field field, const QByteArray &value) = 0;
+    virtual void addValue(Field field, qlonglong value) = 0;
+
+    /**
+     * Adds a value of the extra field @p path of the ExtractionPlan in
+     * use.  Unlike the built-in fields these are passed on as they are
+     * in the file, with no conversion to UTF-8.
+     *
+     * The default implementations ignore the value.
+     */
+    virtual void addPathValue(int path, const QByteArray &value);
+    virtual void addPathValue(int path, qlonglong value);
+
+    /**
+     * Adds the FilePieces field: where each file lies in the pieces of
+     * the torrent.  A single-file torrent has a map of one file.  Only
+     * called with a valid map, which is gone once this returns.
+     *
+     * The default implementation ignores the map.
+     */
+    virtual void addPieceMap(const PieceMap &map);
+
+    /**
+     * Called with the SHA-1 info-hash of the torrent before any of the
+     * per-file fields are extracted.  If this returns true the torrent is
+     * treated as a copy of one already seen and only gets a DuplicateOf
+     * field in addition to the fields already added, holding what
+     * @p original was set to (for the analyzer, the path of the copy
+     * seen first).
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isDuplicate(const QByteArray &infoHash, QByteArray &original);
+};
+
+/**
+ * How far extractTorrentFields() got.
+ */
+enum ExtractionResult {
+    FieldsExtracted,  /**< Every field present was extracted. */
+    DuplicateTorrent, /**< The sink reported the torrent as a duplicate. */
+    MissingInfo,      /**< There is no "info" dictionary. */
+    MissingLength     /**< Neither "length" nor "files" is usable. */
+};
+
+/**
+ * Decodes a .torrent file from @p stream and hands every field found to
+ * @p sink.  @p stream should already be positioned at the first
+ * character.
+ *
+ * Only the values behind the keys of interest are kept; everything else
+ * is checked and skipped without building a BDict tree.  The fields are
+ * the same as from decoding the whole file and using the other overload.
+ *
+ * If @p stream reads from memory, the strings given to @p sink may point
+ * into it; a sink which keeps them must not outlive that memory.
+ *
+ * An exception is thrown if the data is not a valid b-encoded dictionary.
+ */
+ExtractionResult extractTorrentFields(ByteStream &stream, TorrentFieldSink &sink);
+
+/**
+ * Like the above, but extracting the fields of @p plan instead of the
+ * built-in ones.
+ */
+ExtractionResult extractTorrentFields(ByteStream &stream, TorrentFieldSink &sink,
+                                      const ExtractionPlan &plan);
+
+/**
+ * Extracts the fields of an already decoded .torrent file, such as one
+ * from BPushParser.  @p infoData must be the raw b-encoded "info" value
+ * as it appeared in the file, which the info-hash is computed from.
+ *
+ * Values matched by a wildcard in the plan come in sorted key order,
+ * which is file order only if the file was canonically encoded.
+ */
+ExtractionResult extractTorrentFields(const BDict::Ptr &dict, const QByteArray &infoData,
+                                      TorrentFieldSink &sink);
+
+/**
+ * Like the above, but extracting the fields of @p plan instead of the
+ * built-in ones.
+ */
+ExtractionResult extractTorrentFields(const BDict::Ptr &dict, const QByteArray &infoData,
+                                      TorrentFieldSink &sink, const ExtractionPlan &plan);
+
+#endif
+
+// vim: set et sw=4 ts=4:
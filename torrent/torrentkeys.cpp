@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "torrentkeys.h"
+
+#include <string.h>
+
+static const char *const keyNames[TorrentKeyCount] = {
+    0,
+    "announce",
+    "announce-list",
+    "announce.utf-8",
+    "comment",
+    "comment.utf-8",
+    "created by",
+    "creation date",
+    "encoding",
+    "files",
+    "httpseeds",
+    "info",
+    "length",
+    "md5sum",
+    "name",
+    "name.utf-8",
+    "nodes",
+    "path",
+    "path.utf-8",
+    "piece length",
+    "pieces",
+    "private",
+    "source",
+    "url-list"
+};
+
+// Only called once length and first byte match, so a mismatch is rare.
+static inline TorrentKey match(const char *key, int size, TorrentKey candidate)
+{
+    return memcmp(key, keyNames[candidate], size) == 0 ? candidate : UnknownKey;
+}
+
+TorrentKey lookupTorrentKey(const char *key, int size)
+{
+    if(size < 4)
+        return UnknownKey;
+
+    switch(size) {
+        case 4:
+            switch(key[0]) {
+                case 'i': return match(key, size, InfoKey);
+                case 'n': return match(key, size, NameKey);
+                case 'p': return match(key, size, PathKey);
+            }
+            break;
+
+        case 5:
+            switch(key[0]) {
+                case 'f': return match(key, size, FilesKey);
+                case 'n': return match(key, size, NodesKey);
+            }
+            break;
+
+        case 6:
+            switch(key[0]) {
+                case 'l': return match(key, size, LengthKey);
+                case 'm': return match(key, size, Md5SumKey);
+                case 'p': return match(key, size, PiecesKey);
+                case 's': return match(key, size, SourceKey);
+            }
+            break;
+
+        case 7:
+            switch(key[0]) {
+                case 'c': return match(key, size, CommentKey);
+                case 'p': return match(key, size, PrivateKey);
+            }
+            break;
+
+        case 8:
+            switch(key[0]) {
+                case 'a': return match(key, size, AnnounceKey);
+                case 'e': return match(key, size, EncodingKey);
+                case 'u': return match(key, size, UrlListKey);
+            }
+            break;
+
+        case 9:
+            if(key[0] == 'h')
+                return match(key, size, HttpSeedsKey);
+            break;
+
+        case 10:
+            switch(key[0]) {
+                case 'c': return match(key, size, CreatedByKey);
+                case 'n': return match(key, size, NameUtf8Key);
+                case 'p': return match(key, size, PathUtf8Key);
+            }
+            break;
+
+        case 12:
+            if(key[0] == 'p')
+                return match(key, size, PieceLengthKey);
+            break;
+
+        case 13:
+            switch(key[0]) {
+                case 'a': return match(key, size, AnnounceListKey);
+                case 'c': return key[2] == 'm' ? match(key, size, CommentUtf8Key)
+                                               : match(key, size, CreationDateKey);
+            }
+            break;
+
+        case 14:
+            if(key[0] == 'a')
+                return match(key, size, AnnounceUtf8Key);
+            break;
+    }
+
+    return UnknownKey;
+}
+
+const char *torrentKeyName(TorrentKey key)
+{
+    if(key < 0 || key >= TorrentKeyCount)
+        return 0;
+
+    return keyNames[key];
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_TORRENTKEYS_H
+#define TORRENT_ANALYZER_TORRENTKEYS_H
+
+/**
+ * The dictionary keys of the .torrent format (BEP 3 and common
+ * extensions), so that parsers can tell them apart without building and
+ * hashing a QByteArray for every key they read.
+ */
+enum TorrentKey {
+    UnknownKey,
+    AnnounceKey,      /**< "announce" */
+    AnnounceListKey,  /**< "announce-list" */
+    AnnounceUtf8Key,  /**< "announce.utf-8" */
+    CommentKey,       /**< "comment" */
+    CommentUtf8Key,   /**< "comment.utf-8" */
+    CreatedByKey,     /**< "created by" */
+    CreationDateKey,  /**< "creation date" */
+    EncodingKey,      /**< "encoding" */
+    FilesKey,         /**< "files" */
+    HttpSeedsKey,     /**< "httpseeds" */
+    InfoKey,          /**< "info" */
+    LengthKey,        /**< "length" */
+    Md5SumKey,        /**< "md5sum" */
+    NameKey,          /**< "name" */
+    NameUtf8Key,      /**< "name.utf-8" */
+    NodesKey,         /**< "nodes" */
+    PathKey,          /**< "path" */
+    PathUtf8Key,      /**< "path.utf-8" */
+    PieceLengthKey,   /**< "piece length" */
+    PiecesKey,        /**< "pieces" */
+    PrivateKey,       /**< "private" */
+    SourceKey,        /**< "source" */
+    UrlListKey,       /**< "url-list" */
+    TorrentKeyCount
+};
+
+/**
+ * Identifies the @p size byte key at @p key.  This is a switch on the
+ * length and first byte followed by at most two comparisons, so it costs
+ * about as much as comparing against a single string.
+ *
+ * @return the key, or UnknownKey if it isn't part of the vocabulary
+ */
+TorrentKey lookupTorrentKey(const char *key, int size);
+
+/**
+ * @return the text of @p key, or 0 for UnknownKey.
+ */
+const char *torrentKeyName(TorrentKey key);
+
+#endif
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,299 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "tracing.h"
+#include "json.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+#include <kglobal.h>
+
+#ifdef TORRENT_TRACING
+bool Tracing::s_enabled = !qgetenv("STRIGI_TORRENT_TRACE").isEmpty();
+#else
+bool Tracing::s_enabled = false;
+#endif
+
+// Events kept per thread unless STRIGI_TORRENT_TRACE_EVENTS says otherwise,
+// at 40 bytes each.
+static const quint32 defaultEventCapacity = 64 * 1024;
+
+// Span details (file names) kept per thread.  Only a few spans have them.
+static const quint32 detailCapacity = 256;
+
+namespace {
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    qint64 arg;
+    quint32 detail; // Sequence number of the detail plus 1, or 0 for none
+};
+
+// An event copied out of a thread's buffer, ready to be written.
+struct TraceRecord
+{
+    int thread;
+    TraceEvent event;
+    QByteArray detail;
+};
+
+class ThreadTrace;
+
+struct TraceRegistry
+{
+    TraceRegistry() : nextThread(1)
+    {
+        clock.start();
+    }
+
+    QElapsedTimer clock;
+    QMutex mutex;
+    QList<ThreadTrace *> threads;
+    QList<TraceRecord> exited; // Events of threads which have finished
+    int nextThread;
+};
+
+}
+
+K_GLOBAL_STATIC(TraceRegistry, traceRegistry)
+
+static quint32 eventCapacity()
+{
+    bool ok = false;
+    quint32 capacity = qgetenv("STRIGI_TORRENT_TRACE_EVENTS").toUInt(&ok);
+    if(!ok || capacity == 0)
+        capacity = defaultEventCapacity;
+
+    // Round up to a power of 2 so the ring can be indexed with a mask.
+    quint32 size = 1;
+    while(size < capacity && size < 0x80000000U)
+        size <<= 1;
+
+    return size;
+}
+
+namespace {
+
+// A ring buffer of the most recent events of one thread.  Only the owning
+// thread writes to it.  It publishes each event by storing the new count
+// with release semantics, which lets snapshot() copy events out from
+// another thread without locking the writer out.
+class ThreadTrace
+{
+public:
+    ThreadTrace()
+      : m_capacity(eventCapacity()), m_events(new TraceEvent[m_capacity]),
+        m_full(false), m_detailsWritten(0)
+    {
+        QMutexLocker lock(&traceRegistry->mutex);
+        m_thread = traceRegistry->nextThread++;
+        traceRegistry->threads.append(this);
+    }
+
+    // Called by QThreadStorage when the thread exits.
+    ~ThreadTrace()
+    {
+        if(!traceRegistry.isDestroyed()) {
+            QMutexLocker lock(&traceRegistry->mutex);
+            traceRegistry->threads.removeAll(this);
+            snapshot(traceRegistry->exited);
+        }
+
+        delete[] m_events;
+    }
+
+    void record(const char *name, qint64 start, qint64 duration, qint64 arg,
+                const char *detail)
+    {
+        const quint32 index = static_cast<quint32>(int(m_written));
+        TraceEvent &event = m_events[index & (m_capacity - 1)];
+
+        event.name = name;
+        event.start = start;
+        event.duration = duration;
+        event.arg = arg;
+        event.detail = detail ? addDetail(detail) : 0;
+
+        if(index + 1 == m_capacity)
+            m_full = true;
+
+        m_written.fetchAndStoreRelease(static_cast<int>(index + 1));
+    }
+
+    void snapshot(QList<TraceRecord> &records)
+    {
+        const quint32 end = static_cast<quint32>(m_written.fetchAndAddAcquire(0));
+        const quint32 begin = m_full ? end - m_capacity : 0;
+
+        QVector<TraceEvent> events;
+        events.reserve(end - begin);
+        for(quint32 i = begin; i != end; ++i)
+            events.append(m_events[i & (m_capacity - 1)]);
+
+        // The writer may have lapped us while copying, anything it could
+        // have started overwriting is dropped.
+        const quint32 after = static_cast<quint32>(m_written.fetchAndAddAcquire(0));
+
+        QMutexLocker lock(&m_detailMutex);
+        for(quint32 i = begin; i != end; ++i) {
+            if(after - i >= m_capacity)
+                continue;
+
+            TraceRecord record;
+            record.thread = m_thread;
+            record.event = events[i - begin];
+
+            const quint32 detail = record.event.detail;
+            if(detail != 0 && m_detailsWritten - (detail - 1) <= detailCapacity)
+                record.detail = m_details[(detail - 1) % detailCapacity];
+
+            records.append(record);
+        }
+    }
+
+private:
+    quint32 addDetail(const char *detail)
+    {
+        QMutexLocker lock(&m_detailMutex);
+        m_details[m_detailsWritten % detailCapacity] = QByteArray(detail);
+        return ++m_detailsWritten;
+    }
+
+    int m_thread;
+    const quint32 m_capacity;
+    TraceEvent *m_events;
+    QAtomicInt m_written;
+    bool m_full;
+
+    QMutex m_detailMutex;
+    QByteArray m_details[detailCapacity];
+    quint32 m_detailsWritten;
+};
+
+}
+
+static QThreadStorage<ThreadTrace *> threadTrace;
+
+void Tracing::setEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+QString Tracing::traceFileName()
+{
+    return QFile::decodeName(qgetenv("STRIGI_TORRENT_TRACE"));
+}
+
+qint64 Tracing::now()
+{
+    return traceRegistry->clock.nsecsElapsed();
+}
+
+void Tracing::record(const char *name, qint64 start, qint64 arg, const char *detail)
+{
+    const qint64 end = now();
+
+    if(!threadTrace.hasLocalData())
+        threadTrace.setLocalData(new ThreadTrace);
+
+    threadTrace.localData()->record(name, start, end - start, arg, detail);
+}
+
+// Chrome wants microseconds, keep the nanoseconds as decimals.
+static void appendMicroseconds(QByteArray &out, qint64 nsecs)
+{
+    out += QByteArray::number(nsecs / 1000);
+    out += '.';
+
+    const QByteArray fraction = QByteArray::number(nsecs % 1000);
+    out += QByteArray(3 - fraction.size(), '0');
+    out += fraction;
+}
+
+bool Tracing::write(QIODevice &device)
+{
+    QList<TraceRecord> records;
+
+    {
+        QMutexLocker lock(&traceRegistry->mutex);
+        records = traceRegistry->exited;
+        foreach(ThreadTrace *thread, traceRegistry->threads)
+            thread->snapshot(records);
+    }
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray out("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for(int i = 0; i < records.count(); ++i) {
+        const TraceRecord &record = records.at(i);
+
+        out += "{\"ph\":\"X\",\"name\":";
+        Json::appendString(out, record.event.name, qstrlen(record.event.name));
+        out += ",\"pid\":";
+        out += pid;
+        out += ",\"tid\":";
+        out += QByteArray::number(record.thread);
+        out += ",\"ts\":";
+        appendMicroseconds(out, record.event.start);
+        out += ",\"dur\":";
+        appendMicroseconds(out, record.event.duration);
+
+        if(record.event.arg != 0 || !record.detail.isEmpty()) {
+            out += ",\"args\":{\"arg\":";
+            out += QByteArray::number(record.event.arg);
+            if(!record.detail.isEmpty()) {
+                out += ",\"detail\":";
+                Json::appendString(out, record.detail);
+            }
+            out += '}';
+        }
+
+        out += (i + 1 < records.count()) ? "},\n" : "}\n";
+
+        if(out.size() >= 64 * 1024) {
+            if(device.write(out) != out.size())
+                return false;
+            out.clear();
+        }
+    }
+
+    out += "]}\n";
+    return device.write(out) == out.size();
+}
+
+bool Tracing::write(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    return write(file);
+}
+
+// vim: set et sw=4 ts=4:
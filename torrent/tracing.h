@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_TRACING_H
+#define TORRENT_ANALYZER_TRACING_H
+
+#include <QtGlobal>
+
+class QIODevice;
+class QString;
+
+/**
+ * @file
+ * Trace spans for finding out where the time goes while parsing one file.
+ *
+ * Spans are only compiled in when TORRENT_TRACING is defined (the
+ * TORRENT_TRACING CMake option), otherwise the macros below expand to
+ * nothing.  When compiled in, spans are still only recorded while
+ * Tracing::isEnabled(), which is the case when STRIGI_TORRENT_TRACE names
+ * a file to write the trace to.  A disabled span costs one test of a flag.
+ *
+ * Each thread records into its own fixed size ring buffer without any
+ * locking, so only the most recent events of each thread are kept.
+ * Tracing::write() turns them into Chrome trace event JSON, which can be
+ * loaded into chrome://tracing or Perfetto.
+ */
+
+#ifdef TORRENT_TRACING
+
+#define TORRENT_TRACE_SPAN(name) TraceSpan torrentTraceSpan(name)
+#define TORRENT_TRACE_ARG(value) torrentTraceSpan.setArg(value)
+#define TORRENT_TRACE_DETAIL(text) torrentTraceSpan.setDetail(text)
+
+#else
+
+#define TORRENT_TRACE_SPAN(name) do { } while(0)
+#define TORRENT_TRACE_ARG(value) do { } while(0)
+#define TORRENT_TRACE_DETAIL(text) do { } while(0)
+
+#endif
+
+class Tracing
+{
+public:
+    /**
+     * @return true if spans are being recorded.
+     */
+    static bool isEnabled() { return s_enabled; }
+
+    /**
+     * Starts or stops recording spans.  This should be done before any
+     * threads start parsing.  By default recording is enabled if the
+     * STRIGI_TORRENT_TRACE environment variable is set.
+     */
+    static void setEnabled(bool enabled);
+
+    /**
+     * @return the file given in STRIGI_TORRENT_TRACE, if any.
+     */
+    static QString traceFileName();
+
+    /**
+     * @return nanoseconds since tracing was first used.
+     */
+    static qint64 now();
+
+    /**
+     * Records a span on the calling thread.  @p name must be a string
+     * literal, and @p detail (which may be 0) is copied.
+     */
+    static void record(const char *name, qint64 start, qint64 arg, const char *detail);
+
+    /**
+     * Writes the events of every thread to @p device as a Chrome trace
+     * event JSON document.  This may be called while other threads are
+     * recording, events overwritten during the copy are left out.
+     *
+     * @return false if writing failed
+     */
+    static bool write(QIODevice &device);
+
+    /**
+     * Convenience function which writes the trace to @p fileName.
+     */
+    static bool write(const QString &fileName);
+
+private:
+    static bool s_enabled;
+};
+
+/**
+ * Records the time between its construction and destruction as a span,
+ * if tracing is enabled.  Use TORRENT_TRACE_SPAN() instead of creating
+ * these directly so that they can be compiled out.
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+      : m_name(name), m_start(Tracing::isEnabled() ? Tracing::now() : -1),
+        m_arg(0), m_detail(0)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if(m_start >= 0)
+            Tracing::record(m_name, m_start, m_arg, m_detail);
+    }
+
+    /**
+     * Attaches a number to the span, shown as its "arg" in the trace.
+     */
+    void setArg(qint64 arg) { m_arg = arg; }
+
+    /**
+     * Attaches some text to the span, such as the file being parsed.
+     * @p detail must stay valid until the span ends.
+     */
+    void setDetail(const char *detail) { m_detail = detail; }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *m_name;
+    qint64 m_start;
+    qint64 m_arg;
+    const char *m_detail;
+};
+
+#endif
+
+// vim: set et sw=4 ts=4:
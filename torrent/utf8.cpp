@@ -0,0 +1,125 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include "utf8.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QTextCodec>
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Returns the length of the run of ASCII bytes at the start of @p data.
+static int asciiPrefix(const unsigned char *data, int size)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    // A byte is non-ASCII if its high bit is set, which movemask collects.
+    for(; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const int mask = _mm_movemask_epi8(chunk);
+        if(mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#else
+    for(; i + 8 <= size; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof word);
+        if(word & Q_UINT64_C(0x8080808080808080))
+            break;
+    }
+#endif
+
+    while(i < size && data[i] < 0x80)
+        ++i;
+
+    return i;
+}
+
+bool Utf8::isValid(const char *text, int size)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(text);
+    int i = 0;
+
+    for(;;) {
+        i += asciiPrefix(data + i, size - i);
+        if(i >= size)
+            return true;
+
+        // Well-formed sequences per table 3-7 of the Unicode standard: the
+        // lead byte decides the length and the range of the second byte.
+        const unsigned char lead = data[i];
+        int length;
+        unsigned char low = 0x80, high = 0xbf;
+
+        if(lead >= 0xc2 && lead <= 0xdf)
+            length = 2;
+        else if(lead >= 0xe0 && lead <= 0xef) {
+            length = 3;
+            if(lead == 0xe0)
+                low = 0xa0; // Overlong
+            else if(lead == 0xed)
+                high = 0x9f; // Surrogates
+        }
+        else if(lead >= 0xf0 && lead <= 0xf4) {
+            length = 4;
+            if(lead == 0xf0)
+                low = 0x90; // Overlong
+            else if(lead == 0xf4)
+                high = 0x8f; // Past U+10FFFF
+        }
+        else
+            return false;
+
+        if(size - i < length)
+            return false;
+
+        if(data[i + 1] < low || data[i + 1] > high)
+            return false;
+
+        for(int j = 2; j < length; ++j) {
+            if((data[i + j] & 0xc0) != 0x80)
+                return false;
+        }
+
+        i += length;
+    }
+}
+
+bool Utf8::isValid(const QByteArray &data)
+{
+    return isValid(data.constData(), data.size());
+}
+
+QByteArray Utf8::fromLegacy(const QByteArray &text, QTextCodec *codec)
+{
+    if(codec)
+        return codec->toUnicode(text).toUtf8();
+
+    if(isValid(text))
+        return text;
+
+    return QString::fromLatin1(text.constData(), text.size()).toUtf8();
+}
+
+// vim: set et sw=4 ts=4:
@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2009 Michael Pyne <michael.pyne@kdemail.net>
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; see the file COPYING.
+ * If not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef TORRENT_ANALYZER_UTF8_H
+#define TORRENT_ANALYZER_UTF8_H
+
+class QByteArray;
+class QTextCodec;
+
+namespace Utf8
+{
+    /**
+     * @return true if the @p size bytes at @p data are well-formed UTF-8:
+     * no overlong forms, surrogates or code points past U+10FFFF.  Runs
+     * of ASCII, which most text in torrents is, are checked 16 bytes at
+     * a time.
+     */
+    bool isValid(const char *data, int size);
+
+    /**
+     * Convenience overload for a whole QByteArray.
+     */
+    bool isValid(const QByteArray &data);
+
+    /**
+     * Converts text of unknown quality from a torrent to UTF-8.
+     *
+     * If @p codec is given (from the torrent's "encoding") the text is
+     * decoded with it.  Otherwise text which is already valid UTF-8 is
+     * returned unchanged, and anything else is taken to be Latin-1, so
+     * that the result is always valid UTF-8.
+     */
+    QByteArray fromLegacy(const QByteArray &text, QTextCodec *codec = 0);
+}
+
+#endif
+
+// vim: set et sw=4 ts=4: